@@ -13,6 +13,8 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
 #include "util/crc32c.h"
@@ -34,6 +36,7 @@
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
+//      multireadrandom -- read N times in random order, in MultiGet batches
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
 //      seekordered   -- N ordered seeks
@@ -42,6 +45,9 @@
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
+//      writestalls -- Print write stalls of the DB
+//      statistics  -- Print operation latencies and counters of the DB
+//                     (needs --statistics=1)
 //      sstables    -- Print sstable info
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
@@ -70,6 +76,9 @@ static int FLAGS_num = 1000000;
 // Number of read operations to do.  If negative, do FLAGS_num reads.
 static int FLAGS_reads = -1;
 
+// Number of keys looked up by each MultiGet() of multireadrandom.
+static int FLAGS_multiget_batch = 100;
+
 // Number of concurrent threads to run.
 static int FLAGS_threads = 1;
 
@@ -83,6 +92,21 @@ static double FLAGS_compression_ratio = 0.5;
 // Print histogram of operation timings
 static bool FLAGS_histogram = false;
 
+// Rate in bytes per second that writes are delayed to while compactions
+// fall behind.  Negative means use default settings.
+static int FLAGS_delayed_write_rate = -1;
+
+// Rate in bytes per second that memtable compactions and table compactions
+// are limited to.  Zero means no limit.
+static int FLAGS_rate_limit = 0;
+
+// If true, the rate limit is the highest rate, and the rate is widened up
+// to it while compactions fall behind.
+static bool FLAGS_rate_limit_auto_tune = false;
+
+// If true, the DB keeps statistics of its operations
+static bool FLAGS_statistics = false;
+
 // Count the number of string comparisons performed
 static bool FLAGS_comparisons = false;
 
@@ -98,10 +122,30 @@ static int FLAGS_max_file_size = 0;
 // (initialized to default value by "main")
 static int FLAGS_block_size = 0;
 
+// If true, give every data block a hash index for point lookups.
+static bool FLAGS_data_block_hash_index = false;
+
+// If true, split the index and filter blocks of tables into partitions.
+static bool FLAGS_partition_index_and_filters = false;
+
+// If true, give every table a learned index for point lookups.
+static bool FLAGS_learned_index = false;
+
+// Values of at least this many bytes are stored in value log files.
+// Zero keeps all values in tables.
+static int FLAGS_min_separated_value_size = 0;
+
 // Number of bytes to use as a cache of uncompressed data.
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Eviction policy of the block cache: "lru" or "clock".
+static const char* FLAGS_cache_type = "lru";
+
+// The block cache is split into 2^cache_shard_bits shards.
+// Negative means use default settings.
+static int FLAGS_cache_shard_bits = -1;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -109,6 +153,27 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// If true, spread the bloom filter bits over the levels with
+// NewMonkeyFilterPolicy() instead of using the same bits per key everywhere.
+static bool FLAGS_monkey = false;
+
+// If true, use NewBlockedBloomFilterPolicy() for the bloom filters.
+static bool FLAGS_blocked_bloom = false;
+
+// If true, use NewBinaryFuseFilterPolicy() instead of bloom filters.
+static bool FLAGS_binary_fuse = false;
+
+// If true, give every table a single filter instead of one per 2KB of data.
+static bool FLAGS_full_table_filter = false;
+
+// Range filter bits per key.
+// Negative means no range filters.
+static int FLAGS_range_filter_bits = -1;
+
+// If positive, seekrandom bounds its iterators to the keys before the key
+// that is this many keys after the target.
+static int FLAGS_seek_bound = 0;
+
 // Common key prefix length.
 static int FLAGS_key_prefix = 0;
 
@@ -120,9 +185,41 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, log the next group of writes while the current one is being
+// inserted into the memtable by its writers.
+static bool FLAGS_pipelined_write = false;
+
+// Number of log files that writes are striped across
+static int FLAGS_log_stripes = 1;
+
+// Compression of log records: "none", "snappy" or "zstd".
+static const char* FLAGS_log_compression = "none";
+
+// Memtable representation: "skiplist", "vector" or "prefix_hash".
+static const char* FLAGS_memtable_rep = "skiplist";
+
+// Length of the key prefixes used by the prefix_hash memtable, or zero to
+// hash whole keys.
+static int FLAGS_prefix_size = 0;
+
 // If true, use compression.
 static bool FLAGS_compression = true;
 
+// If true, use tiered instead of leveled compaction.
+static bool FLAGS_tiered = false;
+
+// Number of sorted runs per level for tiered compaction.
+// (initialized to default value by "main")
+static int FLAGS_max_sorted_runs = 0;
+
+// Number of table compactions that may run at the same time.
+// (initialized to default value by "main")
+static int FLAGS_max_background_compactions = 0;
+
+// Number of threads a single compaction may be split across.
+// (initialized to default value by "main")
+static int FLAGS_max_subcompactions = 0;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -429,6 +526,9 @@ class Benchmark {
  private:
   Cache* cache_;
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
+  const RangeFilterPolicy* range_filter_policy_;
+  RateLimiter* rate_limiter_;
   DB* db_;
   int num_;
   int value_size_;
@@ -517,12 +617,33 @@ class Benchmark {
 #endif
   }
 
+  static Cache* NewBlockCache() {
+    if (strcmp(FLAGS_cache_type, "clock") == 0) {
+      return NewClockCache(FLAGS_cache_size, FLAGS_cache_shard_bits);
+    }
+    return NewLRUCache(FLAGS_cache_size, FLAGS_cache_shard_bits);
+  }
+
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
-        filter_policy_(FLAGS_bloom_bits >= 0
-                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                           : nullptr),
+      : cache_(FLAGS_cache_size >= 0 ? NewBlockCache() : nullptr),
+        filter_policy_(FLAGS_bloom_bits < 0 ? nullptr
+                       : FLAGS_monkey ? NewMonkeyFilterPolicy(FLAGS_bloom_bits)
+                       : FLAGS_blocked_bloom
+                           ? NewBlockedBloomFilterPolicy(FLAGS_bloom_bits)
+                       : FLAGS_binary_fuse
+                           ? NewBinaryFuseFilterPolicy(FLAGS_bloom_bits)
+                           : NewBloomFilterPolicy(FLAGS_bloom_bits)),
+        prefix_extractor_(FLAGS_prefix_size > 0
+                              ? NewFixedPrefixTransform(FLAGS_prefix_size)
+                              : nullptr),
+        range_filter_policy_(FLAGS_range_filter_bits >= 0
+                                 ? NewRangeFilterPolicy(FLAGS_range_filter_bits)
+                                 : nullptr),
+        rate_limiter_(FLAGS_rate_limit > 0
+                          ? NewGenericRateLimiter(FLAGS_rate_limit,
+                                                  FLAGS_rate_limit_auto_tune)
+                          : nullptr),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -547,6 +668,9 @@ class Benchmark {
     delete db_;
     delete cache_;
     delete filter_policy_;
+    delete prefix_extractor_;
+    delete range_filter_policy_;
+    delete rate_limiter_;
   }
 
   void Run() {
@@ -609,6 +733,8 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
@@ -643,6 +769,10 @@ class Benchmark {
         HeapProfile();
       } else if (name == Slice("stats")) {
         PrintStats("leveldb.stats");
+      } else if (name == Slice("writestalls")) {
+        PrintStats("leveldb.write-stalls");
+      } else if (name == Slice("statistics")) {
+        PrintStats("leveldb.statistics");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
       } else {
@@ -808,14 +938,43 @@ class Benchmark {
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
+    options.partition_index_and_filters = FLAGS_partition_index_and_filters;
+    options.learned_index = FLAGS_learned_index;
+    options.min_separated_value_size = FLAGS_min_separated_value_size;
     if (FLAGS_comparisons) {
       options.comparator = &count_comparator_;
     }
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.full_table_filter = FLAGS_full_table_filter;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.statistics = FLAGS_statistics;
+    if (FLAGS_delayed_write_rate >= 0) {
+      options.delayed_write_rate = FLAGS_delayed_write_rate;
+    }
+    options.pipelined_write = FLAGS_pipelined_write;
+    options.log_stripes = FLAGS_log_stripes;
+    if (strcmp(FLAGS_log_compression, "snappy") == 0) {
+      options.log_compression = kSnappyCompression;
+    } else if (strcmp(FLAGS_log_compression, "zstd") == 0) {
+      options.log_compression = kZstdCompression;
+    }
+    if (strcmp(FLAGS_memtable_rep, "vector") == 0) {
+      options.memtable_rep = kVectorRep;
+    } else if (strcmp(FLAGS_memtable_rep, "prefix_hash") == 0) {
+      options.memtable_rep = kPrefixHashRep;
+    }
+    options.prefix_extractor = prefix_extractor_;
+    options.range_filter_policy = range_filter_policy_;
+    options.rate_limiter = rate_limiter_;
     options.compression =
         FLAGS_compression ? kSnappyCompression : kNoCompression;
+    options.compaction_style =
+        FLAGS_tiered ? kTieredCompaction : kLeveledCompaction;
+    options.max_sorted_runs_per_level = FLAGS_max_sorted_runs;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.max_subcompactions = FLAGS_max_subcompactions;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -909,6 +1068,35 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::vector<std::string> keys;
+    std::vector<Slice> key_slices;
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i += FLAGS_multiget_batch) {
+      const int batch = std::min(FLAGS_multiget_batch, reads_ - i);
+      keys.clear();
+      for (int j = 0; j < batch; j++) {
+        key.Set(thread->rand.Uniform(FLAGS_num));
+        keys.push_back(key.slice().ToString());
+      }
+      key_slices.assign(keys.begin(), keys.end());
+      db_->MultiGet(options, key_slices, &values, &statuses);
+      for (int j = 0; j < batch; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -939,9 +1127,16 @@ class Benchmark {
     ReadOptions options;
     int found = 0;
     KeyBuffer key;
+    KeyBuffer bound_key;
+    Slice bound;
+    if (FLAGS_seek_bound > 0) {
+      options.iterate_upper_bound = &bound;
+    }
     for (int i = 0; i < reads_; i++) {
-      Iterator* iter = db_->NewIterator(options);
       const int k = thread->rand.Uniform(FLAGS_num);
+      bound_key.Set(k + FLAGS_seek_bound);
+      bound = bound_key.slice();
+      Iterator* iter = db_->NewIterator(options);
       key.Set(k);
       iter->Seek(key.slice());
       if (iter->Valid() && iter->key() == key.slice()) found++;
@@ -1068,6 +1263,10 @@ int main(int argc, char** argv) {
   FLAGS_max_file_size = leveldb::Options().max_file_size;
   FLAGS_block_size = leveldb::Options().block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_max_sorted_runs = leveldb::Options().max_sorted_runs_per_level;
+  FLAGS_max_background_compactions =
+      leveldb::Options().max_background_compactions;
+  FLAGS_max_subcompactions = leveldb::Options().max_subcompactions;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
@@ -1081,6 +1280,16 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--histogram=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_histogram = n;
+    } else if (sscanf(argv[i], "--statistics=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_statistics = n;
+    } else if (sscanf(argv[i], "--delayed_write_rate=%d%c", &n, &junk) == 1) {
+      FLAGS_delayed_write_rate = n;
+    } else if (sscanf(argv[i], "--rate_limit=%d%c", &n, &junk) == 1) {
+      FLAGS_rate_limit = n;
+    } else if (sscanf(argv[i], "--rate_limit_auto_tune=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_rate_limit_auto_tune = n;
     } else if (sscanf(argv[i], "--comparisons=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_comparisons = n;
@@ -1090,13 +1299,33 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--log_stripes=%d%c", &n, &junk) == 1) {
+      FLAGS_log_stripes = n;
+    } else if (strncmp(argv[i], "--log_compression=", 18) == 0) {
+      FLAGS_log_compression = argv[i] + 18;
+    } else if (sscanf(argv[i], "--pipelined_write=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pipelined_write = n;
     } else if (sscanf(argv[i], "--compression=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_compression = n;
+    } else if (sscanf(argv[i], "--tiered=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_tiered = n;
+    } else if (sscanf(argv[i], "--max_sorted_runs=%d%c", &n, &junk) == 1) {
+      FLAGS_max_sorted_runs = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
       FLAGS_reads = n;
+    } else if (sscanf(argv[i], "--multiget_batch=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_multiget_batch = n;
     } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
       FLAGS_threads = n;
     } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
@@ -1107,14 +1336,52 @@ int main(int argc, char** argv) {
       FLAGS_max_file_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
+    } else if (sscanf(argv[i], "--learned_index=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_learned_index = n;
+    } else if (sscanf(argv[i], "--min_separated_value_size=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_min_separated_value_size = n;
+    } else if (sscanf(argv[i], "--partition_index_and_filters=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_partition_index_and_filters = n;
     } else if (sscanf(argv[i], "--key_prefix=%d%c", &n, &junk) == 1) {
       FLAGS_key_prefix = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (strncmp(argv[i], "--cache_type=", 13) == 0) {
+      FLAGS_cache_type = argv[i] + 13;
+    } else if (sscanf(argv[i], "--cache_shard_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_shard_bits = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--monkey=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_monkey = n;
+    } else if (sscanf(argv[i], "--blocked_bloom=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_blocked_bloom = n;
+    } else if (sscanf(argv[i], "--binary_fuse=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_binary_fuse = n;
+    } else if (sscanf(argv[i], "--full_table_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_full_table_filter = n;
+    } else if (sscanf(argv[i], "--range_filter_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_range_filter_bits = n;
+    } else if (sscanf(argv[i], "--seek_bound=%d%c", &n, &junk) == 1) {
+      FLAGS_seek_bound = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (strncmp(argv[i], "--memtable_rep=", 15) == 0) {
+      FLAGS_memtable_rep = argv[i] + 15;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_size = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
@@ -50,7 +50,7 @@ void BM_LogAndApply(benchmark::State& state) {
 
   InternalKeyComparator cmp(BytewiseComparator());
   Options options;
-  VersionSet vset(dbname, &options, nullptr, &cmp);
+  VersionSet vset(dbname, &options, nullptr, nullptr, &cmp);
   bool save_manifest;
   ASSERT_LEVELDB_OK(vset.Recover(&save_manifest));
   VersionEdit vbase;
@@ -7,17 +7,21 @@
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/table_cache.h"
+#include "db/value_log.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "util/rate_limiter.h"
 
 namespace leveldb {
 
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, ValueLog* value_log,
+                  Iterator* iter, FileMetaData* meta, int level) {
   Status s;
   meta->file_size = 0;
+  meta->value_log_refs.clear();
   iter->SeekToFirst();
 
   std::string fname = TableFileName(dbname, meta->number);
@@ -27,25 +31,52 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     if (!s.ok()) {
       return s;
     }
+    file = NewRateLimitedFile(file, options.rate_limiter, Env::kHighPriority);
 
-    TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    TableBuilder* builder = new TableBuilder(options, file, level);
+    ValueLogBuilder* value_log_builder = nullptr;
+    if (value_log != nullptr) {
+      value_log_builder = new ValueLogBuilder(dbname, options, value_log,
+                                              nullptr, meta->number);
+    }
     Slice key;
     for (; iter->Valid(); iter->Next()) {
       key = iter->key();
-      builder->Add(key, iter->value());
+      Slice value = iter->value();
+      if (value_log_builder != nullptr) {
+        s = value_log_builder->Add(&key, &value);
+        if (!s.ok()) {
+          break;
+        }
+      }
+      if (builder->NumEntries() == 0) {
+        meta->smallest.DecodeFrom(key);
+      }
+      builder->Add(key, value);
     }
     if (!key.empty()) {
       meta->largest.DecodeFrom(key);
     }
 
     // Finish and check for builder errors
-    s = builder->Finish();
+    if (s.ok()) {
+      s = builder->Finish();
+    } else {
+      builder->Abandon();
+    }
     if (s.ok()) {
       meta->file_size = builder->FileSize();
       assert(meta->file_size > 0);
     }
     delete builder;
+    if (value_log_builder != nullptr) {
+      if (s.ok()) {
+        s = value_log_builder->Finish(&meta->value_log_refs);
+      } else {
+        value_log_builder->Abandon();
+      }
+      delete value_log_builder;
+    }
 
     // Finish and check for file errors
     if (s.ok()) {
@@ -75,6 +106,10 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     // Keep it
   } else {
     env->RemoveFile(fname);
+    if (value_log != nullptr) {
+      env->RemoveFile(ValueLogFileName(dbname, meta->number));
+    }
+    meta->value_log_refs.clear();
   }
   return s;
 }
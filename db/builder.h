@@ -15,15 +15,20 @@ struct FileMetaData;
 class Env;
 class Iterator;
 class TableCache;
+class ValueLog;
 class VersionEdit;
 
 // Build a Table file from the contents of *iter.  The generated file
 // will be named according to meta->number.  On success, the rest of
 // *meta will be filled with metadata about the generated table.
 // If no data is present in *iter, meta->file_size will be set to
-// zero, and no Table file will be produced.
+// zero, and no Table file will be produced.  "level" is the level the
+// table is going to be placed at (see TableBuilder).  Unless "value_log"
+// is null, large values are moved to the value log file of the table
+// (see ValueLogBuilder).
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, ValueLog* value_log,
+                  Iterator* iter, FileMetaData* meta, int level);
 
 }  // namespace leveldb
 
@@ -20,10 +20,13 @@
 #include "db/log_writer.h"
 #include "db/memtable.h"
 #include "db/table_cache.h"
+#include "db/value_log.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
@@ -34,6 +37,8 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/rate_limiter.h"
+#include "util/statistics.h"
 
 namespace leveldb {
 
@@ -42,34 +47,77 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr), sync(false), done(false), group(nullptr), cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  WriteGroup* group;  // Set once the batch is logged and may be inserted
   port::CondVar cv;
 };
 
+// A group of writers whose batches were logged together and that are now
+// inserting their own batches into the memtable (Options::pipelined_write).
+struct DBImpl::WriteGroup {
+  WriteGroup() : mem(nullptr), pending(0), last_sequence(0) {}
+
+  MemTable* mem;
+  std::vector<Writer*> writers;  // Members with a batch to insert
+  int pending;                   // Members still inserting
+  SequenceNumber last_sequence;  // Last sequence number of the group
+  Status status;                 // First error of the inserts
+};
+
+// A log file of mem_ (see Options::log_stripes).
+struct DBImpl::LogFile {
+  LogFile(WritableFile* f, uint64_t n, uint64_t length,
+          const Options& options)
+      : file(f),
+        writer(f, length, options.log_compression,
+               options.zstd_compression_level),
+        number(n),
+        busy(false) {}
+
+  ~LogFile() { delete file; }
+
+  WritableFile* const file;
+  log::Writer writer;
+  const uint64_t number;
+  bool busy;         // Held by a group being logged (pipelined writes only)
+  WriteBatch batch;  // Merged batches of that group
+};
+
 struct DBImpl::CompactionState {
   // Files produced by compaction
   struct Output {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    std::vector<ValueLogRef> value_log_refs;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
+        start(nullptr),
+        end(nullptr),
+        cursor(c),
         smallest_snapshot(0),
         outfile(nullptr),
         builder(nullptr),
+        value_log_builder(nullptr),
         total_bytes(0) {}
 
   Compaction* const compaction;
 
+  // User keys [start,end) merged by this state; null means unbounded.
+  // A compaction split into subcompactions has one state per key range.
+  const std::string* start;
+  const std::string* end;
+  Compaction::Cursor cursor;
+
   // Sequence numbers < smallest_snapshot are not significant since we
   // will never have to service a snapshot below smallest_snapshot.
   // Therefore if we have seen a sequence number S <= smallest_snapshot,
@@ -81,6 +129,7 @@ struct DBImpl::CompactionState {
   // State kept for output being generated
   WritableFile* outfile;
   TableBuilder* builder;
+  ValueLogBuilder* value_log_builder;
 
   uint64_t total_bytes;
 };
@@ -98,10 +147,22 @@ Options SanitizeOptions(const std::string& dbname,
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  if (icmp->user_comparator() != BytewiseComparator()) {
+    // Both rely on the bytewise order of keys
+    result.range_filter_policy = nullptr;
+    result.learned_index = false;
+  }
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_sorted_runs_per_level, 2, 64);
+  ClipToRange(&result.max_background_compactions, 1, 64);
+  ClipToRange(&result.max_subcompactions, 1, 64);
+  ClipToRange(&result.log_stripes, 1, 8);
+  if (result.log_stripes > 1) {
+    result.pipelined_write = true;
+  }
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -118,9 +179,18 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
+static int ValueLogCacheSize(const Options& sanitized_options) {
+  return (sanitized_options.max_open_files - kNumNonTableCacheFiles) / 4;
+}
+
 static int TableCacheSize(const Options& sanitized_options) {
-  // Reserve ten files or so for other uses and give the rest to TableCache.
-  return sanitized_options.max_open_files - kNumNonTableCacheFiles;
+  // Reserve ten files or so for other uses and give the rest to TableCache,
+  // but for the share of ValueLog if values are separated.
+  int entries = sanitized_options.max_open_files - kNumNonTableCacheFiles;
+  if (sanitized_options.min_separated_value_size > 0) {
+    entries -= ValueLogCacheSize(sanitized_options);
+  }
+  return entries;
 }
 
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
@@ -133,27 +203,31 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
       table_cache_(new TableCache(dbname_, options_, TableCacheSize(options_))),
+      value_log_(new ValueLog(dbname_, options_, ValueLogCacheSize(options_))),
+      statistics_(options_.statistics ? new Statistics(env_) : nullptr),
       db_lock_(nullptr),
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
       mem_(nullptr),
       imm_(nullptr),
-      has_imm_(false),
-      logfile_(nullptr),
       logfile_number_(0),
-      log_(nullptr),
+      next_log_(0),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      background_flush_scheduled_(false),
+      background_compactions_scheduled_(0),
+      subcompactions_run_(0),
+      pushing_down_memtable_(false),
       manual_compaction_(nullptr),
-      versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+      versions_(new VersionSet(dbname_, &options_, table_cache_, value_log_,
+                               &internal_comparator_)),
+      write_controller_(options_) {}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_flush_scheduled_ || background_compactions_scheduled_ > 0) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
@@ -166,9 +240,12 @@ DBImpl::~DBImpl() {
   if (mem_ != nullptr) mem_->Unref();
   if (imm_ != nullptr) imm_->Unref();
   delete tmp_batch_;
-  delete log_;
-  delete logfile_;
+  for (LogFile* log : logs_) {
+    delete log;
+  }
+  delete value_log_;
   delete table_cache_;
+  delete statistics_;
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -231,9 +308,12 @@ void DBImpl::RemoveObsoleteFiles() {
     return;
   }
 
-  // Make a set of all of the live files
+  // Make a set of all of the live files.  The value log file of a table
+  // shares its number.
   std::set<uint64_t> live = pending_outputs_;
   versions_->AddLiveFiles(&live);
+  std::set<uint64_t> live_value_logs = pending_outputs_;
+  versions_->AddLiveValueLogs(&live_value_logs);
 
   std::vector<std::string> filenames;
   env_->GetChildren(dbname_, &filenames);  // Ignoring errors on purpose
@@ -261,6 +341,9 @@ void DBImpl::RemoveObsoleteFiles() {
           // be recorded in pending_outputs_, which is inserted into "live"
           keep = (live.find(number) != live.end());
           break;
+        case kValueLogFile:
+          keep = (live_value_logs.find(number) != live_value_logs.end());
+          break;
         case kCurrentFile:
         case kDBLockFile:
         case kInfoLogFile:
@@ -272,6 +355,8 @@ void DBImpl::RemoveObsoleteFiles() {
         files_to_delete.push_back(std::move(filename));
         if (type == kTableFile) {
           table_cache_->Evict(number);
+        } else if (type == kValueLogFile) {
+          value_log_->Evict(number);
         }
         Log(options_.info_log, "Delete type=%d #%lld\n", static_cast<int>(type),
             static_cast<unsigned long long>(number));
@@ -360,19 +445,17 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
     return Status::Corruption(buf, TableFileName(dbname_, *(expected.begin())));
   }
 
-  // Recover in the order in which the logs were generated
   std::sort(logs.begin(), logs.end());
-  for (size_t i = 0; i < logs.size(); i++) {
-    s = RecoverLogFile(logs[i], (i == logs.size() - 1), save_manifest, edit,
-                       &max_sequence);
-    if (!s.ok()) {
-      return s;
-    }
+  s = RecoverLogFiles(logs, save_manifest, edit, &max_sequence);
+  if (!s.ok()) {
+    return s;
+  }
 
-    // The previous incarnation may not have written any MANIFEST
-    // records after allocating this log number.  So we manually
-    // update the file number allocation counter in VersionSet.
-    versions_->MarkFileNumberUsed(logs[i]);
+  // The previous incarnation may not have written any MANIFEST
+  // records after allocating these log numbers.  So we manually
+  // update the file number allocation counter in VersionSet.
+  for (uint64_t log_number : logs) {
+    versions_->MarkFileNumberUsed(log_number);
   }
 
   if (versions_->LastSequence() < max_sequence) {
@@ -382,9 +465,9 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   return Status::OK();
 }
 
-Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
-                              bool* save_manifest, VersionEdit* edit,
-                              SequenceNumber* max_sequence) {
+Status DBImpl::RecoverLogFiles(const std::vector<uint64_t>& log_numbers,
+                               bool* save_manifest, VersionEdit* edit,
+                               SequenceNumber* max_sequence) {
   struct LogReporter : public log::Reader::Reporter {
     Env* env;
     Logger* info_log;
@@ -398,56 +481,103 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     }
   };
 
+  // A log file being replayed, whose next record is in "batch" if valid.
+  struct LogSource {
+    std::string fname;
+    SequentialFile* file;
+    LogReporter reporter;
+    log::Reader* reader;
+    std::string scratch;
+    WriteBatch batch;
+    bool valid;
+  };
+
   mutex_.AssertHeld();
 
-  // Open the log file
-  std::string fname = LogFileName(dbname_, log_number);
-  SequentialFile* file;
-  Status status = env_->NewSequentialFile(fname, &file);
-  if (!status.ok()) {
-    MaybeIgnoreError(&status);
-    return status;
-  }
-
-  // Create the log reader.
-  LogReporter reporter;
-  reporter.env = env_;
-  reporter.info_log = options_.info_log;
-  reporter.fname = fname.c_str();
-  reporter.status = (options_.paranoid_checks ? &status : nullptr);
-  // We intentionally make log::Reader do checksumming even if
-  // paranoid_checks==false so that corruptions cause entire commits
-  // to be skipped instead of propagating bad information (like overly
-  // large sequence numbers).
-  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/);
-  Log(options_.info_log, "Recovering log #%llu",
-      (unsigned long long)log_number);
-
-  // Read all the records and add to a memtable
-  std::string scratch;
-  Slice record;
-  WriteBatch batch;
+  // Open the log files
+  Status status;
+  std::vector<LogSource*> sources;
+  for (uint64_t log_number : log_numbers) {
+    LogSource* source = new LogSource;
+    source->fname = LogFileName(dbname_, log_number);
+    status = env_->NewSequentialFile(source->fname, &source->file);
+    if (!status.ok()) {
+      delete source;
+      MaybeIgnoreError(&status);
+      if (!status.ok()) {
+        break;
+      }
+      continue;
+    }
+
+    // Create the log reader.
+    source->reporter.env = env_;
+    source->reporter.info_log = options_.info_log;
+    source->reporter.fname = source->fname.c_str();
+    source->reporter.status = (options_.paranoid_checks ? &status : nullptr);
+    // We intentionally make log::Reader do checksumming even if
+    // paranoid_checks==false so that corruptions cause entire commits
+    // to be skipped instead of propagating bad information (like overly
+    // large sequence numbers).
+    source->reader = new log::Reader(source->file, &source->reporter,
+                                     true /*checksum*/, 0 /*initial_offset*/);
+    source->valid = false;
+    sources.push_back(source);
+    Log(options_.info_log, "Recovering log #%llu",
+        (unsigned long long)log_number);
+  }
+
+  // Reads the next record of "source" into its batch.
+  auto advance = [&status](LogSource* source) {
+    Slice record;
+    source->valid = false;
+    while (source->reader->ReadRecord(&record, &source->scratch) &&
+           status.ok()) {
+      if (record.size() < 12) {
+        source->reporter.Corruption(
+            record.size(), Status::Corruption("log record too small"));
+        continue;
+      }
+      WriteBatchInternal::SetContents(&source->batch, record);
+      source->valid = true;
+      break;
+    }
+  };
+  if (status.ok()) {
+    for (LogSource* source : sources) {
+      advance(source);
+    }
+  }
+
+  // Add the records to a memtable in the order of their sequence numbers,
+  // which writes that were striped across several log files need.  The
+  // records of each log file are in that order already.
   int compactions = 0;
   MemTable* mem = nullptr;
-  while (reader.ReadRecord(&record, &scratch) && status.ok()) {
-    if (record.size() < 12) {
-      reporter.Corruption(record.size(),
-                          Status::Corruption("log record too small"));
-      continue;
+  while (status.ok()) {
+    LogSource* next = nullptr;
+    for (LogSource* source : sources) {
+      if (source->valid &&
+          (next == nullptr || WriteBatchInternal::Sequence(&source->batch) <
+                                  WriteBatchInternal::Sequence(&next->batch))) {
+        next = source;
+      }
+    }
+    if (next == nullptr) {
+      break;
     }
-    WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+      mem = new MemTable(internal_comparator_, options_);
       mem->Ref();
     }
-    status = WriteBatchInternal::InsertInto(&batch, mem);
+    status = WriteBatchInternal::InsertInto(&next->batch, mem);
     MaybeIgnoreError(&status);
     if (!status.ok()) {
       break;
     }
-    const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
-                                    WriteBatchInternal::Count(&batch) - 1;
+    const SequenceNumber last_seq = WriteBatchInternal::Sequence(&next->batch) +
+                                    WriteBatchInternal::Count(&next->batch) - 1;
     if (last_seq > *max_sequence) {
       *max_sequence = last_seq;
     }
@@ -455,7 +585,10 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t number;
+      mem->MarkImmutable();
+      status = WriteLevel0Table(mem, edit, nullptr, &number);
+      pending_outputs_.erase(number);
       mem->Unref();
       mem = nullptr;
       if (!status.ok()) {
@@ -464,27 +597,36 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         break;
       }
     }
+    advance(next);
   }
 
-  delete file;
+  for (LogSource* source : sources) {
+    delete source->reader;
+    delete source->file;
+    delete source;
+  }
 
-  // See if we should keep reusing the last log file.
-  if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
-    assert(logfile_ == nullptr);
-    assert(log_ == nullptr);
+  // See if we should keep reusing the log file.  Only a single log file
+  // holds all of the records of mem.
+  if (status.ok() && options_.reuse_logs && options_.log_stripes == 1 &&
+      log_numbers.size() == 1 && compactions == 0) {
+    assert(logs_.empty());
     assert(mem_ == nullptr);
+    const std::string fname = LogFileName(dbname_, log_numbers[0]);
     uint64_t lfile_size;
+    WritableFile* lfile;
     if (env_->GetFileSize(fname, &lfile_size).ok() &&
-        env_->NewAppendableFile(fname, &logfile_).ok()) {
+        env_->NewAppendableFile(fname, &lfile).ok()) {
       Log(options_.info_log, "Reusing old log %s \n", fname.c_str());
-      log_ = new log::Writer(logfile_, lfile_size);
-      logfile_number_ = log_number;
+      logs_.push_back(
+          new LogFile(lfile, log_numbers[0], lfile_size, options_));
+      logfile_number_ = log_numbers[0];
       if (mem != nullptr) {
         mem_ = mem;
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = new MemTable(internal_comparator_, options_);
         mem_->Ref();
       }
     }
@@ -494,7 +636,10 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t number;
+      mem->MarkImmutable();
+      status = WriteLevel0Table(mem, edit, nullptr, &number);
+      pending_outputs_.erase(number);
     }
     mem->Unref();
   }
@@ -502,21 +647,77 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   return status;
 }
 
+Status DBImpl::NewLogFiles(std::vector<LogFile*>* logs) {
+  mutex_.AssertHeld();
+  Status s;
+  for (int i = 0; i < options_.log_stripes; i++) {
+    const uint64_t number = versions_->NewFileNumber();
+    WritableFile* file;
+    s = env_->NewWritableFile(LogFileName(dbname_, number), &file);
+    if (!s.ok()) {
+      // Avoid chewing through file number space in a tight loop.
+      versions_->ReuseFileNumber(number);
+      break;
+    }
+    logs->push_back(new LogFile(file, number, 0, options_));
+  }
+  if (!s.ok()) {
+    while (!logs->empty()) {
+      LogFile* log = logs->back();
+      logs->pop_back();
+      const uint64_t number = log->number;
+      delete log;
+      env_->RemoveFile(LogFileName(dbname_, number));
+      versions_->ReuseFileNumber(number);
+    }
+  }
+  return s;
+}
+
+Status DBImpl::CloseLogFiles() {
+  mutex_.AssertHeld();
+  Status s;
+  for (LogFile* log : logs_) {
+    assert(!log->busy);
+    Status close_status = log->file->Close();
+    if (s.ok()) {
+      s = close_status;
+    }
+    delete log;
+  }
+  logs_.clear();
+  return s;
+}
+
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base, uint64_t* number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
+  *number = meta.number;
   Iterator* iter = mem->NewIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
+  // Pick the level of the new table up front so that its filters can be
+  // sized for that level.
+  int level = 0;
+  std::string min_user_key, max_user_key;
+  iter->SeekToFirst();
+  if (base != nullptr && iter->Valid()) {
+    min_user_key = ExtractUserKey(iter->key()).ToString();
+    iter->SeekToLast();
+    max_user_key = ExtractUserKey(iter->key()).ToString();
+    level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+  }
+
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, value_log_, iter,
+                   &meta, level);
     mutex_.Lock();
   }
 
@@ -524,24 +725,32 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
-  int level = 0;
   if (s.ok() && meta.file_size > 0) {
-    const Slice min_user_key = meta.smallest.user_key();
-    const Slice max_user_key = meta.largest.user_key();
-    if (base != nullptr) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+    if (level > 0) {
+      // Compactions may have changed the tree while the table was built.
+      // Check the level again; a table that ends up on a different level
+      // only has filters sized for the wrong level.
+      level = versions_->current()->PickLevelForMemTableOutput(min_user_key,
+                                                               max_user_key);
+      pushing_down_memtable_ = (level > 0);
     }
+    // A table pushed below level-0 overlaps nothing there, so it can join
+    // the newest run of its level.
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+                  meta.largest,
+                  level > 0 ? versions_->current()->NewestRun(level) : 0,
+                  meta.value_log_refs);
   }
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
   stats.bytes_written = meta.file_size;
+  for (const ValueLogRef& ref : meta.value_log_refs) {
+    stats.bytes_written += ref.file_size;
+  }
   stats_[level].Add(stats);
   return s;
 }
@@ -554,7 +763,8 @@ void DBImpl::CompactMemTable() {
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  uint64_t number;
+  Status s = WriteLevel0Table(imm_, &edit, base, &number);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -567,12 +777,15 @@ void DBImpl::CompactMemTable() {
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
     s = versions_->LogAndApply(&edit, &mutex_);
   }
+  // Table compactions may remove obsolete files concurrently, so the new
+  // table is protected until it is part of the current version.
+  pending_outputs_.erase(number);
+  pushing_down_memtable_ = false;
 
   if (s.ok()) {
     // Commit to the new state
     imm_->Unref();
     imm_ = nullptr;
-    has_imm_.store(false, std::memory_order_release);
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -629,9 +842,9 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
       background_work_finished_signal_.Wait();
     }
   }
-  // Finish current background compaction in the case where
+  // Finish current background compactions in the case where
   // `background_work_finished_signal_` was signalled due to an error.
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0) {
     background_work_finished_signal_.Wait();
   }
   if (manual_compaction_ == &manual) {
@@ -666,56 +879,111 @@ void DBImpl::RecordBackgroundError(const Status& s) {
 
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
+    return;
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
-  } else {
-    background_compaction_scheduled_ = true;
+    return;
+  }
+
+  if (options_.rate_limiter != nullptr) {
+    options_.rate_limiter->SetPendingCompactionBytes(
+        versions_->PendingCompactionBytes());
+  }
+
+  // Memtable compactions get a lane of their own, so that writers waiting
+  // for imm_ to be written out never wait behind a table compaction.
+  if (imm_ != nullptr && !background_flush_scheduled_) {
+    background_flush_scheduled_ = true;
+    env_->ScheduleWithPriority(&DBImpl::BGWorkFlush, this,
+                               Env::kHighPriority);
+  }
+
+  // Schedule one more table compaction at a time.  A compaction that finds
+  // work schedules the next one, so the number of concurrent compactions
+  // only grows while there are inputs that do not conflict.
+  if (background_compactions_scheduled_ >=
+      options_.max_background_compactions) {
+    // Enough compactions scheduled already
+  } else if (manual_compaction_ != nullptr) {
+    // A manual compaction runs on its own.  If compactions are still
+    // running, the last one of them to finish schedules it.
+    if (background_compactions_scheduled_ == 0) {
+      background_compactions_scheduled_++;
+      env_->Schedule(&DBImpl::BGWork, this);
+    }
+  } else if (versions_->NeedsCompaction()) {
+    background_compactions_scheduled_++;
     env_->Schedule(&DBImpl::BGWork, this);
   }
 }
 
+void DBImpl::BGWorkFlush(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
 void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != nullptr) {
+    CompactMemTable();
+  }
+
+  background_flush_scheduled_ = false;
+
+  // The new level-0 file may call for a table compaction.
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+}
+
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool made_progress = false;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    made_progress = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  A call that found
+  // nothing to do waits for the next flush or compaction to change that.
+  if (made_progress) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
-    CompactMemTable();
-    return;
+  if (pushing_down_memtable_) {
+    // The memtable compaction schedules us again once its table is
+    // installed.
+    return false;
   }
 
   Compaction* c;
   bool is_manual = (manual_compaction_ != nullptr);
   InternalKey manual_end;
-  if (is_manual) {
+  if (is_manual && versions_->NumRunningCompactions() > 0) {
+    // Wait for the compactions in progress to finish.
+    return false;
+  } else if (is_manual) {
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == nullptr);
@@ -729,6 +997,11 @@ void DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c == nullptr) {
+      return false;
+    }
+    // There may be more work that does not conflict with this compaction.
+    MaybeScheduleCompaction();
   }
 
   Status status;
@@ -739,15 +1012,16 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
+    c->edit()->AddFile(c->output_level(), f->number, f->file_size,
+                       f->smallest, f->largest, c->output_run(),
+                       f->value_log_refs);
     status = versions_->LogAndApply(c->edit(), &mutex_);
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-        static_cast<unsigned long long>(f->number), c->level() + 1,
+        static_cast<unsigned long long>(f->number), c->output_level(),
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
   } else {
@@ -783,6 +1057,7 @@ void DBImpl::BackgroundCompaction() {
     }
     manual_compaction_ = nullptr;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -794,6 +1069,10 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
   } else {
     assert(compact->outfile == nullptr);
   }
+  if (compact->value_log_builder != nullptr) {
+    compact->value_log_builder->Abandon();
+    delete compact->value_log_builder;
+  }
   delete compact->outfile;
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
@@ -822,7 +1101,12 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->outfile = NewRateLimitedFile(
+        compact->outfile, options_.rate_limiter, Env::kLowPriority);
+    compact->builder = new TableBuilder(options_, compact->outfile,
+                                        compact->compaction->output_level());
+    compact->value_log_builder = new ValueLogBuilder(
+        dbname_, options_, value_log_, compact->compaction, file_number);
   }
   return s;
 }
@@ -850,6 +1134,16 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   delete compact->builder;
   compact->builder = nullptr;
 
+  if (s.ok()) {
+    s = compact->value_log_builder->Finish(
+        &compact->current_output()->value_log_refs);
+  } else {
+    compact->value_log_builder->Abandon();
+  }
+  compact->total_bytes += compact->value_log_builder->FileSize();
+  delete compact->value_log_builder;
+  compact->value_log_builder = nullptr;
+
   // Finish and check for file errors
   if (s.ok()) {
     s = compact->outfile->Sync();
@@ -880,28 +1174,30 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
   Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
       compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1), compact->compaction->level() + 1,
+      compact->compaction->num_input_files(1),
+      compact->compaction->output_level(),
       static_cast<long long>(compact->total_bytes));
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
+  const uint64_t run = compact->compaction->output_run();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+    compact->compaction->edit()->AddFile(level, out.number, out.file_size,
+                                         out.smallest, out.largest, run,
+                                         out.value_log_refs);
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
       compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+      compact->compaction->output_level());
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == nullptr);
@@ -912,33 +1208,209 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
   }
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
-
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  input->SeekToFirst();
+  std::vector<std::string> boundaries;
+  if (options_.max_subcompactions > 1) {
+    GetSubcompactionBoundaries(compact->compaction, &boundaries);
+  }
+  Status status;
+  if (boundaries.empty()) {
+    status = DoSubcompactionWork(compact);
+  } else {
+    status = RunSubcompactions(compact, boundaries);
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (const CompactionState::Output& out : compact->outputs) {
+    stats.bytes_written += out.file_size;
+    for (const ValueLogRef& ref : out.value_log_refs) {
+      if (ref.number == out.number) {
+        stats.bytes_written += ref.file_size;
+      }
+    }
+  }
+
+  mutex_.Lock();
+  stats_[compact->compaction->output_level()].Add(stats);
+  if (!boundaries.empty()) {
+    subcompactions_run_++;
+  }
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+void DBImpl::GetSubcompactionBoundaries(Compaction* c,
+                                        std::vector<std::string>* boundaries) {
+  // Candidate boundaries are the largest user keys of the input files.
+  const Comparator* ucmp = user_comparator();
+  std::vector<FileMetaData*> files;
+  std::vector<Slice> candidates;
+  uint64_t total_bytes = 0;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < c->num_input_files(which); i++) {
+      FileMetaData* f = c->input(which, i);
+      files.push_back(f);
+      candidates.push_back(f->largest.user_key());
+      total_bytes += f->file_size;
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [ucmp](const Slice& a, const Slice& b) {
+              return ucmp->Compare(a, b) < 0;
+            });
+  candidates.erase(std::unique(candidates.begin(), candidates.end(),
+                               [ucmp](const Slice& a, const Slice& b) {
+                                 return ucmp->Compare(a, b) == 0;
+                               }),
+                   candidates.end());
+  candidates.pop_back();  // Nothing follows the largest key
+
+  // Do not split into pieces smaller than an output file.
+  const uint64_t max_pieces =
+      std::max<uint64_t>(total_bytes / c->MaxOutputFileSize(), 1);
+  const uint64_t pieces = std::min<uint64_t>(
+      std::min<uint64_t>(options_.max_subcompactions, candidates.size() + 1),
+      max_pieces);
+  if (pieces <= 1) {
+    return;
+  }
+
+  // Cut the key space into pieces of about equal input size, estimated
+  // from the index blocks of the input tables.
+  const InternalKeyComparator& icmp = internal_comparator_;
+  const uint64_t piece_bytes = total_bytes / pieces;
+  for (const Slice& user_key : candidates) {
+    InternalKey key(user_key, kMaxSequenceNumber, kValueTypeForSeek);
+    uint64_t offset = 0;
+    for (FileMetaData* f : files) {
+      if (icmp.Compare(f->largest, key) <= 0) {
+        offset += f->file_size;
+      } else if (icmp.Compare(f->smallest, key) < 0) {
+        Table* tableptr;
+        Iterator* iter = table_cache_->NewIterator(ReadOptions(), f->number,
+                                                   f->file_size, &tableptr);
+        if (tableptr != nullptr) {
+          offset += tableptr->ApproximateOffsetOf(key.Encode());
+        }
+        delete iter;
+      }
+    }
+    if (offset >= piece_bytes * (boundaries->size() + 1)) {
+      boundaries->push_back(user_key.ToString());
+      if (boundaries->size() + 1 == pieces) {
+        break;
+      }
+    }
+  }
+}
+
+Status DBImpl::RunSubcompactions(CompactionState* compact,
+                                 const std::vector<std::string>& boundaries) {
+  // One state per key range; the first range is merged on this thread.
+  std::vector<CompactionState*> subs;
+  for (size_t i = 0; i <= boundaries.size(); i++) {
+    CompactionState* sub = new CompactionState(compact->compaction);
+    sub->start = (i == 0) ? nullptr : &boundaries[i - 1];
+    sub->end = (i == boundaries.size()) ? nullptr : &boundaries[i];
+    sub->smallest_snapshot = compact->smallest_snapshot;
+    subs.push_back(sub);
+  }
+
+  struct Subcompaction {
+    DBImpl* db;
+    CompactionState* state;
+    Status status;
+    port::Mutex* mu;
+    port::CondVar* cv;
+    int* running;
+
+    static void Run(void* arg) {
+      Subcompaction* job = reinterpret_cast<Subcompaction*>(arg);
+      job->status = job->db->DoSubcompactionWork(job->state);
+      MutexLock l(job->mu);
+      (*job->running)--;
+      job->cv->SignalAll();
+    }
+  };
+
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  int running = subs.size() - 1;
+  std::vector<Subcompaction> jobs(subs.size());
+  for (size_t i = 1; i < subs.size(); i++) {
+    jobs[i].db = this;
+    jobs[i].state = subs[i];
+    jobs[i].mu = &mu;
+    jobs[i].cv = &cv;
+    jobs[i].running = &running;
+    env_->StartThread(&Subcompaction::Run, &jobs[i]);
+  }
+  jobs[0].status = DoSubcompactionWork(subs[0]);
+  mu.Lock();
+  while (running > 0) {
+    cv.Wait();
+  }
+  mu.Unlock();
+
+  // Hand the outputs of every range to the whole compaction, in key order.
+  Status status;
+  for (size_t i = 0; i < subs.size(); i++) {
+    if (status.ok()) {
+      status = jobs[i].status;
+    }
+    compact->outputs.insert(compact->outputs.end(), subs[i]->outputs.begin(),
+                            subs[i]->outputs.end());
+    compact->total_bytes += subs[i]->total_bytes;
+    subs[i]->outputs.clear();
+  }
+  mutex_.Lock();
+  for (CompactionState* sub : subs) {
+    CleanupCompaction(sub);
+  }
+  mutex_.Unlock();
+  Log(options_.info_log, "Compacted in %d subcompactions",
+      static_cast<int>(subs.size()));
+  return status;
+}
+
+Status DBImpl::DoSubcompactionWork(CompactionState* compact) {
+  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+
+  if (compact->start != nullptr) {
+    InternalKey start(*compact->start, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+  } else {
+    input->SeekToFirst();
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
-    // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
-      const uint64_t imm_start = env_->NowMicros();
-      mutex_.Lock();
-      if (imm_ != nullptr) {
-        CompactMemTable();
-        // Wake up MakeRoomForWrite() if necessary.
-        background_work_finished_signal_.SignalAll();
-      }
-      mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
-    }
-
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (compact->end != nullptr && ParseInternalKey(key, &ikey) &&
+        user_comparator()->Compare(ikey.user_key, *compact->end) >= 0) {
+      // The rest belongs to the next subcompaction
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != nullptr) {
       status = FinishCompactionOutputFile(compact, input);
       if (!status.ok()) {
@@ -968,7 +1440,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;  // (A)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                 &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -987,7 +1460,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key, &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -999,11 +1472,19 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
           break;
         }
       }
+      // Large values go to the value log file of the output, which may
+      // change the type of the key
+      Slice output_key = key;
+      Slice output_value = input->value();
+      status = compact->value_log_builder->Add(&output_key, &output_value);
+      if (!status.ok()) {
+        break;
+      }
       if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+        compact->current_output()->smallest.DecodeFrom(output_key);
       }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
+      compact->current_output()->largest.DecodeFrom(output_key);
+      compact->builder->Add(output_key, output_value);
 
       // Close output file if it is big enough
       if (compact->builder->FileSize() >=
@@ -1028,30 +1509,6 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     status = input->status();
   }
   delete input;
-  input = nullptr;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
@@ -1117,8 +1574,14 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+int DBImpl::TEST_SubcompactionsRun() {
+  MutexLock l(&mutex_);
+  return subcompactions_run_;
+}
+
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
+  OperationTimer timer(statistics_, Statistics::kGet);
   Status s;
   MutexLock l(&mutex_);
   SequenceNumber snapshot;
@@ -1145,9 +1608,9 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
     if (mem->Get(lkey, value, &s)) {
-      // Done
+      GetPerfContext()->memtable_hit_count++;
     } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
+      GetPerfContext()->memtable_hit_count++;
     } else {
       s = current->Get(options, lkey, value, &stats);
       have_stat_update = true;
@@ -1164,6 +1627,97 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   return s;
 }
 
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  OperationTimer timer(statistics_, Statistics::kMultiGet);
+  const size_t n = keys.size();
+  values->assign(n, std::string());
+  statuses->assign(n, Status());
+
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  mem->Ref();
+  if (imm != nullptr) imm->Ref();
+  current->Ref();
+
+  std::vector<Version::GetStats> stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    // Visit the keys in sorted order so that the version can walk each
+    // table from its first key to its last.
+    const Comparator* ucmp = user_comparator();
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return ucmp->Compare(keys[a], keys[b]) < 0;
+    });
+
+    // First look in the memtable, then in the immutable memtable (if any).
+    std::vector<LookupKey*> lkeys;
+    std::vector<const LookupKey*> file_keys;
+    std::vector<std::string*> file_values;
+    std::vector<size_t> file_order;
+    lkeys.reserve(n);
+    for (size_t i : order) {
+      LookupKey* lkey = new LookupKey(keys[i], snapshot);
+      lkeys.push_back(lkey);
+      Status* s = &(*statuses)[i];
+      std::string* value = &(*values)[i];
+      if (mem->Get(*lkey, value, s)) {
+        GetPerfContext()->memtable_hit_count++;
+      } else if (imm != nullptr && imm->Get(*lkey, value, s)) {
+        GetPerfContext()->memtable_hit_count++;
+      } else {
+        file_keys.push_back(lkey);
+        file_values.push_back(value);
+        file_order.push_back(i);
+      }
+    }
+
+    if (!file_keys.empty()) {
+      std::vector<Status> file_statuses;
+      current->MultiGet(options, file_keys, file_values, &file_statuses,
+                        &stats);
+      for (size_t j = 0; j < file_order.size(); j++) {
+        (*statuses)[file_order[j]] = file_statuses[j];
+      }
+    }
+    for (LookupKey* lkey : lkeys) {
+      delete lkey;
+    }
+    mutex_.Lock();
+  }
+
+  bool need_compaction = false;
+  for (const Version::GetStats& st : stats) {
+    if (current->UpdateStats(st)) {
+      need_compaction = true;
+    }
+  }
+  if (need_compaction) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  if (imm != nullptr) imm->Unref();
+  current->Unref();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
@@ -1173,7 +1727,11 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed,
+                       options.prefix_same_as_start ? options_.prefix_extractor
+                                                    : nullptr,
+                       options.iterate_upper_bound,
+                       options_.range_filter_policy != nullptr);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1183,6 +1741,13 @@ void DBImpl::RecordReadSample(Slice key) {
   }
 }
 
+Status DBImpl::ReadSeparatedValue(const Slice& user_key, const Slice& handle,
+                                  std::string* value) {
+  ReadOptions options;
+  options.verify_checksums = options_.paranoid_checks;
+  return value_log_->Get(options, user_key, handle, value);
+}
+
 const Snapshot* DBImpl::GetSnapshot() {
   MutexLock l(&mutex_);
   return snapshots_.New(versions_->LastSequence());
@@ -1203,6 +1768,13 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
 }
 
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  // A null batch only asks for room in the memtable
+  OperationTimer timer(updates != nullptr ? statistics_ : nullptr,
+                       Statistics::kWrite);
+  if (options_.pipelined_write) {
+    return PipelinedWrite(options, updates);
+  }
+
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1222,9 +1794,10 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+    WriteBatch* write_batch = BuildBatchGroup(&last_writer, tmp_batch_);
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(write_batch);
+    LogFile* log = logs_[0];  // Striped logs imply pipelined writes
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1232,10 +1805,10 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     // into mem_.
     {
       mutex_.Unlock();
-      status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+      status = log->writer.AddRecord(WriteBatchInternal::Contents(write_batch));
       bool sync_error = false;
       if (status.ok() && options.sync) {
-        status = logfile_->Sync();
+        status = log->file->Sync();
         if (!status.ok()) {
           sync_error = true;
         }
@@ -1275,9 +1848,188 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+// Unlike Write(), the leader only logs the group.  The group is taken off
+// the queue before it is logged, so that the next group can be logged to
+// another log file meanwhile (Options::log_stripes), or can wait for this
+// one's.  Once logged, every member of the group inserts its own batch
+// into the memtable.  The sequence numbers of a group are published once
+// it and all groups before it have been inserted.
+Status DBImpl::PipelinedWrite(const WriteOptions& options,
+                              WriteBatch* updates) {
+  Writer w(&mutex_);
+  w.batch = updates;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  // Members of a group that is being logged are no longer in writers_
+  while (!w.done && w.group == nullptr &&
+         (writers_.empty() || &w != writers_.front())) {
+    w.cv.Wait();
+  }
+  if (w.done) {
+    return w.status;
+  }
+
+  WriteGroup group;  // Used if we lead the group; outlives its members
+  if (w.group == nullptr) {
+    // We lead the next group into the log.  May temporarily unlock and
+    // wait.
+    Status status = MakeRoomForWrite(updates == nullptr);
+    Writer* last_writer = &w;
+    LogFile* log = nullptr;
+    WriteBatch* write_batch = nullptr;
+    if (status.ok() && updates != nullptr) {  // nullptr is for compactions
+      // Wait for a log file that no other group is being logged to.
+      while (log == nullptr) {
+        for (size_t i = 0; i < logs_.size(); i++) {
+          const size_t index = (next_log_ + i) % logs_.size();
+          if (!logs_[index]->busy) {
+            log = logs_[index];
+            next_log_ = (index + 1) % logs_.size();
+            break;
+          }
+        }
+        if (log == nullptr) {
+          background_work_finished_signal_.Wait();
+        }
+      }
+      log->busy = true;
+
+      group.mem = mem_;
+      write_batch = BuildBatchGroup(&last_writer, &log->batch);
+      SequenceNumber last_sequence =
+          inserting_groups_.empty() ? versions_->LastSequence()
+                                    : inserting_groups_.back()->last_sequence;
+      WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+
+      // Every member inserts its own batch, so each one gets its share of
+      // the sequence numbers of the log record.
+      for (Writer* member : writers_) {
+        if (member->batch != nullptr) {
+          WriteBatchInternal::SetSequence(member->batch, last_sequence + 1);
+          last_sequence += WriteBatchInternal::Count(member->batch);
+          group.writers.push_back(member);
+        }
+        if (member == last_writer) break;
+      }
+      group.last_sequence = last_sequence;
+
+      // The group holds back the publication of later groups, and the
+      // replacement of mem_, until it has been inserted or has failed.
+      group.pending = group.writers.size();
+      inserting_groups_.push_back(&group);
+    }
+
+    // Take the group off the queue, failing the members that have nothing
+    // to insert.
+    while (true) {
+      Writer* ready = writers_.front();
+      writers_.pop_front();
+      if (ready != &w && (log == nullptr || ready->batch == nullptr)) {
+        ready->status = status;
+        ready->done = true;
+        ready->cv.Signal();
+      }
+      if (ready == last_writer) break;
+    }
+
+    // Notify new head of write queue
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+
+    if (log == nullptr) {
+      return status;
+    }
+
+    // Add to log.  We can release the lock during this phase since the
+    // group holds the log file.
+    mutex_.Unlock();
+    status = log->writer.AddRecord(WriteBatchInternal::Contents(write_batch));
+    bool sync_error = false;
+    if (status.ok() && options.sync) {
+      status = log->file->Sync();
+      if (!status.ok()) {
+        sync_error = true;
+      }
+    }
+    mutex_.Lock();
+    if (sync_error) {
+      // See Write().
+      RecordBackgroundError(status);
+    }
+    if (write_batch == &log->batch) log->batch.Clear();
+    log->busy = false;
+    background_work_finished_signal_.SignalAll();
+
+    if (status.ok()) {
+      // Send the members of the group on to the memtable.
+      for (Writer* member : group.writers) {
+        member->group = &group;
+        if (member != &w) {
+          member->cv.Signal();
+        }
+      }
+    } else {
+      // Nothing was inserted; the members are released in order.
+      group.status = status;
+      group.pending = 0;
+      PublishInsertedGroups();
+      while (!w.done) {
+        w.cv.Wait();
+      }
+      return w.status;
+    }
+  }
+
+  // Insert our own batch alongside the other members of the group.
+  // mem_ is not replaced while any group is inserting.
+  WriteGroup* my_group = w.group;
+  mutex_.Unlock();
+  Status status =
+      WriteBatchInternal::InsertIntoConcurrently(updates, my_group->mem);
+  mutex_.Lock();
+  if (!status.ok() && my_group->status.ok()) {
+    my_group->status = status;
+  }
+  if (--my_group->pending == 0) {
+    PublishInsertedGroups();
+  }
+  while (!w.done) {
+    w.cv.Wait();
+  }
+  return w.status;
+}
+
+// Publish the sequence numbers of the fully inserted groups at the front
+// of inserting_groups_, and release their members.
+void DBImpl::PublishInsertedGroups() {
+  mutex_.AssertHeld();
+  while (!inserting_groups_.empty() &&
+         inserting_groups_.front()->pending == 0) {
+    WriteGroup* group = inserting_groups_.front();
+    inserting_groups_.pop_front();
+    versions_->SetLastSequence(group->last_sequence);
+    // The group lives on its leader's stack, so it must not be touched
+    // once the leader is done.
+    for (Writer* member : group->writers) {
+      member->status = group->status;
+      member->done = true;
+      member->cv.Signal();
+    }
+  }
+  if (inserting_groups_.empty()) {
+    // MakeRoomForWrite() may be waiting to replace mem_.
+    background_work_finished_signal_.SignalAll();
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* tmp_batch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1314,7 +2066,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       // Append to *result
       if (result == first->batch) {
         // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
+        result = tmp_batch;
         assert(WriteBatchInternal::Count(result) == 0);
         WriteBatchInternal::Append(result, first->batch);
       }
@@ -1322,33 +2074,49 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
     }
     *last_writer = w;
   }
+
+  // Charge the whole group to the delayed write rate
+  write_controller_.Charge(WriteBatchInternal::ByteSize(result));
   return result;
 }
 
+uint64_t DBImpl::DelayForWrite() {
+  mutex_.AssertHeld();
+  write_controller_.Update(versions_->NumLevelFiles(0),
+                           versions_->PendingCompactionBytes());
+  if (!write_controller_.delayed()) {
+    return 0;
+  }
+  return write_controller_.GetDelay(env_->NowMicros());
+}
+
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
 Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   bool allow_delay = !force;
+  uint64_t delay;
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
+    } else if (allow_delay && (delay = DelayForWrite()) > 0) {
+      // Compactions are falling behind.  Rather than delaying a single
+      // write by several seconds when we hit the hard limit on the number
+      // of L0 files, delay each write just enough to keep writes to the
+      // delayed write rate.  Also, this delay hands over some CPU to the
+      // compaction thread in case it is sharing the same core as the
+      // writer.
+      const WriteController::StallCause cause =
+          write_controller_.delay_cause();
       mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
+      env_->SleepForMicroseconds(static_cast<int>(delay));
       allow_delay = false;  // Do not delay a single write more than once
       mutex_.Lock();
+      write_controller_.RecordStall(cause, delay);
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
@@ -1357,26 +2125,31 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      const uint64_t start_micros = env_->NowMicros();
       background_work_finished_signal_.Wait();
+      write_controller_.RecordStall(WriteController::kMemTableFull,
+                                    env_->NowMicros() - start_micros);
     } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
+      const uint64_t start_micros = env_->NowMicros();
+      background_work_finished_signal_.Wait();
+      write_controller_.RecordStall(WriteController::kL0Stop,
+                                    env_->NowMicros() - start_micros);
+    } else if (!inserting_groups_.empty()) {
+      // Writes logged to the current log file are still being inserted
+      // into mem_.
       background_work_finished_signal_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
-      uint64_t new_log_number = versions_->NewFileNumber();
-      WritableFile* lfile = nullptr;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      std::vector<LogFile*> new_logs;
+      s = NewLogFiles(&new_logs);
       if (!s.ok()) {
-        // Avoid chewing through file number space in a tight loop.
-        versions_->ReuseFileNumber(new_log_number);
         break;
       }
 
-      delete log_;
-
-      s = logfile_->Close();
+      s = CloseLogFiles();
       if (!s.ok()) {
         // We may have lost some data written to the previous log file.
         // Switch to the new log file anyway, but record as a background
@@ -1387,14 +2160,12 @@ Status DBImpl::MakeRoomForWrite(bool force) {
         // would add more complexity in a critical code path.
         RecordBackgroundError(s);
       }
-      delete logfile_;
 
-      logfile_ = lfile;
-      logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
+      logs_.swap(new_logs);
+      logfile_number_ = logs_[0]->number;
       imm_ = mem_;
-      has_imm_.store(true, std::memory_order_release);
-      mem_ = new MemTable(internal_comparator_);
+      imm_->MarkImmutable();
+      mem_ = new MemTable(internal_comparator_, options_);
       mem_->Ref();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
@@ -1425,6 +2196,19 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
       *value = buf;
       return true;
     }
+  } else if (in.starts_with("num-runs-at-level")) {
+    in.remove_prefix(strlen("num-runs-at-level"));
+    uint64_t level;
+    bool ok = ConsumeDecimalNumber(&in, &level) && in.empty();
+    if (!ok || level >= config::kNumLevels) {
+      return false;
+    } else {
+      char buf[100];
+      std::snprintf(buf, sizeof(buf), "%d",
+                    versions_->NumLevelRuns(static_cast<int>(level)));
+      *value = buf;
+      return true;
+    }
   } else if (in == "stats") {
     char buf[200];
     std::snprintf(buf, sizeof(buf),
@@ -1449,6 +2233,7 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     return true;
   } else if (in == "approximate-memory-usage") {
     size_t total_usage = options_.block_cache->TotalCharge();
+    total_usage += table_cache_->ApproximateMemoryUsage();
     if (mem_) {
       total_usage += mem_->ApproximateMemoryUsage();
     }
@@ -1460,6 +2245,19 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "write-stalls") {
+    *value = write_controller_.StallsToString();
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "Pending compaction bytes: %.3f MB\n",
+                  versions_->PendingCompactionBytes() / 1048576.0);
+    value->append(buf);
+    return true;
+  } else if (in == "statistics") {
+    if (statistics_ == nullptr) {
+      return false;
+    }
+    *value = statistics_->ToString();
+    return true;
   }
 
   return false;
@@ -1497,6 +2295,19 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+void DB::MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  values->assign(keys.size(), std::string());
+  statuses->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(options, keys[i], &(*values)[i]);
+    if (!(*statuses)[i].ok()) {
+      (*values)[i].clear();
+    }
+  }
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1509,17 +2320,12 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   bool save_manifest = false;
   Status s = impl->Recover(&edit, &save_manifest);
   if (s.ok() && impl->mem_ == nullptr) {
-    // Create new log and a corresponding memtable.
-    uint64_t new_log_number = impl->versions_->NewFileNumber();
-    WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    // Create new logs and a corresponding memtable.
+    s = impl->NewLogFiles(&impl->logs_);
     if (s.ok()) {
-      edit.SetLogNumber(new_log_number);
-      impl->logfile_ = lfile;
-      impl->logfile_number_ = new_log_number;
-      impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->logfile_number_ = impl->logs_[0]->number;
+      edit.SetLogNumber(impl->logfile_number_);
+      impl->mem_ = new MemTable(impl->internal_comparator_, impl->options_);
       impl->mem_->Ref();
     }
   }
@@ -1529,6 +2335,8 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
   }
   if (s.ok()) {
+    impl->env_->IncBackgroundThreadsIfNeeded(
+        impl->options_.max_background_compactions, Env::kLowPriority);
     impl->RemoveObsoleteFiles();
     impl->MaybeScheduleCompaction();
   }
@@ -9,10 +9,12 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -20,8 +22,11 @@
 
 namespace leveldb {
 
+class Compaction;
 class MemTable;
+class Statistics;
 class TableCache;
+class ValueLog;
 class Version;
 class VersionEdit;
 class VersionSet;
@@ -42,6 +47,9 @@ class DBImpl : public DB {
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -66,15 +74,28 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
+  // Return the number of compactions that were split into subcompactions.
+  int TEST_SubcompactionsRun();
+
   // Record a sample of bytes read at the specified internal key.
   // Samples are taken approximately once every config::kReadBytesPeriod
   // bytes.
   void RecordReadSample(Slice key);
 
+  // Store in *value the value of user_key that the encoded ValueHandle
+  // "handle" points to in a value log file.
+  Status ReadSeparatedValue(const Slice& user_key, const Slice& handle,
+                            std::string* value);
+
+  // Null unless Options::statistics is set.
+  Statistics* statistics() const { return statistics_; }
+
  private:
   friend class DB;
   struct CompactionState;
+  struct LogFile;
   struct Writer;
+  struct WriteGroup;
 
   // Information for a manual compaction
   struct ManualCompaction {
@@ -123,29 +144,68 @@ class DBImpl : public DB {
   // Errors are recorded in bg_error_.
   void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
-                        VersionEdit* edit, SequenceNumber* max_sequence)
+  // Replay the records of log files "log_numbers" in the order of their
+  // sequence numbers.
+  Status RecoverLogFiles(const std::vector<uint64_t>& log_numbers,
+                         bool* save_manifest, VersionEdit* edit,
+                         SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Create Options::log_stripes new log files with consecutive numbers, to
+  // replace logs_ once the caller has closed them with CloseLogFiles().
+  Status NewLogFiles(std::vector<LogFile*>* logs)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  Status CloseLogFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Build a table from "mem" and add it to *edit.  The number of the new
+  // table is stored in *number and stays in pending_outputs_ until the
+  // caller erases it.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          uint64_t* number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  // Merge the batches at the front of writers_ into *tmp_batch, unless the
+  // first writer is on its own, and return the result.
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* tmp_batch)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Return the microseconds that the next write has to wait for, to keep
+  // writes to the delayed write rate while compactions fall behind.
+  uint64_t DelayForWrite() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  Status PipelinedWrite(const WriteOptions& options, WriteBatch* updates)
+      LOCKS_EXCLUDED(mutex_);
+  void PublishInsertedGroups() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGWorkFlush(void* db);
   static void BGWork(void* db);
+  void BackgroundFlushCall();
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns true iff a compaction was picked and carried out.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Store in *boundaries the user keys at which "c" is split into
+  // subcompactions, or nothing if it is not worth splitting.
+  void GetSubcompactionBoundaries(Compaction* c,
+                                  std::vector<std::string>* boundaries);
+
+  // Merge the key ranges between "boundaries" on threads of their own and
+  // collect their outputs in *compact.  Runs without holding mutex_.
+  Status RunSubcompactions(CompactionState* compact,
+                           const std::vector<std::string>& boundaries)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Merge the inputs of compact->compaction between compact->start and
+  // compact->end into compact->outputs.  Runs without holding mutex_.
+  Status DoSubcompactionWork(CompactionState* compact) LOCKS_EXCLUDED(mutex_);
+
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
   Status InstallCompactionResults(CompactionState* compact)
@@ -167,6 +227,12 @@ class DBImpl : public DB {
   // table_cache_ provides its own synchronization
   TableCache* const table_cache_;
 
+  // value_log_ provides its own synchronization
+  ValueLog* const value_log_;
+
+  // statistics_ provides its own synchronization
+  Statistics* const statistics_;
+
   // Lock over the persistent DB state.  Non-null iff successfully acquired.
   FileLock* db_lock_;
 
@@ -176,24 +242,41 @@ class DBImpl : public DB {
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
   MemTable* mem_;
   MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
-  std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
-  WritableFile* logfile_;
-  uint64_t logfile_number_ GUARDED_BY(mutex_);
-  log::Writer* log_;
+  // The log files of mem_ (one per Options::log_stripes).  A log file is
+  // written by the writer at the front of writers_, or with
+  // Options::pipelined_write by the leader of the group that holds it.
+  std::vector<LogFile*> logs_;
+  uint64_t logfile_number_ GUARDED_BY(mutex_);  // Number of logs_[0]
+  size_t next_log_ GUARDED_BY(mutex_);          // Next log file to try
   uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // Groups of writers inserting into mem_, in the order they were logged
+  // (Options::pipelined_write only).
+  std::deque<WriteGroup*> inserting_groups_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Has a memtable compaction been scheduled or is running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+
+  // Number of table compactions scheduled or running.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Number of compactions that were split into subcompactions.
+  int subcompactions_run_ GUARDED_BY(mutex_);
+
+  // Set while a memtable compaction installs its table below level-0.
+  // Table compactions are not picked meanwhile, since they would not see
+  // the table and could write overlapping files to its level.
+  bool pushing_down_memtable_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
@@ -203,6 +286,9 @@ class DBImpl : public DB {
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+
+  // Delays writes while compactions fall behind, and accounts for stalls.
+  WriteController write_controller_ GUARDED_BY(mutex_);
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
@@ -9,10 +9,12 @@
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
 #include "util/random.h"
+#include "util/statistics.h"
 
 namespace leveldb {
 
@@ -46,13 +48,20 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, const SliceTransform* prefix_extractor,
+         const Slice* upper_bound, bool range_filtered)
       : db_(db),
+        statistics_(db->statistics()),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        prefix_extractor_(prefix_extractor),
+        upper_bound_(upper_bound),
+        range_filtered_(range_filtered && upper_bound != nullptr),
         direction_(kForward),
         valid_(false),
+        prefix_bounded_(false),
+        separated_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
@@ -67,7 +76,8 @@ class DBIter : public Iterator {
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !separated_) ? iter_->value()
+                                                   : saved_value_;
   }
   Status status() const override {
     if (status_.ok()) {
@@ -88,6 +98,38 @@ class DBIter : public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Replaces saved_value_, the handle of the value of the current entry in
+  // a value log file, by the value itself.  Ends the iteration on errors.
+  void ReadSeparatedValue();
+
+  // Returns true if user_key is at or after the upper bound, or if the
+  // iteration is bounded by prefix_ and user_key does not have that prefix.
+  bool PastBound(const Slice& user_key) const {
+    if (upper_bound_ != nullptr &&
+        user_comparator_->Compare(user_key, *upper_bound_) >= 0) {
+      return true;
+    }
+    return prefix_bounded_ && (!prefix_extractor_->InDomain(user_key) ||
+                               prefix_extractor_->Transform(user_key) !=
+                                   Slice(prefix_));
+  }
+
+  // Fails the iteration if it turns around while the internal iterator may
+  // have skipped tables on Seek(): in prefix mode, the tables without the
+  // prefix of the target, and with range filters, the tables without keys
+  // before the upper bound, which only matters when turning to reverse.
+  bool RejectDirectionChange(Direction to) {
+    if (prefix_extractor_ == nullptr && !(range_filtered_ && to == kReverse)) {
+      return false;
+    }
+    status_ = Status::NotSupported(
+        "iterator that skips tables on Seek() cannot change direction");
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    return true;
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -107,14 +149,22 @@ class DBIter : public Iterator {
   }
 
   DBImpl* db_;
+  Statistics* const statistics_;  // Null unless the DB keeps statistics
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const SliceTransform* const prefix_extractor_;  // Non-null in prefix mode
+  const Slice* const upper_bound_;
+  const bool range_filtered_;  // Seeks skip tables by their range filters
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
+                             // or when separated_
+  std::string prefix_;       // Prefix of the seek target if prefix_bounded_
   Direction direction_;
   bool valid_;
+  bool prefix_bounded_;
+  bool separated_;  // The value of the current entry is in a value log file
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -138,10 +188,26 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   }
 }
 
+void DBIter::ReadSeparatedValue() {
+  std::string handle;
+  handle.swap(saved_value_);
+  Status s = db_->ReadSeparatedValue(key(), handle, &saved_value_);
+  if (!s.ok()) {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+  }
+}
+
 void DBIter::Next() {
   assert(valid_);
+  OperationTimer timer(statistics_, Statistics::kNext);
 
   if (direction_ == kReverse) {  // Switch directions?
+    if (RejectDirectionChange(kForward)) {
+      return;
+    }
     direction_ = kForward;
     // iter_ is pointing just before the entries for this->key(),
     // so advance into the range of entries for this->key() and then
@@ -178,9 +244,14 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  separated_ = false;
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+    if (!ParseKey(&ikey)) {
+      // Skip corrupted entries
+    } else if (PastBound(ikey.user_key)) {
+      break;
+    } else if (ikey.sequence <= sequence_) {
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -189,12 +260,19 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           skipping = true;
           break;
         case kTypeValue:
+        case kTypeValueHandle:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
           } else {
             valid_ = true;
             saved_key_.clear();
+            if (ikey.type == kTypeValueHandle) {
+              separated_ = true;
+              Slice handle = iter_->value();
+              saved_value_.assign(handle.data(), handle.size());
+              ReadSeparatedValue();
+            }
             return;
           }
           break;
@@ -208,8 +286,12 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
 
 void DBIter::Prev() {
   assert(valid_);
+  OperationTimer timer(statistics_, Statistics::kNext);
 
   if (direction_ == kForward) {  // Switch directions?
+    if (RejectDirectionChange(kReverse)) {
+      return;
+    }
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
     assert(iter_->Valid());  // Otherwise valid_ would have been false
@@ -272,13 +354,23 @@ void DBIter::FindPrevUserEntry() {
     direction_ = kForward;
   } else {
     valid_ = true;
+    if (value_type == kTypeValueHandle) {
+      ReadSeparatedValue();
+    }
   }
 }
 
 void DBIter::Seek(const Slice& target) {
+  OperationTimer timer(statistics_, Statistics::kSeek);
   direction_ = kForward;
   ClearSavedValue();
   saved_key_.clear();
+  prefix_bounded_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (prefix_bounded_) {
+    Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   AppendInternalKey(&saved_key_,
                     ParsedInternalKey(target, sequence_, kValueTypeForSeek));
   iter_->Seek(saved_key_);
@@ -290,7 +382,9 @@ void DBIter::Seek(const Slice& target) {
 }
 
 void DBIter::SeekToFirst() {
+  OperationTimer timer(statistics_, Statistics::kSeek);
   direction_ = kForward;
+  prefix_bounded_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -301,9 +395,26 @@ void DBIter::SeekToFirst() {
 }
 
 void DBIter::SeekToLast() {
+  OperationTimer timer(statistics_, Statistics::kSeek);
   direction_ = kReverse;
+  prefix_bounded_ = false;
   ClearSavedValue();
-  iter_->SeekToLast();
+  if (upper_bound_ != nullptr) {
+    // Position iter_ just before the entries of the bound
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(*upper_bound_,
+                                                     kMaxSequenceNumber,
+                                                     kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+    saved_key_.clear();
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
@@ -311,8 +422,11 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed,
+                        const SliceTransform* prefix_extractor,
+                        const Slice* upper_bound, bool range_filtered) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    prefix_extractor, upper_bound, range_filtered);
 }
 
 }  // namespace leveldb
@@ -13,13 +13,22 @@
 namespace leveldb {
 
 class DBImpl;
+class SliceTransform;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  If "prefix_extractor" is non-null, an
+// iteration that starts with Seek() ends at the first key without the
+// prefix of the seek target, and the iterator cannot change direction.
+// If "upper_bound" is non-null, the iteration ends at the first key at or
+// after *upper_bound, and if "range_filtered" is also set, the iterator
+// cannot turn from forward to reverse.
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed,
+                        const SliceTransform* prefix_extractor = nullptr,
+                        const Slice* upper_bound = nullptr,
+                        bool range_filtered = false);
 
 }  // namespace leveldb
 
@@ -6,6 +6,9 @@
 
 #include <atomic>
 #include <cinttypes>
+#include <cstring>
+#include <memory>
+#include <set>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -16,6 +19,9 @@
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -141,6 +147,10 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Copy random reads into the caller's scratch buffer, as a file that is
+  // not memory-mapped does, while this bool is true.
+  bool copy_random_reads_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -150,7 +160,8 @@ class SpecialEnv : public EnvWrapper {
         manifest_sync_error_(false),
         manifest_write_error_(false),
         log_file_close_(false),
-        count_random_reads_(false) {}
+        count_random_reads_(false),
+        copy_random_reads_(false) {}
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
@@ -249,7 +260,28 @@ class SpecialEnv : public EnvWrapper {
       }
     };
 
+    class CopyingFile : public RandomAccessFile {
+     private:
+      RandomAccessFile* target_;
+
+     public:
+      explicit CopyingFile(RandomAccessFile* target) : target_(target) {}
+      ~CopyingFile() override { delete target_; }
+      Status Read(uint64_t offset, size_t n, Slice* result,
+                  char* scratch) const override {
+        Status s = target_->Read(offset, n, result, scratch);
+        if (s.ok() && result->data() != scratch) {
+          std::memcpy(scratch, result->data(), result->size());
+          *result = Slice(scratch, result->size());
+        }
+        return s;
+      }
+    };
+
     Status s = target()->NewRandomAccessFile(f, r);
+    if (s.ok() && copy_random_reads_) {
+      *r = new CopyingFile(*r);
+    }
     if (s.ok() && count_random_reads_) {
       *r = new CountingFile(*r, &random_read_counter_);
     }
@@ -267,6 +299,7 @@ class DBTest : public testing::Test {
 
   DBTest() : env_(new SpecialEnv(Env::Default())), option_config_(kDefault) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    prefix_extractor_ = NewFixedPrefixTransform(1);
     dbname_ = testing::TempDir() + "db_test";
     DestroyDB(dbname_, Options());
     db_ = nullptr;
@@ -278,6 +311,7 @@ class DBTest : public testing::Test {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete prefix_extractor_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -306,6 +340,37 @@ class DBTest : public testing::Test {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.pipelined_write = true;
+        break;
+      case kLogStripes:
+        options.log_stripes = 4;
+        break;
+      case kVectorMemTable:
+        options.memtable_rep = kVectorRep;
+        break;
+      case kPrefixHashMemTable:
+        options.memtable_rep = kPrefixHashRep;
+        options.prefix_extractor = prefix_extractor_;
+        break;
+      case kDataBlockHashIndex:
+        options.data_block_hash_index = true;
+        break;
+      case kPartitionedIndexAndFilters:
+        options.filter_policy = filter_policy_;
+        options.partition_index_and_filters = true;
+        options.metadata_block_size = 256;
+        break;
+      case kFullTableFilter:
+        options.filter_policy = filter_policy_;
+        options.full_table_filter = true;
+        break;
+      case kLearnedIndex:
+        options.learned_index = true;
+        break;
+      case kValueLog:
+        options.min_separated_value_size = 10;
+        break;
       default:
         break;
     }
@@ -364,6 +429,30 @@ class DBTest : public testing::Test {
     return result;
   }
 
+  // Look up "keys" with a single MultiGet() and return the results,
+  // formatted like Get() and separated by commas.
+  std::string MultiGet(const std::vector<std::string>& keys,
+                       const Snapshot* snapshot = nullptr) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(options, key_slices, &values, &statuses);
+    std::string result;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (i > 0) result += ",";
+      if (statuses[i].IsNotFound()) {
+        result += "NOT_FOUND";
+      } else if (!statuses[i].ok()) {
+        result += statuses[i].ToString();
+      } else {
+        result += values[i];
+      }
+    }
+    return result;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -420,6 +509,13 @@ class DBTest : public testing::Test {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeValueHandle: {
+              std::string value;
+              Status s = dbfull()->ReadSeparatedValue(ikey.user_key,
+                                                      iter->value(), &value);
+              result += s.ok() ? value : s.ToString();
+              break;
+            }
           }
         }
         iter->Next();
@@ -440,6 +536,13 @@ class DBTest : public testing::Test {
     return std::stoi(property);
   }
 
+  int NumRunsAtLevel(int level) {
+    std::string property;
+    EXPECT_TRUE(db_->GetProperty(
+        "leveldb.num-runs-at-level" + NumberToString(level), &property));
+    return std::stoi(property);
+  }
+
   int TotalTableFiles() {
     int result = 0;
     for (int level = 0; level < config::kNumLevels; level++) {
@@ -471,6 +574,21 @@ class DBTest : public testing::Test {
     return static_cast<int>(files.size());
   }
 
+  // Return the numbers of the files of "type" of the database.
+  std::set<uint64_t> FilesOfType(FileType type) {
+    std::vector<std::string> filenames;
+    env_->GetChildren(dbname_, &filenames);
+    std::set<uint64_t> result;
+    uint64_t number;
+    FileType file_type;
+    for (const std::string& filename : filenames) {
+      if (ParseFileName(filename, &number, &file_type) && file_type == type) {
+        result.insert(number);
+      }
+    }
+    return result;
+  }
+
   uint64_t Size(const Slice& start, const Slice& limit) {
     Range r(start, limit);
     uint64_t size;
@@ -562,9 +680,25 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kPipelinedWrite,
+    kLogStripes,
+    kVectorMemTable,
+    kPrefixHashMemTable,
+    kDataBlockHashIndex,
+    kPartitionedIndexAndFilters,
+    kFullTableFilter,
+    kLearnedIndex,
+    kValueLog,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
   int option_config_;
 };
 
@@ -765,6 +899,55 @@ TEST_F(DBTest, GetPicksCorrectFile) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("e", "ve"));
+    Compact("a", "e");
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_LEVELDB_OK(Put("g", "vg"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Delete("e"));
+    ASSERT_LEVELDB_OK(Put("h", "vh"));
+
+    ASSERT_EQ("", MultiGet({}));
+    ASSERT_EQ("vh,vg,NOT_FOUND,vc2,NOT_FOUND,va,vc2",
+              MultiGet({"h", "g", "e", "c", "b", "a", "c"}));
+    ASSERT_EQ("NOT_FOUND,vg,ve,vc2,NOT_FOUND,va,vc2",
+              MultiGet({"h", "g", "e", "c", "b", "a", "c"}, snapshot));
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, MultiGetMatchesGet) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000;  // Small write buffer
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 2000; i++) {
+    keys.push_back("key" + std::to_string(rnd.Uniform(1000)));
+    if (rnd.OneIn(5)) {
+      ASSERT_LEVELDB_OK(Delete(keys.back()));
+    } else {
+      ASSERT_LEVELDB_OK(Put(keys.back(), RandomString(&rnd, 100)));
+    }
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_GT(TotalTableFiles(), 1);
+
+  keys.push_back("missing");
+  std::string expected;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i > 0) expected += ",";
+    expected += Get(keys[i]);
+  }
+  ASSERT_EQ(expected, MultiGet(keys));
+}
+
 TEST_F(DBTest, GetEncountersEmptyLevel) {
   do {
     // Arrange for the following to happen:
@@ -1225,6 +1408,10 @@ static bool Between(uint64_t val, uint64_t low, uint64_t high) {
 
 TEST_F(DBTest, ApproximateSizes) {
   do {
+    if (CurrentOptions().min_separated_value_size > 0) {
+      // Sizes of separated values are only known per table
+      continue;
+    }
     Options options = CurrentOptions();
     options.write_buffer_size = 100000000;  // Large write buffer
     options.compression = kNoCompression;
@@ -1284,6 +1471,10 @@ TEST_F(DBTest, ApproximateSizes) {
 
 TEST_F(DBTest, ApproximateSizes_MixOfSmallAndLarge) {
   do {
+    if (CurrentOptions().min_separated_value_size > 0) {
+      // Sizes of separated values are only known per table
+      continue;
+    }
     Options options = CurrentOptions();
     options.compression = kNoCompression;
     Reopen();
@@ -1393,7 +1584,11 @@ TEST_F(DBTest, HiddenValuesAreRemoved) {
     ASSERT_GT(NumTableFilesAtLevel(0), 0);
 
     ASSERT_EQ(big, Get("foo", snapshot));
-    ASSERT_TRUE(Between(Size("", "pastfoo"), 50000, 60000));
+    // Size() spreads the values in a value log evenly over their table
+    const bool separated = CurrentOptions().min_separated_value_size > 0;
+    if (!separated) {
+      ASSERT_TRUE(Between(Size("", "pastfoo"), 50000, 60000));
+    }
     db_->ReleaseSnapshot(snapshot);
     ASSERT_EQ(AllEntriesFor("foo"), "[ tiny, " + big + " ]");
     Slice x("x");
@@ -1404,7 +1599,9 @@ TEST_F(DBTest, HiddenValuesAreRemoved) {
     dbfull()->TEST_CompactRange(1, nullptr, &x);
     ASSERT_EQ(AllEntriesFor("foo"), "[ tiny ]");
 
-    ASSERT_TRUE(Between(Size("", "pastfoo"), 0, 1000));
+    if (!separated) {
+      ASSERT_TRUE(Between(Size("", "pastfoo"), 0, 1000));
+    }
   } while (ChangeOptions());
 }
 
@@ -1670,6 +1867,71 @@ TEST_F(DBTest, ManualCompaction) {
   ASSERT_EQ("0,0,1", FilesPerLevel());
 }
 
+TEST_F(DBTest, TieredCompaction) {
+  Options options = CurrentOptions();
+  options.compaction_style = kTieredCompaction;
+  options.max_sorted_runs_per_level = 8;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  // Every manual compaction of level-0 adds a new run to level-1.
+  for (int r = 0; r < 3; r++) {
+    for (int i = 0; i < 10; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "v" + NumberToString(r)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ(1, NumRunsAtLevel(0));
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+    ASSERT_EQ(r + 1, NumRunsAtLevel(1));
+  }
+  ASSERT_EQ("0,3", FilesPerLevel());
+  ASSERT_EQ("v2", Get(Key(0)));
+  ASSERT_EQ("v2", Get(Key(9)));
+  ASSERT_EQ("[ v2, v1, v0 ]", AllEntriesFor(Key(5)));
+
+  // The newest run shadows the older ones, also after reopening.
+  ASSERT_LEVELDB_OK(Delete(Key(3)));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  Reopen(&options);
+  ASSERT_EQ(4, NumRunsAtLevel(1));
+  ASSERT_EQ("NOT_FOUND", Get(Key(3)));
+  ASSERT_EQ("v2", Get(Key(4)));
+
+  // Merging the level produces a single run in the next level.
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ(0, NumRunsAtLevel(1));
+  ASSERT_EQ(1, NumRunsAtLevel(2));
+  ASSERT_EQ("NOT_FOUND", Get(Key(3)));
+  ASSERT_EQ("v2", Get(Key(4)));
+  ASSERT_EQ("[ v2 ]", AllEntriesFor(Key(5)));
+}
+
+TEST_F(DBTest, TieredToLeveledCompaction) {
+  Options options = CurrentOptions();
+  options.compaction_style = kTieredCompaction;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  for (int r = 0; r < 2; r++) {
+    ASSERT_LEVELDB_OK(Put("a", "va" + NumberToString(r)));
+    ASSERT_LEVELDB_OK(Put("z", "vz" + NumberToString(r)));
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  }
+  ASSERT_EQ(2, NumRunsAtLevel(1));
+
+  // A leveled database merges the runs of level-1 in the background.
+  options.compaction_style = kLeveledCompaction;
+  Reopen(&options);
+  for (int i = 0; i < 100 && NumRunsAtLevel(1) > 1; i++) {
+    DelayMilliseconds(100);
+  }
+  ASSERT_EQ(1, NumRunsAtLevel(1));
+  ASSERT_EQ("va1", Get("a"));
+  ASSERT_EQ("vz1", Get("z"));
+  ASSERT_EQ("[ va1 ]", AllEntriesFor("a"));
+}
+
 TEST_F(DBTest, DBOpen_Options) {
   std::string dbname = testing::TempDir() + "db_options_test";
   DestroyDB(dbname, Options());
@@ -1977,6 +2239,563 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+// Looks up Key(0) .. Key(n-1), which must be present, and then keys missing
+// next to them, and stores the random reads that each pass took.
+static void CountLookupReads(DBTest* test, int n, int* present_reads,
+                             int* missing_reads) {
+  SpecialEnv* env = test->env_;
+  // Prevent auto compactions triggered by seeks
+  env->delay_data_sync_.store(true, std::memory_order_release);
+  int wrong_values = 0;
+  env->random_read_counter_.Reset();
+  for (int i = 0; i < n; i++) {
+    if (test->Get(Key(i)) != Key(i)) {
+      wrong_values++;
+    }
+  }
+  *present_reads = env->random_read_counter_.Read();
+  env->random_read_counter_.Reset();
+  for (int i = 0; i < n; i++) {
+    if (test->Get(Key(i) + ".missing") != "NOT_FOUND") {
+      wrong_values++;
+    }
+  }
+  *missing_reads = env->random_read_counter_.Read();
+  env->delay_data_sync_.store(false, std::memory_order_release);
+  ASSERT_EQ(0, wrong_values);
+}
+
+TEST_F(DBTest, PartitionedIndexAndFilters) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 256;
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ(Key(0), Get(Key(0)));  // Open the table
+
+  // Present keys read a filter partition, an index partition and a data
+  // block.  Missing keys should rarely read more than a filter partition.
+  int present_reads, missing_reads;
+  ASSERT_NO_FATAL_FAILURE(
+      CountLookupReads(this, N, &present_reads, &missing_reads));
+  ASSERT_EQ(3 * N, present_reads);
+  ASSERT_LE(missing_reads, N + 2 * 3 * N / 100);
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, FullTableFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.full_table_filter = true;
+  Reopen(&options);
+
+  // Populate multiple layers
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // The filter of a whole table should be as selective as filters per
+  // data block: present keys rarely read from the small sstable, and
+  // missing keys rarely read from either sstable.
+  int present_reads, missing_reads;
+  ASSERT_NO_FATAL_FAILURE(
+      CountLookupReads(this, N, &present_reads, &missing_reads));
+  ASSERT_GE(present_reads, N);
+  ASSERT_LE(present_reads, N + 2 * N / 100);
+  ASSERT_LE(missing_reads, 3 * N / 100);
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, MixedFilterFormats) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.full_table_filter = true;
+  Reopen(&options);
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+
+  // Tables with filters per data block remain readable next to tables
+  // with a filter of the whole table.
+  options.full_table_filter = false;
+  Reopen(&options);
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i) + "v2"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i % 100 == 0 ? Key(i) + "v2" : Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+
+  Close();
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PrefixSameAsStart) {
+  env_->count_random_reads_ = true;
+  std::unique_ptr<const SliceTransform> prefix_extractor(
+      NewFixedPrefixTransform(8));
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = prefix_extractor.get();
+  Reopen(&options);
+
+  // Keys of even groups of ten share a prefix of 8 bytes; odd groups are
+  // missing.  Populate multiple layers.
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    if ((i / 10) % 2 == 0) {
+      ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+    }
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  ReadOptions ro;
+  ro.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(ro);
+  for (int i = 0; i < N; i += 20) {
+    const std::string prefix = Key(i).substr(0, 8);
+    int count = 0;
+    for (iter->Seek(prefix); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(Key(i + count), iter->key().ToString());
+      count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(10, count);
+  }
+
+  // Seeks to missing prefixes should rarely read from either sstable
+  env_->random_read_counter_.Reset();
+  for (int i = 10; i < N; i += 20) {
+    iter->Seek(Key(i).substr(0, 8));
+    ASSERT_TRUE(!iter->Valid());
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing prefixes => %d reads\n", N / 20, reads);
+  ASSERT_LE(reads, 3 * N / 20 / 100 + 2);
+
+  // The iteration is not bounded after SeekToFirst(), and cannot turn
+  iter->SeekToFirst();
+  ASSERT_EQ(Key(0), iter->key().ToString());
+  iter->Seek(Key(20));
+  ASSERT_TRUE(iter->Valid());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  // Tables written without the prefix extractor are not pruned, but the
+  // iteration is still bounded by the prefix.
+  options.prefix_extractor = nullptr;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put(Key(15), "v"));
+  dbfull()->TEST_CompactMemTable();
+  options.prefix_extractor = prefix_extractor.get();
+  Reopen(&options);
+  iter = db_->NewIterator(ro);
+  iter->Seek(Key(10));
+  ASSERT_EQ(IterStatus(iter), Key(15) + "->v");
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, IterateUpperBound) {
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  ASSERT_LEVELDB_OK(Put("d", "vd"));
+
+  Slice bound("c");
+  ReadOptions ro;
+  ro.iterate_upper_bound = &bound;
+  Iterator* iter = db_->NewIterator(ro);
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+  iter->Seek("b");
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Seek("bb");
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  iter->Seek("c");
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  delete iter;
+
+  bound = Slice("a");
+  iter = db_->NewIterator(ro);
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  delete iter;
+}
+
+TEST_F(DBTest, RangeFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.range_filter_policy = NewRangeFilterPolicy(10);
+  Reopen(&options);
+
+  // Populate multiple layers with the even keys
+  const int N = 10000;
+  for (int i = 0; i < N; i += 2) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  std::string bound;
+  Slice bound_slice;
+  ReadOptions ro;
+  ro.iterate_upper_bound = &bound_slice;
+  Iterator* iter = db_->NewIterator(ro);
+
+  // Short scans of present keys
+  for (int i = 0; i < N; i += 2) {
+    bound = Key(i + 4);
+    bound_slice = bound;
+    int count = 0;
+    for (iter->Seek(Key(i)); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(Key(i + 2 * count), iter->key().ToString());
+      count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(i + 4 <= N ? 2 : 1, count);
+  }
+
+  // Empty scans should rarely read from either sstable
+  env_->random_read_counter_.Reset();
+  for (int i = 1; i < N; i += 2) {
+    bound = Key(i) + "~";
+    bound_slice = bound;
+    iter->Seek(Key(i));
+    ASSERT_TRUE(!iter->Valid());
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d empty scans => %d reads\n", N / 2, reads);
+  ASSERT_LE(reads, 3 * N / 2 / 100);
+
+  // Tables without keys before the bound were skipped, so the iterator
+  // cannot turn around
+  bound = Key(N);
+  bound_slice = bound;
+  iter->Seek(Key(N - 2));
+  ASSERT_TRUE(iter->Valid());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  iter->SeekToLast();
+  ASSERT_EQ(Key(N - 2), iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ(Key(N - 4), iter->key().ToString());
+  delete iter;
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  Close();
+  delete options.block_cache;
+  delete options.range_filter_policy;
+}
+
+TEST_F(DBTest, GetMemUsageOfTableFilters) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewBinaryFuseFilterPolicy(8);
+  options.full_table_filter = true;
+  options.block_cache = NewLRUCache(0);  // Only count open tables
+  Reopen(&options);
+
+  const int N = 100000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+  }
+  Compact("a", "z");
+  Reopen(&options);
+
+  std::string val;
+  ASSERT_TRUE(db_->GetProperty("leveldb.approximate-memory-usage", &val));
+  const int before = std::stoi(val);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("v", Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  ASSERT_TRUE(db_->GetProperty("leveldb.approximate-memory-usage", &val));
+  const int after = std::stoi(val);
+  std::fprintf(stderr, "%d keys => %d bytes of index and filter blocks\n", N,
+               after - before);
+  // At least the 8-bit fingerprints of every key.
+  ASSERT_GE(after - before, N);
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PerfContext) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.block_cache = NewLRUCache(8 << 20);
+  // Blocks read from memory-mapped files are not cached
+  options.env = env_;
+  env_->copy_random_reads_ = true;
+  Reopen(&options);
+  PerfContext* perf = GetPerfContext();
+
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  perf->Reset();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(1, perf->memtable_hit_count);
+  ASSERT_EQ(0, perf->block_read_count);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  perf->Reset();
+  ASSERT_EQ(Key(0), Get(Key(0)));
+  ASSERT_EQ(0, perf->memtable_hit_count);
+  ASSERT_EQ(1, perf->filter_positive_count);
+  ASSERT_EQ(0, perf->filter_false_positive_count);
+  ASSERT_EQ(1, perf->block_cache_miss_count);
+  ASSERT_GE(perf->block_read_count, 1);
+  uint64_t read_bytes = 0;
+  for (int level = 0; level < PerfContext::kNumLevels; level++) {
+    read_bytes += perf->get_read_bytes[level];
+  }
+  ASSERT_EQ(perf->block_read_bytes, read_bytes);
+
+  // The data block is now cached
+  perf->Reset();
+  ASSERT_EQ(Key(1), Get(Key(1)));
+  ASSERT_EQ(1, perf->block_cache_hit_count);
+  ASSERT_EQ("block_cache_hit_count = 1, filter_positive_count = 1",
+            perf->ToString());
+
+  // Filters keep most missing keys from reading data blocks
+  perf->Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  ASSERT_GE(perf->filter_useful_count, N - N / 50);
+  ASSERT_EQ(perf->filter_positive_count, perf->filter_false_positive_count);
+  ASSERT_LE(perf->filter_false_positive_count, N / 50);
+  ASSERT_LE(perf->block_cache_hit_count, N / 50);
+
+  Close();
+  env_->copy_random_reads_ = false;
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, Statistics) {
+  std::string stats;
+  ASSERT_TRUE(!db_->GetProperty("leveldb.statistics", &stats));
+
+  Options options = CurrentOptions();
+  options.statistics = true;
+  Reopen(&options);
+  ASSERT_TRUE(db_->GetProperty("leveldb.statistics", &stats));
+  ASSERT_EQ(std::string::npos, stats.find("Get"));
+
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("va,vb", MultiGet({"a", "b"}));
+  ASSERT_EQ("(a->va)(b->vb)", Contents());
+  ASSERT_TRUE(db_->GetProperty("leveldb.statistics", &stats));
+  for (const char* op : {"Get ", "MultiGet ", "Write ", "Seek ", "Next "}) {
+    ASSERT_NE(std::string::npos, stats.find(op)) << op;
+  }
+  ASSERT_NE(std::string::npos, stats.find("memtable_hit_count = 3"));
+}
+
+TEST_F(DBTest, WriteStalls) {
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  std::string stalls;
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stalls", &stalls));
+  for (const char* cause : {"memtable-full", "level0-slowdown", "level0-stop",
+                            "pending-compaction"}) {
+    ASSERT_NE(std::string::npos, stalls.find(cause)) << cause;
+  }
+  ASSERT_NE(std::string::npos, stalls.find("Delayed write rate: none"));
+  ASSERT_NE(std::string::npos, stalls.find("Pending compaction bytes: 0.000"));
+}
+
+TEST_F(DBTest, RateLimiter) {
+  std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(100 << 20));
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.rate_limiter = limiter.get();
+  DestroyAndReopen(&options);
+
+  // Two overlapping tables, so that compacting them rewrites them
+  Random rnd(301);
+  std::vector<std::string> values(100);
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 100; i++) {
+      values[i] = RandomString(&rnd, 1000);
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  const uint64_t flushed = limiter->GetTotalBytesThrough(Env::kHighPriority);
+  ASSERT_GE(flushed, 2 * 100 * 1000);
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(Env::kLowPriority));
+
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(flushed, limiter->GetTotalBytesThrough(Env::kHighPriority));
+  ASSERT_GE(limiter->GetTotalBytesThrough(Env::kLowPriority), 100 * 1000);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+  Close();
+}
+
+TEST_F(DBTest, ValueLog) {
+  Options options = CurrentOptions();
+  options.min_separated_value_size = 100;
+  Reopen(&options);
+
+  const std::string big1(1000, 'a');
+  const std::string big2(5000, 'b');
+  ASSERT_LEVELDB_OK(Put("k1", big1));
+  ASSERT_LEVELDB_OK(Put("k2", "small"));
+  ASSERT_LEVELDB_OK(Put("k3", big2));
+  ASSERT_TRUE(FilesOfType(kValueLogFile).empty());
+  dbfull()->TEST_CompactMemTable();
+  const std::set<uint64_t> value_logs = FilesOfType(kValueLogFile);
+  ASSERT_EQ(1, value_logs.size());
+  // Approximate sizes include the values in the value log file
+  ASSERT_GE(Size("", "z"), big1.size() + big2.size());
+
+  const std::string contents =
+      "(k1->" + big1 + ")(k2->small)(k3->" + big2 + ")";
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(big1, Get("k1"));
+    ASSERT_EQ("small", Get("k2"));
+    ASSERT_EQ(big2, Get("k3"));
+    ASSERT_EQ(big1 + ",small," + big2 + ",NOT_FOUND",
+              MultiGet({"k1", "k2", "k3", "k4"}));
+    ASSERT_EQ(contents, Contents());
+
+    // Compactions move the handles, not the values
+    if (i == 0) {
+      Compact("a", "z");
+    } else {
+      Reopen(&options);
+    }
+    ASSERT_EQ(value_logs, FilesOfType(kValueLogFile));
+  }
+
+  // Databases stay readable without the option
+  options.min_separated_value_size = 0;
+  Reopen(&options);
+  ASSERT_EQ(contents, Contents());
+
+  // The value log file goes once no table points to it
+  ASSERT_LEVELDB_OK(Delete("k1"));
+  ASSERT_LEVELDB_OK(Delete("k3"));
+  Compact("a", "z");
+  ASSERT_EQ("(k2->small)", Contents());
+  ASSERT_TRUE(FilesOfType(kValueLogFile).empty());
+}
+
+TEST_F(DBTest, ValueLogGarbageCollection) {
+  Options options = CurrentOptions();
+  options.min_separated_value_size = 100;
+  Reopen(&options);
+
+  const int N = 100;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  const std::set<uint64_t> first = FilesOfType(kValueLogFile);
+  ASSERT_EQ(1, first.size());
+
+  // Overwriting most values leaves the first value log file mostly garbage
+  // once the overwritten values are compacted away
+  for (int i = 0; i < 3 * N / 4; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'b')));
+  }
+  Compact("a", "z");
+
+  // A background compaction moves the rest of its values elsewhere
+  const uint64_t first_number = *first.begin();
+  for (int i = 0;
+       i < 100 && FilesOfType(kValueLogFile).count(first_number) > 0; i++) {
+    DelayMilliseconds(100);
+  }
+  ASSERT_EQ(0, FilesOfType(kValueLogFile).count(first_number));
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(std::string(1000, i < 3 * N / 4 ? 'b' : 'a'), Get(Key(i)));
+  }
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(std::string(1000, i < 3 * N / 4 ? 'b' : 'a'), Get(Key(i)));
+  }
+}
+
 TEST_F(DBTest, LogCloseError) {
   // Regression test for bug where we could ignore log file
   // Close() error when switching to a new log file.
@@ -2101,6 +2920,165 @@ TEST_F(DBTest, MultiThreaded) {
   } while (ChangeOptions());
 }
 
+namespace {
+
+struct PipelinedWriter {
+  DB* db;
+  int id;
+  std::atomic<bool> done;
+};
+
+static void PipelinedWriterBody(void* arg) {
+  PipelinedWriter* t = reinterpret_cast<PipelinedWriter*>(arg);
+  Random rnd(301 + t->id);
+  std::string value;
+  for (int i = 0; i < 2000;) {
+    // Batches of one to three puts, some of them synced.
+    WriteBatch batch;
+    const int n = 1 + rnd.Uniform(3);
+    for (int j = 0; j < n; j++, i++) {
+      batch.Put(Key(t->id * 10000 + i), std::string(100 + i % 50, 'a' + t->id));
+    }
+    WriteOptions write_options;
+    write_options.sync = rnd.OneIn(50);
+    ASSERT_LEVELDB_OK(t->db->Write(write_options, &batch));
+    // A write is visible as soon as it returns.
+    ASSERT_LEVELDB_OK(t->db->Get(ReadOptions(), Key(t->id * 10000 + i - 1),
+                                 &value));
+  }
+  t->done.store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST_F(DBTest, PipelinedWriteManyWriters) {
+  static const int kWriters = 8;
+  std::unique_ptr<const SliceTransform> prefix_extractor(
+      NewFixedPrefixTransform(7));
+  // Every memtable rep takes concurrent inserts.
+  for (MemTableRepType rep : {kSkipListRep, kVectorRep, kPrefixHashRep}) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.pipelined_write = true;
+    options.memtable_rep = rep;
+    options.prefix_extractor = prefix_extractor.get();
+    options.write_buffer_size = 100000;  // Switch memtables while writing
+    DestroyAndReopen(&options);
+
+    PipelinedWriter writers[kWriters];
+    for (int id = 0; id < kWriters; id++) {
+      writers[id].db = db_;
+      writers[id].id = id;
+      writers[id].done.store(false, std::memory_order_release);
+      env_->StartThread(PipelinedWriterBody, &writers[id]);
+    }
+    for (int id = 0; id < kWriters; id++) {
+      while (!writers[id].done.load(std::memory_order_acquire)) {
+        DelayMilliseconds(10);
+      }
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+      for (int id = 0; id < kWriters; id++) {
+        for (int i = 0; i < 2000; i++) {
+          ASSERT_EQ(std::string(100 + i % 50, 'a' + id),
+                    Get(Key(id * 10000 + i)));
+        }
+      }
+      // The log records written by the groups must replay to the same
+      // state.
+      Reopen(&options);
+    }
+  }
+}
+
+TEST_F(DBTest, LogStripes) {
+  static const int kWriters = 8;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.log_stripes = 4;
+  DestroyAndReopen(&options);
+  ASSERT_EQ(4, FilesOfType(kLogFile).size());
+
+  // Consecutive writes go to different log files.  Recovery must replay
+  // them in order, also when it writes tables in between.  Recovery writes
+  // too few tables to trigger a compaction that would merge them again.
+  for (int i = 0; i < 200; i++) {
+    ASSERT_LEVELDB_OK(Put("foo", std::string(1000, 'x') + std::to_string(i)));
+  }
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+  ASSERT_GT(NumTableFilesAtLevel(0), 1);
+  ASSERT_LT(NumTableFilesAtLevel(0), config::kL0_CompactionTrigger);
+  ASSERT_EQ(std::string(1000, 'x') + "199", Get("foo"));
+
+  PipelinedWriter writers[kWriters];
+  for (int id = 0; id < kWriters; id++) {
+    writers[id].db = db_;
+    writers[id].id = id;
+    writers[id].done.store(false, std::memory_order_release);
+    env_->StartThread(PipelinedWriterBody, &writers[id]);
+  }
+  for (int id = 0; id < kWriters; id++) {
+    while (!writers[id].done.load(std::memory_order_acquire)) {
+      DelayMilliseconds(10);
+    }
+  }
+  for (int pass = 0; pass < 2; pass++) {
+    for (int id = 0; id < kWriters; id++) {
+      for (int i = 0; i < 2000; i++) {
+        ASSERT_EQ(std::string(100 + i % 50, 'a' + id),
+                  Get(Key(id * 10000 + i)));
+      }
+    }
+    Reopen(&options);
+  }
+  ASSERT_EQ(std::string(1000, 'x') + "199", Get("foo"));
+  ASSERT_EQ(4, FilesOfType(kLogFile).size());
+}
+
+TEST_F(DBTest, LogCompression) {
+  // Records are logged uncompressed if the library is missing
+  std::string compressed;
+  const bool supported =
+      port::Zstd_Compress(/*level=*/1, "aaaaaaaa", 8, &compressed);
+
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.log_compression = kZstdCompression;
+  DestroyAndReopen(&options);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + i % 26)));
+  }
+  WriteBatch batch;
+  for (int i = 100; i < 200; i++) {
+    batch.Put(Key(i), std::string(1000, 'a' + i % 26));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->Write(WriteOptions(), &batch));
+  uint64_t log_size = 0;
+  for (uint64_t number : FilesOfType(kLogFile)) {
+    uint64_t size;
+    ASSERT_LEVELDB_OK(env_->GetFileSize(LogFileName(dbname_, number), &size));
+    log_size += size;
+  }
+  if (supported) {
+    ASSERT_LT(log_size, 200 * 1000 / 10);
+  } else {
+    ASSERT_GT(log_size, 200 * 1000);
+  }
+
+  // Logs written with and without compression are both recovered
+  options.log_compression = kNoCompression;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put(Key(200), "v200"));
+  options.log_compression = kSnappyCompression;
+  Reopen(&options);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(std::string(1000, 'a' + i % 26), Get(Key(i)));
+  }
+  ASSERT_EQ("v200", Get(Key(200)));
+}
+
 namespace {
 typedef std::map<std::string, std::string> KVMap;
 }
@@ -2357,4 +3335,119 @@ TEST_F(DBTest, Randomized) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, RandomizedTiered) {
+  Random rnd(test::RandomSeed());
+  Options options = CurrentOptions();
+  options.compaction_style = kTieredCompaction;
+  options.max_sorted_runs_per_level = 2;
+  options.write_buffer_size = 64 << 10;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  // Use large values so that runs cascade through several levels.
+  ModelDB model(options);
+  const int N = 10000;
+  std::string k, v;
+  for (int step = 0; step < N; step++) {
+    k = RandomKey(&rnd);
+    if (rnd.OneIn(4)) {
+      ASSERT_LEVELDB_OK(model.Delete(WriteOptions(), k));
+      ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), k));
+    } else {
+      v = RandomString(&rnd, 100 + rnd.Uniform(900));
+      ASSERT_LEVELDB_OK(model.Put(WriteOptions(), k, v));
+      ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), k, v));
+    }
+
+    if ((step % 1000) == 0) {
+      ASSERT_TRUE(CompareIterators(step, &model, db_, nullptr, nullptr));
+      Reopen(&options);
+      ASSERT_TRUE(CompareIterators(step, &model, db_, nullptr, nullptr));
+    }
+  }
+  ASSERT_TRUE(CompareIterators(N, &model, db_, nullptr, nullptr));
+}
+
+TEST_F(DBTest, Subcompactions) {
+  for (CompactionStyle style : {kLeveledCompaction, kTieredCompaction}) {
+    Random rnd(test::RandomSeed());
+    Options options = CurrentOptions();
+    options.compaction_style = style;
+    options.max_subcompactions = 4;
+    options.write_buffer_size = 256 << 10;
+    options.max_file_size = 1 << 20;
+    options.compression = kNoCompression;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    // Enough data for the full compactions below to be split.
+    ModelDB model(options);
+    std::string k, v;
+    for (int round = 0; round < 3; round++) {
+      for (int i = 0; i < 6000; i++) {
+        k = Key(rnd.Uniform(10000));
+        if (rnd.OneIn(8)) {
+          ASSERT_LEVELDB_OK(model.Delete(WriteOptions(), k));
+          ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), k));
+        } else {
+          v = RandomString(&rnd, 1000);
+          ASSERT_LEVELDB_OK(model.Put(WriteOptions(), k, v));
+          ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), k, v));
+        }
+      }
+      const Snapshot* snapshot = db_->GetSnapshot();
+      const Snapshot* model_snapshot = model.GetSnapshot();
+      db_->CompactRange(nullptr, nullptr);
+      ASSERT_GT(dbfull()->TEST_SubcompactionsRun(), 0);
+      ASSERT_TRUE(CompareIterators(round, &model, db_, nullptr, nullptr));
+      ASSERT_TRUE(
+          CompareIterators(round, &model, db_, model_snapshot, snapshot));
+      db_->ReleaseSnapshot(snapshot);
+      model.ReleaseSnapshot(model_snapshot);
+      Reopen(&options);
+      ASSERT_TRUE(CompareIterators(round, &model, db_, nullptr, nullptr));
+    }
+  }
+}
+
+TEST_F(DBTest, RandomizedConcurrentCompactions) {
+  for (CompactionStyle style : {kLeveledCompaction, kTieredCompaction}) {
+    Random rnd(test::RandomSeed());
+    Options options = CurrentOptions();
+    options.compaction_style = style;
+    options.max_sorted_runs_per_level = 2;
+    options.max_background_compactions = 4;
+    options.write_buffer_size = 64 << 10;
+    options.max_file_size = 1 << 20;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    ModelDB model(options);
+    const int N = 10000;
+    std::string k, v;
+    for (int step = 0; step < N; step++) {
+      k = RandomKey(&rnd);
+      if (rnd.OneIn(4)) {
+        ASSERT_LEVELDB_OK(model.Delete(WriteOptions(), k));
+        ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), k));
+      } else {
+        v = RandomString(&rnd, 100 + rnd.Uniform(900));
+        ASSERT_LEVELDB_OK(model.Put(WriteOptions(), k, v));
+        ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), k, v));
+      }
+
+      if ((step % 1000) == 0) {
+        ASSERT_TRUE(CompareIterators(step, &model, db_, nullptr, nullptr));
+      }
+      if ((step % 3000) == 0) {
+        dbfull()->CompactRange(nullptr, nullptr);
+        ASSERT_TRUE(CompareIterators(step, &model, db_, nullptr, nullptr));
+        Reopen(&options);
+        ASSERT_TRUE(CompareIterators(step, &model, db_, nullptr, nullptr));
+      }
+    }
+    ASSERT_TRUE(CompareIterators(N, &model, db_, nullptr, nullptr));
+  }
+}
+
 }  // namespace leveldb
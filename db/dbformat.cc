@@ -110,10 +110,27 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
   user_policy_->CreateFilter(keys, n, dst);
 }
 
+void InternalFilterPolicy::CreateFilterForLevel(const Slice* keys, int n,
+                                                int level,
+                                                std::string* dst) const {
+  // See CreateFilter() above.
+  Slice* mkey = const_cast<Slice*>(keys);
+  for (int i = 0; i < n; i++) {
+    mkey[i] = ExtractUserKey(keys[i]);
+  }
+  user_policy_->CreateFilterForLevel(keys, n, level, dst);
+}
+
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
 }
 
+void InternalFilterPolicy::UpdateLevelSizes(const uint64_t* level_bytes,
+                                            const int* level_runs,
+                                            int num_levels) const {
+  user_policy_->UpdateLevelSizes(level_bytes, level_runs, num_levels);
+}
+
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   size_t usize = user_key.size();
   size_t needed = usize + 13;  // A conservative estimate
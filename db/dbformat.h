@@ -51,14 +51,18 @@ class InternalKey;
 // Value types encoded as the last component of internal keys.
 // DO NOT CHANGE THESE ENUM VALUES: they are embedded in the on-disk
 // data structures.
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+enum ValueType {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  kTypeValueHandle = 0x2  // The value is stored in a value log file
+};
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeValueHandle;
 
 typedef uint64_t SequenceNumber;
 
@@ -125,7 +129,11 @@ class InternalFilterPolicy : public FilterPolicy {
   explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) {}
   const char* Name() const override;
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override;
+  void CreateFilterForLevel(const Slice* keys, int n, int level,
+                            std::string* dst) const override;
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
+  void UpdateLevelSizes(const uint64_t* level_bytes, const int* level_runs,
+                        int num_levels) const override;
 };
 
 // Modules in this directory should keep internal keys wrapped inside
@@ -177,7 +185,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<uint8_t>(kTypeValue));
+  return (c <= static_cast<uint8_t>(kTypeValueHandle));
 }
 
 // A helper class useful for DBImpl::Get()
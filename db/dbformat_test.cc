@@ -60,6 +60,7 @@ TEST(FormatTest, InternalKey_EncodeDecode) {
     for (int s = 0; s < sizeof(seq) / sizeof(seq[0]); s++) {
       TestKey(keys[k], seq[s], kTypeValue);
       TestKey("hello", 1, kTypeDeletion);
+      TestKey("hello", 1, kTypeValueHandle);
     }
   }
 }
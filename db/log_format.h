@@ -20,9 +20,14 @@ enum RecordType {
   // For fragments
   kFirstType = 2,
   kMiddleType = 3,
-  kLastType = 4
+  kLastType = 4,
+
+  // For compressed records, which continue with kMiddleType and kLastType
+  // fragments.  The record ends with its CompressionType.
+  kCompressedFullType = 5,
+  kCompressedFirstType = 6
 };
-static const int kMaxRecordType = kLastType;
+static const int kMaxRecordType = kCompressedFirstType;
 
 static const int kBlockSize = 32768;
 
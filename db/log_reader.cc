@@ -7,6 +7,8 @@
 #include <cstdio>
 
 #include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -63,6 +65,7 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
   scratch->clear();
   record->clear();
   bool in_fragmented_record = false;
+  bool compressed = false;  // Whether the fragmented record is compressed
   // Record offset of the logical record that we're reading
   // 0 is a dummy value to make compilers happy
   uint64_t prospective_record_offset = 0;
@@ -90,6 +93,7 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
 
     switch (record_type) {
       case kFullType:
+      case kCompressedFullType:
         if (in_fragmented_record) {
           // Handle bug in earlier versions of log::Writer where
           // it could emit an empty kFirstType record at the tail end
@@ -102,10 +106,15 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         prospective_record_offset = physical_record_offset;
         scratch->clear();
         *record = fragment;
+        if (record_type == kCompressedFullType && !Uncompress(record)) {
+          in_fragmented_record = false;
+          break;
+        }
         last_record_offset_ = prospective_record_offset;
         return true;
 
       case kFirstType:
+      case kCompressedFirstType:
         if (in_fragmented_record) {
           // Handle bug in earlier versions of log::Writer where
           // it could emit an empty kFirstType record at the tail end
@@ -118,6 +127,7 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         prospective_record_offset = physical_record_offset;
         scratch->assign(fragment.data(), fragment.size());
         in_fragmented_record = true;
+        compressed = (record_type == kCompressedFirstType);
         break;
 
       case kMiddleType:
@@ -136,6 +146,11 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         } else {
           scratch->append(fragment.data(), fragment.size());
           *record = Slice(*scratch);
+          if (compressed && !Uncompress(record)) {
+            in_fragmented_record = false;
+            scratch->clear();
+            break;
+          }
           last_record_offset_ = prospective_record_offset;
           return true;
         }
@@ -175,6 +190,36 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
 
 uint64_t Reader::LastRecordOffset() { return last_record_offset_; }
 
+bool Reader::Uncompress(Slice* record) {
+  bool ok = false;
+  if (!record->empty()) {
+    // The record ends with its compression type
+    const char* data = record->data();
+    const size_t n = record->size() - 1;
+    size_t ulength = 0;
+    switch (data[n]) {
+      case kSnappyCompression:
+        if (port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+          uncompressed_.resize(ulength);
+          ok = port::Snappy_Uncompress(data, n, &uncompressed_[0]);
+        }
+        break;
+      case kZstdCompression:
+        if (port::Zstd_GetUncompressedLength(data, n, &ulength)) {
+          uncompressed_.resize(ulength);
+          ok = port::Zstd_Uncompress(data, n, &uncompressed_[0]);
+        }
+        break;
+    }
+  }
+  if (!ok) {
+    ReportCorruption(record->size(), "corrupted compressed record");
+    return false;
+  }
+  *record = Slice(uncompressed_);
+  return true;
+}
+
 void Reader::ReportCorruption(uint64_t bytes, const char* reason) {
   ReportDrop(bytes, Status::Corruption(reason));
 }
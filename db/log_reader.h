@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_LOG_READER_H_
 
 #include <cstdint>
+#include <string>
 
 #include "db/log_format.h"
 #include "leveldb/slice.h"
@@ -80,6 +81,11 @@ class Reader {
   // Return type, or one of the preceding special values
   unsigned int ReadPhysicalRecord(Slice* result);
 
+  // Replaces the compressed record *record by its uncompressed form, which
+  // is stored in uncompressed_.  Returns false, after reporting the
+  // record as dropped, if it cannot be uncompressed.
+  bool Uncompress(Slice* record);
+
   // Reports dropped bytes to the reporter.
   // buffer_ must be updated to remove the dropped bytes prior to invocation.
   void ReportCorruption(uint64_t bytes, const char* reason);
@@ -89,6 +95,7 @@ class Reader {
   Reporter* const reporter_;
   bool const checksum_;
   char* const backing_store_;
+  std::string uncompressed_;
   Slice buffer_;
   bool eof_;  // Last Read() indicated EOF by returning < kBlockSize
 
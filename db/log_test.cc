@@ -6,9 +6,11 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/random.h"
+#include "util/testutil.h"
 
 namespace leveldb {
 namespace log {
@@ -36,6 +38,17 @@ static std::string RandomSkewedString(int i, Random* rnd) {
   return BigString(NumberString(i), rnd->Skewed(17));
 }
 
+static bool CompressionSupported(CompressionType type) {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  if (type == kSnappyCompression) {
+    return port::Snappy_Compress(in.data(), in.size(), &out);
+  } else if (type == kZstdCompression) {
+    return port::Zstd_Compress(/*level=*/1, in.data(), in.size(), &out);
+  }
+  return false;
+}
+
 class LogTest : public testing::Test {
  public:
   LogTest()
@@ -54,6 +67,17 @@ class LogTest : public testing::Test {
     writer_ = new Writer(&dest_, dest_.contents_.size());
   }
 
+  // Compress the records that are written from now on with "type".
+  void UseCompression(CompressionType type) {
+    delete writer_;
+    writer_ = new Writer(&dest_, dest_.contents_.size(), type, 1);
+  }
+
+  // Return the type of the record whose header starts at "header_offset".
+  int RecordType(int header_offset) {
+    return static_cast<unsigned char>(dest_.contents_[header_offset + 6]);
+  }
+
   void Write(const std::string& msg) {
     ASSERT_TRUE(!reading_) << "Write() after starting to read";
     writer_->AddRecord(Slice(msg));
@@ -122,6 +146,25 @@ class LogTest : public testing::Test {
     reader_ = new Reader(&source_, &report_, true /*checksum*/, initial_offset);
   }
 
+  void CheckCompressedRecords(CompressionType type) {
+    Random rnd(301);
+    std::string compressible;
+    test::CompressibleString(&rnd, 0.5, 100000, &compressible);
+    UseCompression(type);
+    Write("small");
+    Write(BigString("medium", 50000));
+    Write(compressible);  // Fragmented even when compressed
+    Write("");
+    ASSERT_LT(WrittenBytes(), 60000 + 3 * kHeaderSize);
+    ASSERT_EQ(kFullType, RecordType(0));  // Too small to compress
+    ASSERT_EQ("small", Read());
+    ASSERT_EQ(BigString("medium", 50000), Read());
+    ASSERT_EQ(compressible, Read());
+    ASSERT_EQ("", Read());
+    ASSERT_EQ("EOF", Read());
+    ASSERT_EQ(0, DroppedBytes());
+  }
+
   void CheckOffsetPastEndReturnsNoRecords(uint64_t offset_past_end) {
     WriteInitialOffsetLog();
     reading_ = true;
@@ -514,6 +557,54 @@ TEST_F(LogTest, ErrorJoinsRecords) {
   ASSERT_GE(dropped, 2 * kBlockSize);
 }
 
+TEST_F(LogTest, SnappyCompressedRecords) {
+  if (!CompressionSupported(kSnappyCompression)) {
+    GTEST_SKIP() << "skipping compression test: " << kSnappyCompression;
+  }
+  CheckCompressedRecords(kSnappyCompression);
+}
+
+TEST_F(LogTest, ZstdCompressedRecords) {
+  if (!CompressionSupported(kZstdCompression)) {
+    GTEST_SKIP() << "skipping compression test: " << kZstdCompression;
+  }
+  CheckCompressedRecords(kZstdCompression);
+}
+
+TEST_F(LogTest, IncompressibleRecordsStayRaw) {
+  Random rnd(301);
+  std::string record;
+  for (int i = 0; i < 1000; i++) {
+    record.push_back(static_cast<char>(rnd.Uniform(256)));
+  }
+  UseCompression(CompressionSupported(kZstdCompression) ? kZstdCompression
+                                                        : kSnappyCompression);
+  Write(record);
+  ASSERT_EQ(kHeaderSize + record.size(), WrittenBytes());
+  ASSERT_EQ(kFullType, RecordType(0));
+  ASSERT_EQ(record, Read());
+}
+
+TEST_F(LogTest, BadCompressedRecord) {
+  CompressionType type = kSnappyCompression;
+  if (!CompressionSupported(type)) {
+    type = kZstdCompression;
+    if (!CompressionSupported(type)) {
+      GTEST_SKIP() << "skipping compression test";
+    }
+  }
+  UseCompression(type);
+  Write(BigString("foo", 1000));
+  const int len = WrittenBytes() - kHeaderSize;
+  ASSERT_EQ(kCompressedFullType, RecordType(0));
+  // The compression type is the last byte of the record
+  SetByte(kHeaderSize + len - 1, 100);
+  FixChecksum(0, len);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(len, DroppedBytes());
+  ASSERT_EQ("OK", MatchError("corrupted compressed record"));
+}
+
 TEST_F(LogTest, ReadStart) { CheckInitialOffsetRecord(0, 0); }
 
 TEST_F(LogTest, ReadSecondOneOff) { CheckInitialOffsetRecord(1, 1); }
@@ -7,6 +7,7 @@
 #include <cstdint>
 
 #include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -20,20 +21,46 @@ static void InitTypeCrc(uint32_t* type_crc) {
   }
 }
 
-Writer::Writer(WritableFile* dest) : dest_(dest), block_offset_(0) {
-  InitTypeCrc(type_crc_);
-}
+Writer::Writer(WritableFile* dest) : Writer(dest, 0) {}
 
 Writer::Writer(WritableFile* dest, uint64_t dest_length)
-    : dest_(dest), block_offset_(dest_length % kBlockSize) {
+    : Writer(dest, dest_length, kNoCompression, 0) {}
+
+Writer::Writer(WritableFile* dest, uint64_t dest_length,
+               CompressionType compression, int zstd_compression_level)
+    : dest_(dest),
+      block_offset_(dest_length % kBlockSize),
+      compression_(compression),
+      zstd_compression_level_(zstd_compression_level) {
   InitTypeCrc(type_crc_);
 }
 
 Writer::~Writer() = default;
 
 Status Writer::AddRecord(const Slice& slice) {
-  const char* ptr = slice.data();
-  size_t left = slice.size();
+  bool compressed = false;
+  switch (compression_) {
+    case kNoCompression:
+      break;
+    case kSnappyCompression:
+      compressed = port::Snappy_Compress(slice.data(), slice.size(),
+                                         &compressed_);
+      break;
+    case kZstdCompression:
+      compressed = port::Zstd_Compress(zstd_compression_level_, slice.data(),
+                                       slice.size(), &compressed_);
+      break;
+  }
+  // Keep records that compress poorly, or not at all, uncompressed.
+  compressed = compressed && compressed_.size() + 1 <
+                                 slice.size() - (slice.size() / 8u);
+  if (compressed) {
+    compressed_.push_back(static_cast<char>(compression_));
+  }
+
+  const Slice record = compressed ? Slice(compressed_) : slice;
+  const char* ptr = record.data();
+  size_t left = record.size();
 
   // Fragment the record if necessary and emit it.  Note that if slice
   // is empty, we still want to iterate once to emit a single
@@ -62,9 +89,9 @@ Status Writer::AddRecord(const Slice& slice) {
     RecordType type;
     const bool end = (left == fragment_length);
     if (begin && end) {
-      type = kFullType;
+      type = compressed ? kCompressedFullType : kFullType;
     } else if (begin) {
-      type = kFirstType;
+      type = compressed ? kCompressedFirstType : kFirstType;
     } else if (end) {
       type = kLastType;
     } else {
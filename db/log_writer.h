@@ -6,8 +6,10 @@
 #define STORAGE_LEVELDB_DB_LOG_WRITER_H_
 
 #include <cstdint>
+#include <string>
 
 #include "db/log_format.h"
+#include "leveldb/options.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 
@@ -29,6 +31,12 @@ class Writer {
   // "*dest" must remain live while this Writer is in use.
   Writer(WritableFile* dest, uint64_t dest_length);
 
+  // Like Writer(dest, dest_length), but compresses every record with
+  // "compression" (see Options::log_compression) when that makes it at
+  // least 12.5% smaller.
+  Writer(WritableFile* dest, uint64_t dest_length, CompressionType compression,
+         int zstd_compression_level);
+
   Writer(const Writer&) = delete;
   Writer& operator=(const Writer&) = delete;
 
@@ -41,6 +49,9 @@ class Writer {
 
   WritableFile* dest_;
   int block_offset_;  // Current offset in block
+  const CompressionType compression_;
+  const int zstd_compression_level_;
+  std::string compressed_;  // Compressed form of the current record
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
@@ -8,8 +8,9 @@
 #include <string>
 
 #include "db/dbformat.h"
-#include "db/skiplist.h"
+#include "db/memtablerep.h"
 #include "leveldb/db.h"
+#include "leveldb/options.h"
 #include "util/arena.h"
 
 namespace leveldb {
@@ -21,7 +22,9 @@ class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
   // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  // options.memtable_rep selects the data structure that holds the entries.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    const Options& options = Options());
 
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
@@ -56,30 +59,29 @@ class MemTable {
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Like Add(), but may be called from several threads at once.  All
+  // writers of a memtable must use either Add() or AddConcurrently().
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
   // If memtable contains a value for key, store it in *value and return true.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
   // Else, return false.
   bool Get(const LookupKey& key, std::string* value, Status* s);
 
- private:
-  friend class MemTableIterator;
-  friend class MemTableBackwardIterator;
-
-  struct KeyComparator {
-    const InternalKeyComparator comparator;
-    explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) {}
-    int operator()(const char* a, const char* b) const;
-  };
+  // Called once the memtable stops taking writes, before it is flushed.
+  void MarkImmutable() { rep_->MarkReadOnly(); }
 
-  typedef SkipList<const char*, KeyComparator> Table;
+ private:
+  typedef MemTableRep::KeyComparator KeyComparator;
 
   ~MemTable();  // Private since only Unref() should be used to delete it
 
   KeyComparator comparator_;
   int refs_;
   Arena arena_;
-  Table table_;
+  MemTableRep* const rep_;
 };
 
 }  // namespace leveldb
@@ -0,0 +1,317 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/memtablerep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "db/skiplist.h"
+#include "leveldb/slice_transform.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/coding.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+static Slice GetLengthPrefixedSlice(const char* data) {
+  uint32_t len;
+  const char* p = data;
+  p = GetVarint32Ptr(p, p + 5, &len);  // +5: we assume "p" is not corrupted
+  return Slice(p, len);
+}
+
+int MemTableRep::KeyComparator::operator()(const char* aptr,
+                                           const char* bptr) const {
+  // Internal keys are encoded as length-prefixed strings.
+  Slice a = GetLengthPrefixedSlice(aptr);
+  Slice b = GetLengthPrefixedSlice(bptr);
+  return comparator.Compare(a, b);
+}
+
+namespace {
+
+typedef SkipList<const char*, MemTableRep::KeyComparator> List;
+
+class ListIterator : public MemTableRep::Iterator {
+ public:
+  explicit ListIterator(const List* list) : iter_(list) {}
+
+  bool Valid() const override { return iter_.Valid(); }
+  const char* key() const override { return iter_.key(); }
+  void Next() override { iter_.Next(); }
+  void Prev() override { iter_.Prev(); }
+  void Seek(const char* target) override { iter_.Seek(target); }
+  void SeekToFirst() override { iter_.SeekToFirst(); }
+  void SeekToLast() override { iter_.SeekToLast(); }
+
+ private:
+  List::Iterator iter_;
+};
+
+// Iterates over a sorted vector of entries, either one it owns or one
+// that is no longer modified.
+class VectorIterator : public MemTableRep::Iterator {
+ public:
+  // Sorts "entries" and takes ownership of them.
+  VectorIterator(std::vector<const char*>&& entries,
+                 const MemTableRep::KeyComparator& cmp)
+      : owned_(std::move(entries)), entries_(&owned_), cmp_(cmp) {
+    std::sort(owned_.begin(), owned_.end(), Less(cmp_));
+    index_ = owned_.size();
+  }
+
+  // REQUIRES: *entries is sorted and outlives the iterator.
+  VectorIterator(const std::vector<const char*>* entries,
+                 const MemTableRep::KeyComparator& cmp)
+      : entries_(entries), cmp_(cmp), index_(entries->size()) {}
+
+  bool Valid() const override { return index_ < entries_->size(); }
+  const char* key() const override {
+    assert(Valid());
+    return (*entries_)[index_];
+  }
+  void Next() override {
+    assert(Valid());
+    index_++;
+  }
+  void Prev() override {
+    assert(Valid());
+    index_ = (index_ == 0) ? entries_->size() : index_ - 1;
+  }
+  void Seek(const char* target) override {
+    index_ = std::lower_bound(entries_->begin(), entries_->end(), target,
+                              Less(cmp_)) -
+             entries_->begin();
+  }
+  void SeekToFirst() override { index_ = 0; }
+  void SeekToLast() override {
+    index_ = entries_->empty() ? 0 : entries_->size() - 1;
+  }
+
+  struct Less {
+    explicit Less(const MemTableRep::KeyComparator& cmp) : cmp(cmp) {}
+    bool operator()(const char* a, const char* b) const {
+      return cmp(a, b) < 0;
+    }
+    const MemTableRep::KeyComparator& cmp;
+  };
+
+ private:
+  std::vector<const char*> owned_;
+  const std::vector<const char*>* const entries_;
+  const MemTableRep::KeyComparator& cmp_;
+  size_t index_;  // entries_->size() if not valid
+};
+
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const KeyComparator& cmp, Arena* arena) : list_(cmp, arena) {}
+
+  void Insert(const char* entry) override { list_.Insert(entry); }
+
+  void InsertConcurrently(const char* entry) override {
+    list_.InsertConcurrently(entry);
+  }
+
+  const char* Lookup(const char* key) override {
+    List::Iterator iter(&list_);
+    iter.Seek(key);
+    return iter.Valid() ? iter.key() : nullptr;
+  }
+
+  Iterator* NewIterator() override { return new ListIterator(&list_); }
+
+ private:
+  List list_;
+};
+
+// Appends entries in arrival order and sorts them once, when the memtable
+// becomes read-only.  Until then every read works on a copy.
+class VectorRep : public MemTableRep {
+ public:
+  explicit VectorRep(const KeyComparator& cmp)
+      : cmp_(cmp), read_only_(false), sorted_(false), bytes_(0) {}
+
+  void Insert(const char* entry) override {
+    MutexLock l(&mu_);
+    assert(!read_only_);
+    entries_.push_back(entry);
+    bytes_.store(entries_.capacity() * sizeof(const char*),
+                 std::memory_order_relaxed);
+  }
+
+  void InsertConcurrently(const char* entry) override { Insert(entry); }
+
+  const char* Lookup(const char* key) override {
+    MutexLock l(&mu_);
+    VectorIterator::Less less(cmp_);
+    if (read_only_) {
+      SortEntries();
+      auto iter = std::lower_bound(entries_.begin(), entries_.end(), key, less);
+      return iter == entries_.end() ? nullptr : *iter;
+    }
+    const char* result = nullptr;
+    for (const char* entry : entries_) {
+      if (!less(entry, key) && (result == nullptr || less(entry, result))) {
+        result = entry;
+      }
+    }
+    return result;
+  }
+
+  void MarkReadOnly() override {
+    MutexLock l(&mu_);
+    read_only_ = true;
+  }
+
+  size_t ApproximateMemoryUsage() override {
+    return bytes_.load(std::memory_order_relaxed);
+  }
+
+  Iterator* NewIterator() override {
+    mu_.Lock();
+    if (read_only_) {
+      SortEntries();
+      mu_.Unlock();
+      return new VectorIterator(&entries_, cmp_);
+    }
+    std::vector<const char*> copy(entries_);
+    mu_.Unlock();
+    return new VectorIterator(std::move(copy), cmp_);
+  }
+
+ private:
+  void SortEntries() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    assert(read_only_);
+    if (!sorted_) {
+      std::sort(entries_.begin(), entries_.end(), VectorIterator::Less(cmp_));
+      sorted_ = true;
+    }
+  }
+
+  const KeyComparator cmp_;
+  port::Mutex mu_;
+  std::vector<const char*> entries_ GUARDED_BY(mu_);
+  bool read_only_ GUARDED_BY(mu_);
+  bool sorted_ GUARDED_BY(mu_);
+  std::atomic<size_t> bytes_;
+};
+
+// A fixed-size hash table of skiplists, one per key prefix.  Point
+// lookups only search the list of their prefix.
+class PrefixHashRep : public MemTableRep {
+ public:
+  PrefixHashRep(const KeyComparator& cmp, Arena* arena,
+                const SliceTransform* prefix_extractor)
+      : cmp_(cmp),
+        arena_(arena),
+        prefix_extractor_(prefix_extractor),
+        buckets_(new std::atomic<List*>[kBuckets]) {
+    for (int i = 0; i < kBuckets; i++) {
+      buckets_[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~PrefixHashRep() override {
+    // The lists themselves live in the arena.
+    for (int i = 0; i < kBuckets; i++) {
+      List* list = buckets_[i].load(std::memory_order_relaxed);
+      if (list != nullptr) {
+        list->~List();
+      }
+    }
+    delete[] buckets_;
+  }
+
+  void Insert(const char* entry) override {
+    GetOrCreateList(entry)->Insert(entry);
+  }
+
+  void InsertConcurrently(const char* entry) override {
+    GetOrCreateList(entry)->InsertConcurrently(entry);
+  }
+
+  const char* Lookup(const char* key) override {
+    List* list = Bucket(key)->load(std::memory_order_acquire);
+    if (list == nullptr) {
+      return nullptr;
+    }
+    List::Iterator iter(list);
+    iter.Seek(key);
+    return iter.Valid() ? iter.key() : nullptr;
+  }
+
+  Iterator* NewIterator() override {
+    std::vector<const char*> entries;
+    for (int i = 0; i < kBuckets; i++) {
+      List* list = buckets_[i].load(std::memory_order_acquire);
+      if (list != nullptr) {
+        List::Iterator iter(list);
+        for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+          entries.push_back(iter.key());
+        }
+      }
+    }
+    return new VectorIterator(std::move(entries), cmp_);
+  }
+
+ private:
+  enum { kBuckets = 1 << 14 };
+
+  std::atomic<List*>* Bucket(const char* entry) const {
+    Slice key = ExtractUserKey(GetLengthPrefixedSlice(entry));
+    if (prefix_extractor_ != nullptr && prefix_extractor_->InDomain(key)) {
+      key = prefix_extractor_->Transform(key);
+    }
+    return &buckets_[Hash(key.data(), key.size(), 0) % kBuckets];
+  }
+
+  List* GetOrCreateList(const char* entry) {
+    std::atomic<List*>* bucket = Bucket(entry);
+    List* list = bucket->load(std::memory_order_acquire);
+    if (list == nullptr) {
+      // Concurrent writers may each build a list for the bucket; the ones
+      // that lose the race are left unused in the arena.
+      List* fresh = new (arena_->AllocateAlignedConcurrently(sizeof(List)))
+          List(cmp_, arena_);
+      if (bucket->compare_exchange_strong(list, fresh,
+                                          std::memory_order_acq_rel,
+                                          std::memory_order_acquire)) {
+        list = fresh;
+      } else {
+        fresh->~List();
+      }
+    }
+    return list;
+  }
+
+  const KeyComparator cmp_;
+  Arena* const arena_;
+  const SliceTransform* const prefix_extractor_;
+  std::atomic<List*>* const buckets_;
+};
+
+}  // namespace
+
+MemTableRep* NewMemTableRep(const Options& options,
+                            const MemTableRep::KeyComparator& cmp,
+                            Arena* arena) {
+  switch (options.memtable_rep) {
+    case kVectorRep:
+      return new VectorRep(cmp);
+    case kPrefixHashRep:
+      return new PrefixHashRep(cmp, arena, options.prefix_extractor);
+    case kSkipListRep:
+    default:
+      return new SkipListRep(cmp, arena);
+  }
+}
+
+}  // namespace leveldb
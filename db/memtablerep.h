@@ -0,0 +1,101 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MEMTABLEREP_H_
+#define STORAGE_LEVELDB_DB_MEMTABLEREP_H_
+
+#include <cstddef>
+
+#include "db/dbformat.h"
+#include "leveldb/options.h"
+#include "util/arena.h"
+
+namespace leveldb {
+
+// The data structure that holds the entries of a MemTable.  An entry is
+// the buffer MemTable::Add() encodes into the memtable's arena; it starts
+// with the length-prefixed internal key.  Reps store pointers to entries
+// and order them with KeyComparator.
+//
+// Writes require external synchronization unless every writer uses
+// InsertConcurrently().  Reads may run alongside writes.
+class MemTableRep {
+ public:
+  struct KeyComparator {
+    const InternalKeyComparator comparator;
+    explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) {}
+    int operator()(const char* a, const char* b) const;
+  };
+
+  // Iteration over the entries of a rep, in KeyComparator order.
+  class Iterator {
+   public:
+    virtual ~Iterator() = default;
+
+    // Returns true iff the iterator is positioned at a valid entry.
+    virtual bool Valid() const = 0;
+
+    // Returns the entry at the current position.
+    // REQUIRES: Valid()
+    virtual const char* key() const = 0;
+
+    // Advances to the next position.
+    // REQUIRES: Valid()
+    virtual void Next() = 0;
+
+    // Advances to the previous position.
+    // REQUIRES: Valid()
+    virtual void Prev() = 0;
+
+    // Advance to the first entry >= target
+    virtual void Seek(const char* target) = 0;
+
+    // Position at the first entry in the rep.
+    virtual void SeekToFirst() = 0;
+
+    // Position at the last entry in the rep.
+    virtual void SeekToLast() = 0;
+  };
+
+  MemTableRep() = default;
+
+  MemTableRep(const MemTableRep&) = delete;
+  MemTableRep& operator=(const MemTableRep&) = delete;
+
+  virtual ~MemTableRep() = default;
+
+  // Insert entry into the rep.
+  // REQUIRES: nothing that compares equal to entry is currently in the rep.
+  virtual void Insert(const char* entry) = 0;
+
+  // Like Insert(), but may be called from several threads at once.  Any
+  // memory taken from the arena must come from its concurrent variants.
+  virtual void InsertConcurrently(const char* entry) = 0;
+
+  // Return the earliest entry at or after "key" among the entries that may
+  // have the same user key, or nullptr if there is none.  The caller checks
+  // the user key of the result.
+  virtual const char* Lookup(const char* key) = 0;
+
+  // Called once the memtable stops taking writes, before it is flushed.
+  virtual void MarkReadOnly() {}
+
+  // Returns an estimate of the memory used by the rep outside of the
+  // arena.
+  virtual size_t ApproximateMemoryUsage() { return 0; }
+
+  // Return an iterator over the entries of the rep.  The result may or may
+  // not see entries inserted after it was created.
+  virtual Iterator* NewIterator() = 0;
+};
+
+// Return a new rep of the type named by options.memtable_rep, which uses
+// "cmp" to order entries and allocates from "*arena".
+MemTableRep* NewMemTableRep(const Options& options,
+                            const MemTableRep::KeyComparator& cmp,
+                            Arena* arena);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MEMTABLEREP_H_
@@ -7,6 +7,7 @@
 // (2) We scan every table to compute
 //     (a) smallest/largest for the table
 //     (b) largest sequence number in the table
+//     (c) bytes of the value log files that the table points to
 // (3) We generate descriptor contents:
 //      - log number is set to zero
 //      - next-file-number is set to 1 + largest file number we found
@@ -32,6 +33,7 @@
 #include "db/log_writer.h"
 #include "db/memtable.h"
 #include "db/table_cache.h"
+#include "db/value_log.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/comparator.h"
@@ -203,7 +205,8 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    status = BuildTable(dbname_, env_, options_, table_cache_, nullptr, iter,
+                        &meta, 0);
     delete iter;
     mem->Unref();
     mem = nullptr;
@@ -259,6 +262,7 @@ class Repairer {
     bool empty = true;
     ParsedInternalKey parsed;
     t.max_sequence = 0;
+    std::map<uint64_t, uint64_t> value_log_bytes;
     for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       if (!ParseInternalKey(key, &parsed)) {
@@ -276,6 +280,11 @@ class Repairer {
       if (parsed.sequence > t.max_sequence) {
         t.max_sequence = parsed.sequence;
       }
+      ValueHandle handle;
+      Slice input = iter->value();
+      if (parsed.type == kTypeValueHandle && handle.DecodeFrom(&input)) {
+        value_log_bytes[handle.number] += handle.size;
+      }
     }
     if (!iter->status().ok()) {
       status = iter->status();
@@ -284,6 +293,22 @@ class Repairer {
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
+    for (const auto& kvp : value_log_bytes) {
+      ValueLogRef ref;
+      ref.number = kvp.first;
+      ref.bytes = kvp.second;
+      if (!env_->GetFileSize(ValueLogFileName(dbname_, ref.number),
+                             &ref.file_size)
+               .ok()) {
+        // Values in a lost value log file cannot be read anymore
+        Log(options_.info_log, "Table #%llu: value log #%llu is missing",
+            (unsigned long long)t.meta.number,
+            (unsigned long long)ref.number);
+        ref.file_size = ref.bytes;
+      }
+      t.meta.value_log_refs.push_back(ref);
+    }
+
     if (status.ok()) {
       tables_.push_back(t);
     } else {
@@ -302,7 +327,7 @@ class Repairer {
     if (!s.ok()) {
       return;
     }
-    TableBuilder* builder = new TableBuilder(options_, file);
+    TableBuilder* builder = new TableBuilder(options_, file, 0);
 
     // Copy data.
     Iterator* iter = NewTableIterator(t.meta);
@@ -369,7 +394,7 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+                    t.meta.largest, 0, t.meta.value_log_refs);
     }
 
     // std::fprintf(stderr,
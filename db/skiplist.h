@@ -8,10 +8,12 @@
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
-// Reads require a guarantee that the SkipList will not be destroyed
-// while the read is in progress.  Apart from that, reads progress
-// without any internal locking or synchronization.
+// Writes require external synchronization, most likely a mutex, unless
+// every writer uses InsertConcurrently(), which links nodes in with
+// compare-and-swap and may run in several threads at once.  Reads
+// require a guarantee that the SkipList will not be destroyed while the
+// read is in progress.  Apart from that, reads progress without any
+// internal locking or synchronization.
 //
 // Invariants:
 //
@@ -21,15 +23,17 @@
 //
 // (2) The contents of a Node except for the next/prev pointers are
 // immutable after the Node has been linked into the SkipList.
-// Only Insert() modifies the list, and it is careful to initialize
-// a node and use release-stores to publish the nodes in one or
-// more lists.
+// Only Insert() and InsertConcurrently() modify the list, and they
+// are careful to initialize a node and use release-stores (or
+// release compare-and-swaps) to publish the nodes in one or more lists.
 //
 // ... prev vs. next pointer ordering ...
 
 #include <atomic>
 #include <cassert>
 #include <cstdlib>
+#include <functional>
+#include <thread>
 
 #include "util/arena.h"
 #include "util/random.h"
@@ -54,6 +58,12 @@ class SkipList {
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
+  // Like Insert(), but may be called from several threads at once, and
+  // allocates from the arena with Arena::AllocateAlignedConcurrently().
+  // Must not be mixed with concurrent calls to Insert().
+  // REQUIRES: nothing that compares equal to key is currently in the list.
+  void InsertConcurrently(const Key& key);
+
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
@@ -104,7 +114,9 @@ class SkipList {
   }
 
   Node* NewNode(const Key& key, int height);
-  int RandomHeight();
+  // Like NewNode(), but allocates with Arena::AllocateAlignedConcurrently().
+  Node* NewNodeConcurrently(const Key& key, int height);
+  int RandomHeight(Random* rnd);
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -131,8 +143,8 @@ class SkipList {
 
   Node* const head_;
 
-  // Modified only by Insert().  Read racily by readers, but stale
-  // values are ok.
+  // Modified only by Insert() and InsertConcurrently().  Read racily by
+  // readers, but stale values are ok.
   std::atomic<int> max_height_;  // Height of the entire list
 
   // Read/written only by Insert().
@@ -171,6 +183,15 @@ struct SkipList<Key, Comparator>::Node {
     next_[n].store(x, std::memory_order_relaxed);
   }
 
+  // Set next_[n] to x if it still points to "expected".  Publishes x
+  // with release semantics, like SetNext().
+  bool CasNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].compare_exchange_strong(expected, x,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   std::atomic<Node*> next_[1];
@@ -184,6 +205,14 @@ typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::NewNode(
   return new (node_memory) Node(key);
 }
 
+template <typename Key, class Comparator>
+typename SkipList<Key, Comparator>::Node*
+SkipList<Key, Comparator>::NewNodeConcurrently(const Key& key, int height) {
+  char* const node_memory = arena_->AllocateAlignedConcurrently(
+      sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
+  return new (node_memory) Node(key);
+}
+
 template <typename Key, class Comparator>
 inline SkipList<Key, Comparator>::Iterator::Iterator(const SkipList* list) {
   list_ = list;
@@ -237,11 +266,11 @@ inline void SkipList<Key, Comparator>::Iterator::SeekToLast() {
 }
 
 template <typename Key, class Comparator>
-int SkipList<Key, Comparator>::RandomHeight() {
+int SkipList<Key, Comparator>::RandomHeight(Random* rnd) {
   // Increase height with probability 1 in kBranching
   static const unsigned int kBranching = 4;
   int height = 1;
-  while (height < kMaxHeight && rnd_.OneIn(kBranching)) {
+  while (height < kMaxHeight && rnd->OneIn(kBranching)) {
     height++;
   }
   assert(height > 0);
@@ -323,7 +352,10 @@ template <typename Key, class Comparator>
 SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena* arena)
     : compare_(cmp),
       arena_(arena),
-      head_(NewNode(0 /* any key will do */, kMaxHeight)),
+      // The head comes from the concurrent variant, so that new lists may
+      // share an arena with lists that are being inserted into
+      // concurrently.
+      head_(NewNodeConcurrently(0 /* any key will do */, kMaxHeight)),
       max_height_(1),
       rnd_(0xdeadbeef) {
   for (int i = 0; i < kMaxHeight; i++) {
@@ -341,7 +373,7 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
   // Our data structure does not allow duplicate insertion
   assert(x == nullptr || !Equal(key, x->key));
 
-  int height = RandomHeight();
+  int height = RandomHeight(&rnd_);
   if (height > GetMaxHeight()) {
     for (int i = GetMaxHeight(); i < height; i++) {
       prev[i] = head_;
@@ -365,6 +397,47 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
   }
 }
 
+template <typename Key, class Comparator>
+void SkipList<Key, Comparator>::InsertConcurrently(const Key& key) {
+  // rnd_ belongs to Insert(), so every inserting thread draws heights
+  // from a generator of its own.
+  static thread_local Random rnd(static_cast<uint32_t>(
+      std::hash<std::thread::id>()(std::this_thread::get_id())));
+  const int height = RandomHeight(&rnd);
+
+  // Raise max_height_ before linking anything, for the same reasons
+  // Insert() may store it without synchronization.
+  int max_height = GetMaxHeight();
+  while (height > max_height &&
+         !max_height_.compare_exchange_weak(max_height, height,
+                                            std::memory_order_relaxed)) {
+  }
+
+  Node* const x = NewNodeConcurrently(key, height);
+
+  // Find the predecessors of key on every level.  Other writers may link
+  // nodes in after them before we get to a level, so each level is linked
+  // with a compare-and-swap, moving forward past any new nodes on failure.
+  Node* prev[kMaxHeight];
+  FindGreaterOrEqual(key, prev);
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      Node* next = prev[i]->Next(i);
+      while (KeyIsAfterNode(key, next)) {
+        prev[i] = next;
+        next = prev[i]->Next(i);
+      }
+      // Our data structure does not allow duplicate insertion
+      assert(next == nullptr || !Equal(key, next->key));
+      // NoBarrier_SetNext() suffices since CasNext() publishes "x".
+      x->NoBarrier_SetNext(i, next);
+      if (prev[i]->CasNext(i, next, x)) {
+        break;
+      }
+    }
+  }
+}
+
 template <typename Key, class Comparator>
 bool SkipList<Key, Comparator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, nullptr);
@@ -6,6 +6,7 @@
 
 #include <atomic>
 #include <set>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "leveldb/env.h"
@@ -13,6 +14,7 @@
 #include "port/thread_annotations.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -365,4 +367,149 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several writers call InsertConcurrently() on the same list while a
+// reader keeps checking that the keys it iterates over are in order.
+// Writer "w" of kWriters inserts the keys congruent to w modulo kWriters,
+// in random order, so that neighbouring keys come from different threads.
+class MultiWriterState {
+ public:
+  static constexpr int kWriters = 4;
+  static constexpr int kKeysPerWriter = 20000;
+
+  explicit MultiWriterState(int seed)
+      : seed_(seed),
+        list_(Comparator(), &arena_),
+        running_(0),
+        reader_quit_(false),
+        out_of_order_(false),
+        cv_(&mu_) {}
+
+  SkipList<Key, Comparator>* list() { return &list_; }
+  int seed() const { return seed_; }
+  bool reader_quit() const {
+    return reader_quit_.load(std::memory_order_acquire);
+  }
+  void QuitReader() { reader_quit_.store(true, std::memory_order_release); }
+
+  // Set by the reader if it saw keys out of order.
+  bool out_of_order() const {
+    return out_of_order_.load(std::memory_order_acquire);
+  }
+  void SetOutOfOrder() { out_of_order_.store(true, std::memory_order_release); }
+
+  void Start() LOCKS_EXCLUDED(mu_) {
+    MutexLock l(&mu_);
+    running_++;
+  }
+
+  void Done() LOCKS_EXCLUDED(mu_) {
+    MutexLock l(&mu_);
+    running_--;
+    cv_.SignalAll();
+  }
+
+  // Wait until at most "running" threads are left.
+  void WaitFor(int running) LOCKS_EXCLUDED(mu_) {
+    MutexLock l(&mu_);
+    while (running_ > running) {
+      cv_.Wait();
+    }
+  }
+
+ private:
+  const int seed_;
+  Arena arena_;
+  SkipList<Key, Comparator> list_;
+  port::Mutex mu_;
+  int running_ GUARDED_BY(mu_);
+  std::atomic<bool> reader_quit_;
+  std::atomic<bool> out_of_order_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+};
+
+// Needed when building in C++11 mode.
+constexpr int MultiWriterState::kWriters;
+constexpr int MultiWriterState::kKeysPerWriter;
+
+struct MultiWriterArg {
+  MultiWriterState* state;
+  int id;
+};
+
+static void MultiWriterInsert(void* arg) {
+  MultiWriterArg* a = reinterpret_cast<MultiWriterArg*>(arg);
+  std::vector<Key> keys;
+  for (int i = 0; i < MultiWriterState::kKeysPerWriter; i++) {
+    keys.push_back(static_cast<Key>(i) * MultiWriterState::kWriters + a->id);
+  }
+  Random rnd(a->state->seed() + a->id);
+  for (size_t i = keys.size() - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  }
+  for (Key k : keys) {
+    a->state->list()->InsertConcurrently(k);
+  }
+  a->state->Done();
+}
+
+static void MultiWriterRead(void* arg) {
+  MultiWriterState* state = reinterpret_cast<MultiWriterState*>(arg);
+  // Failures are reported by RunMultiWriter(), since the reader has to
+  // call Done() in any case.
+  while (!state->reader_quit() && !state->out_of_order()) {
+    SkipList<Key, Comparator>::Iterator iter(state->list());
+    iter.SeekToFirst();
+    Key last = 0;
+    bool first = true;
+    for (; iter.Valid(); iter.Next()) {
+      if (!first && !(last < iter.key())) {
+        state->SetOutOfOrder();
+        break;
+      }
+      last = iter.key();
+      first = false;
+    }
+  }
+  state->Done();
+}
+
+static void RunMultiWriter(int run) {
+  MultiWriterState state(test::RandomSeed() + run * 100);
+  MultiWriterArg args[MultiWriterState::kWriters];
+  state.Start();
+  Env::Default()->StartThread(MultiWriterRead, &state);
+  for (int id = 0; id < MultiWriterState::kWriters; id++) {
+    args[id].state = &state;
+    args[id].id = id;
+    state.Start();
+    Env::Default()->StartThread(MultiWriterInsert, &args[id]);
+  }
+  state.WaitFor(1);
+  state.QuitReader();
+  state.WaitFor(0);
+  ASSERT_TRUE(!state.out_of_order());
+
+  // Every key must be linked in, in order, exactly once.
+  const Key kNumKeys = static_cast<Key>(MultiWriterState::kWriters) *
+                       MultiWriterState::kKeysPerWriter;
+  SkipList<Key, Comparator>::Iterator iter(state.list());
+  iter.SeekToFirst();
+  for (Key k = 0; k < kNumKeys; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (Key k = 0; k < kNumKeys; k += 97) {
+    ASSERT_TRUE(state.list()->Contains(k));
+    iter.Seek(k);
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+  }
+}
+
+TEST(SkipTest, MultiWriter1) { RunMultiWriter(1); }
+TEST(SkipTest, MultiWriter2) { RunMultiWriter(2); }
+TEST(SkipTest, MultiWriter3) { RunMultiWriter(3); }
+
 }  // namespace leveldb
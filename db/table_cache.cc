@@ -14,10 +14,13 @@ namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  std::atomic<size_t>* memory_usage;  // TableCache::memory_usage_
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  tf->memory_usage->fetch_sub(tf->table->ApproximateMemoryUsage(),
+                              std::memory_order_relaxed);
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -34,6 +37,7 @@ TableCache::TableCache(const std::string& dbname, const Options& options,
     : env_(options.env),
       dbname_(dbname),
       options_(options),
+      memory_usage_(0),
       cache_(NewLRUCache(entries)) {}
 
 TableCache::~TableCache() { delete cache_; }
@@ -69,6 +73,9 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->memory_usage = &memory_usage_;
+      memory_usage_.fetch_add(table->ApproximateMemoryUsage(),
+                              std::memory_order_relaxed);
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -111,6 +118,33 @@ Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
   return s;
 }
 
+bool TableCache::SeekMayMatch(const ReadOptions& options, uint64_t file_number,
+                              uint64_t file_size, const Slice& target) {
+  Cache::Handle* handle = nullptr;
+  if (!FindTable(file_number, file_size, &handle).ok()) {
+    return true;
+  }
+  Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  bool may_match = t->SeekMayMatch(options, target);
+  cache_->Release(handle);
+  return may_match;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                            uint64_t file_size, int n, const Slice* keys,
+                            void* const* args,
+                            void (*handle_result)(void*, const Slice&,
+                                                  const Slice&)) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    s = t->InternalMultiGet(options, n, keys, args, handle_result);
+    cache_->Release(handle);
+  }
+  return s;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
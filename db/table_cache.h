@@ -7,6 +7,7 @@
 #ifndef STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 #define STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 
@@ -44,15 +45,37 @@ class TableCache {
              uint64_t file_size, const Slice& k, void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
+  // Like Get() for each of the n sorted internal keys, calling
+  // (*handle_result)(args[i], found_key, found_value) for keys[i].
+  Status MultiGet(const ReadOptions& options, uint64_t file_number,
+                  uint64_t file_size, int n, const Slice* keys,
+                  void* const* args,
+                  void (*handle_result)(void*, const Slice&, const Slice&));
+
+  // Returns false if the filters of the specified file say that no entry
+  // at or after internal key "target" has the prefix of target under
+  // options_.prefix_extractor (with options.prefix_same_as_start), or is
+  // before options.iterate_upper_bound.  Errors are treated as potential
+  // matches.
+  bool SeekMayMatch(const ReadOptions& options, uint64_t file_number,
+                    uint64_t file_size, const Slice& target);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Returns the number of bytes of index and filter blocks held by the
+  // open tables.
+  size_t ApproximateMemoryUsage() const {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+
  private:
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
 
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
+  std::atomic<size_t> memory_usage_;
   Cache* cache_;
 };
 
@@ -0,0 +1,295 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/value_log.h"
+
+#include <cassert>
+
+#include "db/dbformat.h"
+#include "db/filename.h"
+#include "db/version_set.h"
+#include "leveldb/env.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/rate_limiter.h"
+
+namespace leveldb {
+
+void ValueHandle::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, number);
+  PutVarint64(dst, offset);
+  PutVarint64(dst, size);
+}
+
+bool ValueHandle::DecodeFrom(Slice* input) {
+  return GetVarint64(input, &number) && GetVarint64(input, &offset) &&
+         GetVarint64(input, &size);
+}
+
+namespace {
+
+// The cache entry of an open value log file.
+struct ValueLogFile {
+  RandomAccessFile* file;
+  uint64_t size;
+};
+
+}  // namespace
+
+static void DeleteEntry(const Slice& key, void* value) {
+  ValueLogFile* f = reinterpret_cast<ValueLogFile*>(value);
+  delete f->file;
+  delete f;
+}
+
+ValueLog::ValueLog(const std::string& dbname, const Options& options,
+                   int entries)
+    : env_(options.env), dbname_(dbname), cache_(NewLRUCache(entries)) {}
+
+ValueLog::~ValueLog() { delete cache_; }
+
+Status ValueLog::FindFile(uint64_t number, Cache::Handle** handle) {
+  char buf[sizeof(number)];
+  EncodeFixed64(buf, number);
+  Slice key(buf, sizeof(buf));
+  *handle = cache_->Lookup(key);
+  if (*handle != nullptr) {
+    return Status::OK();
+  }
+  const std::string fname = ValueLogFileName(dbname_, number);
+  uint64_t size;
+  RandomAccessFile* file = nullptr;
+  Status s = env_->GetFileSize(fname, &size);
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &file);
+  }
+  if (s.ok()) {
+    ValueLogFile* f = new ValueLogFile;
+    f->file = file;
+    f->size = size;
+    *handle = cache_->Insert(key, f, 1, &DeleteEntry);
+  }
+  return s;
+}
+
+Status ValueLog::Get(const ReadOptions& options, const Slice& user_key,
+                     const Slice& handle, std::string* value) {
+  ValueHandle h;
+  Slice input = handle;
+  if (!h.DecodeFrom(&input)) {
+    return Status::Corruption("bad value handle");
+  }
+  Cache::Handle* file_handle;
+  Status s = FindFile(h.number, &file_handle);
+  if (!s.ok()) {
+    return s;
+  }
+  const ValueLogFile* f =
+      reinterpret_cast<ValueLogFile*>(cache_->Value(file_handle));
+  RandomAccessFile* file = f->file;
+
+  // A record holds at least a checksum and the lengths of its key and
+  // value, and lies within the file.
+  if (h.size < 4 + 2 || h.size > f->size || h.offset > f->size - h.size) {
+    cache_->Release(file_handle);
+    return Status::Corruption("bad value handle");
+  }
+
+  // The record is read into *value, unless the file returns a pointer to
+  // its own storage (e.g. for mmapped files).
+  value->resize(h.size);
+  Slice record;
+  s = file->Read(h.offset, h.size, &record, &(*value)[0]);
+  if (s.ok() && record.size() != h.size) {
+    s = Status::Corruption("truncated value log record");
+  }
+  if (s.ok() && options.verify_checksums) {
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(record.data()));
+    if (crc != crc32c::Value(record.data() + 4, record.size() - 4)) {
+      s = Status::Corruption("value log checksum mismatch");
+    }
+  }
+  Slice contents;
+  uint32_t key_size, value_size;
+  if (s.ok()) {
+    contents = Slice(record.data() + 4, record.size() - 4);
+    if (!GetVarint32(&contents, &key_size) ||
+        !GetVarint32(&contents, &value_size) ||
+        contents.size() != uint64_t{key_size} + value_size) {
+      s = Status::Corruption("bad value log record");
+    } else if (Slice(contents.data(), key_size) != user_key) {
+      s = Status::Corruption("value log record of another key");
+    }
+  }
+  if (s.ok()) {
+    const char* v = contents.data() + key_size;
+    if (v >= value->data() && v < value->data() + value->size()) {
+      value->erase(0, v - value->data());
+      value->resize(value_size);
+    } else {
+      value->assign(v, value_size);
+    }
+  }
+  cache_->Release(file_handle);
+  return s;
+}
+
+void ValueLog::Evict(uint64_t number) {
+  char buf[sizeof(number)];
+  EncodeFixed64(buf, number);
+  cache_->Erase(Slice(buf, sizeof(buf)));
+}
+
+ValueLogBuilder::ValueLogBuilder(const std::string& dbname,
+                                 const Options& options, ValueLog* value_log,
+                                 const Compaction* c, uint64_t number)
+    : dbname_(dbname),
+      options_(options),
+      value_log_(value_log),
+      compaction_(c),
+      number_(number),
+      file_(nullptr),
+      offset_(0),
+      closed_(false) {}
+
+ValueLogBuilder::~ValueLogBuilder() {
+  assert(closed_);  // Catch errors where caller forgot to call Finish()
+  delete file_;
+}
+
+Status ValueLogBuilder::Add(Slice* key, Slice* value) {
+  assert(!closed_);
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(*key, &ikey)) {
+    return Status::OK();  // Do not hide error keys
+  }
+  const size_t min_size = options_.min_separated_value_size;
+  Status s;
+  if (ikey.type == kTypeValue) {
+    if (min_size == 0 || value->size() < min_size) {
+      return s;
+    }
+    s = AddRecord(ikey.user_key, *value);
+  } else if (ikey.type == kTypeValueHandle) {
+    ValueHandle handle;
+    Slice input = *value;
+    if (!handle.DecodeFrom(&input)) {
+      return Status::Corruption("bad value handle");
+    }
+    if (compaction_ == nullptr ||
+        !compaction_->CollectsValueLog(handle.number)) {
+      bytes_[handle.number] += handle.size;
+      return s;
+    }
+    ReadOptions options;
+    options.verify_checksums = options_.paranoid_checks;
+    options.fill_cache = false;
+    s = value_log_->Get(options, ikey.user_key, *value, &value_);
+    if (s.ok() && (min_size == 0 || value_.size() < min_size)) {
+      // Values that are no longer separated move back into the table
+      key_.clear();
+      AppendInternalKey(&key_, ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                                 kTypeValue));
+      *key = key_;
+      *value = value_;
+      return s;
+    }
+    if (s.ok()) {
+      s = AddRecord(ikey.user_key, value_);
+    }
+  } else {
+    return s;
+  }
+  if (s.ok()) {
+    key_.clear();
+    AppendInternalKey(&key_, ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                               kTypeValueHandle));
+    *key = key_;
+    *value = handle_;
+  }
+  return s;
+}
+
+Status ValueLogBuilder::AddRecord(const Slice& user_key, const Slice& value) {
+  Status s;
+  if (file_ == nullptr) {
+    s = options_.env->NewWritableFile(ValueLogFileName(dbname_, number_),
+                                      &file_);
+    if (!s.ok()) {
+      return s;
+    }
+    file_ = NewRateLimitedFile(
+        file_, options_.rate_limiter,
+        compaction_ == nullptr ? Env::kHighPriority : Env::kLowPriority);
+  }
+
+  // The header is followed by the key and the value, which are appended
+  // without copying them.
+  record_.assign(4, '\0');
+  PutVarint32(&record_, user_key.size());
+  PutVarint32(&record_, value.size());
+  uint32_t crc = crc32c::Value(record_.data() + 4, record_.size() - 4);
+  crc = crc32c::Extend(crc, user_key.data(), user_key.size());
+  crc = crc32c::Extend(crc, value.data(), value.size());
+  EncodeFixed32(&record_[0], crc32c::Mask(crc));
+  s = file_->Append(record_);
+  if (s.ok()) {
+    s = file_->Append(user_key);
+  }
+  if (s.ok()) {
+    s = file_->Append(value);
+  }
+  if (s.ok()) {
+    ValueHandle handle;
+    handle.number = number_;
+    handle.offset = offset_;
+    handle.size = record_.size() + user_key.size() + value.size();
+    handle_.clear();
+    handle.EncodeTo(&handle_);
+    offset_ += handle.size;
+    bytes_[number_] += handle.size;
+  }
+  return s;
+}
+
+Status ValueLogBuilder::Finish(std::vector<ValueLogRef>* refs) {
+  assert(!closed_);
+  closed_ = true;
+  Status s;
+  if (file_ != nullptr) {
+    s = file_->Sync();
+    if (s.ok()) {
+      s = file_->Close();
+    }
+    delete file_;
+    file_ = nullptr;
+  }
+  refs->clear();
+  for (const auto& kvp : bytes_) {
+    ValueLogRef ref;
+    ref.number = kvp.first;
+    ref.bytes = kvp.second;
+    if (kvp.first == number_) {
+      ref.file_size = offset_;
+    } else {
+      // Only compactions pass on handles into other value log files
+      assert(compaction_ != nullptr);
+      ref.file_size = compaction_->ValueLogFileSize(kvp.first);
+    }
+    refs->push_back(ref);
+  }
+  return s;
+}
+
+void ValueLogBuilder::Abandon() {
+  assert(!closed_);
+  closed_ = true;
+  if (file_ != nullptr) {
+    file_->Close();
+    delete file_;
+    file_ = nullptr;
+  }
+}
+
+}  // namespace leveldb
@@ -0,0 +1,132 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Values of at least Options::min_separated_value_size bytes are moved out
+// of tables into value log files when tables are built, so that compactions
+// only rewrite the keys and small handles that point to them.  The table
+// keeps the entry under an internal key of type kTypeValueHandle, whose
+// value is the encoded ValueHandle of a record of a value log file:
+//    checksum: fixed32, masked crc32c of the rest of the record
+//    key size: varint32
+//    value size: varint32
+//    key: char[key size], the user key of the entry
+//    value: char[value size]
+// Each value log file is written alongside the table with the same number,
+// and is never modified afterwards.  A value log file is deleted once no
+// live table points to it; compactions move the values that are still live
+// out of value log files that are mostly garbage (see
+// Version::value_logs_to_collect_).
+
+#ifndef STORAGE_LEVELDB_DB_VALUE_LOG_H_
+#define STORAGE_LEVELDB_DB_VALUE_LOG_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "db/version_edit.h"
+#include "leveldb/cache.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Compaction;
+class Env;
+class WritableFile;
+
+// Location of a record in a value log file.
+struct ValueHandle {
+  uint64_t number;  // Value log file number
+  uint64_t offset;  // Offset of the record in the file
+  uint64_t size;    // Size of the record
+
+  void EncodeTo(std::string* dst) const;
+  bool DecodeFrom(Slice* input);
+};
+
+// Thread-safe (provides internal synchronization)
+class ValueLog {
+ public:
+  // Keeps up to "entries" value log files open.
+  ValueLog(const std::string& dbname, const Options& options, int entries);
+
+  ValueLog(const ValueLog&) = delete;
+  ValueLog& operator=(const ValueLog&) = delete;
+
+  ~ValueLog();
+
+  // Stores in *value the value of the record that the encoded ValueHandle
+  // "handle" points to.  Returns a corruption error if the record was not
+  // written for "user_key".
+  Status Get(const ReadOptions& options, const Slice& user_key,
+             const Slice& handle, std::string* value);
+
+  // Evict any entry for the specified file number
+  void Evict(uint64_t number);
+
+ private:
+  Status FindFile(uint64_t number, Cache::Handle** handle);
+
+  Env* const env_;
+  const std::string dbname_;
+  Cache* cache_;
+};
+
+// Writes the value log file of a table that is being built, and rewrites
+// the entries that are added to the table to point into value log files.
+class ValueLogBuilder {
+ public:
+  // The value log file is "number".  Values of compaction "c" (null for
+  // tables built from memtables) that are in value log files which it
+  // collects are moved to the new file as well.
+  ValueLogBuilder(const std::string& dbname, const Options& options,
+                  ValueLog* value_log, const Compaction* c, uint64_t number);
+
+  ValueLogBuilder(const ValueLogBuilder&) = delete;
+  ValueLogBuilder& operator=(const ValueLogBuilder&) = delete;
+
+  // REQUIRES: Either Finish() or Abandon() has been called.
+  ~ValueLogBuilder();
+
+  // Replaces the internal key and value of an entry of the table by those
+  // that the table should hold instead.  On return, *key and *value may
+  // refer to storage of the builder, which is valid until the next call.
+  Status Add(Slice* key, Slice* value);
+
+  // Syncs and closes the value log file, if any value was moved to it, and
+  // stores in *refs the value log files that the table points to.
+  Status Finish(std::vector<ValueLogRef>* refs);
+
+  // Closes the value log file without syncing it.  The caller is
+  // responsible for deleting it.
+  void Abandon();
+
+  // Size of the value log file generated so far.
+  uint64_t FileSize() const { return offset_; }
+
+ private:
+  // Appends a record for (user_key, value) to the value log file, and
+  // stores its handle in handle_.
+  Status AddRecord(const Slice& user_key, const Slice& value);
+
+  const std::string dbname_;
+  const Options& options_;
+  ValueLog* const value_log_;
+  const Compaction* const compaction_;
+  const uint64_t number_;
+  WritableFile* file_;
+  uint64_t offset_;
+  bool closed_;
+  std::map<uint64_t, uint64_t> bytes_;  // Referenced bytes by file number
+  std::string key_;
+  std::string handle_;
+  std::string record_;
+  std::string value_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_VALUE_LOG_H_
@@ -0,0 +1,168 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/value_log.h"
+
+#include "gtest/gtest.h"
+#include "db/dbformat.h"
+#include "db/filename.h"
+#include "helpers/memenv/memenv.h"
+#include "leveldb/env.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+class ValueLogTest : public testing::Test {
+ public:
+  ValueLogTest() : env_(NewMemEnv(Env::Default())), dbname_("/vlog") {
+    options_.env = env_;
+    options_.min_separated_value_size = 100;
+    env_->CreateDir(dbname_);
+    value_log_ = new ValueLog(dbname_, options_, 10);
+  }
+
+  ~ValueLogTest() {
+    delete value_log_;
+    delete env_;
+  }
+
+  // Adds an entry to "builder" and returns the type of the key that the
+  // table gets instead.
+  ValueType Add(ValueLogBuilder* builder, const std::string& user_key,
+                SequenceNumber seq, ValueType type, const std::string& value,
+                std::string* table_value) {
+    std::string ikey;
+    AppendInternalKey(&ikey, ParsedInternalKey(user_key, seq, type));
+    Slice key(ikey);
+    Slice v(value);
+    EXPECT_LEVELDB_OK(builder->Add(&key, &v));
+    ParsedInternalKey parsed;
+    EXPECT_TRUE(ParseInternalKey(key, &parsed));
+    EXPECT_EQ(user_key, parsed.user_key.ToString());
+    EXPECT_EQ(seq, parsed.sequence);
+    table_value->assign(v.data(), v.size());
+    return parsed.type;
+  }
+
+  std::string Read(const std::string& user_key, const std::string& handle,
+                   bool verify_checksums = true) {
+    ReadOptions options;
+    options.verify_checksums = verify_checksums;
+    std::string value;
+    Status s = value_log_->Get(options, user_key, handle, &value);
+    return s.ok() ? value : s.ToString();
+  }
+
+ protected:
+  Env* env_;
+  const std::string dbname_;
+  Options options_;
+  ValueLog* value_log_;
+};
+
+TEST_F(ValueLogTest, SmallValuesStay) {
+  ValueLogBuilder builder(dbname_, options_, value_log_, nullptr, 7);
+  std::string table_value;
+  ASSERT_EQ(kTypeValue,
+            Add(&builder, "a", 1, kTypeValue, "small", &table_value));
+  ASSERT_EQ("small", table_value);
+  ASSERT_EQ(kTypeDeletion,
+            Add(&builder, "b", 2, kTypeDeletion, "", &table_value));
+  std::vector<ValueLogRef> refs;
+  ASSERT_LEVELDB_OK(builder.Finish(&refs));
+  ASSERT_TRUE(refs.empty());
+  ASSERT_EQ(0, builder.FileSize());
+  ASSERT_TRUE(!env_->FileExists(ValueLogFileName(dbname_, 7)));
+}
+
+TEST_F(ValueLogTest, LargeValuesMove) {
+  ValueLogBuilder builder(dbname_, options_, value_log_, nullptr, 7);
+  const std::string big1(100, 'x');
+  const std::string big2(5000, 'y');
+  std::string handle1, handle2, small;
+  ASSERT_EQ(kTypeValueHandle,
+            Add(&builder, "a", 3, kTypeValue, big1, &handle1));
+  ASSERT_EQ(kTypeValue, Add(&builder, "b", 2, kTypeValue, "v", &small));
+  ASSERT_EQ(kTypeValueHandle,
+            Add(&builder, "c", 1, kTypeValue, big2, &handle2));
+  ASSERT_LT(handle1.size(), 10);
+
+  std::vector<ValueLogRef> refs;
+  ASSERT_LEVELDB_OK(builder.Finish(&refs));
+  ASSERT_EQ(1, refs.size());
+  ASSERT_EQ(7, refs[0].number);
+  ASSERT_EQ(builder.FileSize(), refs[0].bytes);
+  ASSERT_EQ(builder.FileSize(), refs[0].file_size);
+  uint64_t file_size;
+  ASSERT_LEVELDB_OK(
+      env_->GetFileSize(ValueLogFileName(dbname_, 7), &file_size));
+  ASSERT_EQ(builder.FileSize(), file_size);
+
+  ASSERT_EQ(big1, Read("a", handle1));
+  ASSERT_EQ(big2, Read("c", handle2));
+  ASSERT_EQ(big2, Read("c", handle2, false));
+
+  // Handles are checked against the key that they were written for
+  ASSERT_NE(big1, Read("b", handle1));
+  ASSERT_NE(big1, Read("a", "junk"));
+
+  // Removed files cannot be read once evicted
+  ASSERT_LEVELDB_OK(env_->RemoveFile(ValueLogFileName(dbname_, 7)));
+  value_log_->Evict(7);
+  ASSERT_NE(big1, Read("a", handle1));
+}
+
+TEST_F(ValueLogTest, Checksum) {
+  ValueLogBuilder builder(dbname_, options_, value_log_, nullptr, 9);
+  const std::string big(1000, 'z');
+  std::string handle;
+  ASSERT_EQ(kTypeValueHandle, Add(&builder, "k", 1, kTypeValue, big, &handle));
+  std::vector<ValueLogRef> refs;
+  ASSERT_LEVELDB_OK(builder.Finish(&refs));
+
+  // Flip a byte of the value
+  const std::string fname = ValueLogFileName(dbname_, 9);
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, fname, &contents));
+  contents[contents.size() - 10] ^= 0x1;
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, contents, fname));
+  value_log_->Evict(9);
+
+  ASSERT_NE(big, Read("k", handle));
+  ASSERT_EQ(big.size(), Read("k", handle, false).size());
+}
+
+TEST_F(ValueLogTest, BadHandles) {
+  ValueLogBuilder builder(dbname_, options_, value_log_, nullptr, 9);
+  const std::string big(1000, 'z');
+  std::string handle;
+  ASSERT_EQ(kTypeValueHandle, Add(&builder, "k", 1, kTypeValue, big, &handle));
+  std::vector<ValueLogRef> refs;
+  ASSERT_LEVELDB_OK(builder.Finish(&refs));
+  ASSERT_EQ(big, Read("k", handle));
+
+  // Records that are too small to hold their header, or that reach past
+  // the end of the file, are rejected before they are read.
+  const uint64_t file_size = builder.FileSize();
+  const uint64_t bad[][2] = {{0, 0},
+                             {0, 3},
+                             {0, 5},
+                             {0, file_size + 1},
+                             {file_size, 6},
+                             {1, file_size},
+                             {0, ~uint64_t{0}},
+                             {~uint64_t{0}, 6}};
+  for (const uint64_t* offset_and_size : bad) {
+    ValueHandle h;
+    h.number = 9;
+    h.offset = offset_and_size[0];
+    h.size = offset_and_size[1];
+    std::string encoded;
+    h.EncodeTo(&encoded);
+    ASSERT_EQ("Corruption: bad value handle", Read("k", encoded))
+        << h.offset << " " << h.size;
+  }
+}
+
+}  // namespace leveldb
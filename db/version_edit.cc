@@ -20,7 +20,9 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  kNewRunFile = 10,
+  kNewValueLogFile = 11
 };
 
 void VersionEdit::Clear() {
@@ -75,12 +77,31 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    // Files of run 0 keep the original encoding so that databases that
+    // never use tiered compaction remain readable by older releases.
+    Tag tag = kNewFile;
+    if (!f.value_log_refs.empty()) {
+      tag = kNewValueLogFile;
+    } else if (f.run != 0) {
+      tag = kNewRunFile;
+    }
+    PutVarint32(dst, tag);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (tag != kNewFile) {
+      PutVarint64(dst, f.run);
+    }
+    if (tag == kNewValueLogFile) {
+      PutVarint32(dst, f.value_log_refs.size());
+      for (const ValueLogRef& ref : f.value_log_refs) {
+        PutVarint64(dst, ref.number);
+        PutVarint64(dst, ref.bytes);
+        PutVarint64(dst, ref.file_size);
+      }
+    }
   }
 }
 
@@ -93,6 +114,21 @@ static bool GetInternalKey(Slice* input, InternalKey* dst) {
   }
 }
 
+static bool GetValueLogRefs(Slice* input, std::vector<ValueLogRef>* refs) {
+  uint32_t n;
+  if (!GetVarint32(input, &n)) {
+    return false;
+  }
+  refs->resize(n);
+  for (ValueLogRef& ref : *refs) {
+    if (!GetVarint64(input, &ref.number) || !GetVarint64(input, &ref.bytes) ||
+        !GetVarint64(input, &ref.file_size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 static bool GetLevel(Slice* input, int* level) {
   uint32_t v;
   if (GetVarint32(input, &v) && v < config::kNumLevels) {
@@ -180,12 +216,40 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.run = 0;
+          f.value_log_refs.clear();
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
         }
         break;
 
+      case kNewRunFile:
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.run)) {
+          f.value_log_refs.clear();
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-run-file entry";
+        }
+        break;
+
+      case kNewValueLogFile:
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.run) &&
+            GetValueLogRefs(&input, &f.value_log_refs)) {
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-value-log-file entry";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -250,6 +314,18 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.run != 0) {
+      r.append(" run ");
+      AppendNumberTo(&r, f.run);
+    }
+    for (const ValueLogRef& ref : f.value_log_refs) {
+      r.append(" vlog ");
+      AppendNumberTo(&r, ref.number);
+      r.append(":");
+      AppendNumberTo(&r, ref.bytes);
+      r.append("/");
+      AppendNumberTo(&r, ref.file_size);
+    }
   }
   r.append("\n}\n");
   return r;
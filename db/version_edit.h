@@ -15,8 +15,20 @@ namespace leveldb {
 
 class VersionSet;
 
+// The records of a value log file that the entries of a table point to.
+struct ValueLogRef {
+  uint64_t number;     // Value log file number
+  uint64_t bytes;      // Bytes of the records that the table points to
+  uint64_t file_size;  // Size of the whole value log file
+};
+
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        run(0),
+        being_compacted(false) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -24,6 +36,19 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+
+  // Sorted run of the level that this file belongs to.  Files of a level
+  // that share a run do not overlap; among the runs of a level, a larger
+  // number holds newer data.  Level-0 files ignore this field and are
+  // ordered by file number instead.
+  uint64_t run;
+
+  // Value log files that the table points to, if its values of at least
+  // Options::min_separated_value_size bytes were moved out of it.
+  std::vector<ValueLogRef> value_log_refs;
+
+  // Set while a compaction in progress reads this file.  Not persisted.
+  bool being_compacted;
 };
 
 class VersionEdit {
@@ -57,16 +82,22 @@ class VersionEdit {
     compact_pointers_.push_back(std::make_pair(level, key));
   }
 
-  // Add the specified file at the specified number.
+  // Add the specified file at the specified number, as part of sorted
+  // run "run" of the level, pointing into the value log files of
+  // "value_log_refs".
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
   // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
   void AddFile(int level, uint64_t file, uint64_t file_size,
-               const InternalKey& smallest, const InternalKey& largest) {
+               const InternalKey& smallest, const InternalKey& largest,
+               uint64_t run = 0,
+               const std::vector<ValueLogRef>& value_log_refs = {}) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.run = run;
+    f.value_log_refs = value_log_refs;
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -27,6 +27,13 @@ TEST(VersionEditTest, EncodeDecode) {
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
                  InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+    edit.AddFile(5, kBig + 800 + i, kBig + 400 + i,
+                 InternalKey("bar", kBig + 500 + i, kTypeValue),
+                 InternalKey("car", kBig + 600 + i, kTypeValue), i + 1);
+    edit.AddFile(6, kBig + 1100 + i, kBig + 400 + i,
+                 InternalKey("dog", kBig + 500 + i, kTypeValueHandle),
+                 InternalKey("emu", kBig + 600 + i, kTypeValue), i,
+                 {{kBig + 1100 + i, kBig + 10, kBig + 20}, {kBig + 8, 10, 20}});
     edit.RemoveFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
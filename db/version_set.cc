@@ -12,7 +12,9 @@
 #include "db/log_writer.h"
 #include "db/memtable.h"
 #include "db/table_cache.h"
+#include "db/value_log.h"
 #include "leveldb/env.h"
+#include "leveldb/perf_context.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
@@ -21,6 +23,9 @@
 
 namespace leveldb {
 
+static_assert(PerfContext::kNumLevels == config::kNumLevels,
+              "PerfContext has a counter per level");
+
 static size_t TargetFileSize(const Options* options) {
   return options->max_file_size;
 }
@@ -219,11 +224,21 @@ static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
   }
 }
 
-Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
-                                            int level) const {
-  return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+static bool FileSeekMayMatch(void* arg, const ReadOptions& options,
+                             const Slice& file_value, const Slice& target) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 16) {
+    return true;  // Let GetFileIterator() report the corruption
+  }
+  return cache->SeekMayMatch(options, DecodeFixed64(file_value.data()),
+                             DecodeFixed64(file_value.data() + 8), target);
+}
+
+Iterator* Version::NewConcatenatingIterator(
+    const ReadOptions& options, const std::vector<FileMetaData*>* files) const {
+  return NewTwoLevelIterator(new LevelFileNumIterator(vset_->icmp_, files),
+                             &GetFileIterator, vset_->table_cache_, options,
+                             &FileSeekMayMatch);
 }
 
 void Version::AddIterators(const ReadOptions& options,
@@ -234,12 +249,12 @@ void Version::AddIterators(const ReadOptions& options,
         options, files_[0][i]->number, files_[0][i]->file_size));
   }
 
-  // For levels > 0, we can use a concatenating iterator that sequentially
-  // walks through the non-overlapping files in the level, opening them
-  // lazily.
+  // For levels > 0, we can use a concatenating iterator per sorted run
+  // that sequentially walks through the non-overlapping files in the run,
+  // opening them lazily.
   for (int level = 1; level < config::kNumLevels; level++) {
-    if (!files_[level].empty()) {
-      iters->push_back(NewConcatenatingIterator(options, level));
+    for (size_t i = 0; i < runs_[level].size(); i++) {
+      iters->push_back(NewConcatenatingIterator(options, &runs_[level][i]));
     }
   }
 }
@@ -257,6 +272,7 @@ struct Saver {
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  bool separated;  // *value is the handle of a value in a value log file
 };
 }  // namespace
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -266,9 +282,10 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      s->state = (parsed_key.type == kTypeDeletion) ? kDeleted : kFound;
       if (s->state == kFound) {
         s->value->assign(v.data(), v.size());
+        s->separated = (parsed_key.type == kTypeValueHandle);
       }
     }
   }
@@ -301,20 +318,21 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
     }
   }
 
-  // Search other levels.
+  // Search other levels, visiting the runs of a level from newest to oldest.
   for (int level = 1; level < config::kNumLevels; level++) {
-    size_t num_files = files_[level].size();
-    if (num_files == 0) continue;
-
-    // Binary search to find earliest index whose largest key >= internal_key.
-    uint32_t index = FindFile(vset_->icmp_, files_[level], internal_key);
-    if (index < num_files) {
-      FileMetaData* f = files_[level][index];
-      if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
-        // All of "f" is past any data for user_key
-      } else {
-        if (!(*func)(arg, level, f)) {
-          return;
+    for (size_t r = 0; r < runs_[level].size(); r++) {
+      const std::vector<FileMetaData*>& run = runs_[level][r];
+
+      // Binary search to find earliest index whose largest key >= internal_key.
+      uint32_t index = FindFile(vset_->icmp_, run, internal_key);
+      if (index < run.size()) {
+        FileMetaData* f = run[index];
+        if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
+          // All of "f" is past any data for user_key
+        } else {
+          if (!(*func)(arg, level, f)) {
+            return;
+          }
         }
       }
     }
@@ -351,9 +369,17 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
+      PerfContext* perf = GetPerfContext();
+      const uint64_t read_bytes = perf->block_read_bytes;
+      const uint64_t positives = perf->filter_positive_count;
       state->s = state->vset->table_cache_->Get(*state->options, f->number,
                                                 f->file_size, state->ikey,
                                                 &state->saver, SaveValue);
+      perf->get_read_bytes[level] += perf->block_read_bytes - read_bytes;
+      if (state->saver.state == kNotFound &&
+          perf->filter_positive_count > positives) {
+        perf->filter_false_positive_count++;
+      }
       if (!state->s.ok()) {
         state->found = true;
         return false;
@@ -393,15 +419,188 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
+  state.saver.separated = false;
 
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 
-  return state.found ? state.s : Status::NotFound(Slice());
+  if (!state.found) {
+    return Status::NotFound(Slice());
+  }
+  if (state.s.ok() && state.saver.separated) {
+    state.s = ReadSeparatedValue(options, k.user_key(), value);
+  }
+  return state.s;
+}
+
+Status Version::ReadSeparatedValue(const ReadOptions& options,
+                                   const Slice& user_key, std::string* value) {
+  std::string handle;
+  handle.swap(*value);
+  return vset_->value_log_->Get(options, user_key, handle, value);
+}
+
+void Version::MultiGet(const ReadOptions& options,
+                       const std::vector<const LookupKey*>& keys,
+                       const std::vector<std::string*>& values,
+                       std::vector<Status>* statuses,
+                       std::vector<GetStats>* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const size_t n = keys.size();
+
+  struct KeyState {
+    Saver saver;
+    Slice ikey;
+    FileMetaData* last_file_read;
+    int last_file_read_level;
+    bool done;
+  };
+  std::vector<KeyState> state(n);
+  statuses->assign(n, Status::NotFound(Slice()));
+  stats->resize(n);
+  for (size_t i = 0; i < n; i++) {
+    KeyState* ks = &state[i];
+    ks->saver.state = kNotFound;
+    ks->saver.ucmp = ucmp;
+    ks->saver.user_key = keys[i]->user_key();
+    ks->saver.value = values[i];
+    ks->saver.separated = false;
+    ks->ikey = keys[i]->internal_key();
+    ks->last_file_read = nullptr;
+    ks->last_file_read_level = -1;
+    ks->done = false;
+    (*stats)[i].seek_file = nullptr;
+    (*stats)[i].seek_file_level = -1;
+  }
+
+  // Searches file "f" of "level" for the keys with the given indexes and
+  // records the outcome the same way Get() does.
+  std::vector<Slice> batch_keys;
+  std::vector<void*> batch_args;
+  auto search = [&](int level, FileMetaData* f,
+                    const std::vector<size_t>& batch) {
+    batch_keys.clear();
+    batch_args.clear();
+    for (size_t i : batch) {
+      KeyState* ks = &state[i];
+      GetStats* st = &(*stats)[i];
+      if (st->seek_file == nullptr && ks->last_file_read != nullptr) {
+        // More than one seek for this key.  Charge the 1st file.
+        st->seek_file = ks->last_file_read;
+        st->seek_file_level = ks->last_file_read_level;
+      }
+      ks->last_file_read = f;
+      ks->last_file_read_level = level;
+      batch_keys.push_back(ks->ikey);
+      batch_args.push_back(&ks->saver);
+    }
+    PerfContext* perf = GetPerfContext();
+    const uint64_t read_bytes = perf->block_read_bytes;
+    const uint64_t positives = perf->filter_positive_count;
+    Status s = vset_->table_cache_->MultiGet(
+        options, f->number, f->file_size, static_cast<int>(batch.size()),
+        batch_keys.data(), batch_args.data(), SaveValue);
+    perf->get_read_bytes[level] += perf->block_read_bytes - read_bytes;
+    // Every key that the table has an entry for passed its filters
+    uint64_t true_positives = 0;
+    for (size_t i : batch) {
+      KeyState* ks = &state[i];
+      if (ks->saver.state != kNotFound) {
+        true_positives++;
+      }
+      switch (ks->saver.state) {
+        case kNotFound:
+          if (!s.ok()) {
+            (*statuses)[i] = s;
+            ks->done = true;
+          }
+          break;  // Keep searching in other files
+        case kFound:
+          (*statuses)[i] = Status::OK();
+          ks->done = true;
+          break;
+        case kDeleted:
+          ks->done = true;
+          break;
+        case kCorrupt:
+          (*statuses)[i] =
+              Status::Corruption("corrupted key for ", ks->saver.user_key);
+          ks->done = true;
+          break;
+      }
+    }
+    if (perf->filter_positive_count > positives + true_positives) {
+      perf->filter_false_positive_count +=
+          perf->filter_positive_count - positives - true_positives;
+    }
+  };
+
+  // Search level-0 in order from newest to oldest, each file for all the
+  // pending keys in its range.
+  std::vector<FileMetaData*> tmp(files_[0]);
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  std::vector<size_t> batch;
+  for (FileMetaData* f : tmp) {
+    batch.clear();
+    for (size_t i = 0; i < n; i++) {
+      if (!state[i].done &&
+          ucmp->Compare(state[i].saver.user_key, f->smallest.user_key()) >=
+              0 &&
+          ucmp->Compare(state[i].saver.user_key, f->largest.user_key()) <= 0) {
+        batch.push_back(i);
+      }
+    }
+    if (!batch.empty()) {
+      search(0, f, batch);
+    }
+  }
+
+  // Search other levels, visiting the runs of a level from newest to oldest.
+  // The keys are sorted, so the keys that fall into a file are adjacent.
+  for (int level = 1; level < config::kNumLevels; level++) {
+    for (size_t r = 0; r < runs_[level].size(); r++) {
+      const std::vector<FileMetaData*>& run = runs_[level][r];
+      FileMetaData* batch_file = nullptr;
+      batch.clear();
+      for (size_t i = 0; i < n; i++) {
+        if (state[i].done) {
+          continue;
+        }
+        uint32_t index = FindFile(vset_->icmp_, run, state[i].ikey);
+        if (index >= run.size()) {
+          break;  // This and all later keys are past the end of the run
+        }
+        FileMetaData* f = run[index];
+        if (ucmp->Compare(state[i].saver.user_key, f->smallest.user_key()) <
+            0) {
+          continue;  // All of "f" is past any data for this key
+        }
+        if (f != batch_file) {
+          if (!batch.empty()) {
+            search(level, batch_file, batch);
+            batch.clear();
+          }
+          batch_file = f;
+        }
+        batch.push_back(i);
+      }
+      if (!batch.empty()) {
+        search(level, batch_file, batch);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if ((*statuses)[i].ok() && state[i].saver.separated) {
+      (*statuses)[i] =
+          ReadSeparatedValue(options, state[i].saver.user_key, values[i]);
+    }
+  }
 }
 
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
-  if (f != nullptr) {
+  if (f != nullptr &&
+      vset_->options_->compaction_style != kTieredCompaction) {
     f->allowed_seeks--;
     if (f->allowed_seeks <= 0 && file_to_compact_ == nullptr) {
       file_to_compact_ = f;
@@ -463,13 +662,26 @@ void Version::Unref() {
 
 bool Version::OverlapInLevel(int level, const Slice* smallest_user_key,
                              const Slice* largest_user_key) {
-  return SomeFileOverlapsRange(vset_->icmp_, (level > 0), files_[level],
-                               smallest_user_key, largest_user_key);
+  if (level == 0) {
+    return SomeFileOverlapsRange(vset_->icmp_, false, files_[level],
+                                 smallest_user_key, largest_user_key);
+  }
+  for (size_t i = 0; i < runs_[level].size(); i++) {
+    if (SomeFileOverlapsRange(vset_->icmp_, true, runs_[level][i],
+                              smallest_user_key, largest_user_key)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                         const Slice& largest_user_key) {
   int level = 0;
+  if (vset_->options_->compaction_style == kTieredCompaction) {
+    // Every flush becomes a level-0 run; runs only move down as a whole.
+    return level;
+  }
   if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
     // Push to next level if there is no overlap in next level,
     // and the #bytes overlapping in the level after that are limited.
@@ -477,7 +689,9 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
     InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
     std::vector<FileMetaData*> overlaps;
     while (level < config::kMaxMemCompactLevel) {
-      if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
+      if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key) ||
+          vset_->OverlapsCompactionOutput(level + 1, smallest_user_key,
+                                          largest_user_key)) {
         break;
       }
       if (level + 2 < config::kNumLevels) {
@@ -494,6 +708,15 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
   return level;
 }
 
+uint64_t Version::NewestRun(int level) const {
+  assert(level > 0);
+  return runs_[level].empty() ? 0 : runs_[level][0][0]->run;
+}
+
+int Version::NumRuns(int level) const {
+  return level == 0 ? files_[0].size() : runs_[level].size();
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 void Version::GetOverlappingInputs(int level, const InternalKey* begin,
                                    const InternalKey* end,
@@ -509,6 +732,8 @@ void Version::GetOverlappingInputs(int level, const InternalKey* begin,
     user_end = end->user_key();
   }
   const Comparator* user_cmp = vset_->icmp_.user_comparator();
+  // Files of different runs may overlap each other just like level-0 files.
+  const bool may_overlap = (level == 0 || runs_[level].size() > 1);
   for (size_t i = 0; i < files_[level].size();) {
     FileMetaData* f = files_[level][i++];
     const Slice file_start = f->smallest.user_key();
@@ -519,7 +744,7 @@ void Version::GetOverlappingInputs(int level, const InternalKey* begin,
       // "f" is completely after specified range; skip it
     } else {
       inputs->push_back(f);
-      if (level == 0) {
+      if (may_overlap) {
         // Level-0 files may overlap each other.  So check if the newly
         // added file has expanded the range.  If so, restart search.
         if (begin != nullptr && user_cmp->Compare(file_start, user_begin) < 0) {
@@ -553,6 +778,10 @@ std::string Version::DebugString() const {
       AppendNumberTo(&r, files[i]->number);
       r.push_back(':');
       AppendNumberTo(&r, files[i]->file_size);
+      if (files[i]->run != 0) {
+        r.push_back('@');
+        AppendNumberTo(&r, files[i]->run);
+      }
       r.append("[");
       r.append(files[i]->smallest.DebugString());
       r.append(" .. ");
@@ -696,22 +925,48 @@ class VersionSet::Builder {
         MaybeAddFile(v, level, *base_iter);
       }
 
-#ifndef NDEBUG
-      // Make sure there is no overlap in levels > 0
       if (level > 0) {
-        for (uint32_t i = 1; i < v->files_[level].size(); i++) {
-          const InternalKey& prev_end = v->files_[level][i - 1]->largest;
-          const InternalKey& this_begin = v->files_[level][i]->smallest;
-          if (vset_->icmp_.Compare(prev_end, this_begin) >= 0) {
-            std::fprintf(stderr, "overlapping ranges in same level %s vs. %s\n",
-                         prev_end.DebugString().c_str(),
-                         this_begin.DebugString().c_str());
-            std::abort();
-          }
+        SplitIntoRuns(v, level);
+      }
+    }
+  }
+
+  // Group the files of v->files_[level] into v->runs_[level].
+  void SplitIntoRuns(Version* v, int level) {
+    std::vector<std::vector<FileMetaData*>>* runs = &v->runs_[level];
+    for (FileMetaData* f : v->files_[level]) {
+      // Levels rarely hold more than a handful of runs, so a linear scan
+      // is cheaper than a map here.
+      size_t r = 0;
+      while (r < runs->size() && (*runs)[r][0]->run != f->run) {
+        r++;
+      }
+      if (r == runs->size()) {
+        runs->emplace_back();
+      }
+      (*runs)[r].push_back(f);
+    }
+    std::sort(runs->begin(), runs->end(),
+              [](const std::vector<FileMetaData*>& a,
+                 const std::vector<FileMetaData*>& b) {
+                return a[0]->run > b[0]->run;
+              });
+
+#ifndef NDEBUG
+    // Make sure there is no overlap within a run
+    for (const std::vector<FileMetaData*>& run : *runs) {
+      for (uint32_t i = 1; i < run.size(); i++) {
+        const InternalKey& prev_end = run[i - 1]->largest;
+        const InternalKey& this_begin = run[i]->smallest;
+        if (vset_->icmp_.Compare(prev_end, this_begin) >= 0) {
+          std::fprintf(stderr, "overlapping ranges in same run %s vs. %s\n",
+                       prev_end.DebugString().c_str(),
+                       this_begin.DebugString().c_str());
+          std::abort();
         }
       }
-#endif
     }
+#endif
   }
 
   void MaybeAddFile(Version* v, int level, FileMetaData* f) {
@@ -719,11 +974,6 @@ class VersionSet::Builder {
       // File is deleted: do nothing
     } else {
       std::vector<FileMetaData*>* files = &v->files_[level];
-      if (level > 0 && !files->empty()) {
-        // Must not overlap
-        assert(vset_->icmp_.Compare((*files)[files->size() - 1]->largest,
-                                    f->smallest) < 0);
-      }
       f->refs++;
       files->push_back(f);
     }
@@ -731,18 +981,20 @@ class VersionSet::Builder {
 };
 
 VersionSet::VersionSet(const std::string& dbname, const Options* options,
-                       TableCache* table_cache,
+                       TableCache* table_cache, ValueLog* value_log,
                        const InternalKeyComparator* cmp)
     : env_(options->env),
       dbname_(dbname),
       options_(options),
       table_cache_(table_cache),
+      value_log_(value_log),
       icmp_(*cmp),
       next_file_number_(2),
       manifest_file_number_(0),  // Filled by Recover()
       last_sequence_(0),
       log_number_(0),
       prev_log_number_(0),
+      last_run_number_(0),
       descriptor_file_(nullptr),
       descriptor_log_(nullptr),
       dummy_versions_(this),
@@ -772,9 +1024,29 @@ void VersionSet::AppendVersion(Version* v) {
   v->next_ = &dummy_versions_;
   v->prev_->next_ = v;
   v->next_->prev_ = v;
+
+  // Let the filter policy adapt to the new shape of the tree.
+  if (options_->filter_policy != nullptr) {
+    uint64_t level_bytes[config::kNumLevels];
+    int level_runs[config::kNumLevels];
+    for (int level = 0; level < config::kNumLevels; level++) {
+      level_bytes[level] = TotalFileSize(v->files_[level]);
+      level_runs[level] = v->NumRuns(level);
+    }
+    options_->filter_policy->UpdateLevelSizes(level_bytes, level_runs,
+                                              config::kNumLevels);
+  }
 }
 
 Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
+  // Wait for the edits of earlier callers to be written and installed, so
+  // that *edit is applied on top of them.
+  port::CondVar cv(mu);
+  manifest_writers_.push_back(&cv);
+  while (manifest_writers_.front() != &cv) {
+    cv.Wait();
+  }
+
   if (edit->has_log_number_) {
     assert(edit->log_number_ >= log_number_);
     assert(edit->log_number_ < next_file_number_);
@@ -855,6 +1127,10 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     }
   }
 
+  manifest_writers_.pop_front();
+  if (!manifest_writers_.empty()) {
+    manifest_writers_.front()->Signal();
+  }
   return s;
 }
 
@@ -1033,7 +1309,8 @@ void VersionSet::Finalize(Version* v) {
   int best_level = -1;
   double best_score = -1;
 
-  for (int level = 0; level < config::kNumLevels - 1; level++) {
+  const bool tiered = (options_->compaction_style == kTieredCompaction);
+  for (int level = 0; level < config::kNumLevels; level++) {
     double score;
     if (level == 0) {
       // We treat level-0 specially by bounding the number of files
@@ -1049,13 +1326,27 @@ void VersionSet::Finalize(Version* v) {
       // overwrites/deletions).
       score = v->files_[level].size() /
               static_cast<double>(config::kL0_CompactionTrigger);
-    } else {
+    } else if (tiered) {
+      // A tiered level is full once it holds max_sorted_runs_per_level
+      // runs.  This includes the last level, whose runs are merged in place.
+      score = v->runs_[level].size() /
+              static_cast<double>(options_->max_sorted_runs_per_level);
+    } else if (v->runs_[level].size() > 1) {
+      // Left behind by tiered compaction.  Merge the runs of the level
+      // before anything else so that it becomes a single run again.
+      score = v->runs_[level].size();
+    } else if (level + 1 < config::kNumLevels) {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
       score =
           static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
+    } else {
+      // The last level of a leveled tree has nowhere to go.
+      v->level_scores_[level] = -1;
+      continue;
     }
 
+    v->level_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1064,6 +1355,46 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Estimate the bytes that compactions have to rewrite by pushing what
+  // is too much for each level into the next one.
+  uint64_t pending = 0;
+  uint64_t incoming = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const uint64_t level_bytes = TotalFileSize(v->files_[level]) + incoming;
+    uint64_t excess = 0;
+    if (level == 0 || tiered || v->runs_[level].size() > 1) {
+      // The whole level is merged once it holds too many runs
+      if (v->level_scores_[level] >= 1) {
+        excess = level_bytes;
+      }
+    } else if (level + 1 < config::kNumLevels) {
+      const double max_bytes = MaxBytesForLevel(options_, level);
+      if (level_bytes > max_bytes) {
+        excess = level_bytes - static_cast<uint64_t>(max_bytes);
+      }
+    }
+    pending += excess;
+    incoming = excess;
+  }
+  v->pending_compaction_bytes_ = pending;
+
+  // A value log file is collected once at least half of it is garbage,
+  // i.e. values that no file points to anymore.
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const FileMetaData* f : v->files_[level]) {
+      for (const ValueLogRef& ref : f->value_log_refs) {
+        Version::ValueLogUsage* usage = &v->value_logs_[ref.number];
+        usage->live_bytes += ref.bytes;
+        usage->file_size = ref.file_size;
+      }
+    }
+  }
+  for (const auto& kvp : v->value_logs_) {
+    if (kvp.second.live_bytes * 2 <= kvp.second.file_size) {
+      v->value_logs_to_collect_.insert(kvp.first);
+    }
+  }
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1087,7 +1418,8 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->run, f->value_log_refs);
     }
   }
 
@@ -1114,6 +1446,15 @@ const char* VersionSet::LevelSummary(LevelSummaryStorage* scratch) const {
   return scratch->buffer;
 }
 
+// Bytes of the values of "f" that are stored in value log files.
+static uint64_t SeparatedBytes(const FileMetaData* f) {
+  uint64_t sum = 0;
+  for (const ValueLogRef& ref : f->value_log_refs) {
+    sum += ref.bytes;
+  }
+  return sum;
+}
+
 uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
   uint64_t result = 0;
   for (int level = 0; level < config::kNumLevels; level++) {
@@ -1121,7 +1462,7 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
     for (size_t i = 0; i < files.size(); i++) {
       if (icmp_.Compare(files[i]->largest, ikey) <= 0) {
         // Entire file is before "ikey", so just add the file size
-        result += files[i]->file_size;
+        result += files[i]->file_size + SeparatedBytes(files[i]);
       } else if (icmp_.Compare(files[i]->smallest, ikey) > 0) {
         // Entire file is after "ikey", so ignore
         if (level > 0) {
@@ -1137,7 +1478,11 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         Iterator* iter = table_cache_->NewIterator(
             ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
         if (tableptr != nullptr) {
-          result += tableptr->ApproximateOffsetOf(ikey.Encode());
+          const uint64_t offset = tableptr->ApproximateOffsetOf(ikey.Encode());
+          // Assume that separated values are spread evenly over the table
+          result += offset + static_cast<uint64_t>(
+                                 static_cast<double>(SeparatedBytes(files[i])) *
+                                 offset / files[i]->file_size);
         }
         delete iter;
       }
@@ -1158,6 +1503,21 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
   }
 }
 
+void VersionSet::AddLiveValueLogs(std::set<uint64_t>* live) {
+  for (Version* v = dummy_versions_.next_; v != &dummy_versions_;
+       v = v->next_) {
+    for (const auto& kvp : v->value_logs_) {
+      live->insert(kvp.first);
+    }
+  }
+}
+
+int VersionSet::NumLevelRuns(int level) const {
+  assert(level >= 0);
+  assert(level < config::kNumLevels);
+  return current_->NumRuns(level);
+}
+
 int64_t VersionSet::NumLevelBytes(int level) const {
   assert(level >= 0);
   assert(level < config::kNumLevels);
@@ -1222,68 +1582,114 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   options.fill_cache = false;
 
   // Level-0 files have to be merged together.  For other levels,
-  // we will make a concatenating iterator per level.
+  // we will make a concatenating iterator per sorted run.
   // TODO(opt): use concatenating iterator for level-0 if there is no overlap
-  const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2);
+  const int space =
+      (c->level() == 0 ? c->inputs_[0].size() : 0) + c->input_runs_.size();
   Iterator** list = new Iterator*[space];
   int num = 0;
-  for (int which = 0; which < 2; which++) {
-    if (!c->inputs_[which].empty()) {
-      if (c->level() + which == 0) {
-        const std::vector<FileMetaData*>& files = c->inputs_[which];
-        for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
-        }
-      } else {
-        // Create concatenating iterator for the files from this level
-        list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
-      }
+  if (c->level() == 0) {
+    const std::vector<FileMetaData*>& files = c->inputs_[0];
+    for (size_t i = 0; i < files.size(); i++) {
+      list[num++] = table_cache_->NewIterator(options, files[i]->number,
+                                              files[i]->file_size);
     }
   }
-  assert(num <= space);
+  for (size_t r = 0; r < c->input_runs_.size(); r++) {
+    // Create concatenating iterator for the files from this run
+    list[num++] = NewTwoLevelIterator(
+        new Version::LevelFileNumIterator(icmp_, &c->input_runs_[r]),
+        &GetFileIterator, table_cache_, options);
+  }
+  assert(num == space);
   Iterator* result = NewMergingIterator(&icmp_, list, num);
   delete[] list;
   return result;
 }
 
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+  Compaction* c = nullptr;
 
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
+  // the compactions triggered by seeks.  Levels are tried from the highest
+  // score down, since compactions in progress may hold the inputs of the
+  // best level.
+  if (current_->compaction_score_ >= 1) {
+    int levels[config::kNumLevels];
+    int num_levels = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      if (current_->level_scores_[level] >= 1) {
+        levels[num_levels++] = level;
+      }
+    }
+    std::stable_sort(levels, levels + num_levels, [this](int a, int b) {
+      return current_->level_scores_[a] > current_->level_scores_[b];
+    });
+    for (int i = 0; i < num_levels && c == nullptr; i++) {
+      c = PickSizeCompaction(levels[i]);
+    }
+  }
+
+  FileMetaData* seek_file = current_->file_to_compact_;
+  if (c == nullptr && seek_file != nullptr && !seek_file->being_compacted) {
+    c = new Compaction(options_, current_->file_to_compact_level_);
+    c->inputs_[0].push_back(seek_file);
+    c = SetupCompaction(c);
+  }
+
+  if (c == nullptr && !current_->value_logs_to_collect_.empty()) {
+    c = PickValueLogCompaction();
+  }
+
+  return c;
+}
+
+Compaction* VersionSet::PickSizeCompaction(int level) {
+  if (options_->compaction_style == kTieredCompaction ||
+      (level > 0 && current_->runs_[level].size() > 1)) {
+    Compaction* c = MergeRuns(level);
+    if (c != nullptr && ConflictsWithRunningCompactions(c)) {
+      delete c;
+      return nullptr;
+    }
+    if (c != nullptr) {
+      RegisterCompaction(c);
+    }
+    return c;
+  }
+  assert(level + 1 < config::kNumLevels);
+
+  // Pick the first file that comes after compact_pointer_[level],
+  // wrapping around to the beginning of the key space.  Files that are
+  // already being compacted are passed over.
+  const std::vector<FileMetaData*>& files = current_->files_[level];
+  size_t start = 0;
+  if (!compact_pointer_[level].empty()) {
+    for (size_t i = 0; i < files.size(); i++) {
+      if (icmp_.Compare(files[i]->largest.Encode(), compact_pointer_[level]) >
+          0) {
+        start = i;
         break;
       }
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+  }
+  for (size_t i = 0; i < files.size(); i++) {
+    FileMetaData* f = files[(start + i) % files.size()];
+    if (f->being_compacted) {
+      continue;
+    }
+    Compaction* c = new Compaction(options_, level);
+    c->inputs_[0].push_back(f);
+    c = SetupCompaction(c);
+    if (c != nullptr) {
+      return c;
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
+  return nullptr;
+}
 
+Compaction* VersionSet::SetupCompaction(Compaction* c) {
+  const int level = c->level();
   c->input_version_ = current_;
   c->input_version_->Ref();
 
@@ -1298,11 +1704,108 @@ Compaction* VersionSet::PickCompaction() {
     assert(!c->inputs_[0].empty());
   }
 
+  const std::string compact_pointer = compact_pointer_[level];
   SetupOtherInputs(c);
-
+  if (ConflictsWithRunningCompactions(c)) {
+    // Leave the next compaction of this level where it would have started.
+    compact_pointer_[level] = compact_pointer;
+    delete c;
+    return nullptr;
+  }
+  RegisterCompaction(c);
   return c;
 }
 
+bool VersionSet::ConflictsWithRunningCompactions(const Compaction* c) {
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      if (f->being_compacted) {
+        return true;
+      }
+    }
+  }
+  if (running_compactions_.empty()) {
+    return false;
+  }
+
+  InternalKey smallest, largest;
+  GetRange2(c->inputs_[0], c->inputs_[1], &smallest, &largest);
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (const Compaction* r : running_compactions_) {
+    if (c->level_ == 0 && r->level_ == 0) {
+      return true;
+    }
+    // Two outputs that overlap in one level would need to be ordered
+    // against each other.
+    if (c->output_level_ == r->output_level_ &&
+        user_cmp->Compare(smallest.user_key(), r->largest_.user_key()) <= 0 &&
+        user_cmp->Compare(largest.user_key(), r->smallest_.user_key()) >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool VersionSet::OverlapsCompactionOutput(
+    int level, const Slice& smallest_user_key,
+    const Slice& largest_user_key) const {
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (const Compaction* r : running_compactions_) {
+    if (r->output_level_ == level &&
+        user_cmp->Compare(smallest_user_key, r->largest_.user_key()) <= 0 &&
+        user_cmp->Compare(largest_user_key, r->smallest_.user_key()) >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void VersionSet::RegisterCompaction(Compaction* c) {
+  assert(c->vset_ == nullptr);
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      assert(!f->being_compacted);
+      f->being_compacted = true;
+    }
+  }
+  GetRange2(c->inputs_[0], c->inputs_[1], &c->smallest_, &c->largest_);
+
+  // Group the inputs of levels >= 1 by sorted run for MakeInputIterator().
+  // This is done once here, since the subcompactions of "c" make their
+  // iterators concurrently.
+  c->input_runs_.clear();
+  for (int which = 0; which < 2; which++) {
+    if (c->level() + which == 0) continue;
+    // Inputs are sorted by smallest key, so every group stays sorted.
+    const size_t first_group = c->input_runs_.size();
+    for (FileMetaData* f : c->inputs_[which]) {
+      size_t r = first_group;
+      while (r < c->input_runs_.size() && c->input_runs_[r][0]->run != f->run) {
+        r++;
+      }
+      if (r == c->input_runs_.size()) {
+        c->input_runs_.emplace_back();
+      }
+      c->input_runs_[r].push_back(f);
+    }
+  }
+  running_compactions_.insert(c);
+  c->vset_ = this;
+}
+
+void VersionSet::UnregisterCompaction(Compaction* c) {
+  if (c->vset_ == nullptr) {
+    return;
+  }
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      f->being_compacted = false;
+    }
+  }
+  running_compactions_.erase(c);
+  c->vset_ = nullptr;
+}
+
 // Finds the largest key in a vector of files. Returns true if files is not
 // empty.
 bool FindLargestKey(const InternalKeyComparator& icmp,
@@ -1382,6 +1885,115 @@ void AddBoundaryInputs(const InternalKeyComparator& icmp,
   }
 }
 
+Compaction* VersionSet::MergeRuns(int level) {
+  if (current_->files_[level].empty()) {
+    return nullptr;
+  }
+
+  Compaction* c = new Compaction(options_, level);
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  c->inputs_[0] = current_->files_[level];
+  if (options_->compaction_style == kTieredCompaction) {
+    // The output is newer than every run already in the output level.
+    if (level + 1 < config::kNumLevels) {
+      c->output_level_ = level + 1;
+    } else {
+      c->output_level_ = level;
+    }
+    c->output_run_ = NewRunNumber();
+  } else {
+    // Merge a level left behind by tiered compaction back into a single
+    // run, using the plain leveled file encoding again.
+    assert(level > 0);
+    c->output_level_ = level;
+    c->output_run_ = 0;
+  }
+  SetupBaseRuns(c);
+  return c;
+}
+
+void VersionSet::SetupBaseRuns(Compaction* c) {
+  const Version* v = c->input_version_;
+  const int out = c->output_level_;
+  for (size_t r = 0; r < v->runs_[out].size(); r++) {
+    const std::vector<FileMetaData*>& run = v->runs_[out][r];
+    bool is_input = false;
+    for (int which = 0; which < 2 && !is_input; which++) {
+      for (FileMetaData* f : c->inputs_[which]) {
+        if (c->level_ + which == out && f->run == run[0]->run) {
+          is_input = true;
+          break;
+        }
+      }
+    }
+    // Files of an input run that are not part of the compaction do not
+    // overlap the compaction's key range.
+    if (!is_input) {
+      c->base_runs_.push_back(&run);
+    }
+  }
+  for (int lvl = out + 1; lvl < config::kNumLevels; lvl++) {
+    for (size_t r = 0; r < v->runs_[lvl].size(); r++) {
+      c->base_runs_.push_back(&v->runs_[lvl][r]);
+    }
+  }
+}
+
+Compaction* VersionSet::PickValueLogCompaction() {
+  // Level-0 files are left alone: they only point into the value log files
+  // of level-0 files, which are hardly ever garbage yet.
+  for (int level = 1; level < config::kNumLevels; level++) {
+    for (const std::vector<FileMetaData*>& run : current_->runs_[level]) {
+      for (FileMetaData* f : run) {
+        if (f->being_compacted) {
+          continue;
+        }
+        bool collects = false;
+        for (const ValueLogRef& ref : f->value_log_refs) {
+          if (current_->value_logs_to_collect_.count(ref.number) > 0) {
+            collects = true;
+            break;
+          }
+        }
+        if (!collects) {
+          continue;
+        }
+
+        // Rewrite the file in place.  Files of its run that share a user
+        // key with it must be rewritten as well, or IsBaseLevelForKey()
+        // would miss the older entries they hold.
+        Compaction* c = new Compaction(options_, level);
+        c->input_version_ = current_;
+        c->input_version_->Ref();
+        c->inputs_[0].push_back(f);
+        AddBoundaryInputs(icmp_, run, &c->inputs_[0]);
+        c->output_level_ = level;
+        c->output_run_ = f->run;
+        SetupBaseRuns(c);
+        if (ConflictsWithRunningCompactions(c)) {
+          delete c;
+          continue;
+        }
+        RegisterCompaction(c);
+        return c;
+      }
+    }
+  }
+  return nullptr;
+}
+
+uint64_t VersionSet::NewRunNumber() {
+  uint64_t max_run = last_run_number_;
+  for (int level = 1; level < config::kNumLevels; level++) {
+    for (size_t r = 0; r < current_->runs_[level].size(); r++) {
+      max_run = std::max(max_run, current_->runs_[level][r][0]->run);
+    }
+  }
+  last_run_number_ = max_run + 1;
+  return last_run_number_;
+}
+
 void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
@@ -1437,6 +2049,17 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
                                    &c->grandparents_);
   }
 
+  // Join the single run of "level+1".  If "level+1" still holds several
+  // runs, the inputs picked there cover every file overlapping the
+  // compaction, so the output may as well start a run of its own.
+  c->output_level_ = level + 1;
+  if (current_->runs_[level + 1].size() > 1) {
+    c->output_run_ = NewRunNumber();
+  } else {
+    c->output_run_ = current_->NewestRun(level + 1);
+  }
+  SetupBaseRuns(c);
+
   // Update the place where we will do the next compaction for this level.
   // We update this immediately instead of waiting for the VersionEdit
   // to be applied so that if the compaction fails, we will try a different
@@ -1447,6 +2070,20 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
 
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
                                      const InternalKey* end) {
+  if (options_->compaction_style == kTieredCompaction ||
+      (level > 0 && current_->runs_[level].size() > 1)) {
+    // Runs are only ever merged as a whole.
+    std::vector<FileMetaData*> inputs;
+    current_->GetOverlappingInputs(level, begin, end, &inputs);
+    if (inputs.empty()) {
+      return nullptr;
+    }
+    Compaction* c = MergeRuns(level);
+    assert(c != nullptr && !ConflictsWithRunningCompactions(c));
+    RegisterCompaction(c);
+    return c;
+  }
+
   std::vector<FileMetaData*> inputs;
   current_->GetOverlappingInputs(level, begin, end, &inputs);
   if (inputs.empty()) {
@@ -1475,26 +2112,20 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
+  assert(!ConflictsWithRunningCompactions(c));
+  RegisterCompaction(c);
   return c;
 }
 
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
+      output_level_(level + 1),
+      output_run_(0),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
-  for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
-  }
-}
+      vset_(nullptr) {}
 
-Compaction::~Compaction() {
-  if (input_version_ != nullptr) {
-    input_version_->Unref();
-  }
-}
+Compaction::~Compaction() { ReleaseInputs(); }
 
 bool Compaction::IsTrivialMove() const {
   const VersionSet* vset = input_version_->vset_;
@@ -1502,6 +2133,7 @@ bool Compaction::IsTrivialMove() const {
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
   return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
+          output_level_ != level_ &&
           TotalFileSize(grandparents_) <=
               MaxGrandParentOverlapBytes(vset->options_));
 }
@@ -1514,13 +2146,15 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
-    const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    while (level_ptrs_[lvl] < files.size()) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+  std::vector<size_t>& base_run_ptrs = cursor->base_run_ptrs;
+  for (size_t r = 0; r < base_runs_.size(); r++) {
+    const std::vector<FileMetaData*>& files = *base_runs_[r];
+    while (base_run_ptrs[r] < files.size()) {
+      FileMetaData* f = files[base_run_ptrs[r]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1529,37 +2163,51 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      base_run_ptrs[r]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
-         icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
-             0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+  while (cursor->grandparent_index < grandparents_.size() &&
+         icmp->Compare(
+             internal_key,
+             grandparents_[cursor->grandparent_index]->largest.Encode()) > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+bool Compaction::CollectsValueLog(uint64_t number) const {
+  return input_version_->value_logs_to_collect_.count(number) > 0;
+}
+
+uint64_t Compaction::ValueLogFileSize(uint64_t number) const {
+  auto it = input_version_->value_logs_.find(number);
+  return it == input_version_->value_logs_.end() ? 0 : it->second.file_size;
+}
+
 void Compaction::ReleaseInputs() {
+  if (vset_ != nullptr) {
+    vset_->UnregisterCompaction(this);
+  }
   if (input_version_ != nullptr) {
     input_version_->Unref();
     input_version_ = nullptr;
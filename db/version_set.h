@@ -15,6 +15,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <deque>
 #include <map>
 #include <set>
 #include <vector>
@@ -35,6 +36,7 @@ class Iterator;
 class MemTable;
 class TableBuilder;
 class TableCache;
+class ValueLog;
 class Version;
 class VersionSet;
 class WritableFile;
@@ -75,6 +77,15 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // Like Get() for every key of "keys", which must be sorted by user key
+  // and share a sequence number.  Stores the result of keys[i] in
+  // *values[i] and (*statuses)[i], and fills (*stats)[i].  Each file is
+  // searched once for all the keys that may be in it.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const std::vector<const LookupKey*>& keys,
+                const std::vector<std::string*>& values,
+                std::vector<Status>* statuses, std::vector<GetStats>* stats);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -109,8 +120,17 @@ class Version {
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                  const Slice& largest_user_key);
 
+  // Return the run that a file placed at "level" without overlapping any
+  // of the level's files should join: the newest run of the level, or
+  // zero if the level is empty.
+  uint64_t NewestRun(int level) const;
+
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // Return the number of sorted runs at "level".  Every level-0 file is a
+  // run of its own.
+  int NumRuns(int level) const;
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
@@ -120,6 +140,12 @@ class Version {
 
   class LevelFileNumIterator;
 
+  // Live bytes and size of a value log file.
+  struct ValueLogUsage {
+    uint64_t live_bytes;
+    uint64_t file_size;
+  };
+
   explicit Version(VersionSet* vset)
       : vset_(vset),
         next_(this),
@@ -128,14 +154,20 @@ class Version {
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        pending_compaction_bytes_(0) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      level_scores_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
 
   ~Version();
 
-  Iterator* NewConcatenatingIterator(const ReadOptions&, int level) const;
+  Iterator* NewConcatenatingIterator(
+      const ReadOptions&, const std::vector<FileMetaData*>* files) const;
 
   // Call func(arg, level, f) for every file that overlaps user_key in
   // order from newest to oldest.  If an invocation of func returns
@@ -145,6 +177,11 @@ class Version {
   void ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
                           bool (*func)(void*, int, FileMetaData*));
 
+  // Replaces *value, the handle of a value of user_key in a value log
+  // file, by the value itself.
+  Status ReadSeparatedValue(const ReadOptions& options, const Slice& user_key,
+                            std::string* value);
+
   VersionSet* vset_;  // VersionSet to which this Version belongs
   Version* next_;     // Next version in linked list
   Version* prev_;     // Previous version in linked list
@@ -153,6 +190,11 @@ class Version {
   // List of files per level
   std::vector<FileMetaData*> files_[config::kNumLevels];
 
+  // The files of every level >= 1 split into their sorted runs, newest run
+  // first.  Each run is a sorted list of disjoint files.  Under leveled
+  // compaction every non-empty level has exactly one run.
+  std::vector<std::vector<FileMetaData*>> runs_[config::kNumLevels];
+
   // Next file to compact based on seek stats.
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
@@ -162,12 +204,29 @@ class Version {
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level, or -1 for a level that is never
+  // compacted because of its size.  PickCompaction() falls back to the
+  // next best level when the inputs of a better one are busy.
+  double level_scores_[config::kNumLevels];
+
+  // Estimated number of bytes that compactions have to rewrite until no
+  // level needs one.  Initialized by Finalize().
+  uint64_t pending_compaction_bytes_;
+
+  // Every value log file that the files of this version point to, and
+  // those of them whose live values compactions move to new value log
+  // files, because most of their bytes are garbage.  These fields are
+  // initialized by Finalize().
+  std::map<uint64_t, ValueLogUsage> value_logs_;
+  std::set<uint64_t> value_logs_to_collect_;
 };
 
 class VersionSet {
  public:
   VersionSet(const std::string& dbname, const Options* options,
-             TableCache* table_cache, const InternalKeyComparator*);
+             TableCache* table_cache, ValueLog* value_log,
+             const InternalKeyComparator*);
   VersionSet(const VersionSet&) = delete;
   VersionSet& operator=(const VersionSet&) = delete;
 
@@ -177,7 +236,7 @@ class VersionSet {
   // is both saved to persistent state and installed as the new
   // current version.  Will release *mu while actually writing to the file.
   // REQUIRES: *mu is held on entry.
-  // REQUIRES: no other thread concurrently calls LogAndApply()
+  // Concurrent calls are applied one at a time, in the order they were made.
   Status LogAndApply(VersionEdit* edit, port::Mutex* mu)
       EXCLUSIVE_LOCKS_REQUIRED(mu);
 
@@ -205,9 +264,18 @@ class VersionSet {
   // Return the number of Table files at the specified level.
   int NumLevelFiles(int level) const;
 
+  // Return the number of sorted runs at the specified level.
+  int NumLevelRuns(int level) const;
+
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
+  // Return the estimated number of bytes that compactions have to rewrite
+  // until no level needs one.
+  uint64_t PendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
 
@@ -228,36 +296,53 @@ class VersionSet {
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
   // Pick level and inputs for a new compaction.
-  // Returns nullptr if there is no compaction to be done.
+  // Returns nullptr if there is no compaction to be done, or if every
+  // candidate conflicts with a compaction in progress.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
+  // The compaction counts as in progress until its inputs are released.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
   // the result.
+  // REQUIRES: no compaction is in progress.
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
 
+  // Return the number of compactions in progress.
+  int NumRunningCompactions() const { return running_compactions_.size(); }
+
+  // Returns true iff a compaction in progress writes to "level" somewhere
+  // in [smallest_user_key,largest_user_key].
+  bool OverlapsCompactionOutput(int level, const Slice& smallest_user_key,
+                                const Slice& largest_user_key) const;
+
   // Return the maximum overlapping data (in bytes) at next level for any
   // file at a level >= 1.
   int64_t MaxNextLevelOverlappingBytes();
 
   // Create an iterator that reads over the compaction inputs for "*c".
   // The caller should delete the iterator when no longer needed.
+  // REQUIRES: "*c" has been registered (see RegisterCompaction()).
   Iterator* MakeInputIterator(Compaction* c);
 
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
+    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr) ||
+           !v->value_logs_to_collect_.empty();
   }
 
   // Add all files listed in any live version to *live.
   // May also mutate some internal state.
   void AddLiveFiles(std::set<uint64_t>* live);
 
+  // Add all value log files that some file of a live version points to
+  // to *live.
+  void AddLiveValueLogs(std::set<uint64_t>* live);
+
   // Return the approximate offset in the database of the data for
   // "key" as of version "v".
   uint64_t ApproximateOffsetOf(Version* v, const InternalKey& key);
@@ -288,6 +373,43 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Return a compaction of "level" that starts with the first file after
+  // compact_pointer_[level] that can be compacted now, or nullptr.
+  Compaction* PickSizeCompaction(int level);
+
+  // Complete the inputs of "c", which holds the file picked in its level,
+  // and register it.  Deletes "c" and returns nullptr if it conflicts
+  // with a compaction in progress.
+  Compaction* SetupCompaction(Compaction* c);
+
+  // Returns true iff "c" cannot run alongside the compactions in progress:
+  // it shares an input file with one of them, both take files from
+  // level-0, or both write overlapping key ranges of the same level.
+  bool ConflictsWithRunningCompactions(const Compaction* c);
+
+  // Mark the inputs of "c" as being compacted, or clear the marks again.
+  // Unregistering a compaction that was never registered does nothing.
+  void RegisterCompaction(Compaction* c);
+  void UnregisterCompaction(Compaction* c);
+
+  // Return a compaction that merges every run of "level" into a single
+  // new run.  Under tiered compaction the run is placed in the next level
+  // (or stays in place for the last level); a multi-run level under
+  // leveled compaction is always merged in place.
+  Compaction* MergeRuns(int level);
+
+  // Record in "*c" the runs that IsBaseLevelForKey() must consult.
+  void SetupBaseRuns(Compaction* c);
+
+  // Return a compaction that rewrites in place a file of a level >= 1 that
+  // points into a value log file which is being collected, or nullptr.
+  Compaction* PickValueLogCompaction();
+
+  // Return a run number that is larger than the number of every existing
+  // run and every run number handed out before, for a run that must be
+  // ordered as newer than its whole level.
+  uint64_t NewRunNumber();
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -297,12 +419,14 @@ class VersionSet {
   const std::string dbname_;
   const Options* const options_;
   TableCache* const table_cache_;
+  ValueLog* const value_log_;
   const InternalKeyComparator icmp_;
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
   uint64_t last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
+  uint64_t last_run_number_;  // Largest run number handed out so far
 
   // Opened lazily
   WritableFile* descriptor_file_;
@@ -313,6 +437,13 @@ class VersionSet {
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
+
+  // Compactions picked but not yet released.
+  std::set<Compaction*> running_compactions_;
+
+  // Callers of LogAndApply() waiting for their turn; the front one is
+  // writing to the MANIFEST.
+  std::deque<port::CondVar*> manifest_writers_;
 };
 
 // A Compaction encapsulates information about a compaction.
@@ -321,9 +452,17 @@ class Compaction {
   ~Compaction();
 
   // Return the level that is being compacted.  Inputs from "level"
-  // and "level+1" will be merged to produce a set of "level+1" files.
+  // and "level+1" will be merged to produce a set of "output_level()" files.
   int level() const { return level_; }
 
+  // Return the level that receives the compaction output.  This is
+  // "level+1", except when all runs of the last level (or of a multi-run
+  // level under leveled compaction) are merged in place.
+  int output_level() const { return output_level_; }
+
+  // Return the sorted run of "output_level()" that the output joins.
+  uint64_t output_run() const { return output_run_; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
@@ -344,17 +483,45 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Position of one pass over the keys of the compaction.  The keys of
+  // a pass are visited in increasing order, so the position only moves
+  // forward.  A compaction split into subcompactions makes one pass per
+  // subcompaction, each with a Cursor of its own.
+  struct Cursor {
+    explicit Cursor(const Compaction* c)
+        : grandparent_index(0),
+          seen_key(false),
+          overlapped_bytes(0),
+          base_run_ptrs(c->base_runs_.size(), 0) {}
+
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // base_run_ptrs[i] is our position in base_runs_[i].
+    std::vector<size_t> base_run_ptrs;
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
+
+  // Returns true iff the output of this compaction takes the values out
+  // of value log file "number", instead of pointing into it.
+  bool CollectsValueLog(uint64_t number) const;
+
+  // Return the size of value log file "number", which input files of this
+  // compaction point into.
+  uint64_t ValueLogFileSize(uint64_t number) const;
 
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful.  The inputs may be picked by other compactions again.
   void ReleaseInputs();
 
  private:
@@ -364,28 +531,35 @@ class Compaction {
   Compaction(const Options* options, int level);
 
   int level_;
+  int output_level_;
+  uint64_t output_run_;
   uint64_t max_output_file_size_;
   Version* input_version_;
+  VersionSet* vset_;  // Non-null while registered as in progress
   VersionEdit edit_;
 
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
+  // Key range covered by inputs_, set by VersionSet::RegisterCompaction().
+  InternalKey smallest_;
+  InternalKey largest_;
+
+  // Inputs of levels >= 1 grouped by sorted run, set by
+  // VersionSet::RegisterCompaction() and read by MakeInputIterator().
+  std::vector<std::vector<FileMetaData*>> input_runs_;
+
   // State used to check for number of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
 
   // State for implementing IsBaseLevelForKey
 
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
+  // base_runs_ holds every run of input_version_ that may contain older
+  // data for a key being compacted: all runs of the levels below the
+  // output level, plus the runs of the output level that take no part
+  // in this compaction.
+  std::vector<const std::vector<FileMetaData*>*> base_runs_;
 };
 
 }  // namespace leveldb
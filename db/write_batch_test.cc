@@ -37,6 +37,9 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeValueHandle:
+        ADD_FAILURE() << "value handle in a write batch";
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
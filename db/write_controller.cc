@@ -0,0 +1,133 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+#include "db/dbformat.h"
+
+namespace leveldb {
+
+// The bucket holds at most this many microseconds worth of writes, so
+// that writes cannot save up for a long burst while they are delayed.
+static const uint64_t kMaxBurstMicros = 1000;
+
+// A single write never waits longer than this.  Any debt that is left is
+// paid by the writes that follow.
+static const uint64_t kMaxDelayMicros = 100000;
+
+const uint64_t WriteController::kMinDelayedWriteRate;
+
+WriteController::WriteController(const Options& options)
+    : max_rate_(std::max(options.delayed_write_rate, kMinDelayedWriteRate)),
+      pending_compaction_bytes_limit_(
+          options.soft_pending_compaction_bytes_limit),
+      rate_(0),
+      cause_(kL0Slowdown),
+      credit_(0),
+      last_refill_micros_(0) {
+  for (int i = 0; i < kNumStallCauses; i++) {
+    stall_count_[i] = 0;
+    stall_micros_[i] = 0;
+  }
+}
+
+void WriteController::Update(int level0_files,
+                             uint64_t pending_compaction_bytes) {
+  // Fraction of max_rate_ that writes are held to, or 1 if writes are not
+  // delayed.
+  double fraction = 1;
+  if (level0_files >= config::kL0_SlowdownWritesTrigger) {
+    // The full rate at the slowdown trigger, going down linearly to the
+    // minimum at the stop trigger.
+    fraction = static_cast<double>(config::kL0_StopWritesTrigger -
+                                   level0_files) /
+               (config::kL0_StopWritesTrigger -
+                config::kL0_SlowdownWritesTrigger);
+    cause_ = kL0Slowdown;
+  }
+  const bool over_limit = pending_compaction_bytes_limit_ > 0 &&
+                          pending_compaction_bytes >=
+                              pending_compaction_bytes_limit_;
+  if (over_limit) {
+    const double f = static_cast<double>(pending_compaction_bytes_limit_) /
+                     pending_compaction_bytes;
+    if (level0_files < config::kL0_SlowdownWritesTrigger || f < fraction) {
+      fraction = f;
+      cause_ = kPendingCompaction;
+    }
+  }
+
+  if (level0_files < config::kL0_SlowdownWritesTrigger && !over_limit) {
+    rate_ = 0;
+    credit_ = 0;
+    last_refill_micros_ = 0;
+  } else {
+    rate_ = std::max(static_cast<uint64_t>(max_rate_ * std::max(fraction, 0.0)),
+                     kMinDelayedWriteRate);
+  }
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros) {
+  if (rate_ == 0) {
+    return 0;
+  }
+  if (last_refill_micros_ == 0) {
+    last_refill_micros_ = now_micros;
+  }
+  if (now_micros > last_refill_micros_) {
+    credit_ += static_cast<double>(now_micros - last_refill_micros_) * rate_ /
+               1000000;
+    credit_ = std::min(credit_,
+                       static_cast<double>(rate_) * kMaxBurstMicros / 1000000);
+    last_refill_micros_ = now_micros;
+  }
+  if (credit_ >= 0) {
+    return 0;
+  }
+  const double delay = -credit_ * 1000000 / rate_;
+  return std::min(static_cast<uint64_t>(delay) + 1, kMaxDelayMicros);
+}
+
+void WriteController::Charge(uint64_t bytes) {
+  if (rate_ > 0) {
+    credit_ -= static_cast<double>(bytes);
+  }
+}
+
+void WriteController::RecordStall(StallCause cause, uint64_t micros) {
+  stall_count_[cause]++;
+  stall_micros_[cause] += micros;
+}
+
+std::string WriteController::StallsToString() const {
+  static const char* const kNames[kNumStallCauses] = {
+      "memtable-full", "level0-slowdown", "level0-stop",
+      "pending-compaction"};
+  std::string result;
+  char buf[200];
+  std::snprintf(buf, sizeof(buf),
+                "                    Write stalls\n"
+                "Cause                   Count Time(sec)\n"
+                "---------------------------------------\n");
+  result.append(buf);
+  for (int i = 0; i < kNumStallCauses; i++) {
+    std::snprintf(buf, sizeof(buf), "%-18s %10" PRIu64 " %9.3f\n", kNames[i],
+                  stall_count_[i], stall_micros_[i] / 1e6);
+    result.append(buf);
+  }
+  if (rate_ > 0) {
+    std::snprintf(buf, sizeof(buf), "Delayed write rate: %.3f MB/s (%s)\n",
+                  rate_ / 1048576.0, kNames[cause_]);
+  } else {
+    std::snprintf(buf, sizeof(buf), "Delayed write rate: none\n");
+  }
+  result.append(buf);
+  return result;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,86 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+// Decides how long writes are delayed while compactions fall behind, and
+// keeps track of how long writes stalled for each cause.  Writes are held
+// to a delayed write rate with a token bucket: every write group is
+// charged its bytes, and the next write waits until the bucket has been
+// refilled at the delayed write rate.
+//
+// Not thread-safe; DBImpl only uses it while holding its mutex.
+class WriteController {
+ public:
+  enum StallCause {
+    kMemTableFull,       // Waiting for the immutable memtable to be flushed
+    kL0Slowdown,         // Delayed because of the number of level-0 files
+    kL0Stop,             // Waiting for level-0 compactions
+    kPendingCompaction,  // Delayed because of the pending compaction bytes
+    kNumStallCauses
+  };
+
+  // Writes are never held to less than this many bytes per second.
+  static const uint64_t kMinDelayedWriteRate = 16 * 1024;
+
+  explicit WriteController(const Options& options);
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // Recompute the delayed write rate from the number of level-0 files and
+  // the estimated bytes of pending compactions.
+  void Update(int level0_files, uint64_t pending_compaction_bytes);
+
+  // Return true if writes are delayed.
+  bool delayed() const { return rate_ > 0; }
+
+  // Return the delayed write rate in bytes per second, or 0 if writes are
+  // not delayed.
+  uint64_t delayed_write_rate() const { return rate_; }
+
+  // Return the cause of the delay.  REQUIRES: delayed()
+  StallCause delay_cause() const { return cause_; }
+
+  // Return the number of microseconds that a write has to wait at
+  // "now_micros" for the bytes charged so far to fit the delayed write
+  // rate.
+  uint64_t GetDelay(uint64_t now_micros);
+
+  // Charge "bytes" of writes to the token bucket.
+  void Charge(uint64_t bytes);
+
+  // Record that writes stalled for "micros" because of "cause".
+  void RecordStall(StallCause cause, uint64_t micros);
+
+  // Return a multi-line summary of the stalls of each cause.
+  std::string StallsToString() const;
+
+ private:
+  const uint64_t max_rate_;
+  const uint64_t pending_compaction_bytes_limit_;
+
+  uint64_t rate_;  // 0 if writes are not delayed
+  StallCause cause_;
+
+  // Bytes that may be written without delay, or minus the bytes that
+  // the next write has to wait for.
+  double credit_;
+  uint64_t last_refill_micros_;  // 0 if the bucket has not been used yet
+
+  uint64_t stall_count_[kNumStallCauses];
+  uint64_t stall_micros_[kNumStallCauses];
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
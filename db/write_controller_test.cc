@@ -0,0 +1,121 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "gtest/gtest.h"
+#include "db/dbformat.h"
+
+namespace leveldb {
+
+static const uint64_t kMB = 1024 * 1024;
+
+static Options TestOptions() {
+  Options options;
+  options.delayed_write_rate = kMB;
+  options.soft_pending_compaction_bytes_limit = 100 * kMB;
+  return options;
+}
+
+TEST(WriteControllerTest, NotDelayed) {
+  WriteController controller(TestOptions());
+  controller.Update(config::kL0_SlowdownWritesTrigger - 1, 99 * kMB);
+  ASSERT_TRUE(!controller.delayed());
+  controller.Charge(10 * kMB);
+  ASSERT_EQ(0, controller.GetDelay(1000));
+}
+
+TEST(WriteControllerTest, Level0Files) {
+  WriteController controller(TestOptions());
+  controller.Update(config::kL0_SlowdownWritesTrigger, 0);
+  ASSERT_TRUE(controller.delayed());
+  ASSERT_EQ(WriteController::kL0Slowdown, controller.delay_cause());
+  ASSERT_EQ(kMB, controller.delayed_write_rate());
+
+  // Every further file lowers the rate
+  uint64_t rate = controller.delayed_write_rate();
+  for (int files = config::kL0_SlowdownWritesTrigger + 1;
+       files <= config::kL0_StopWritesTrigger; files++) {
+    controller.Update(files, 0);
+    ASSERT_LT(controller.delayed_write_rate(), rate);
+    rate = controller.delayed_write_rate();
+    ASSERT_GE(rate, WriteController::kMinDelayedWriteRate);
+  }
+  ASSERT_EQ(WriteController::kMinDelayedWriteRate, rate);
+}
+
+TEST(WriteControllerTest, PendingCompactionBytes) {
+  WriteController controller(TestOptions());
+  controller.Update(0, 100 * kMB);
+  ASSERT_TRUE(controller.delayed());
+  ASSERT_EQ(WriteController::kPendingCompaction, controller.delay_cause());
+  ASSERT_EQ(kMB, controller.delayed_write_rate());
+  controller.Update(0, 400 * kMB);
+  ASSERT_EQ(kMB / 4, controller.delayed_write_rate());
+
+  // The slower of the two causes wins
+  controller.Update(config::kL0_StopWritesTrigger - 1, 200 * kMB);
+  ASSERT_EQ(WriteController::kL0Slowdown, controller.delay_cause());
+  controller.Update(config::kL0_SlowdownWritesTrigger, 200 * kMB);
+  ASSERT_EQ(WriteController::kPendingCompaction, controller.delay_cause());
+  ASSERT_EQ(kMB / 2, controller.delayed_write_rate());
+
+  Options options = TestOptions();
+  options.soft_pending_compaction_bytes_limit = 0;
+  WriteController unlimited(options);
+  unlimited.Update(0, 1000 * kMB);
+  ASSERT_TRUE(!unlimited.delayed());
+}
+
+TEST(WriteControllerTest, TokenBucket) {
+  WriteController controller(TestOptions());
+  controller.Update(config::kL0_SlowdownWritesTrigger, 0);
+  uint64_t now = 1000000;
+  ASSERT_EQ(0, controller.GetDelay(now));
+
+  // Writes wait for the bytes charged before them
+  controller.Charge(kMB / 20);
+  uint64_t delay = controller.GetDelay(now);
+  ASSERT_GE(delay, 50000);
+  ASSERT_LE(delay, 50001);
+  now += 25000;
+  delay = controller.GetDelay(now);
+  ASSERT_GE(delay, 25000);
+  ASSERT_LE(delay, 25001);
+  now += 25000;
+  ASSERT_EQ(0, controller.GetDelay(now));
+
+  // Idle time only saves up for a short burst
+  now += 10000000;
+  ASSERT_EQ(0, controller.GetDelay(now));
+  controller.Charge(kMB / 10);
+  ASSERT_GT(controller.GetDelay(now), 90000);
+
+  // A single write waits for at most 100ms
+  controller.Charge(10 * kMB);
+  ASSERT_EQ(100000, controller.GetDelay(now));
+
+  // The debt is forgotten once writes are no longer delayed
+  controller.Update(0, 0);
+  ASSERT_EQ(0, controller.GetDelay(now));
+  controller.Update(config::kL0_SlowdownWritesTrigger, 0);
+  ASSERT_EQ(0, controller.GetDelay(now));
+}
+
+TEST(WriteControllerTest, Stalls) {
+  WriteController controller(TestOptions());
+  controller.RecordStall(WriteController::kMemTableFull, 1500000);
+  controller.RecordStall(WriteController::kL0Stop, 250000);
+  controller.RecordStall(WriteController::kL0Stop, 250000);
+  const std::string stalls = controller.StallsToString();
+  ASSERT_NE(std::string::npos,
+            stalls.find("memtable-full               1     1.500"))
+      << stalls;
+  ASSERT_NE(std::string::npos,
+            stalls.find("level0-stop                 2     0.500"))
+      << stalls;
+  ASSERT_NE(std::string::npos, stalls.find("Delayed write rate: none"));
+}
+
+}  // namespace leveldb
@@ -14,6 +14,11 @@ static void add_db_stats(leveldb::DB* db, BenchTime& bench_time) {
   leveldb::Options options;
   string stats;
   db->GetProperty("leveldb.stats", &stats);
+  // Latencies measured inside the DB, if it keeps statistics
+  string statistics;
+  if (db->GetProperty("leveldb.statistics", &statistics)) {
+    stats += "\n" + statistics;
+  }
   bench_time.add_db_stats(stats);
 }
 
@@ -27,6 +27,7 @@ int main() {
   leveldb::DB* db;
   leveldb::Options options;
   options.create_if_missing = true;
+  options.statistics = true;
   leveldb::WriteOptions write_options;
   // write_options.sync = true;
   leveldb::ReadOptions read_options;
@@ -27,6 +27,8 @@ int main() {
   leveldb::DB* db;
   leveldb::Options options;
   options.create_if_missing = true;
+  options.compaction_style = leveldb::kTieredCompaction;
+  options.statistics = true;
   leveldb::WriteOptions write_options;
   // write_options.sync = true;
   leveldb::ReadOptions read_options;
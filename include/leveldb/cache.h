@@ -31,6 +31,19 @@ class LEVELDB_EXPORT Cache;
 // of Cache uses a least-recently-used eviction policy.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but splits the capacity evenly across
+// 2^num_shard_bits shards (16 by default), each guarded by a mutex of its
+// own.  More shards mean less lock contention between threads, at the
+// cost of a coarser eviction order.  Negative values pick the default.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, int num_shard_bits);
+
+// Create a new cache with a fixed size capacity that approximates LRU with
+// a CLOCK eviction policy.  Lookups only take a shard's lock shared, and
+// releasing a handle takes no lock, so concurrent readers of the same
+// shard do not serialize.  The sharding is as for NewLRUCache().
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity);
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, int num_shard_bits);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -7,6 +7,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -87,6 +89,17 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Look up every key of "keys" as Get() would, as of a single implicit
+  // (or the supplied) snapshot.  On return, (*values)[i] and (*statuses)[i]
+  // hold the outcome for keys[i]; (*values)[i] is empty unless
+  // (*statuses)[i] is OK.  Cheaper than the same number of Get() calls:
+  // each table is searched once for all of its keys, and each data block
+  // is read once for all the keys that fall into it.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -115,12 +128,20 @@ class LEVELDB_EXPORT DB {
   //
   //  "leveldb.num-files-at-level<N>" - return the number of files at level <N>,
   //     where <N> is an ASCII representation of a level number (e.g. "0").
+  //  "leveldb.num-runs-at-level<N>" - return the number of sorted runs at
+  //     level <N>.  Every level-0 file counts as a run.
   //  "leveldb.stats" - returns a multi-line string that describes statistics
   //     about the internal operation of the DB.
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.write-stalls" - returns a multi-line string with the number
+  //     and duration of the stalls of writes for each cause, and the rate
+  //     that writes are currently delayed to.
+  //  "leveldb.statistics" - returns a multi-line string with the latencies
+  //     of the operations of the DB and their PerfContext counters, if
+  //     Options::statistics is set.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -197,6 +197,23 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Background work is run by one pool of threads per priority.  Work
+  // scheduled with kHighPriority never waits behind work scheduled with
+  // kLowPriority.  Schedule() uses kLowPriority.
+  enum Priority { kLowPriority = 0, kHighPriority = 1 };
+
+  // Like Schedule(), but runs "(*function)(arg)" in the pool for "pri".
+  //
+  // The default implementation ignores "pri" and calls Schedule().
+  virtual void ScheduleWithPriority(void (*function)(void* arg), void* arg,
+                                    Priority pri);
+
+  // Make sure the pool for "pri" has at least "number" threads.  Pools
+  // never shrink.
+  //
+  // The default implementation does nothing.
+  virtual void IncBackgroundThreadsIfNeeded(int number, Priority pri);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -269,6 +286,26 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // One read of a MultiRead() batch.
+  struct ReadRequest {
+    uint64_t offset;  // Input: as for Read()
+    size_t n;         // Input: as for Read()
+    char* scratch;    // Input: as for Read()
+    Slice result;     // Output: as for Read()
+    Status status;    // Output: the status Read() would return
+  };
+
+  // Perform every read of reqs[0..n-1] as Read() would, and store each
+  // outcome in its request.  Implementations may have all of the reads in
+  // flight at once, which keeps fast devices busier than one read at a
+  // time.  Returns a non-OK status only if the reads could not be
+  // attempted at all.
+  //
+  // The default implementation calls Read() for each request in turn.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status MultiRead(ReadRequest* reqs, size_t n) const;
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -384,6 +421,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void ScheduleWithPriority(void (*f)(void*), void* a, Priority pri) override {
+    return target_->ScheduleWithPriority(f, a, pri);
+  }
+  void IncBackgroundThreadsIfNeeded(int number, Priority pri) override {
+    return target_->IncBackgroundThreadsIfNeeded(number, pri);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
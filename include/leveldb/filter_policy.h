@@ -16,6 +16,7 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
 #define STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
 
+#include <cstdint>
 #include <string>
 
 #include "leveldb/export.h"
@@ -43,6 +44,19 @@ class LEVELDB_EXPORT FilterPolicy {
   virtual void CreateFilter(const Slice* keys, int n,
                             std::string* dst) const = 0;
 
+  // Like CreateFilter(), for a table that is being written to "level"
+  // of the database, or -1 if the level is not known.  The default
+  // implementation ignores the level and calls CreateFilter().
+  virtual void CreateFilterForLevel(const Slice* keys, int n, int level,
+                                    std::string* dst) const;
+
+  // Called by the database whenever the shape of its tree changes.
+  // level_bytes[i] and level_runs[i] hold the total file size and the
+  // number of sorted runs of level i.  May be called concurrently with
+  // CreateFilterForLevel().  The default implementation does nothing.
+  virtual void UpdateLevelSizes(const uint64_t* level_bytes,
+                                const int* level_runs, int num_levels) const;
+
   // "filter" contains the data appended by a preceding call to
   // CreateFilter() on this class.  This method must return true if
   // the key was in the list of keys passed to CreateFilter().
@@ -67,6 +81,98 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that builds the same bloom filters as
+// NewBloomFilterPolicy(), but spends a different number of bits per key
+// on every level so that the sum of the false positive rates over all
+// sorted runs is minimized ("Monkey", Dayan et al., SIGMOD 2017).  The
+// total filter memory stays at about bits_per_key bits per key.  Small,
+// upper levels get more bits per key and the largest level gets fewer,
+// which mostly helps lookups of keys that are not in the database.
+//
+// The allocation follows the level sizes reported by the database, so
+// the result must not be shared between databases.  Tables written by
+// either policy can be read with the other one.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const FilterPolicy* NewMonkeyFilterPolicy(double bits_per_key);
+
+// Return a new filter policy that builds blocked bloom filters: all of the
+// bits of a key are set in the same 64-byte line of the filter, so that a
+// lookup reads a single cache line.  Probes are checked with AVX2 on CPUs
+// that support it.  Lookups of filters that are not in the CPU cache are
+// much cheaper, at the cost of a slightly higher false positive rate for
+// the same bits_per_key, since keys are not spread evenly over the lines.
+// Its filters are not readable by the other bloom filter policies.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(
+    int bits_per_key);
+
+// Return a new filter policy that builds binary fuse filters with
+// fingerprints of bits_per_key * 8 / 9 bits.  A filter with r-bit
+// fingerprints has a false positive rate of 2^-r and takes 1.125 * r bits
+// per key for a million keys or more, about 1.3 * r at ten thousand keys
+// and more for fewer keys, where a bloom filter takes about 1.44 * r bits
+// per key at any size.  E.g. NewBinaryFuseFilterPolicy(8) matches the
+// false positive rate of NewBloomFilterPolicy(10) in 10-20% less memory.
+// Since small filters gain little, this policy is best combined with
+// Options::full_table_filter or Options::partition_index_and_filters.
+// Building a filter takes about five times as long as a bloom filter.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const FilterPolicy* NewBinaryFuseFilterPolicy(int bits_per_key);
+
+// A RangeFilterPolicy creates a small filter from the keys of a table that
+// tells whether the table may hold a key in a range of keys.  Unlike a
+// FilterPolicy, it depends on the order of the keys, which must be
+// bytewise.
+class LEVELDB_EXPORT RangeFilterPolicy {
+ public:
+  virtual ~RangeFilterPolicy();
+
+  // Return the name of this policy.  Note that if the filter encoding
+  // changes in an incompatible way, the name returned by this method
+  // must be changed.  Otherwise, old incompatible filters may be
+  // passed to methods of this type.
+  virtual const char* Name() const = 0;
+
+  // keys[0,n-1] contains a list of keys (potentially with duplicates)
+  // that are ordered bytewise.  Append a filter that summarizes
+  // keys[0,n-1] to *dst.
+  //
+  // Warning: do not change the initial contents of *dst.  Instead,
+  // append the newly constructed filter to *dst.
+  virtual void CreateFilter(const Slice* keys, int n,
+                            std::string* dst) const = 0;
+
+  // "filter" contains the data appended by a preceding call to
+  // CreateFilter() on this class.  This method must return true if a key
+  // in the list of keys passed to CreateFilter() is in [start, limit).
+  // Otherwise it may return true or false, but it should aim to return
+  // false with a high probability.
+  virtual bool RangeMayMatch(const Slice& start, const Slice& limit,
+                             const Slice& filter) const = 0;
+};
+
+// Return a new range filter policy that stores the keys of a table after
+// their common prefix, truncated to bits_per_key - 3 more bits than it
+// takes to tell them apart.  Ranges that hold no key and are short
+// compared to the gaps between keys pass with a probability of about
+// 2^-(bits_per_key - 3): e.g. about 1% for bits_per_key of 10.  Longer
+// ranges pass more often.  Filters take about bits_per_key bits per key if
+// the keys are spread evenly over the values of their bytes, and more
+// otherwise: about 27 bits per key for decimal numbers.  Keys are told
+// apart by the 8 bytes after their common prefix, so keys that share
+// longer prefixes do not filter well.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const RangeFilterPolicy* NewRangeFilterPolicy(
+    int bits_per_key);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
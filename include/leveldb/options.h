@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
 
 #include "leveldb/export.h"
 
@@ -16,6 +17,10 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class RangeFilterPolicy;
+class RateLimiter;
+class Slice;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -30,6 +35,38 @@ enum CompressionType {
   kZstdCompression = 0x2,
 };
 
+// The shape of the LSM-tree that background compactions maintain.
+enum CompactionStyle {
+  // Every level below level-0 holds a single sorted run.  A compaction
+  // merges part of a level into the overlapping part of the next level.
+  // Cheap reads and space usage, higher write amplification.
+  kLeveledCompaction = 0x0,
+
+  // Every level holds up to Options::max_sorted_runs_per_level sorted
+  // runs.  Once a level is full, all of its runs are merged into a single
+  // new run in the next level, without rewriting the runs already there.
+  // Much lower write amplification at the cost of more runs per lookup.
+  kTieredCompaction = 0x1,
+};
+
+// The data structure that holds the entries of a memtable.
+enum MemTableRepType {
+  // A skiplist.  Inserts and lookups take O(log n).
+  kSkipListRep = 0x0,
+
+  // An unsorted vector that is sorted once, when the memtable is full.
+  // Inserts are a cheap append, which suits bulk loads, but every read
+  // of a memtable that is still being written searches or sorts a copy
+  // of the whole vector.
+  kVectorRep = 0x1,
+
+  // A hash table of skiplists, one per key prefix as given by
+  // Options::prefix_extractor (the whole key if it is null).  Lookups
+  // only search the keys that share a prefix; iterating over the whole
+  // memtable sorts a copy of all entries.
+  kPrefixHashRep = 0x2,
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct LEVELDB_EXPORT Options {
   // Create an Options object with default values for all fields.
@@ -105,6 +142,34 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // If true, every data block written to a new table gets a hash index that
+  // maps each key to the restart interval holding it, so that point lookups
+  // skip the binary search over the restart points of the block.  Costs a
+  // little over one byte per key.  The index is stored outside of the
+  // blocks, so the tables remain readable by builds that do not know about
+  // it.  Blocks with more than 254 restart points are left without an
+  // index.  This parameter can be changed dynamically.
+  //
+  // Default: false
+  bool data_block_hash_index = false;
+
+  // If true, the index block of each new table is split into partitions
+  // of about metadata_block_size bytes, found through a small top-level
+  // index, and its filter (see filter_policy) is split into one filter per
+  // index partition the same way.  Opening a table then only reads the
+  // top-level blocks; partitions are read on demand through the block
+  // cache.  Helps tables with large index and filter blocks, e.g. with a
+  // large max_file_size.  Older builds refuse to open such tables.
+  //
+  // Default: false
+  bool partition_index_and_filters = false;
+
+  // Approximate size of the partitions of index and filter blocks when
+  // partition_index_and_filters is set.
+  //
+  // Default: 4K
+  size_t metadata_block_size = 4 * 1024;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -135,6 +200,102 @@ struct LEVELDB_EXPORT Options {
   // Currently only the range [-5,22] is supported. Default is 1.
   int zstd_compression_level = 1;
 
+  // Compaction strategy used for levels 1 and above.  A database may be
+  // reopened with a different style; a tiered database reopened with
+  // kLeveledCompaction first merges every multi-run level back into a
+  // single run.
+  //
+  // Default: kLeveledCompaction
+  CompactionStyle compaction_style = kLeveledCompaction;
+
+  // Number of sorted runs a level may accumulate under kTieredCompaction
+  // before its runs are merged into the next level.  This is also the size
+  // ratio between adjacent levels.  Ignored for kLeveledCompaction.
+  // Level-0 keeps using the usual file-count compaction trigger.
+  //
+  // Default: 4
+  int max_sorted_runs_per_level = 4;
+
+  // Maximum number of table compactions that may run at the same time.
+  // Compactions only run concurrently when their inputs and outputs do not
+  // overlap.  Memtable compactions do not count against this limit: they
+  // run on the Env's kHighPriority pool, so they never wait behind a long
+  // table compaction.  DB::Open() grows the Env's kLowPriority pool to
+  // this many threads.
+  //
+  // Default: 1
+  int max_background_compactions = 1;
+
+  // Maximum number of threads a single table compaction is split across.
+  // A large compaction is divided into key ranges of about equal size,
+  // based on the index blocks of its input tables; each range is merged
+  // by a thread of its own into files of its own.  The extra threads are
+  // started with Env::StartThread() and exit with the compaction.
+  //
+  // Default: 1
+  int max_subcompactions = 1;
+
+  // If true, writers that are grouped into a single log record insert
+  // their own batches into the memtable in parallel, and the next group
+  // is written to the log while the current one is being inserted.  A
+  // write becomes visible once it and all writes logged before it have
+  // been inserted.  Helps workloads with many concurrent writers.
+  //
+  // Default: false
+  bool pipelined_write = false;
+
+  // Number of log files that writes are striped across, at most 8.  Every
+  // group of writes is logged to one of them, so that up to this many
+  // groups, e.g. of writes with WriteOptions::sync, are logged in parallel.
+  // Values above 1 imply pipelined_write.  Recovery replays the log files
+  // in the order of the sequence numbers of their writes.  After a crash,
+  // writes that were not synced may be lost even if later writes that
+  // were logged to other log files survive.
+  //
+  // Default: 1
+  int log_stripes = 1;
+
+  // Compress the records of the log files with the specified compression
+  // algorithm, which cuts the bytes that writes log when their values
+  // compress well.  Records that do not get at least 12.5% smaller are
+  // logged uncompressed.  Versions of leveldb that do not know about
+  // compressed log records drop them, so a database must be closed
+  // cleanly before it is opened by one of them.
+  //
+  // Default: kNoCompression
+  CompressionType log_compression = kNoCompression;
+
+  // Rate, in bytes per second, that writes are held to once compactions
+  // fall behind, i.e. once level-0 has 8 files or the estimated bytes of
+  // pending compactions exceed soft_pending_compaction_bytes_limit.  The
+  // rate goes down as level-0 approaches the 12 files at which writes
+  // stop, and as the pending compaction bytes grow past the limit, but
+  // never below 16KB/s.  Writes are delayed just enough to keep to the
+  // rate, so that latency grows smoothly instead of in steps.
+  //
+  // Default: 16MB/s
+  uint64_t delayed_write_rate = 16 * 1024 * 1024;
+
+  // Writes are delayed while the estimated number of bytes that
+  // compactions have to rewrite until no level needs one exceeds this.
+  // Zero disables the limit.
+  //
+  // Default: 64GB
+  uint64_t soft_pending_compaction_bytes_limit = uint64_t{64} << 30;
+
+  // If non-null, the bytes of the tables and value log files that memtable
+  // compactions and table compactions write are requested from this
+  // limiter, with memtable compactions going first.  See
+  // leveldb/rate_limiter.h.
+  //
+  // Default: nullptr
+  RateLimiter* rate_limiter = nullptr;
+
+  // Data structure used for memtables.
+  //
+  // Default: kSkipListRep
+  MemTableRepType memtable_rep = kSkipListRep;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
@@ -145,6 +306,63 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If true, new tables get a single filter for all of their keys instead
+  // of one filter per 2KB of data blocks.  Lookups check it before they
+  // search the index block, so most lookups of missing keys stop there.
+  // Builds that do not know about it ignore it.  Ignored if
+  // partition_index_and_filters is set, which gets a filter per index
+  // partition.
+  //
+  // Default: false
+  bool full_table_filter = false;
+
+  // If non-null, use the specified transform to derive key prefixes.  Used
+  // by the kPrefixHashRep memtable to group the keys of a prefix.  With a
+  // filter_policy, the filters of new tables also hold the prefixes of
+  // their keys, which lets iterators with ReadOptions::prefix_same_as_start
+  // skip the tables and blocks that hold no key with the prefix of the
+  // Seek() target.  The keys that share a prefix must be adjacent in the
+  // order of the comparator.
+  const SliceTransform* prefix_extractor = nullptr;
+
+  // If non-null, new tables also get a range filter built by the specified
+  // policy, stored next to the filter of filter_policy.  Iterators with
+  // ReadOptions::iterate_upper_bound check it on Seek(target) and skip the
+  // tables that hold no key in [target, iterate_upper_bound).  Ignored
+  // unless the comparator is BytewiseComparator().
+  const RangeFilterPolicy* range_filter_policy = nullptr;
+
+  // If true, new tables get a learned index: a piecewise linear model of
+  // the position of the entries of their index block, which point lookups
+  // use to binary-search only a few restart points of it.  The index block
+  // then has a restart point every 16 entries instead of every entry, which
+  // makes it smaller.  Fits fixed-width integer keys best.  Ignored unless
+  // the comparator is BytewiseComparator(), or if
+  // partition_index_and_filters is set.
+  //
+  // Default: false
+  bool learned_index = false;
+
+  // If positive, values of at least this many bytes are moved out of new
+  // tables into value log files, and the tables only hold small handles
+  // that point to them.  Compactions then rewrite the handles instead of
+  // the values, which cuts write amplification for large values at the
+  // cost of an extra read per value.  Compactions move the live values
+  // out of value log files that are mostly garbage.  Older builds cannot
+  // read the tables of such databases.
+  //
+  // Default: 0
+  size_t min_separated_value_size = 0;
+
+  // If true, the database keeps histograms of the latencies of Get(),
+  // MultiGet(), writes and iterator steps, and sums up the PerfContext
+  // counters of these operations over all threads.  They are reported by
+  // the "leveldb.statistics" property.  Timing every operation costs two
+  // clock reads.
+  //
+  // Default: false
+  bool statistics = false;
 };
 
 // Options that control read operations
@@ -162,6 +380,24 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If true and Options::prefix_extractor is set, an iterator positioned
+  // by Seek(target) only yields the keys that share the prefix of target,
+  // and becomes invalid at the first key with another prefix.  Tables and
+  // blocks whose filters do not hold that prefix are not read.  Such an
+  // iterator may only move in the direction it was positioned in: Next()
+  // after Seek() or SeekToFirst(), Prev() after SeekToLast().  Iterators
+  // positioned by SeekToFirst() or SeekToLast(), or by a target outside the
+  // domain of the prefix extractor, see every key.
+  bool prefix_same_as_start = false;
+
+  // If non-null, an iterator only yields the keys before
+  // *iterate_upper_bound, and becomes invalid at the first key at or
+  // after it.  With Options::range_filter_policy, Seek(target) does not read
+  // the tables whose range filters hold no key in [target, bound), and
+  // Prev() is only supported after SeekToLast() or Prev().  The bound must
+  // stay live and unchanged while the iterator is live.
+  const Slice* iterate_upper_bound = nullptr;
 };
 
 // Options that control write operations
@@ -0,0 +1,67 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PerfContext counts what the reads of one thread cost inside the
+// database, e.g. how many blocks they found in the block cache.  Every
+// thread has its own PerfContext, which the database updates without any
+// synchronization.  To measure an operation, Reset() the PerfContext of
+// the calling thread, run the operation and read the counters:
+//
+//   leveldb::PerfContext* perf = leveldb::GetPerfContext();
+//   perf->Reset();
+//   db->Get(leveldb::ReadOptions(), key, &value);
+//   ... perf->block_cache_miss_count ...
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+struct LEVELDB_EXPORT PerfContext {
+  // Number of levels of the database.
+  static constexpr int kNumLevels = 7;
+
+  PerfContext() { Reset(); }
+
+  // Set all counters to zero.
+  void Reset();
+
+  // Return the non-zero counters in the form "name = value, ...".
+  std::string ToString() const;
+
+  // Lookups that were answered by the memtable or the immutable memtable.
+  uint64_t memtable_hit_count;
+
+  // Data blocks, index partitions and filter partitions that were found
+  // in, or missing from, the block cache.
+  uint64_t block_cache_hit_count;
+  uint64_t block_cache_miss_count;
+
+  // Blocks read from table files, and their bytes (trailers included).
+  uint64_t block_read_count;
+  uint64_t block_read_bytes;
+
+  // Table lookups that a filter ruled out without reading a data block.
+  uint64_t filter_useful_count;
+
+  // Table lookups that passed the filters of a table, and those of them
+  // that then found no entry for the key.
+  uint64_t filter_positive_count;
+  uint64_t filter_false_positive_count;
+
+  // Bytes that lookups read from the tables of each level.
+  uint64_t get_read_bytes[kNumLevels];
+};
+
+// Return the PerfContext of the calling thread.
+LEVELDB_EXPORT PerfContext* GetPerfContext();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
@@ -0,0 +1,66 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter caps the bandwidth of the files that the database writes
+// in the background, i.e. of the tables (and value log files) written by
+// memtable compactions and by table compactions, so that they do not
+// starve foreground reads and writes of I/O.  Writes to the log and to the
+// MANIFEST are never limited.  A RateLimiter may be shared by several
+// databases to cap their total bandwidth.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "leveldb/env.h"
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT RateLimiter {
+ public:
+  RateLimiter() = default;
+
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  virtual ~RateLimiter();
+
+  // Block until "bytes" may be written.  Memtable compactions request
+  // with kHighPriority and table compactions with kLowPriority; requests
+  // of kHighPriority are served before any waiting request of
+  // kLowPriority.  Safe to call from several threads at once.
+  virtual void Request(size_t bytes, Env::Priority pri) = 0;
+
+  // Set the rate in bytes per second that requests are held to.  For an
+  // auto-tuned limiter this is the highest rate that it may pick.
+  virtual void SetBytesPerSecond(uint64_t bytes_per_second) = 0;
+
+  // Return the rate in bytes per second that requests are held to now.
+  virtual uint64_t GetBytesPerSecond() const = 0;
+
+  // Return the bytes requested so far with priority "pri".
+  virtual uint64_t GetTotalBytesThrough(Env::Priority pri) const = 0;
+
+  // Called by the database whenever the estimated number of bytes that
+  // compactions have to rewrite until no level needs one changes.
+  // Limiters that adapt to the compaction debt override this.
+  virtual void SetPendingCompactionBytes(uint64_t bytes);
+};
+
+// Return a new rate limiter that holds the requests of all threads to
+// "bytes_per_second" with a token bucket.  If "auto_tuned" is true, the
+// rate starts at a tenth of "bytes_per_second" and is widened up to
+// "bytes_per_second" while compactions fall behind.  "env" (Env::Default()
+// if null) is used to read the clock and to wait, and must outlive the
+// limiter.
+LEVELDB_EXPORT RateLimiter* NewGenericRateLimiter(uint64_t bytes_per_second,
+                                                  bool auto_tuned = false,
+                                                  Env* env = nullptr);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
@@ -7,6 +7,7 @@
 
 #include <cstdint>
 
+#include "leveldb/cache.h"
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 
@@ -58,23 +59,93 @@ class LEVELDB_EXPORT Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Returns the number of bytes of index and filter blocks that the table
+  // keeps in memory while it is open.  Partitions of a partitioned index or
+  // filter are held in the block cache instead and not included.
+  size_t ApproximateMemoryUsage() const;
+
  private:
   friend class TableCache;
   struct Rep;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Finds the data block of the index block entry "index_value" in the block
+  // cache or reads it from the file.  On success, *block is the block and
+  // *cache_handle is its cache handle, or nullptr if the caller owns it.
+  Status LoadBlock(const ReadOptions&, const Slice& index_value, Block** block,
+                   Cache::Handle** cache_handle);
+
   explicit Table(Rep* rep) : rep_(rep) {}
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // that key is not present.  If the table has no entry whose key equals
+  // key but for its last 8 bytes, the data block hash index may lead to
+  // a call with another entry, or to none.
   Status InternalGet(const ReadOptions&, const Slice& key, void* arg,
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
+  // Like InternalGet() for each of the n keys, which must be sorted, but
+  // calls (*handle_result)(args[i], ...) for keys[i].  Keys that fall into
+  // the same data block share a single read of that block.
+  Status InternalMultiGet(const ReadOptions&, int n, const Slice* keys,
+                          void* const* args,
+                          void (*handle_result)(void* arg, const Slice& k,
+                                                const Slice& v));
+
+  // Returns an iterator over the index entries of the data blocks,
+  // reading index partitions on demand if the index is partitioned.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
+  // Positions "index_iter", which was returned by NewIndexIterator(), at
+  // the index entry for key, using the learned index if the table has one.
+  void SeekIndex(Iterator* index_iter, const Slice& key) const;
+
+  // Returns true if the table has a filter of any kind.
+  bool HasFilter() const;
+
+  // Returns false if the filter of the whole table, or the filter
+  // partition that covers key, says that filter_key is not present.
+  // Returns true if the table has neither, and leaves filters per data
+  // block alone.
+  bool KeyMayMatch(const ReadOptions&, const Slice& key,
+                   const Slice& filter_key);
+
+  // Returns false if the filters say that no entry at or after target in
+  // the data block of the index block entry "index_value", or in any later
+  // data block, has the prefix of target under options.prefix_extractor.
+  static bool BlockPrefixMayMatch(void*, const ReadOptions&,
+                                  const Slice& index_value,
+                                  const Slice& target);
+
+  // Like BlockPrefixMayMatch() for the data block that holds target.
+  bool PrefixMayMatch(const ReadOptions&, const Slice& target);
+
+  // Returns false if the range filter says that the table holds no key
+  // in [target, options.iterate_upper_bound), ignoring the last 8 bytes of
+  // target.
+  bool RangeMayMatch(const ReadOptions&, const Slice& target);
+
+  // Returns true if target is at or after options.iterate_upper_bound but
+  // for its last 8 bytes.  Such seeks position iterators for Prev(), and
+  // are never skipped.
+  bool SeekPastUpperBound(const ReadOptions&, const Slice& target) const;
+
+  // Returns false if BlockPrefixMayMatch() or RangeMayMatch() does, unless
+  // SeekPastUpperBound().
+  static bool BlockSeekMayMatch(void*, const ReadOptions&,
+                                const Slice& index_value, const Slice& target);
+
+  // Like BlockSeekMayMatch() for the data block that holds target.
+  bool SeekMayMatch(const ReadOptions&, const Slice& target);
+
   void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  void ReadFilter(const Slice& filter_handle_value, bool full);
+  void ReadFilterIndex(const Slice& filter_index_handle_value);
+  void ReadRangeFilter(const Slice& range_filter_handle_value);
+  void ReadLearnedIndex(const Slice& learned_index_handle_value);
 
   Rep* const rep_;
 };
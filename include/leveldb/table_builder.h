@@ -30,7 +30,10 @@ class LEVELDB_EXPORT TableBuilder {
   // Create a builder that will store the contents of the table it is
   // building in *file.  Does not close the file.  It is up to the
   // caller to close the file after calling Finish().
-  TableBuilder(const Options& options, WritableFile* file);
+  //
+  // "level" is the level of the database the table is written to, or -1
+  // if unknown.  It lets options.filter_policy size the filters per level.
+  TableBuilder(const Options& options, WritableFile* file, int level = -1);
 
   TableBuilder(const TableBuilder&) = delete;
   TableBuilder& operator=(const TableBuilder&) = delete;
@@ -81,6 +84,8 @@ class LEVELDB_EXPORT TableBuilder {
 
  private:
   bool ok() const { return status().ok(); }
+  void AddIndexEntry();
+  void FlushIndexPartition();
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
 
@@ -40,6 +40,26 @@ class LOCKABLE Mutex {
   void AssertHeld() ASSERT_EXCLUSIVE_LOCK();
 };
 
+// A SharedMutex is a lock that may be held either by one exclusive holder
+// or by any number of shared holders.
+class LOCKABLE SharedMutex {
+ public:
+  SharedMutex();
+  ~SharedMutex();
+
+  // Lock the mutex exclusively.  Waits until all other holders have exited.
+  void Lock() EXCLUSIVE_LOCK_FUNCTION();
+
+  // Release an exclusive lock.
+  void Unlock() UNLOCK_FUNCTION();
+
+  // Lock the mutex shared.  Waits only while it is held exclusively.
+  void LockShared() SHARED_LOCK_FUNCTION();
+
+  // Release a shared lock.
+  void UnlockShared() UNLOCK_FUNCTION();
+};
+
 class CondVar {
  public:
   explicit CondVar(Mutex* mu);
@@ -38,6 +38,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <mutex>  // NOLINT
+#include <shared_mutex>  // NOLINT
 #include <string>
 
 #include "port/thread_annotations.h"
@@ -65,6 +66,24 @@ class LOCKABLE Mutex {
   std::mutex mu_;
 };
 
+// Thinly wraps std::shared_mutex.
+class LOCKABLE SharedMutex {
+ public:
+  SharedMutex() = default;
+  ~SharedMutex() = default;
+
+  SharedMutex(const SharedMutex&) = delete;
+  SharedMutex& operator=(const SharedMutex&) = delete;
+
+  void Lock() EXCLUSIVE_LOCK_FUNCTION() { mu_.lock(); }
+  void Unlock() UNLOCK_FUNCTION() { mu_.unlock(); }
+  void LockShared() SHARED_LOCK_FUNCTION() { mu_.lock_shared(); }
+  void UnlockShared() UNLOCK_FUNCTION() { mu_.unlock_shared(); }
+
+ private:
+  std::shared_mutex mu_;
+};
+
 // Thinly wraps std::condition_variable.
 class CondVar {
  public:
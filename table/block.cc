@@ -25,7 +25,14 @@ inline uint32_t Block::NumRestarts() const {
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
-      owned_(contents.heap_allocated) {
+      owned_(contents.heap_allocated),
+      hash_index_(contents.hash_index) {
+  if (hash_index_.size() <= sizeof(uint32_t) ||
+      DecodeFixed32(hash_index_.data() + hash_index_.size() -
+                    sizeof(uint32_t)) !=
+          hash_index_.size() - sizeof(uint32_t)) {
+    hash_index_.clear();  // Missing or malformed: do without
+  }
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
   } else {
@@ -81,6 +88,10 @@ class Block::Iter : public Iterator {
   uint32_t const restarts_;      // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
 
+  // Buckets of the block's hash index, or nullptr if it has none
+  const uint8_t* const buckets_;
+  uint32_t const num_buckets_;
+
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
   uint32_t restart_index_;  // Index of restart block in which current_ falls
@@ -114,11 +125,13 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, const uint8_t* buckets, uint32_t num_buckets)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        buckets_(buckets),
+        num_buckets_(num_buckets),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -184,27 +197,8 @@ class Block::Iter : public Iterator {
       }
     }
 
-    while (left < right) {
-      uint32_t mid = (left + right + 1) / 2;
-      uint32_t region_offset = GetRestartPoint(mid);
-      uint32_t shared, non_shared, value_length;
-      const char* key_ptr =
-          DecodeEntry(data_ + region_offset, data_ + restarts_, &shared,
-                      &non_shared, &value_length);
-      if (key_ptr == nullptr || (shared != 0)) {
-        CorruptionError();
-        return;
-      }
-      Slice mid_key(key_ptr, non_shared);
-      if (Compare(mid_key, target) < 0) {
-        // Key at "mid" is smaller than "target".  Therefore all
-        // blocks before "mid" are uninteresting.
-        left = mid;
-      } else {
-        // Key at "mid" is >= "target".  Therefore all blocks at or
-        // after "mid" are uninteresting.
-        right = mid - 1;
-      }
+    if (!FindRestartBefore(target, &left, right)) {
+      return;
     }
 
     // We might be able to use our current position within the restart block.
@@ -226,6 +220,59 @@ class Block::Iter : public Iterator {
     }
   }
 
+  void SeekForGet(const Slice& target) {
+    if (buckets_ == nullptr) {
+      Seek(target);
+      return;
+    }
+    const uint8_t restart = buckets_[HashIndexKeyHash(target) % num_buckets_];
+    if (restart == kHashIndexNoEntry) {
+      // No entry for the key in this block
+      current_ = restarts_;
+      restart_index_ = num_restarts_;
+      return;
+    }
+    if (restart >= num_restarts_) {
+      // A collision, or a corrupt index: fall back to the binary search
+      Seek(target);
+      return;
+    }
+    // Linear search from the restart point for first key >= target
+    SeekToRestartPoint(restart);
+    while (ParseNextKey() && Compare(key_, target) < 0) {
+      // Keep skipping
+    }
+  }
+
+  void SeekInRange(const Slice& target, uint32_t first, uint32_t last) {
+    // Check that the key at restart point "first" is < target, and the one
+    // after "last" >= target, before trusting the range
+    last = std::min(last, num_restarts_ - 1);
+    Slice key;
+    bool in_range = first <= last;
+    if (in_range && first > 0) {
+      if (!GetRestartKey(first, &key)) return;
+      in_range = Compare(key, target) < 0;
+    }
+    if (in_range && last + 1 < num_restarts_) {
+      if (!GetRestartKey(last + 1, &key)) return;
+      in_range = Compare(key, target) >= 0;
+    }
+    if (!in_range) {
+      first = 0;
+      last = num_restarts_ - 1;
+    }
+
+    if (!FindRestartBefore(target, &first, last)) {
+      return;
+    }
+    // Linear search from the restart point for first key >= target
+    SeekToRestartPoint(first);
+    while (ParseNextKey() && Compare(key_, target) < 0) {
+      // Keep skipping
+    }
+  }
+
   void SeekToFirst() override {
     SeekToRestartPoint(0);
     ParseNextKey();
@@ -247,6 +294,44 @@ class Block::Iter : public Iterator {
     value_.clear();
   }
 
+  // Sets *key to the key at restart point "index".  Returns false after
+  // recording an error if the entry cannot be decoded.
+  bool GetRestartKey(uint32_t index, Slice* key) {
+    uint32_t shared, non_shared, value_length;
+    const char* key_ptr =
+        DecodeEntry(data_ + GetRestartPoint(index), data_ + restarts_, &shared,
+                    &non_shared, &value_length);
+    if (key_ptr == nullptr || (shared != 0)) {
+      CorruptionError();
+      return false;
+    }
+    *key = Slice(key_ptr, non_shared);
+    return true;
+  }
+
+  // Binary search in restart array [*left, right] to find the last
+  // restart point with a key < target, or *left if there is none.
+  bool FindRestartBefore(const Slice& target, uint32_t* left,
+                         uint32_t right) {
+    while (*left < right) {
+      uint32_t mid = (*left + right + 1) / 2;
+      Slice mid_key;
+      if (!GetRestartKey(mid, &mid_key)) {
+        return false;
+      }
+      if (Compare(mid_key, target) < 0) {
+        // Key at "mid" is smaller than "target".  Therefore all
+        // blocks before "mid" are uninteresting.
+        *left = mid;
+      } else {
+        // Key at "mid" is >= "target".  Therefore all blocks at or
+        // after "mid" are uninteresting.
+        right = mid - 1;
+      }
+    }
+    return true;
+  }
+
   bool ParseNextKey() {
     current_ = NextEntryOffset();
     const char* p = data_ + current_;
@@ -285,7 +370,31 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   if (num_restarts == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    const uint8_t* buckets = nullptr;
+    uint32_t num_buckets = 0;
+    if (!hash_index_.empty()) {
+      buckets = reinterpret_cast<const uint8_t*>(hash_index_.data());
+      num_buckets = hash_index_.size() - sizeof(uint32_t);
+    }
+    return new Iter(comparator, data_, restart_offset_, num_restarts, buckets,
+                    num_buckets);
+  }
+}
+
+void Block::SeekForGet(Iterator* iter, const Slice& target) const {
+  if (size_ < sizeof(uint32_t) || NumRestarts() == 0) {
+    iter->Seek(target);  // Not a Block::Iter
+  } else {
+    static_cast<Iter*>(iter)->SeekForGet(target);
+  }
+}
+
+void Block::SeekInRange(Iterator* iter, const Slice& target, uint32_t first,
+                        uint32_t last) const {
+  if (size_ < sizeof(uint32_t) || NumRestarts() == 0) {
+    iter->Seek(target);  // Not a Block::Iter
+  } else {
+    static_cast<Iter*>(iter)->SeekInRange(target, first, last);
   }
 }
 
@@ -7,6 +7,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <string>
 
 #include "leveldb/iterator.h"
 
@@ -25,9 +26,25 @@ class Block {
 
   ~Block();
 
-  size_t size() const { return size_; }
+  size_t size() const { return size_ + hash_index_.size(); }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Position "iter", which must have been returned by NewIterator(), for
+  // a point lookup of "target".  If the block holds an entry whose key
+  // equals "target" but for its last 8 bytes (for the internal keys of a
+  // DB: an entry for the same user key), "iter" ends up where
+  // Seek(target) would have put it; otherwise it is either at an entry
+  // that does not, or not valid.  Uses the hash index of the block, if
+  // it has one, to skip the binary search of Seek().
+  void SeekForGet(Iterator* iter, const Slice& target) const;
+
+  // Position "iter", which must have been returned by NewIterator(), where
+  // Seek(target) would.  The last restart point whose key is < target is
+  // expected in [first, last], which narrows down the binary search of
+  // Seek(); if it is not, the search covers the whole block.
+  void SeekInRange(Iterator* iter, const Slice& target, uint32_t first,
+                   uint32_t last) const;
+
  private:
   class Iter;
 
@@ -37,6 +54,7 @@ class Block {
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
   bool owned_;               // Block owns data_[]
+  std::string hash_index_;   // Empty if the block has no hash index
 };
 
 }  // namespace leveldb
@@ -25,6 +25,19 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// A data block may also have a hash index, which is not part of the block
+// but is stored right after the block's trailer in the table file, where
+// readers that do not know about it never look.  It has the form:
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+// Every key hashes to a bucket (see HashIndexKeyHash()).  A bucket holds
+// the index of the restart interval in which the entries for its keys
+// start, kHashIndexNoEntry if the block has no key of the bucket, or
+// kHashIndexCollision if its keys start in different restart intervals.
+// A point lookup can thus go straight to the right restart interval
+// without a binary search.  Blocks with more restart points than a bucket
+// can name have no hash index.
 
 #include "table/block_builder.h"
 
@@ -33,12 +46,20 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
+// Number of keys per bucket in a hash index.
+static const double kHashIndexUtilRatio = 0.75;
+
 BlockBuilder::BlockBuilder(const Options* options)
-    : options_(options), restarts_(), counter_(0), finished_(false) {
+    : options_(options),
+      restarts_(),
+      counter_(0),
+      finished_(false),
+      hash_index_enabled_(false) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);  // First restart point is at offset 0
 }
@@ -50,6 +71,8 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  key_hashes_.clear();
+  hash_index_.clear();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
@@ -68,12 +91,37 @@ Slice BlockBuilder::Finish() {
   return Slice(buffer_);
 }
 
+Slice BlockBuilder::FinishHashIndex() {
+  hash_index_.clear();
+  if (!hash_index_enabled_ || key_hashes_.empty() ||
+      restarts_.size() > kHashIndexCollision) {
+    return Slice();
+  }
+  const uint32_t num_buckets =
+      static_cast<uint32_t>(key_hashes_.size() / kHashIndexUtilRatio) + 1;
+  hash_index_.assign(num_buckets, static_cast<char>(kHashIndexNoEntry));
+  for (const auto& key_hash : key_hashes_) {
+    char* bucket = &hash_index_[key_hash.first % num_buckets];
+    const uint8_t restart = static_cast<uint8_t>(key_hash.second);
+    if (static_cast<uint8_t>(*bucket) == kHashIndexNoEntry) {
+      *bucket = static_cast<char>(restart);
+    } else if (static_cast<uint8_t>(*bucket) != restart) {
+      *bucket = static_cast<char>(kHashIndexCollision);
+    }
+  }
+  PutFixed32(&hash_index_, num_buckets);
+  return Slice(hash_index_);
+}
+
 void BlockBuilder::Add(const Slice& key, const Slice& value) {
   Slice last_key_piece(last_key_);
   assert(!finished_);
   assert(counter_ <= options_->block_restart_interval);
   assert(buffer_.empty()  // No values yet?
          || options_->comparator->Compare(key, last_key_piece) > 0);
+  if (buffer_.empty()) {
+    hash_index_enabled_ = options_->data_block_hash_index;
+  }
   size_t shared = 0;
   if (counter_ < options_->block_restart_interval) {
     // See how much sharing to do with previous string
@@ -86,6 +134,14 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
     restarts_.push_back(buffer_.size());
     counter_ = 0;
   }
+  if (hash_index_enabled_) {
+    // All entries for a user key are adjacent, and lookups scan forward
+    // from the restart interval of the first one.
+    const uint32_t hash = HashIndexKeyHash(key);
+    if (key_hashes_.empty() || key_hashes_.back().first != hash) {
+      key_hashes_.emplace_back(hash, restarts_.size() - 1);
+    }
+  }
   const size_t non_shared = key.size() - shared;
 
   // Add "<shared><non_shared><value_size>" to buffer_
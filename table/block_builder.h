@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
 #include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "leveldb/slice.h"
@@ -33,6 +35,13 @@ class BlockBuilder {
   // lifetime of this builder or until Reset() is called.
   Slice Finish();
 
+  // Build the hash index of the block if Options::data_block_hash_index was
+  // set when its first entry was added, and return a slice that refers to
+  // it, or an empty slice if the block has no hash index.  The returned
+  // slice will remain valid for the lifetime of this builder or until
+  // Reset() is called.
+  Slice FinishHashIndex();
+
   // Returns an estimate of the current (uncompressed) size of the block
   // we are building.
   size_t CurrentSizeEstimate() const;
@@ -47,6 +56,12 @@ class BlockBuilder {
   int counter_;                     // Number of entries emitted since restart
   bool finished_;                   // Has Finish() been called?
   std::string last_key_;
+
+  // Hash index state: the hash of every distinct key (see HashIndexKeyHash())
+  // together with the restart interval of its first entry.
+  bool hash_index_enabled_;
+  std::vector<std::pair<uint32_t, uint32_t>> key_hashes_;
+  std::string hash_index_;
 };
 
 }  // namespace leveldb
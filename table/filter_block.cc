@@ -15,8 +15,8 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {}
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy, int level)
+    : policy_(policy), level_(level) {}
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
   uint64_t filter_index = (block_offset / kFilterBase);
@@ -67,7 +67,8 @@ void FilterBlockBuilder::GenerateFilter() {
 
   // Generate filter for current set of keys and append to result_.
   filter_offsets_.push_back(result_.size());
-  policy_->CreateFilter(&tmp_keys_[0], static_cast<int>(num_keys), &result_);
+  policy_->CreateFilterForLevel(&tmp_keys_[0], static_cast<int>(num_keys),
+                                level_, &result_);
 
   tmp_keys_.clear();
   keys_.clear();
@@ -103,4 +104,82 @@ bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
   return true;  // Errors are treated as potential matches
 }
 
+FullFilterBlockBuilder::FullFilterBlockBuilder(const FilterPolicy* policy,
+                                               int level)
+    : policy_(policy), level_(level) {}
+
+void FullFilterBlockBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+Slice FullFilterBlockBuilder::Finish() {
+  result_.clear();
+  const size_t num_keys = start_.size();
+  if (num_keys == 0) {
+    return Slice(result_);  // Empty filters do not match any keys
+  }
+
+  // Make list of keys from flattened key structure
+  start_.push_back(keys_.size());  // Simplify length computation
+  tmp_keys_.resize(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    const char* base = keys_.data() + start_[i];
+    size_t length = start_[i + 1] - start_[i];
+    tmp_keys_[i] = Slice(base, length);
+  }
+  policy_->CreateFilterForLevel(&tmp_keys_[0], static_cast<int>(num_keys),
+                                level_, &result_);
+
+  tmp_keys_.clear();
+  keys_.clear();
+  start_.clear();
+  return Slice(result_);
+}
+
+FullFilterBlockReader::FullFilterBlockReader(const FilterPolicy* policy,
+                                             const Slice& contents)
+    : policy_(policy), filter_(contents) {}
+
+bool FullFilterBlockReader::KeyMayMatch(const Slice& key) const {
+  if (filter_.empty()) {
+    return false;  // Empty filters do not match any keys
+  }
+  return policy_->KeyMayMatch(key, filter_);
+}
+
+RangeFilterBlockBuilder::RangeFilterBlockBuilder(
+    const RangeFilterPolicy* policy)
+    : policy_(policy) {}
+
+void RangeFilterBlockBuilder::AddKey(const Slice& key) {
+  if (!start_.empty() &&
+      Slice(keys_.data() + start_.back(), keys_.size() - start_.back()) ==
+          key) {
+    return;
+  }
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+Slice RangeFilterBlockBuilder::Finish() {
+  const size_t num_keys = start_.size();
+  start_.push_back(keys_.size());  // Simplify length computation
+  std::vector<Slice> tmp_keys(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    tmp_keys[i] = Slice(keys_.data() + start_[i], start_[i + 1] - start_[i]);
+  }
+  policy_->CreateFilter(tmp_keys.data(), static_cast<int>(num_keys), &result_);
+  return Slice(result_);
+}
+
+RangeFilterBlockReader::RangeFilterBlockReader(const RangeFilterPolicy* policy,
+                                               const Slice& contents)
+    : policy_(policy), filter_(contents) {}
+
+bool RangeFilterBlockReader::RangeMayMatch(const Slice& start,
+                                           const Slice& limit) const {
+  return policy_->RangeMayMatch(start, limit, filter_);
+}
+
 }  // namespace leveldb
@@ -4,7 +4,8 @@
 //
 // A filter block is stored near the end of a Table file.  It contains
 // filters (e.g., bloom filters) for all data blocks in the table combined
-// into a single filter block.
+// into a single filter block.  Tables with partitioned filters have one
+// full filter block per index partition instead.
 
 #ifndef STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
 #define STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -20,6 +21,7 @@
 namespace leveldb {
 
 class FilterPolicy;
+class RangeFilterPolicy;
 
 // A FilterBlockBuilder is used to construct all of the filters for a
 // particular Table.  It generates a single string which is stored as
@@ -29,7 +31,8 @@ class FilterPolicy;
 //      (StartBlock AddKey*)* Finish
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  // "level" is passed on to FilterPolicy::CreateFilterForLevel().
+  explicit FilterBlockBuilder(const FilterPolicy*, int level = -1);
 
   FilterBlockBuilder(const FilterBlockBuilder&) = delete;
   FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
@@ -42,6 +45,7 @@ class FilterBlockBuilder {
   void GenerateFilter();
 
   const FilterPolicy* policy_;
+  const int level_;
   std::string keys_;             // Flattened key contents
   std::vector<size_t> start_;    // Starting index in keys_ of each key
   std::string result_;           // Filter data computed so far
@@ -63,6 +67,81 @@ class FilterBlockReader {
   size_t base_lg_;      // Encoding parameter (see kFilterBaseLg in .cc file)
 };
 
+// A FullFilterBlockBuilder constructs a single filter for all of the keys
+// added to it, whichever data blocks they belong to.  The full filter
+// block is nothing but the filter itself.
+//
+// The sequence of calls to FullFilterBlockBuilder must match the regexp:
+//      (AddKey* Finish)*
+class FullFilterBlockBuilder {
+ public:
+  // "level" is passed on to FilterPolicy::CreateFilterForLevel().
+  explicit FullFilterBlockBuilder(const FilterPolicy*, int level = -1);
+
+  FullFilterBlockBuilder(const FullFilterBlockBuilder&) = delete;
+  FullFilterBlockBuilder& operator=(const FullFilterBlockBuilder&) = delete;
+
+  void AddKey(const Slice& key);
+
+  // Returns the filter of the keys added since the last call to Finish().
+  // The result remains valid until the next call to Finish().
+  Slice Finish();
+
+ private:
+  const FilterPolicy* policy_;
+  const int level_;
+  std::string keys_;             // Flattened key contents
+  std::vector<size_t> start_;    // Starting index in keys_ of each key
+  std::string result_;           // Filter of the last Finish()
+  std::vector<Slice> tmp_keys_;  // policy_->CreateFilter() argument
+};
+
+class FullFilterBlockReader {
+ public:
+  // REQUIRES: "contents" and *policy must stay live while *this is live.
+  FullFilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  bool KeyMayMatch(const Slice& key) const;
+
+ private:
+  const FilterPolicy* policy_;
+  Slice filter_;
+};
+
+// A RangeFilterBlockBuilder constructs the range filter of all of the
+// keys added to it.  Adjacent duplicate keys are only passed to the policy
+// once.  The range filter block is nothing but the filter itself.
+//
+// The sequence of calls to RangeFilterBlockBuilder must match the regexp:
+//      AddKey* Finish
+class RangeFilterBlockBuilder {
+ public:
+  explicit RangeFilterBlockBuilder(const RangeFilterPolicy*);
+
+  RangeFilterBlockBuilder(const RangeFilterBlockBuilder&) = delete;
+  RangeFilterBlockBuilder& operator=(const RangeFilterBlockBuilder&) = delete;
+
+  void AddKey(const Slice& key);
+  Slice Finish();
+
+ private:
+  const RangeFilterPolicy* policy_;
+  std::string keys_;           // Flattened key contents
+  std::vector<size_t> start_;  // Starting index in keys_ of each key
+  std::string result_;         // Filter data computed so far
+};
+
+class RangeFilterBlockReader {
+ public:
+  // REQUIRES: "contents" and *policy must stay live while *this is live.
+  RangeFilterBlockReader(const RangeFilterPolicy* policy,
+                         const Slice& contents);
+  bool RangeMayMatch(const Slice& start, const Slice& limit) const;
+
+ private:
+  const RangeFilterPolicy* policy_;
+  Slice filter_;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
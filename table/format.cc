@@ -4,12 +4,17 @@
 
 #include "table/format.h"
 
+#include <vector>
+
 #include "leveldb/env.h"
 #include "leveldb/options.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/slice_transform.h"
 #include "port/port.h"
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
@@ -29,13 +34,38 @@ Status BlockHandle::DecodeFrom(Slice* input) {
   }
 }
 
+uint32_t HashIndexKeyHash(const Slice& key) {
+  size_t n = key.size();
+  if (n >= 8) {
+    n -= 8;
+  }
+  return Hash(key.data(), n, 0x2f5a8e17);
+}
+
+bool FilterPrefixKey(const SliceTransform* prefix_extractor, const Slice& key,
+                     std::string* dst) {
+  if (key.size() < 8) {
+    return false;
+  }
+  const Slice user_key(key.data(), key.size() - 8);
+  if (!prefix_extractor->InDomain(user_key)) {
+    return false;
+  }
+  const Slice prefix = prefix_extractor->Transform(user_key);
+  dst->assign(prefix.data(), prefix.size());
+  dst->append(key.data() + user_key.size(), 8);
+  return true;
+}
+
 void Footer::EncodeTo(std::string* dst) const {
   const size_t original_size = dst->size();
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
   dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+  const uint64_t magic = partitioned_index_ ? kPartitionedIndexTableMagicNumber
+                                            : kTableMagicNumber;
+  PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
   assert(dst->size() == original_size + kEncodedLength);
   (void)original_size;  // Disable unused variable warning.
 }
@@ -50,9 +80,11 @@ Status Footer::DecodeFrom(Slice* input) {
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  if (magic != kTableMagicNumber &&
+      magic != kPartitionedIndexTableMagicNumber) {
     return Status::Corruption("not an sstable (bad magic number)");
   }
+  partitioned_index_ = (magic == kPartitionedIndexTableMagicNumber);
 
   Status result = metaindex_handle_.DecodeFrom(input);
   if (result.ok()) {
@@ -66,36 +98,47 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
-
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
+// Checks and uncompresses the block of "handle" and its hash index of
+// "hash_index_size" bytes, which were read into "contents" with "buf" as
+// scratch space.  Takes ownership of "buf", which was allocated with new[].
+static Status DecodeBlock(const ReadOptions& options, const BlockHandle& handle,
+                          uint64_t hash_index_size, char* buf,
+                          const Slice& contents, BlockContents* result) {
   size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-  if (!s.ok()) {
-    delete[] buf;
-    return s;
-  }
-  if (contents.size() != n + kBlockTrailerSize) {
+  size_t h = static_cast<size_t>(hash_index_size);
+  if (contents.size() != n + kBlockTrailerSize + h) {
     delete[] buf;
     return Status::Corruption("truncated block read");
   }
 
-  // Check the crc of the type and the block contents
   const char* data = contents.data();  // Pointer to where Read put the data
+  if (h > 0) {
+    // The hash index is stored uncompressed, with a trailer of its own
+    const char* index = data + n + kBlockTrailerSize;
+    if (h < kBlockTrailerSize ||
+        index[h - kBlockTrailerSize] != kNoCompression) {
+      delete[] buf;
+      return Status::Corruption("bad hash index");
+    }
+    h -= kBlockTrailerSize;
+    if (options.verify_checksums) {
+      const uint32_t crc = crc32c::Unmask(DecodeFixed32(index + h + 1));
+      const uint32_t actual = crc32c::Value(index, h + 1);
+      if (actual != crc) {
+        delete[] buf;
+        return Status::Corruption("hash index checksum mismatch");
+      }
+    }
+    result->hash_index.assign(index, h);
+  }
+
+  // Check the crc of the type and the block contents
   if (options.verify_checksums) {
     const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
       delete[] buf;
-      s = Status::Corruption("block checksum mismatch");
-      return s;
+      return Status::Corruption("block checksum mismatch");
     }
   }
 
@@ -161,4 +204,60 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   return Status::OK();
 }
 
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, BlockContents* result,
+                 uint64_t hash_index_size) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+  result->hash_index.clear();
+
+  // Read the block contents as well as the type/crc footer, and the hash
+  // index that follows it, if any.
+  // See table_builder.cc for the code that built this structure.
+  size_t n = static_cast<size_t>(handle.size() + hash_index_size) +
+             kBlockTrailerSize;
+  char* buf = new char[n];
+  Slice contents;
+  Status s = file->Read(handle.offset(), n, &contents, buf);
+  if (!s.ok()) {
+    delete[] buf;
+    return s;
+  }
+  PerfContext* perf = GetPerfContext();
+  perf->block_read_count++;
+  perf->block_read_bytes += contents.size();
+  return DecodeBlock(options, handle, hash_index_size, buf, contents, result);
+}
+
+void ReadBlocks(RandomAccessFile* file, const ReadOptions& options, int n,
+                const BlockHandle* handles, const uint64_t* hash_index_sizes,
+                BlockContents* results, Status* statuses) {
+  std::vector<RandomAccessFile::ReadRequest> reqs(n);
+  for (int i = 0; i < n; i++) {
+    results[i].data = Slice();
+    results[i].cachable = false;
+    results[i].heap_allocated = false;
+    results[i].hash_index.clear();
+    reqs[i].offset = handles[i].offset();
+    reqs[i].n = static_cast<size_t>(handles[i].size() + hash_index_sizes[i]) +
+                kBlockTrailerSize;
+    reqs[i].scratch = new char[reqs[i].n];
+  }
+  Status s = file->MultiRead(reqs.data(), reqs.size());
+  PerfContext* perf = GetPerfContext();
+  for (int i = 0; i < n; i++) {
+    if (!s.ok() || !reqs[i].status.ok()) {
+      delete[] reqs[i].scratch;
+      statuses[i] = s.ok() ? reqs[i].status : s;
+    } else {
+      perf->block_read_count++;
+      perf->block_read_bytes += reqs[i].result.size();
+      statuses[i] =
+          DecodeBlock(options, handles[i], hash_index_sizes[i],
+                      reqs[i].scratch, reqs[i].result, &results[i]);
+    }
+  }
+}
+
 }  // namespace leveldb
@@ -16,6 +16,7 @@ namespace leveldb {
 
 class Block;
 class RandomAccessFile;
+class SliceTransform;
 struct ReadOptions;
 
 // BlockHandle is a pointer to the extent of a file that stores a data
@@ -62,12 +63,18 @@ class Footer {
   const BlockHandle& index_handle() const { return index_handle_; }
   void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
 
+  // Whether the index block is the top level of a partitioned index,
+  // whose entries point to index partitions instead of data blocks
+  bool partitioned_index() const { return partitioned_index_; }
+  void set_partitioned_index(bool p) { partitioned_index_ = p; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_index_ = false;
 };
 
 // kTableMagicNumber was picked by running
@@ -75,19 +82,56 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Tables with a partitioned index use a magic number of their own, so
+// that readers that do not know about partitioned indexes refuse them
+// instead of taking index partitions for data blocks.
+static const uint64_t kPartitionedIndexTableMagicNumber =
+    0xdb4775248b80fb58ull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Special bucket values of a data block hash index (see
+// BlockBuilder::FinishHashIndex()).  All other values are restart indexes.
+static const uint8_t kHashIndexNoEntry = 255;
+static const uint8_t kHashIndexCollision = 254;
+
+// Returns the hash of "key" in a data block hash index.  Keys are hashed
+// without their last 8 bytes, so all entries for a user key of the DB,
+// which differ only in their sequence number and type, share a bucket.
+uint32_t HashIndexKeyHash(const Slice& key);
+
+// If the key "key" without its last 8 bytes is in the domain of
+// "prefix_extractor", sets *dst to its prefix followed by those 8 bytes and
+// returns true.  This is the key that stands for the prefix in filters: a
+// filter policy that ignores the last 8 bytes of keys, as the DB's does,
+// sees the prefix where it sees the user key of a whole key.
+bool FilterPrefixKey(const SliceTransform* prefix_extractor, const Slice& key,
+                     std::string* dst);
+
 struct BlockContents {
-  Slice data;           // Actual contents of data
-  bool cachable;        // True iff data can be cached
-  bool heap_allocated;  // True iff caller should delete[] data.data()
+  Slice data;              // Actual contents of data
+  bool cachable;           // True iff data can be cached
+  bool heap_allocated;     // True iff caller should delete[] data.data()
+  std::string hash_index;  // Hash index of a data block, if it has one
 };
 
-// Read the block identified by "handle" from "file".  On failure
-// return non-OK.  On success fill *result and return OK.
+// Read the block identified by "handle" from "file".  A data block may be
+// followed in the file by a hash index of "hash_index_size" bytes, block
+// trailer included, as recorded in its index block entry; if so, it is
+// read along with the block into result->hash_index.  On failure return
+// non-OK.  On success fill *result and return OK.
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result);
+                 const BlockHandle& handle, BlockContents* result,
+                 uint64_t hash_index_size = 0);
+
+// Read the n blocks identified by "handles", with hash indexes of
+// hash_index_sizes[i] bytes, from "file" as ReadBlock() would, with all of
+// the reads issued at once through MultiRead().  Stores the outcome for
+// handles[i] in results[i] and statuses[i].
+void ReadBlocks(RandomAccessFile* file, const ReadOptions& options, int n,
+                const BlockHandle* handles, const uint64_t* hash_index_sizes,
+                BlockContents* results, Status* statuses);
 
 // Implementation details follow.  Clients should ignore,
 
@@ -0,0 +1,246 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The keys of a learned index share a common prefix, which is stored once.
+// The next 8 bytes of every key, read as a big-endian number, are its
+// image: images are in the same order as the keys, though different keys
+// may share one.  The model is fitted to the points (image, position of the
+// first entry with that image) by the greedy "shrinking cone" algorithm:
+// a segment starts at a point and takes the following points for as long
+// as some slope through its start passes within kMaxError entries of all
+// of them.
+
+#include "table/learned_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "util/coding.h"
+
+namespace leveldb {
+
+namespace {
+
+// A model is a list of segments sorted by their first image:
+//    first image: fixed64
+//    position of its first entry: fixed32
+//    slope: fixed64, the bits of a double
+// followed by the common prefix of the keys and:
+//    prefix_size: fixed32
+//    num_segments: fixed32
+//    num_entries: fixed32
+//    error: fixed32
+//    restart_interval: fixed32
+// "error" bounds the distance between the predicted position of a key and
+// the position of the first entry at or after it.
+const size_t kSegmentSize = 8 + 4 + 8;
+const size_t kTrailerSize = 5 * 4;
+
+// Largest distance of a point from the segment that it belongs to.
+const uint32_t kMaxError = 8;
+
+// Returns the first 8 bytes of s, padded with zeros, as a big-endian number.
+uint64_t KeyImage(const Slice& s) {
+  uint64_t image = 0;
+  for (size_t i = 0; i < 8; i++) {
+    image <<= 8;
+    if (i < s.size()) {
+      image |= static_cast<unsigned char>(s[i]);
+    }
+  }
+  return image;
+}
+
+// Returns s without its first n bytes.
+Slice Suffix(const Slice& s, size_t n) {
+  return Slice(s.data() + n, s.size() - n);
+}
+
+void PutSegment(std::string* dst, uint64_t image, uint32_t position,
+                double slope) {
+  uint64_t slope_bits;
+  std::memcpy(&slope_bits, &slope, sizeof(slope_bits));
+  PutFixed64(dst, image);
+  PutFixed32(dst, position);
+  PutFixed64(dst, slope_bits);
+}
+
+double DecodeSlope(const char* segment) {
+  const uint64_t slope_bits = DecodeFixed64(segment + 12);
+  double slope;
+  std::memcpy(&slope, &slope_bits, sizeof(slope));
+  return slope;
+}
+
+}  // namespace
+
+LearnedIndexBuilder::LearnedIndexBuilder(int restart_interval)
+    : restart_interval_(restart_interval) {}
+
+void LearnedIndexBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+Slice LearnedIndexBuilder::Finish() {
+  const size_t n = start_.size();
+  start_.push_back(keys_.size());  // Simplify length computation
+  std::vector<Slice> keys(n);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = Slice(keys_.data() + start_[i], start_[i + 1] - start_[i]);
+  }
+
+  // Keys are sorted, so the common prefix of all keys is that of the first
+  // and the last one.
+  size_t prefix_size = 0;
+  if (n > 0) {
+    const Slice& first = keys[0];
+    const Slice& last = keys[n - 1];
+    while (prefix_size < first.size() && prefix_size < last.size() &&
+           first[prefix_size] == last[prefix_size]) {
+      prefix_size++;
+    }
+  }
+
+  std::vector<uint64_t> images(n);
+  for (size_t i = 0; i < n; i++) {
+    images[i] = KeyImage(Suffix(keys[i], prefix_size));
+  }
+
+  // Fit the segments to the distinct images, and find the largest number
+  // of keys that share an image.
+  uint32_t max_run = 0;
+  size_t num_segments = 0;
+  uint64_t first_image = 0;
+  uint32_t first_position = 0;
+  double min_slope = 0;
+  double max_slope = std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < n;) {
+    const uint64_t image = images[i];
+    const uint32_t position = static_cast<uint32_t>(i);
+    while (i < n && images[i] == image) {
+      i++;
+    }
+    max_run = std::max(max_run, static_cast<uint32_t>(i) - position);
+
+    if (num_segments > 0) {
+      const double dx = static_cast<double>(image - first_image);
+      const double dy = static_cast<double>(position - first_position);
+      const double lo = std::max(min_slope, (dy - kMaxError) / dx);
+      const double hi = std::min(max_slope, (dy + kMaxError) / dx);
+      if (lo <= hi) {
+        min_slope = lo;
+        max_slope = hi;
+        continue;
+      }
+      PutSegment(&result_, first_image, first_position,
+                 max_slope == std::numeric_limits<double>::infinity()
+                     ? 0
+                     : (min_slope + max_slope) / 2);
+    }
+    // Start a new segment at this point
+    num_segments++;
+    first_image = image;
+    first_position = position;
+    min_slope = 0;
+    max_slope = std::numeric_limits<double>::infinity();
+  }
+  if (num_segments > 0) {
+    PutSegment(&result_, first_image, first_position,
+               max_slope == std::numeric_limits<double>::infinity()
+                   ? 0
+                   : (min_slope + max_slope) / 2);
+  }
+
+  // A key between two images may be predicted at either one's position,
+  // and the first entry at or after a key may be past all entries with its
+  // image.  The extra entry covers rounding.
+  const uint32_t error = kMaxError + 2 * max_run + 1;
+  if (n > 0) {
+    result_.append(keys[0].data(), prefix_size);
+  }
+  PutFixed32(&result_, static_cast<uint32_t>(prefix_size));
+  PutFixed32(&result_, static_cast<uint32_t>(num_segments));
+  PutFixed32(&result_, static_cast<uint32_t>(n));
+  PutFixed32(&result_, error);
+  PutFixed32(&result_, static_cast<uint32_t>(restart_interval_));
+  return Slice(result_);
+}
+
+LearnedIndexReader::LearnedIndexReader(const Slice& contents)
+    : contents_(contents),
+      segments_(nullptr),
+      num_segments_(0),
+      num_entries_(0),
+      error_(0),
+      restart_interval_(0) {
+  if (contents.size() < kTrailerSize) return;
+  const char* trailer = contents.data() + contents.size() - kTrailerSize;
+  const uint32_t prefix_size = DecodeFixed32(trailer);
+  const uint32_t num_segments = DecodeFixed32(trailer + 4);
+  const uint64_t rest = contents.size() - kTrailerSize;
+  if (prefix_size > rest ||
+      uint64_t{num_segments} * kSegmentSize != rest - prefix_size) {
+    return;  // Do not trust a model of the wrong size
+  }
+  num_entries_ = DecodeFixed32(trailer + 8);
+  error_ = DecodeFixed32(trailer + 12);
+  restart_interval_ = DecodeFixed32(trailer + 16);
+  if (restart_interval_ == 0) return;
+  segments_ = contents.data();
+  num_segments_ = num_segments;
+  prefix_ = Slice(trailer - prefix_size, prefix_size);
+}
+
+bool LearnedIndexReader::PredictRestarts(const Slice& key, uint32_t* first,
+                                         uint32_t* last) const {
+  if (num_segments_ == 0) {
+    return false;
+  }
+
+  // Predict the position of the first entry at or after key
+  uint64_t predicted;
+  if (key.starts_with(prefix_)) {
+    const uint64_t image = KeyImage(Suffix(key, prefix_.size()));
+    // Find the last segment that starts at or before image
+    uint32_t left = 0;
+    uint32_t right = num_segments_;
+    while (left < right) {
+      const uint32_t mid = (left + right) / 2;
+      if (DecodeFixed64(segments_ + mid * kSegmentSize) <= image) {
+        left = mid + 1;
+      } else {
+        right = mid;
+      }
+    }
+    if (left == 0) {
+      predicted = 0;  // Before all entries
+    } else {
+      const char* segment = segments_ + (left - 1) * kSegmentSize;
+      const uint64_t dx = image - DecodeFixed64(segment);
+      const double y = DecodeFixed32(segment + 8) +
+                       DecodeSlope(segment) * static_cast<double>(dx);
+      // Keys past the last point of a segment are before the first entry
+      // of the next one
+      const uint32_t limit = left < num_segments_
+                                 ? DecodeFixed32(segment + kSegmentSize + 8)
+                                 : num_entries_;
+      predicted = y >= limit ? limit : static_cast<uint64_t>(y);
+    }
+  } else if (key.compare(prefix_) < 0) {
+    predicted = 0;
+  } else {
+    predicted = num_entries_;
+  }
+
+  // The last entry before key precedes the first one at or after it
+  const uint64_t lo = predicted > error_ ? predicted - error_ : 0;
+  const uint64_t hi = std::min<uint64_t>(predicted + error_, num_entries_);
+  *first = static_cast<uint32_t>((lo > 0 ? lo - 1 : 0) / restart_interval_);
+  *last = static_cast<uint32_t>((hi > 0 ? hi - 1 : 0) / restart_interval_);
+  return true;
+}
+
+}  // namespace leveldb
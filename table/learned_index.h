@@ -0,0 +1,77 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A learned index is a piecewise linear model of the position of the
+// entries of an index block, as a function of their keys.  A point lookup
+// then only has to search the few restart points of the index block that
+// the model predicts, instead of all of them.  The model is meant for
+// fixed-width integer keys, which it fits with a handful of segments.
+
+#ifndef STORAGE_LEVELDB_TABLE_LEARNED_INDEX_H_
+#define STORAGE_LEVELDB_TABLE_LEARNED_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+// Restart interval of the index blocks of tables with a learned index.
+// Prefix compression makes such index blocks smaller, and the model makes
+// up for the longer search.
+const int kLearnedIndexRestartInterval = 16;
+
+// A LearnedIndexBuilder fits the model of the keys added to it, which
+// are the keys of the entries of an index block in order.  Keys are
+// compared bytewise: the model maps each key to a number that sorts
+// alike, so it only fits keys of BytewiseComparator().
+//
+// The sequence of calls to LearnedIndexBuilder must match the regexp:
+//      AddKey* Finish
+class LearnedIndexBuilder {
+ public:
+  explicit LearnedIndexBuilder(int restart_interval);
+
+  LearnedIndexBuilder(const LearnedIndexBuilder&) = delete;
+  LearnedIndexBuilder& operator=(const LearnedIndexBuilder&) = delete;
+
+  void AddKey(const Slice& key);
+  Slice Finish();
+
+ private:
+  const int restart_interval_;
+  std::string keys_;           // Flattened key contents
+  std::vector<size_t> start_;  // Starting index in keys_ of each key
+  std::string result_;         // Model data computed so far
+};
+
+class LearnedIndexReader {
+ public:
+  // REQUIRES: "contents" must stay live while *this is live.
+  explicit LearnedIndexReader(const Slice& contents);
+
+  // Sets [*first, *last] to the range of restart points that the model
+  // predicts to hold the last index block entry whose key is before
+  // "key".  Returns false if the model cannot tell.
+  bool PredictRestarts(const Slice& key, uint32_t* first,
+                       uint32_t* last) const;
+
+  size_t size() const { return contents_.size(); }
+
+ private:
+  Slice contents_;
+  const char* segments_;  // Array of num_segments_ segments
+  uint32_t num_segments_;
+  uint32_t num_entries_;
+  uint32_t error_;  // Bound on the error of a prediction, in entries
+  uint32_t restart_interval_;
+  Slice prefix_;  // Common prefix of the keys
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_LEARNED_INDEX_H_
@@ -0,0 +1,156 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/learned_index.h"
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+// Returns v as 8 big-endian bytes, so that numbers and keys sort alike.
+static std::string Key(uint64_t v) {
+  std::string result(8, '\0');
+  for (int i = 7; i >= 0; i--) {
+    result[i] = static_cast<char>(v & 0xff);
+    v >>= 8;
+  }
+  return result;
+}
+
+class LearnedIndexTest : public testing::Test {
+ public:
+  LearnedIndexTest() : reader_(nullptr) {}
+
+  ~LearnedIndexTest() { delete reader_; }
+
+  void Add(const std::string& key) { keys_.push_back(key); }
+
+  void Build() {
+    std::sort(keys_.begin(), keys_.end());
+    LearnedIndexBuilder builder(kLearnedIndexRestartInterval);
+    for (const std::string& key : keys_) {
+      builder.AddKey(key);
+    }
+    model_ = builder.Finish().ToString();
+    delete reader_;
+    reader_ = new LearnedIndexReader(model_);
+  }
+
+  size_t ModelSize() const { return model_.size(); }
+
+  bool Predicts(const Slice& target) const {
+    uint32_t first, last;
+    return reader_->PredictRestarts(target, &first, &last);
+  }
+
+  // Checks that the predicted range holds the restart point of the last
+  // key before target, and returns the number of restart points in it.
+  uint32_t Check(const std::string& target) {
+    uint32_t first, last;
+    EXPECT_TRUE(reader_->PredictRestarts(target, &first, &last));
+    const size_t pos =
+        std::lower_bound(keys_.begin(), keys_.end(), target) - keys_.begin();
+    const uint32_t restart = pos > 0 ? (pos - 1) / kLearnedIndexRestartInterval
+                                     : 0;
+    EXPECT_LE(first, restart) << target;
+    EXPECT_GE(last, restart) << target;
+    return last - first + 1;
+  }
+
+ protected:
+  std::vector<std::string> keys_;
+
+ private:
+  std::string model_;
+  LearnedIndexReader* reader_;
+};
+
+TEST_F(LearnedIndexTest, Empty) {
+  Build();
+  ASSERT_TRUE(!Predicts("foo"));
+}
+
+TEST_F(LearnedIndexTest, Corrupt) {
+  Add("foo");
+  Build();
+  ASSERT_TRUE(Predicts("foo"));
+  LearnedIndexReader truncated(Slice("bad model"));
+  uint32_t first, last;
+  ASSERT_TRUE(!truncated.PredictRestarts("foo", &first, &last));
+}
+
+TEST_F(LearnedIndexTest, Small) {
+  Add("bar");
+  Add("foo");
+  Add("hello");
+  Add("world");
+  Build();
+  for (const char* target : {"", "a", "bar", "baz", "foo", "x", "zzz"}) {
+    ASSERT_EQ(1, Check(target));
+  }
+}
+
+TEST_F(LearnedIndexTest, FixedWidthIntegers) {
+  const int kNumKeys = 100000;
+  for (int i = 0; i < kNumKeys; i++) {
+    Add("user" + Key(uint64_t{1000003} * i));
+  }
+  Build();
+  // A single segment fits the keys
+  ASSERT_LE(ModelSize(), 100);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_LE(Check("user" + Key(uint64_t{1000003} * i)), 3);
+    ASSERT_LE(Check("user" + Key(uint64_t{1000003} * i + 1)), 3);
+  }
+  ASSERT_EQ(1, Check("a"));
+  ASSERT_EQ(1, Check("user"));
+  ASSERT_EQ(1, Check("z"));
+}
+
+TEST_F(LearnedIndexTest, DecimalKeys) {
+  char buf[20];
+  const int kNumKeys = 10000;
+  for (int i = 0; i < kNumKeys; i++) {
+    std::snprintf(buf, sizeof(buf), "%016d", 2 * i);
+    Add(buf);
+  }
+  Build();
+  std::fprintf(stderr, "Model bytes = %d\n", static_cast<int>(ModelSize()));
+  for (int i = 0; i < 2 * kNumKeys + 2; i++) {
+    std::snprintf(buf, sizeof(buf), "%016d", i);
+    ASSERT_LE(Check(buf), 3);
+  }
+}
+
+TEST_F(LearnedIndexTest, DuplicateKeys) {
+  for (int i = 0; i < 1000; i++) {
+    for (int j = 0; j < 1 + i % 5; j++) {
+      Add(Key(i * 10));
+    }
+  }
+  Build();
+  for (int i = 0; i < 10010; i++) {
+    Check(Key(i));
+  }
+}
+
+TEST_F(LearnedIndexTest, RandomKeys) {
+  Random rnd(301);
+  for (int i = 0; i < 10000; i++) {
+    std::string key = Key((uint64_t{rnd.Next()} << 32) | rnd.Next());
+    key.resize(rnd.Uniform(12));
+    Add(key);
+  }
+  Build();
+  std::fprintf(stderr, "Model bytes = %d\n", static_cast<int>(ModelSize()));
+  for (int i = 0; i < 10000; i++) {
+    Check(keys_[rnd.Uniform(keys_.size())]);
+    Check(Key((uint64_t{rnd.Next()} << 32) | rnd.Next()));
+  }
+}
+
+}  // namespace leveldb
@@ -4,6 +4,10 @@
 
 #include "table/merger.h"
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 #include "table/iterator_wrapper.h"
@@ -22,6 +26,7 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
+    tree_.resize(n);
   }
 
   ~MergingIterator() override { delete[] children_; }
@@ -32,24 +37,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildTree();
   }
 
   void SeekToLast() override {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    BuildTree();
   }
 
   void Seek(const Slice& target) override {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildTree();
   }
 
   void Next() override {
@@ -72,10 +77,13 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      current_->Next();
+      BuildTree();
+      return;
     }
 
     current_->Next();
-    FindSmallest();
+    ReplayWinner();
   }
 
   void Prev() override {
@@ -101,10 +109,13 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      current_->Prev();
+      BuildTree();
+      return;
     }
 
     current_->Prev();
-    FindLargest();
+    ReplayWinner();
   }
 
   Slice key() const override {
@@ -132,47 +143,78 @@ class MergingIterator : public Iterator {
   // Which direction is the iterator moving?
   enum Direction { kForward, kReverse };
 
-  void FindSmallest();
-  void FindLargest();
+  // Returns true if child "a" comes before child "b" in direction_.
+  // Exhausted children come after all others.  Among children with equal
+  // keys, the forward direction visits the one that was passed first to
+  // the constructor first, and the reverse direction the one passed last.
+  bool Precedes(int a, int b) const {
+    const IteratorWrapper& x = children_[a];
+    const IteratorWrapper& y = children_[b];
+    if (!x.Valid()) return false;
+    if (!y.Valid()) return true;
+    const int r = comparator_->Compare(x.key(), y.key());
+    if (direction_ == kForward) {
+      return r < 0 || (r == 0 && a < b);
+    } else {
+      return r > 0 || (r == 0 && a > b);
+    }
+  }
+
+  // Rebuilds tree_ from all children and sets current_ to the winner.
+  void BuildTree();
+
+  // Replays the matches of the winner after it has moved, and sets
+  // current_ to the new winner.
+  void ReplayWinner();
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
   IteratorWrapper* current_;
   Direction direction_;
+
+  // A tournament tree of loser indexes over the children: child i is leaf
+  // n_ + i, and internal node p, with children 2p and 2p + 1, holds the
+  // loser of the match played there.  tree_[0] holds the overall winner,
+  // the child that comes first in direction_.  After the winner moves,
+  // only the matches on its path to the root are replayed, so each step
+  // costs O(log n) comparisons instead of O(n).
+  std::vector<int> tree_;
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = nullptr;
+void MergingIterator::BuildTree() {
+  // Enter the children one at a time.  The first player to reach a node
+  // waits there; the second one plays against it and the winner moves up.
+  std::fill(tree_.begin(), tree_.end(), -1);
   for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == nullptr) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
+    int player = i;
+    int p = (n_ + i) / 2;
+    while (p >= 1) {
+      if (tree_[p] < 0) {
+        tree_[p] = player;
+        break;
+      }
+      if (Precedes(tree_[p], player)) {
+        std::swap(tree_[p], player);
       }
+      p /= 2;
+    }
+    if (p == 0) {
+      tree_[0] = player;
     }
   }
-  current_ = smallest;
+  current_ = children_[tree_[0]].Valid() ? &children_[tree_[0]] : nullptr;
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = nullptr;
-  for (int i = n_ - 1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == nullptr) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+void MergingIterator::ReplayWinner() {
+  int winner = tree_[0];
+  for (int p = (n_ + winner) / 2; p >= 1; p /= 2) {
+    if (Precedes(tree_[p], winner)) {
+      std::swap(tree_[p], winner);
     }
   }
-  current_ = largest;
+  tree_[0] = winner;
+  current_ = children_[winner].Valid() ? &children_[winner] : nullptr;
 }
 }  // namespace
 
@@ -4,14 +4,19 @@
 
 #include "leveldb/table.h"
 
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/slice_transform.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/learned_index.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
@@ -20,7 +25,13 @@ namespace leveldb {
 struct Table::Rep {
   ~Rep() {
     delete filter;
+    delete full_filter;
     delete[] filter_data;
+    delete range_filter;
+    delete[] range_filter_data;
+    delete learned_index;
+    delete[] learned_index_data;
+    delete filter_index;
     delete index_block;
   }
 
@@ -28,11 +39,22 @@ struct Table::Rep {
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
+  // At most one of filter, full_filter and filter_index is set
   FilterBlockReader* filter;
+  FullFilterBlockReader* full_filter;  // Filter of the whole table
   const char* filter_data;
+  size_t filter_size;  // Of filter or full_filter
+  Block* filter_index;  // Top-level index of partitioned filters
+  bool prefix_filtered;  // Filters hold prefixes of options.prefix_extractor
+  RangeFilterBlockReader* range_filter;  // Range filter of the user keys
+  const char* range_filter_data;
+  size_t range_filter_size;
+  LearnedIndexReader* learned_index;  // Model of the index block entries
+  const char* learned_index_data;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
-  Block* index_block;
+  Block* index_block;  // The top level of the index if partitioned_index
+  bool partitioned_index;
 };
 
 Status Table::Open(const Options& options, RandomAccessFile* file,
@@ -69,9 +91,19 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
+    rep->partitioned_index = footer.partitioned_index();
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
+    rep->filter_size = 0;
     rep->filter = nullptr;
+    rep->full_filter = nullptr;
+    rep->filter_index = nullptr;
+    rep->prefix_filtered = false;
+    rep->range_filter = nullptr;
+    rep->range_filter_data = nullptr;
+    rep->range_filter_size = 0;
+    rep->learned_index = nullptr;
+    rep->learned_index_data = nullptr;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   }
@@ -79,8 +111,17 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   return s;
 }
 
+// Positions "iter" over a metaindex block at the entry for "key" and
+// returns true if there is one.
+static bool SeekMetaEntry(Iterator* iter, const std::string& key) {
+  iter->Seek(key);
+  return iter->Valid() && iter->key() == Slice(key);
+}
+
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
+  if (rep_->options.filter_policy == nullptr &&
+      rep_->options.range_filter_policy == nullptr &&
+      !rep_->options.learned_index) {
     return;  // Do not need any metadata
   }
 
@@ -97,18 +138,38 @@ void Table::ReadMeta(const Footer& footer) {
   }
   Block* meta = new Block(contents);
 
+  // The table has either filters per 2KB of data blocks, a filter of the
+  // whole table, or partitioned filters.
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    const std::string name = rep_->options.filter_policy->Name();
+    if (SeekMetaEntry(iter, "filter." + name)) {
+      ReadFilter(iter->value(), false);
+    } else if (SeekMetaEntry(iter, "fullfilter." + name)) {
+      ReadFilter(iter->value(), true);
+    } else if (SeekMetaEntry(iter, "partitionedfilter." + name)) {
+      ReadFilterIndex(iter->value());
+    }
+    const SliceTransform* prefix_extractor = rep_->options.prefix_extractor;
+    if (prefix_extractor != nullptr) {
+      rep_->prefix_filtered = SeekMetaEntry(
+          iter, std::string("prefixextractor.") + prefix_extractor->Name());
+    }
+  }
+  const RangeFilterPolicy* range_policy = rep_->options.range_filter_policy;
+  if (range_policy != nullptr &&
+      SeekMetaEntry(iter, std::string("rangefilter.") + range_policy->Name())) {
+    ReadRangeFilter(iter->value());
+  }
+  if (rep_->options.learned_index && !rep_->partitioned_index &&
+      SeekMetaEntry(iter, "learnedindex")) {
+    ReadLearnedIndex(iter->value());
   }
   delete iter;
   delete meta;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value, bool full) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
@@ -128,11 +189,92 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();  // Will need to delete later
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  rep_->filter_size = block.data.size();
+  if (full) {
+    rep_->full_filter =
+        new FullFilterBlockReader(rep_->options.filter_policy, block.data);
+  } else {
+    rep_->filter =
+        new FilterBlockReader(rep_->options.filter_policy, block.data);
+  }
+}
+
+void Table::ReadRangeFilter(const Slice& range_filter_handle_value) {
+  Slice v = range_filter_handle_value;
+  BlockHandle range_filter_handle;
+  if (!range_filter_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, range_filter_handle, &block).ok()) {
+    return;
+  }
+  if (block.heap_allocated) {
+    rep_->range_filter_data = block.data.data();  // Will need to delete later
+  }
+  rep_->range_filter_size = block.data.size();
+  rep_->range_filter = new RangeFilterBlockReader(
+      rep_->options.range_filter_policy, block.data);
+}
+
+void Table::ReadLearnedIndex(const Slice& learned_index_handle_value) {
+  Slice v = learned_index_handle_value;
+  BlockHandle learned_index_handle;
+  if (!learned_index_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, learned_index_handle, &block).ok()) {
+    return;
+  }
+  if (block.heap_allocated) {
+    rep_->learned_index_data = block.data.data();  // Will need to delete later
+  }
+  rep_->learned_index = new LearnedIndexReader(block.data);
+}
+
+void Table::ReadFilterIndex(const Slice& filter_index_handle_value) {
+  Slice v = filter_index_handle_value;
+  BlockHandle filter_index_handle;
+  if (!filter_index_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, filter_index_handle, &block).ok()) {
+    return;
+  }
+  rep_->filter_index = new Block(block);
 }
 
 Table::~Table() { delete rep_; }
 
+size_t Table::ApproximateMemoryUsage() const {
+  size_t usage = rep_->index_block->size() + rep_->filter_size +
+                 rep_->range_filter_size;
+  if (rep_->filter_index != nullptr) {
+    usage += rep_->filter_index->size();
+  }
+  if (rep_->learned_index != nullptr) {
+    usage += rep_->learned_index->size();
+  }
+  return usage;
+}
+
 static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
 }
@@ -148,48 +290,86 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
-// Convert an index iterator value (i.e., an encoded BlockHandle)
-// into an iterator over the contents of the corresponding block.
-Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
-                             const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
-  Block* block = nullptr;
-  Cache::Handle* cache_handle = nullptr;
+// A partition of a partitioned filter, as held in the block cache.
+struct FilterPartition {
+  FilterPartition(const FilterPolicy* policy, const BlockContents& contents)
+      : data(contents.heap_allocated ? contents.data.data() : nullptr),
+        reader(policy, contents.data) {}
+  ~FilterPartition() { delete[] data; }
 
-  BlockHandle handle;
+  const char* const data;  // Filter data to delete, if heap allocated
+  FullFilterBlockReader reader;
+};
+
+static void DeleteCachedFilterPartition(const Slice& key, void* value) {
+  delete reinterpret_cast<FilterPartition*>(value);
+}
+
+// Decodes an index block entry: the handle of a data block, followed by the
+// size of the block's hash index if it has one.
+static Status DecodeIndexValue(const Slice& index_value, BlockHandle* handle,
+                               uint64_t* hash_index_size) {
   Slice input = index_value;
-  Status s = handle.DecodeFrom(&input);
+  Status s = handle->DecodeFrom(&input);
+  *hash_index_size = 0;
+  if (s.ok() && !input.empty() && !GetVarint64(&input, hash_index_size)) {
+    s = Status::Corruption("bad hash index size");
+  }
   // We intentionally allow extra stuff in index_value so that we
   // can add more features in the future.
+  return s;
+}
+
+Status Table::LoadBlock(const ReadOptions& options, const Slice& index_value,
+                        Block** block, Cache::Handle** cache_handle) {
+  Cache* block_cache = rep_->options.block_cache;
+  *block = nullptr;
+  *cache_handle = nullptr;
+
+  BlockHandle handle;
+  uint64_t hash_index_size;
+  Status s = DecodeIndexValue(index_value, &handle, &hash_index_size);
 
   if (s.ok()) {
     BlockContents contents;
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
+      EncodeFixed64(cache_key_buffer, rep_->cache_id);
       EncodeFixed64(cache_key_buffer + 8, handle.offset());
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
-      if (cache_handle != nullptr) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+      *cache_handle = block_cache->Lookup(key);
+      if (*cache_handle != nullptr) {
+        GetPerfContext()->block_cache_hit_count++;
+        *block = reinterpret_cast<Block*>(block_cache->Value(*cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        GetPerfContext()->block_cache_miss_count++;
+        s = ReadBlock(rep_->file, options, handle, &contents, hash_index_size);
         if (s.ok()) {
-          block = new Block(contents);
+          *block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
+            *cache_handle = block_cache->Insert(key, *block, (*block)->size(),
+                                                &DeleteCachedBlock);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(rep_->file, options, handle, &contents, hash_index_size);
       if (s.ok()) {
-        block = new Block(contents);
+        *block = new Block(contents);
       }
     }
   }
+  return s;
+}
+
+// Convert an index iterator value (i.e., an encoded BlockHandle)
+// into an iterator over the contents of the corresponding block.
+Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
+                             const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  Block* block;
+  Cache::Handle* cache_handle;
+  Status s = table->LoadBlock(options, index_value, &block, &cache_handle);
 
   Iterator* iter;
   if (block != nullptr) {
@@ -197,7 +377,8 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
     if (cache_handle == nullptr) {
       iter->RegisterCleanup(&DeleteBlock, block, nullptr);
     } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+      iter->RegisterCleanup(&ReleaseBlock, table->rep_->options.block_cache,
+                            cache_handle);
     }
   } else {
     iter = NewErrorIterator(s);
@@ -205,45 +386,363 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   return iter;
 }
 
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter = rep_->index_block->NewIterator(rep_->options.comparator);
+  if (rep_->partitioned_index) {
+    // Index partitions are read and cached like data blocks
+    iter = NewTwoLevelIterator(iter, &Table::BlockReader,
+                               const_cast<Table*>(this), options);
+  }
+  return iter;
+}
+
+void Table::SeekIndex(Iterator* index_iter, const Slice& key) const {
+  LearnedIndexReader* model = rep_->learned_index;
+  uint32_t first, last;
+  if (model != nullptr && key.size() >= 8 &&
+      model->PredictRestarts(Slice(key.data(), key.size() - 8), &first,
+                             &last)) {
+    rep_->index_block->SeekInRange(index_iter, key, first, last);
+  } else {
+    index_iter->Seek(key);
+  }
+}
+
+bool Table::HasFilter() const {
+  return rep_->filter != nullptr || rep_->full_filter != nullptr ||
+         rep_->filter_index != nullptr;
+}
+
+bool Table::KeyMayMatch(const ReadOptions& options, const Slice& key,
+                        const Slice& filter_key) {
+  if (rep_->full_filter != nullptr) {
+    return rep_->full_filter->KeyMayMatch(filter_key);
+  }
+  if (rep_->filter_index == nullptr) {
+    return true;
+  }
+  Iterator* iter = rep_->filter_index->NewIterator(rep_->options.comparator);
+  iter->Seek(key);
+  if (!iter->Valid()) {
+    // The key is past the last key of the table, unless there was an error
+    bool may_match = !iter->status().ok();
+    delete iter;
+    return may_match;
+  }
+  BlockHandle handle;
+  Slice input = iter->value();
+  Status s = handle.DecodeFrom(&input);
+  delete iter;
+  if (!s.ok()) {
+    return true;  // Errors are treated as potential matches
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  FilterPartition* partition = nullptr;
+  Cache::Handle* cache_handle = nullptr;
+  if (block_cache != nullptr) {
+    cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != nullptr) {
+      GetPerfContext()->block_cache_hit_count++;
+    } else {
+      GetPerfContext()->block_cache_miss_count++;
+    }
+  }
+  if (cache_handle != nullptr) {
+    partition =
+        reinterpret_cast<FilterPartition*>(block_cache->Value(cache_handle));
+  } else {
+    BlockContents contents;
+    if (!ReadBlock(rep_->file, options, handle, &contents).ok()) {
+      return true;
+    }
+    partition = new FilterPartition(rep_->options.filter_policy, contents);
+    if (block_cache != nullptr && contents.cachable && options.fill_cache) {
+      cache_handle = block_cache->Insert(cache_key, partition,
+                                         contents.data.size(),
+                                         &DeleteCachedFilterPartition);
+    }
+  }
+  bool may_match = partition->reader.KeyMayMatch(filter_key);
+  if (cache_handle != nullptr) {
+    block_cache->Release(cache_handle);
+  } else {
+    delete partition;
+  }
+  return may_match;
+}
+
+bool Table::BlockPrefixMayMatch(void* arg, const ReadOptions& options,
+                                const Slice& index_value, const Slice& target) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  Rep* r = table->rep_;
+  std::string prefix_key;
+  if (!r->prefix_filtered ||
+      !FilterPrefixKey(r->options.prefix_extractor, target, &prefix_key)) {
+    return true;
+  }
+  if (r->filter != nullptr) {
+    BlockHandle handle;
+    uint64_t hash_index_size;
+    if (!DecodeIndexValue(index_value, &handle, &hash_index_size).ok()) {
+      return true;  // Errors are treated as potential matches
+    }
+    return r->filter->KeyMayMatch(handle.offset(), prefix_key);
+  }
+  return table->KeyMayMatch(options, target, prefix_key);
+}
+
+bool Table::RangeMayMatch(const ReadOptions& options, const Slice& target) {
+  const Slice* upper_bound = options.iterate_upper_bound;
+  if (rep_->range_filter == nullptr || upper_bound == nullptr ||
+      target.size() < 8) {
+    return true;
+  }
+  return rep_->range_filter->RangeMayMatch(
+      Slice(target.data(), target.size() - 8), *upper_bound);
+}
+
+bool Table::SeekPastUpperBound(const ReadOptions& options,
+                               const Slice& target) const {
+  if (options.iterate_upper_bound == nullptr) {
+    return false;
+  }
+  // Sorts before all entries whose key is the bound but for the last 8
+  // bytes, which hold the largest tag
+  std::string bound = options.iterate_upper_bound->ToString();
+  bound.append(8, '\xff');
+  return rep_->options.comparator->Compare(target, bound) >= 0;
+}
+
+bool Table::BlockSeekMayMatch(void* arg, const ReadOptions& options,
+                              const Slice& index_value, const Slice& target) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  if (table->SeekPastUpperBound(options, target)) {
+    return true;
+  }
+  return BlockPrefixMayMatch(arg, options, index_value, target) &&
+         table->RangeMayMatch(options, target);
+}
+
+bool Table::SeekMayMatch(const ReadOptions& options, const Slice& target) {
+  if (SeekPastUpperBound(options, target)) {
+    return true;
+  }
+  return PrefixMayMatch(options, target) && RangeMayMatch(options, target);
+}
+
+bool Table::PrefixMayMatch(const ReadOptions& options, const Slice& target) {
+  if (!rep_->prefix_filtered) {
+    return true;
+  }
+  if (rep_->filter == nullptr) {
+    // The filter does not depend on the data block
+    return BlockPrefixMayMatch(this, options, Slice(), target);
+  }
+  Iterator* iiter = NewIndexIterator(options);
+  iiter->Seek(target);
+  bool may_match = !iiter->Valid() ||
+                   BlockPrefixMayMatch(this, options, iiter->value(), target);
+  delete iiter;
+  return may_match;
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  return NewTwoLevelIterator(NewIndexIterator(options), &Table::BlockReader,
+                             const_cast<Table*>(this), options,
+                             &Table::BlockSeekMayMatch);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
+  PerfContext* perf = GetPerfContext();
+  if (!KeyMayMatch(options, k, k)) {
+    perf->filter_useful_count++;
+    return Status::OK();  // Not found
+  }
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
-  iiter->Seek(k);
+  Iterator* iiter = NewIndexIterator(options);
+  SeekIndex(iiter, k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
     FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
     if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
-      // Not found
+      perf->filter_useful_count++;  // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        (*handle_result)(arg, block_iter->key(), block_iter->value());
+      if (HasFilter()) {
+        perf->filter_positive_count++;
       }
-      s = block_iter->status();
-      delete block_iter;
+      Block* block;
+      Cache::Handle* cache_handle;
+      s = LoadBlock(options, iiter->value(), &block, &cache_handle);
+      if (s.ok()) {
+        Iterator* block_iter = block->NewIterator(rep_->options.comparator);
+        block->SeekForGet(block_iter, k);
+        if (block_iter->Valid()) {
+          (*handle_result)(arg, block_iter->key(), block_iter->value());
+        }
+        s = block_iter->status();
+        delete block_iter;
+        if (cache_handle != nullptr) {
+          rep_->options.block_cache->Release(cache_handle);
+        } else {
+          delete block;
+        }
+      }
+    }
+  }
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  return s;
+}
+
+Status Table::InternalMultiGet(const ReadOptions& options, int n,
+                               const Slice* keys, void* const* args,
+                               void (*handle_result)(void*, const Slice&,
+                                                     const Slice&)) {
+  // A data block that holds some of the keys.
+  struct BlockLookup {
+    BlockHandle handle;
+    uint64_t hash_index_size;
+    std::vector<int> keys;  // Indexes of the keys that fall into the block
+    Block* block = nullptr;
+    Cache::Handle* cache_handle = nullptr;
+  };
+
+  // Find the data block of every key that passes the filter.  The keys
+  // are sorted, so the keys that share a block are adjacent.
+  Status s;
+  const Comparator* cmp = rep_->options.comparator;
+  std::vector<BlockLookup> blocks;
+  PerfContext* perf = GetPerfContext();
+  const bool has_filter = HasFilter();
+  Iterator* iiter = NewIndexIterator(options);
+  for (int i = 0; i < n; i++) {
+    const Slice& k = keys[i];
+    if (!KeyMayMatch(options, k, k)) {
+      perf->filter_useful_count++;
+      continue;  // Not found
+    }
+    // The index entry of the previous key is also the one of k unless k is
+    // past its last key.
+    if (!iiter->Valid() || cmp->Compare(iiter->key(), k) < 0) {
+      SeekIndex(iiter, k);
+      if (!iiter->Valid()) {
+        break;  // This and all later keys are past the end of the table
+      }
+    }
+    BlockHandle handle;
+    uint64_t hash_index_size;
+    s = DecodeIndexValue(iiter->value(), &handle, &hash_index_size);
+    if (!s.ok()) {
+      break;
+    }
+    FilterBlockReader* filter = rep_->filter;
+    if (filter != nullptr && !filter->KeyMayMatch(handle.offset(), k)) {
+      perf->filter_useful_count++;
+      continue;  // Not found
+    }
+    if (has_filter) {
+      perf->filter_positive_count++;
     }
+    if (blocks.empty() || blocks.back().handle.offset() != handle.offset()) {
+      blocks.emplace_back();
+      blocks.back().handle = handle;
+      blocks.back().hash_index_size = hash_index_size;
+    }
+    blocks.back().keys.push_back(i);
   }
   if (s.ok()) {
     s = iiter->status();
   }
   delete iiter;
+
+  // Take what we can from the block cache and read all other blocks with
+  // a single batch of reads.
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  std::vector<BlockHandle> missing;
+  std::vector<uint64_t> missing_hash_index_sizes;
+  std::vector<size_t> missing_blocks;
+  for (size_t b = 0; b < blocks.size(); b++) {
+    if (block_cache != nullptr) {
+      EncodeFixed64(cache_key_buffer + 8, blocks[b].handle.offset());
+      Cache::Handle* h = block_cache->Lookup(
+          Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+      if (h != nullptr) {
+        perf->block_cache_hit_count++;
+        blocks[b].cache_handle = h;
+        blocks[b].block = reinterpret_cast<Block*>(block_cache->Value(h));
+        continue;
+      }
+      perf->block_cache_miss_count++;
+    }
+    missing.push_back(blocks[b].handle);
+    missing_hash_index_sizes.push_back(blocks[b].hash_index_size);
+    missing_blocks.push_back(b);
+  }
+  if (!missing.empty()) {
+    std::vector<BlockContents> contents(missing.size());
+    std::vector<Status> statuses(missing.size());
+    ReadBlocks(rep_->file, options, static_cast<int>(missing.size()),
+               missing.data(), missing_hash_index_sizes.data(),
+               contents.data(), statuses.data());
+    for (size_t m = 0; m < missing.size(); m++) {
+      if (!statuses[m].ok()) {
+        if (s.ok()) {
+          s = statuses[m];
+        }
+        continue;
+      }
+      BlockLookup* lookup = &blocks[missing_blocks[m]];
+      lookup->block = new Block(contents[m]);
+      if (block_cache != nullptr && contents[m].cachable &&
+          options.fill_cache) {
+        EncodeFixed64(cache_key_buffer + 8, lookup->handle.offset());
+        lookup->cache_handle = block_cache->Insert(
+            Slice(cache_key_buffer, sizeof(cache_key_buffer)), lookup->block,
+            lookup->block->size(), &DeleteCachedBlock);
+      }
+    }
+  }
+
+  // Search every block for its keys.
+  for (BlockLookup& lookup : blocks) {
+    if (lookup.block == nullptr) {
+      continue;  // The read failed
+    }
+    Iterator* block_iter = lookup.block->NewIterator(cmp);
+    for (int i : lookup.keys) {
+      lookup.block->SeekForGet(block_iter, keys[i]);
+      if (block_iter->Valid()) {
+        (*handle_result)(args[i], block_iter->key(), block_iter->value());
+      }
+    }
+    if (s.ok()) {
+      s = block_iter->status();
+    }
+    delete block_iter;
+    if (lookup.cache_handle != nullptr) {
+      block_cache->Release(lookup.cache_handle);
+    } else {
+      delete lookup.block;
+    }
+  }
   return s;
 }
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
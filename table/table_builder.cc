@@ -10,16 +10,18 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/learned_index.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
 namespace leveldb {
 
 struct TableBuilder::Rep {
-  Rep(const Options& opt, WritableFile* f)
+  Rep(const Options& opt, WritableFile* f, int level)
       : options(opt),
         index_block_options(opt),
         file(f),
@@ -28,11 +30,38 @@ struct TableBuilder::Rep {
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
+        filter_block(opt.filter_policy == nullptr ||
+                             opt.partition_index_and_filters ||
+                             opt.full_table_filter
                          ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
-    index_block_options.block_restart_interval = 1;
+                         : new FilterBlockBuilder(opt.filter_policy, level)),
+        full_filter(opt.filter_policy == nullptr ||
+                            (!opt.partition_index_and_filters &&
+                             !opt.full_table_filter)
+                        ? nullptr
+                        : new FullFilterBlockBuilder(opt.filter_policy, level)),
+        range_filter(
+            opt.range_filter_policy == nullptr
+                ? nullptr
+                : new RangeFilterBlockBuilder(opt.range_filter_policy)),
+        partitioned(opt.partition_index_and_filters),
+        learned_index(!opt.learned_index || opt.partition_index_and_filters
+                          ? nullptr
+                          : new LearnedIndexBuilder(
+                                kLearnedIndexRestartInterval)),
+        top_index_block(&index_block_options),
+        filter_index_block(&index_block_options),
+        pending_index_entry(false),
+        pending_hash_index_size(0) {
+    SetIndexBlockOptions();
+  }
+
+  // Index blocks are searched on every lookup: restart points are usually
+  // kept at every entry, but the learned index narrows the search down.
+  void SetIndexBlockOptions() {
+    index_block_options.block_restart_interval =
+        learned_index != nullptr ? kLearnedIndexRestartInterval : 1;
+    index_block_options.data_block_hash_index = false;
   }
 
   Options options;
@@ -45,7 +74,24 @@ struct TableBuilder::Rep {
   std::string last_key;
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
-  FilterBlockBuilder* filter_block;
+  FilterBlockBuilder* filter_block;     // Filters per 2KB of data blocks
+  FullFilterBlockBuilder* full_filter;  // Filter of the table or partition
+  // Prefix last added to the filters with prefix_extractor, cleared at the
+  // start of every data block so that each block's filter gets it.
+  std::string last_prefix;
+  std::string prefix_key;  // Scratch space for FilterPrefixKey()
+  // Range filter of the user keys, i.e. the keys without their 8-byte tag
+  RangeFilterBlockBuilder* range_filter;
+
+  // With a partitioned index, index_block holds the current index
+  // partition, which is written out once it is large enough, and so is
+  // the full filter of the keys of its data blocks.  The top-level blocks
+  // map the last key of every partition to its handle.
+  const bool partitioned;
+  // Model of the user keys of the index entries, if not partitioned
+  LearnedIndexBuilder* learned_index;
+  BlockBuilder top_index_block;
+  BlockBuilder filter_index_block;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -58,12 +104,17 @@ struct TableBuilder::Rep {
   // Invariant: r->pending_index_entry is true only if data_block is empty.
   bool pending_index_entry;
   BlockHandle pending_handle;  // Handle to add to index block
+  // Size of the hash index that follows the pending block, trailer
+  // included, or zero if it has none.  Recorded after the handle in the
+  // index block entry, where readers that do not know about it ignore it.
+  uint64_t pending_hash_index_size;
 
   std::string compressed_output;
 };
 
-TableBuilder::TableBuilder(const Options& options, WritableFile* file)
-    : rep_(new Rep(options, file)) {
+TableBuilder::TableBuilder(const Options& options, WritableFile* file,
+                           int level)
+    : rep_(new Rep(options, file, level)) {
   if (rep_->filter_block != nullptr) {
     rep_->filter_block->StartBlock(0);
   }
@@ -72,6 +123,9 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->full_filter;
+  delete rep_->range_filter;
+  delete rep_->learned_index;
   delete rep_;
 }
 
@@ -82,12 +136,32 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.partition_index_and_filters !=
+      rep_->options.partition_index_and_filters) {
+    return Status::InvalidArgument(
+        "changing index partitioning while building table");
+  }
+  if (options.full_table_filter != rep_->options.full_table_filter) {
+    return Status::InvalidArgument("changing filter kind while building table");
+  }
+  if (options.prefix_extractor != rep_->options.prefix_extractor) {
+    return Status::InvalidArgument(
+        "changing prefix extractor while building table");
+  }
+  if (options.range_filter_policy != rep_->options.range_filter_policy) {
+    return Status::InvalidArgument(
+        "changing range filter policy while building table");
+  }
+  if (options.learned_index != rep_->options.learned_index) {
+    return Status::InvalidArgument(
+        "changing learned index while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
   rep_->options = options;
   rep_->index_block_options = options;
-  rep_->index_block_options.block_restart_interval = 1;
+  rep_->SetIndexBlockOptions();
   return Status::OK();
 }
 
@@ -102,15 +176,32 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
+    AddIndexEntry();
     r->pending_index_entry = false;
   }
 
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(key);
   }
+  if (r->full_filter != nullptr) {
+    r->full_filter->AddKey(key);
+  }
+  if (r->options.prefix_extractor != nullptr &&
+      FilterPrefixKey(r->options.prefix_extractor, key, &r->prefix_key)) {
+    const Slice prefix(r->prefix_key.data(), r->prefix_key.size() - 8);
+    if (r->last_prefix.empty() || prefix != Slice(r->last_prefix)) {
+      if (r->filter_block != nullptr) {
+        r->filter_block->AddKey(r->prefix_key);
+      }
+      if (r->full_filter != nullptr) {
+        r->full_filter->AddKey(r->prefix_key);
+      }
+      r->last_prefix.assign(prefix.data(), prefix.size());
+    }
+  }
+  if (r->range_filter != nullptr && key.size() >= 8) {
+    r->range_filter->AddKey(Slice(key.data(), key.size() - 8));
+  }
 
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
@@ -136,6 +227,46 @@ void TableBuilder::Flush() {
   if (r->filter_block != nullptr) {
     r->filter_block->StartBlock(r->offset);
   }
+  r->last_prefix.clear();
+}
+
+void TableBuilder::AddIndexEntry() {
+  Rep* r = rep_;
+  std::string handle_encoding;
+  r->pending_handle.EncodeTo(&handle_encoding);
+  if (r->pending_hash_index_size > 0) {
+    PutVarint64(&handle_encoding, r->pending_hash_index_size);
+  }
+  r->index_block.Add(r->last_key, Slice(handle_encoding));
+  if (r->learned_index != nullptr) {
+    // Entries are numbered by the model, so every one needs a key
+    const size_t tag_size = r->last_key.size() >= 8 ? 8 : 0;
+    r->learned_index->AddKey(
+        Slice(r->last_key.data(), r->last_key.size() - tag_size));
+  }
+  if (r->partitioned &&
+      r->index_block.CurrentSizeEstimate() >= r->options.metadata_block_size) {
+    FlushIndexPartition();
+  }
+}
+
+void TableBuilder::FlushIndexPartition() {
+  Rep* r = rep_;
+  assert(r->partitioned && !r->index_block.empty());
+  if (!ok()) return;
+  // r->last_key is the key of the last entry of the partition, which is
+  // >= all keys of its data blocks and < all keys of later data blocks.
+  BlockHandle handle;
+  std::string handle_encoding;
+  WriteBlock(&r->index_block, &handle);
+  handle.EncodeTo(&handle_encoding);
+  r->top_index_block.Add(r->last_key, Slice(handle_encoding));
+  if (ok() && r->full_filter != nullptr) {
+    WriteRawBlock(r->full_filter->Finish(), kNoCompression, &handle);
+    handle_encoding.clear();
+    handle.EncodeTo(&handle_encoding);
+    r->filter_index_block.Add(r->last_key, Slice(handle_encoding));
+  }
 }
 
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
@@ -186,6 +317,20 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
+
+  // The hash index of a data block follows it as a block of its own.  It
+  // is not covered by the block's handle, so that readers that do not know
+  // about hash indexes still find the data block where they expect it.
+  if (block == &r->data_block) {
+    r->pending_hash_index_size = 0;
+    Slice hash_index = block->FinishHashIndex();
+    if (ok() && !hash_index.empty()) {
+      BlockHandle hash_index_handle;
+      WriteRawBlock(hash_index, kNoCompression, &hash_index_handle);
+      r->pending_hash_index_size =
+          hash_index_handle.size() + kBlockTrailerSize;
+    }
+  }
   block->Reset();
 }
 
@@ -216,40 +361,91 @@ Status TableBuilder::Finish() {
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, range_filter_handle, learned_index_handle,
+      metaindex_block_handle, index_block_handle;
 
-  // Write filter block
+  // Complete the index
+  if (ok() && r->pending_index_entry) {
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    AddIndexEntry();
+    r->pending_index_entry = false;
+  }
+  if (r->partitioned && !r->index_block.empty()) {
+    FlushIndexPartition();
+  }
+
+  // Write filter block: the filters per 2KB of data blocks, the filter of
+  // the whole table, or the top-level filter index of partitioned filters
+  const char* filter_meta_key = nullptr;
   if (ok() && r->filter_block != nullptr) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+    filter_meta_key = "filter.";
+  } else if (ok() && r->full_filter != nullptr && !r->partitioned) {
+    WriteRawBlock(r->full_filter->Finish(), kNoCompression,
+                  &filter_block_handle);
+    filter_meta_key = "fullfilter.";
+  } else if (ok() && r->full_filter != nullptr) {
+    WriteBlock(&r->filter_index_block, &filter_block_handle);
+    filter_meta_key = "partitionedfilter.";
+  }
+
+  // Write range filter block
+  if (ok() && r->range_filter != nullptr) {
+    WriteRawBlock(r->range_filter->Finish(), kNoCompression,
+                  &range_filter_handle);
+  }
+
+  // Write learned index block
+  if (ok() && r->learned_index != nullptr) {
+    WriteRawBlock(r->learned_index->Finish(), kNoCompression,
+                  &learned_index_handle);
   }
 
   // Write metaindex block
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+    if (filter_meta_key != nullptr) {
+      // Add mapping from "<kind>filter.Name" to location of filter data
+      std::string key = filter_meta_key;
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->learned_index != nullptr) {
+      // Add mapping from "learnedindex" to location of the model.  Tables
+      // with a learned index have no partitioned filters, whose key would
+      // sort after it.
+      std::string handle_encoding;
+      learned_index_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("learnedindex", handle_encoding);
+    }
+    if (filter_meta_key != nullptr &&
+        r->options.prefix_extractor != nullptr) {
+      // Record that the filters hold the prefixes of keys, and how they
+      // were derived.  Sorts after all "<kind>filter." keys.
+      std::string key = "prefixextractor.";
+      key.append(r->options.prefix_extractor->Name());
+      meta_index_block.Add(key, Slice());
+    }
+    if (r->range_filter != nullptr) {
+      // Add mapping from "rangefilter.Name" to location of the range filter
+      std::string key = "rangefilter.";
+      key.append(r->options.range_filter_policy->Name());
+      std::string handle_encoding;
+      range_filter_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
 
-  // Write index block
+  // Write index block, or the top-level index of a partitioned index
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
-    }
-    WriteBlock(&r->index_block, &index_block_handle);
+    WriteBlock(r->partitioned ? &r->top_index_block : &r->index_block,
+               &index_block_handle);
   }
 
   // Write footer
@@ -257,6 +453,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_partitioned_index(r->partitioned);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
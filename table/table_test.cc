@@ -4,8 +4,11 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "db/dbformat.h"
@@ -19,6 +22,9 @@
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/learned_index.h"
+#include "table/merger.h"
+#include "util/coding.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -371,12 +377,59 @@ class DBConstructor : public Constructor {
   DB* db_;
 };
 
-enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST };
+// Spreads the data over many blocks and merges them with a
+// MergingIterator.
+class MergerConstructor : public Constructor {
+ public:
+  explicit MergerConstructor(const Comparator* cmp)
+      : Constructor(cmp), comparator_(cmp) {
+    for (int i = 0; i < kNumChildren; i++) {
+      children_[i] = new BlockConstructor(cmp);
+    }
+  }
+  ~MergerConstructor() override {
+    for (int i = 0; i < kNumChildren; i++) {
+      delete children_[i];
+    }
+  }
+  Status FinishImpl(const Options& options, const KVMap& data) override {
+    // Runs of consecutive keys go to the same child, and the last child
+    // stays empty.
+    std::vector<KVMap> parts(kNumChildren, KVMap(STLLessThan(comparator_)));
+    int i = 0;
+    for (const auto& kvp : data) {
+      parts[(i++ / 3) % (kNumChildren - 1)].insert(kvp);
+    }
+    for (int c = 0; c < kNumChildren; c++) {
+      Status s = children_[c]->FinishImpl(options, parts[c]);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+  Iterator* NewIterator() const override {
+    Iterator* list[kNumChildren];
+    for (int i = 0; i < kNumChildren; i++) {
+      list[i] = children_[i]->NewIterator();
+    }
+    return NewMergingIterator(comparator_, list, kNumChildren);
+  }
+
+ private:
+  static constexpr int kNumChildren = 37;
+
+  const Comparator* const comparator_;
+  BlockConstructor* children_[kNumChildren];
+};
+
+enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST, MERGER_TEST };
 
 struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool partitioned = false;
 };
 
 static const TestArgs kTestArgList[] = {
@@ -387,6 +440,10 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
 
+    // Partitioned index
+    {TABLE_TEST, false, 16, true},
+    {TABLE_TEST, true, 1, true},
+
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
     {BLOCK_TEST, false, 1024},
@@ -401,6 +458,9 @@ static const TestArgs kTestArgList[] = {
     // Do not bother with restart interval variations for DB
     {DB_TEST, false, 16},
     {DB_TEST, true, 16},
+
+    {MERGER_TEST, false, 16},
+    {MERGER_TEST, true, 16},
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -417,6 +477,8 @@ class Harness : public testing::Test {
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
+    options_.partition_index_and_filters = args.partitioned;
+    options_.metadata_block_size = 64;
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
@@ -433,6 +495,9 @@ class Harness : public testing::Test {
       case DB_TEST:
         constructor_ = new DBConstructor(options_.comparator);
         break;
+      case MERGER_TEST:
+        constructor_ = new MergerConstructor(options_.comparator);
+        break;
     }
   }
 
@@ -785,6 +850,234 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
+TEST(TableTest, DataBlockHashIndex) {
+  // Several entries for most user keys, and only every other user key, so
+  // that lookups of missing keys fall between present ones.
+  InternalKeyComparator icmp(BytewiseComparator());
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; i += 2) {
+    char user_key[16];
+    std::snprintf(user_key, sizeof(user_key), "k%06d", i);
+    for (int seq = 3; seq > i % 3; seq--) {
+      keys.push_back(
+          InternalKey(user_key, seq, kTypeValue).Encode().ToString());
+    }
+  }
+  Options options;
+  options.comparator = &icmp;
+  options.block_size = 512;
+  options.block_restart_interval = 4;
+  options.data_block_hash_index = true;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  for (const std::string& key : keys) {
+    builder.Add(key, "v" + key);
+  }
+  ASSERT_LEVELDB_OK(builder.Finish());
+  StringSource source(sink.contents());
+
+  // Walk the data blocks through the index block.
+  Footer footer;
+  Slice footer_input(sink.contents().data() + sink.contents().size() -
+                         Footer::kEncodedLength,
+                     Footer::kEncodedLength);
+  ASSERT_LEVELDB_OK(footer.DecodeFrom(&footer_input));
+  ReadOptions read_options;
+  read_options.verify_checksums = true;
+  BlockContents index_contents;
+  ASSERT_LEVELDB_OK(ReadBlock(&source, read_options, footer.index_handle(),
+                              &index_contents));
+  Block index_block(index_contents);
+  Iterator* iiter = index_block.NewIterator(&icmp);
+  size_t num_keys = 0;
+  int num_blocks = 0;
+  for (iiter->SeekToFirst(); iiter->Valid(); iiter->Next()) {
+    Slice index_value = iiter->value();
+    BlockHandle handle;
+    ASSERT_LEVELDB_OK(handle.DecodeFrom(&index_value));
+    uint64_t hash_index_size;
+    ASSERT_TRUE(GetVarint64(&index_value, &hash_index_size));
+    ASSERT_GT(hash_index_size, 0);
+
+    // Readers that only decode the handle still read the block.
+    BlockContents plain_contents;
+    ASSERT_LEVELDB_OK(
+        ReadBlock(&source, read_options, handle, &plain_contents));
+    ASSERT_TRUE(plain_contents.hash_index.empty());
+    BlockContents contents;
+    ASSERT_LEVELDB_OK(ReadBlock(&source, read_options, handle, &contents,
+                                hash_index_size));
+    ASSERT_FALSE(contents.hash_index.empty());
+    ASSERT_EQ(plain_contents.data.ToString(), contents.data.ToString());
+    Block plain_block(plain_contents);
+    Block block(contents);
+    num_blocks++;
+
+    Iterator* scan = plain_block.NewIterator(&icmp);
+    Iterator* iter = block.NewIterator(&icmp);
+    for (scan->SeekToFirst(); scan->Valid(); scan->Next()) {
+      ASSERT_EQ(keys[num_keys], scan->key().ToString());
+      num_keys++;
+      // Every entry is found from any sequence number at or above its own.
+      ParsedInternalKey parsed;
+      ASSERT_TRUE(ParseInternalKey(scan->key(), &parsed));
+      for (SequenceNumber seq = parsed.sequence; seq <= 4; seq++) {
+        InternalKey target(parsed.user_key, seq, kValueTypeForSeek);
+        Iterator* expected = plain_block.NewIterator(&icmp);
+        expected->Seek(target.Encode());
+        block.SeekForGet(iter, target.Encode());
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(expected->key().ToString(), iter->key().ToString());
+        ASSERT_EQ(expected->value().ToString(), iter->value().ToString());
+        delete expected;
+      }
+      // A missing user key is never reported as present.
+      std::string missing = parsed.user_key.ToString();
+      missing.back()++;
+      block.SeekForGet(iter,
+                       InternalKey(missing, 4, kValueTypeForSeek).Encode());
+      if (iter->Valid()) {
+        ASSERT_NE(Slice(missing), ExtractUserKey(iter->key()));
+      }
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    delete scan;
+  }
+  ASSERT_LEVELDB_OK(iiter->status());
+  delete iiter;
+  ASSERT_EQ(keys.size(), num_keys);
+  ASSERT_GT(num_blocks, 1);
+
+  // The table reads back in full through its iterator.
+  Table* table;
+  ASSERT_LEVELDB_OK(
+      Table::Open(options, &source, sink.contents().size(), &table));
+  Iterator* titer = table->NewIterator(read_options);
+  num_keys = 0;
+  for (titer->SeekToFirst(); titer->Valid(); titer->Next()) {
+    ASSERT_EQ(keys[num_keys], titer->key().ToString());
+    ASSERT_EQ("v" + keys[num_keys], titer->value().ToString());
+    num_keys++;
+  }
+  ASSERT_LEVELDB_OK(titer->status());
+  ASSERT_EQ(keys.size(), num_keys);
+  delete titer;
+  delete table;
+}
+
+// Returns the user key "v" as 8 big-endian bytes.
+static std::string IntegerKey(uint64_t v) {
+  std::string result;
+  PutFixed64(&result, v);
+  std::reverse(result.begin(), result.end());
+  return result;
+}
+
+TEST(TableTest, LearnedIndex) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  StringSink plain_sink;
+  TableBuilder plain_builder(options, &plain_sink);
+  options.learned_index = true;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  std::vector<std::string> keys;
+  for (uint64_t i = 0; i < 10000; i++) {
+    keys.push_back(InternalKey(IntegerKey(i * 7), 1, kTypeValue).Encode()
+                       .ToString());
+    plain_builder.Add(keys.back(), "v");
+    builder.Add(keys.back(), "v");
+  }
+  ASSERT_LEVELDB_OK(plain_builder.Finish());
+  ASSERT_LEVELDB_OK(builder.Finish());
+  StringSource plain_source(plain_sink.contents());
+  StringSource source(sink.contents());
+
+  // The index block is prefix-compressed, which more than pays for the
+  // model.
+  Table* plain_table;
+  ASSERT_LEVELDB_OK(Table::Open(options, &plain_source,
+                                plain_sink.contents().size(), &plain_table));
+  Table* table;
+  ASSERT_LEVELDB_OK(
+      Table::Open(options, &source, sink.contents().size(), &table));
+  std::fprintf(stderr, "Index bytes: %d plain, %d learned\n",
+               static_cast<int>(plain_table->ApproximateMemoryUsage()),
+               static_cast<int>(table->ApproximateMemoryUsage()));
+  ASSERT_LT(table->ApproximateMemoryUsage() * 3,
+            plain_table->ApproximateMemoryUsage() * 2);
+  delete plain_table;
+
+  // Find the index block and the model.
+  Footer footer;
+  Slice footer_input(sink.contents().data() + sink.contents().size() -
+                         Footer::kEncodedLength,
+                     Footer::kEncodedLength);
+  ASSERT_LEVELDB_OK(footer.DecodeFrom(&footer_input));
+  ReadOptions read_options;
+  read_options.verify_checksums = true;
+  BlockContents index_contents, meta_contents, model_contents;
+  ASSERT_LEVELDB_OK(ReadBlock(&source, read_options, footer.index_handle(),
+                              &index_contents));
+  ASSERT_LEVELDB_OK(ReadBlock(&source, read_options, footer.metaindex_handle(),
+                              &meta_contents));
+  Block index_block(index_contents);
+  Block meta_block(meta_contents);
+  Iterator* meta_iter = meta_block.NewIterator(BytewiseComparator());
+  meta_iter->Seek("learnedindex");
+  ASSERT_TRUE(meta_iter->Valid());
+  ASSERT_EQ("learnedindex", meta_iter->key().ToString());
+  Slice handle_value = meta_iter->value();
+  BlockHandle model_handle;
+  ASSERT_LEVELDB_OK(model_handle.DecodeFrom(&handle_value));
+  ASSERT_LEVELDB_OK(
+      ReadBlock(&source, read_options, model_handle, &model_contents));
+  LearnedIndexReader model(model_contents.data);
+  delete meta_iter;
+
+  // Seeks within the predicted restart points, or within wrong ones, end up
+  // where a full Seek() does.
+  Iterator* expected = index_block.NewIterator(&icmp);
+  Iterator* iter = index_block.NewIterator(&icmp);
+  int num_seeks = 0;
+  for (uint64_t i = 0; i < 10000 * 7 + 2; i += 3) {
+    InternalKey target(IntegerKey(i), kMaxSequenceNumber, kValueTypeForSeek);
+    expected->Seek(target.Encode());
+    uint32_t first, last;
+    ASSERT_TRUE(model.PredictRestarts(IntegerKey(i), &first, &last));
+    ASSERT_LE(last - first, 2);
+    const uint32_t ranges[][2] = {{first, last}, {0, 0}, {1000, 1000}};
+    for (const auto& range : ranges) {
+      index_block.SeekInRange(iter, target.Encode(), range[0], range[1]);
+      ASSERT_EQ(expected->Valid(), iter->Valid());
+      if (expected->Valid()) {
+        ASSERT_EQ(expected->key().ToString(), iter->key().ToString());
+      }
+    }
+    num_seeks++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  delete expected;
+  ASSERT_GT(num_seeks, 1000);
+
+  // The table reads back in full through its iterator.
+  Iterator* titer = table->NewIterator(read_options);
+  size_t num_keys = 0;
+  for (titer->SeekToFirst(); titer->Valid(); titer->Next()) {
+    ASSERT_EQ(keys[num_keys], titer->key().ToString());
+    num_keys++;
+  }
+  ASSERT_LEVELDB_OK(titer->status());
+  ASSERT_EQ(keys.size(), num_keys);
+  delete titer;
+  delete table;
+}
+
 static bool CompressionSupported(CompressionType type) {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -14,11 +14,14 @@ namespace leveldb {
 namespace {
 
 typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
+typedef bool (*SeekMayMatchFunction)(void*, const ReadOptions&, const Slice&,
+                                     const Slice&);
 
 class TwoLevelIterator : public Iterator {
  public:
   TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
-                   void* arg, const ReadOptions& options);
+                   void* arg, const ReadOptions& options,
+                   SeekMayMatchFunction seek_may_match);
 
   ~TwoLevelIterator() override;
 
@@ -58,6 +61,7 @@ class TwoLevelIterator : public Iterator {
   void InitDataBlock();
 
   BlockFunction block_function_;
+  SeekMayMatchFunction seek_may_match_;  // Null unless checked in Seek()
   void* arg_;
   const ReadOptions options_;
   Status status_;
@@ -70,8 +74,13 @@ class TwoLevelIterator : public Iterator {
 
 TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
                                    BlockFunction block_function, void* arg,
-                                   const ReadOptions& options)
+                                   const ReadOptions& options,
+                                   SeekMayMatchFunction seek_may_match)
     : block_function_(block_function),
+      seek_may_match_(options.prefix_same_as_start ||
+                              options.iterate_upper_bound != nullptr
+                          ? seek_may_match
+                          : nullptr),
       arg_(arg),
       options_(options),
       index_iter_(index_iter),
@@ -81,6 +90,14 @@ TwoLevelIterator::~TwoLevelIterator() = default;
 
 void TwoLevelIterator::Seek(const Slice& target) {
   index_iter_.Seek(target);
+  if (seek_may_match_ != nullptr && index_iter_.Valid() &&
+      !(*seek_may_match_)(arg_, options_, index_iter_.value(), target)) {
+    // The keys with the prefix of target are adjacent, and so are the keys
+    // before the upper bound, so if the block that target falls into has
+    // none at or after target, no later block has any.
+    SetDataIterator(nullptr);
+    return;
+  }
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.Seek(target);
   SkipEmptyDataBlocksForward();
@@ -164,8 +181,10 @@ void TwoLevelIterator::InitDataBlock() {
 
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function, void* arg,
-                              const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+                              const ReadOptions& options,
+                              SeekMayMatchFunction seek_may_match) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              seek_may_match);
 }
 
 }  // namespace leveldb
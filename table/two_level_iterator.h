@@ -20,11 +20,21 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// If options.prefix_same_as_start or options.iterate_upper_bound is set
+// and "seek_may_match" is non-null, Seek(target) first asks
+// (*seek_may_match)(arg, options, index_value, target) whether the block
+// that target falls into may hold a key at or after target that has the
+// prefix of target, or is before the upper bound.  If not, no later block
+// can either, and the iterator becomes invalid without reading the block.
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(void* arg, const ReadOptions& options,
                                 const Slice& index_value),
-    void* arg, const ReadOptions& options);
+    void* arg, const ReadOptions& options,
+    bool (*seek_may_match)(void* arg, const ReadOptions& options,
+                           const Slice& index_value,
+                           const Slice& target) = nullptr);
 
 }  // namespace leveldb
 
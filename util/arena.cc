@@ -4,12 +4,32 @@
 
 #include "util/arena.h"
 
+#include <new>
+
+#include "util/mutexlock.h"
+
 namespace leveldb {
 
 static const int kBlockSize = 4096;
+static const int kAlign = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+
+// Header at the start of a block shared by the concurrent allocation
+// variants.  Blocks are never freed before the arena, so a thread may
+// keep carving from a block that has already been replaced.
+struct Arena::SharedBlock {
+  explicit SharedBlock(size_t size) : size(size), used(0) {}
+
+  char* data() { return reinterpret_cast<char*>(this + 1); }
+
+  const size_t size;         // Bytes available after the header
+  std::atomic<size_t> used;  // Bytes handed out so far
+};
 
 Arena::Arena()
-    : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
+    : alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      memory_usage_(0),
+      shared_block_(nullptr) {}
 
 Arena::~Arena() {
   for (size_t i = 0; i < blocks_.size(); i++) {
@@ -36,7 +56,7 @@ char* Arena::AllocateFallback(size_t bytes) {
 }
 
 char* Arena::AllocateAligned(size_t bytes) {
-  const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+  const int align = kAlign;
   static_assert((align & (align - 1)) == 0,
                 "Pointer size should be a power of 2");
   size_t current_mod = reinterpret_cast<uintptr_t>(alloc_ptr_) & (align - 1);
@@ -55,6 +75,50 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+char* Arena::AllocateConcurrently(size_t bytes) {
+  return AllocateShared(bytes, 1);
+}
+
+char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  return AllocateShared(bytes, kAlign);
+}
+
+char* Arena::AllocateShared(size_t bytes, size_t align) {
+  assert(bytes > 0);
+  if (bytes > kBlockSize / 4) {
+    // As in AllocateFallback(), big objects get a block of their own.
+    MutexLock l(&mu_);
+    return AllocateNewBlock(bytes);
+  }
+
+  while (true) {
+    SharedBlock* block = shared_block_.load(std::memory_order_acquire);
+    if (block != nullptr) {
+      size_t used = block->used.load(std::memory_order_relaxed);
+      while (true) {
+        uintptr_t current = reinterpret_cast<uintptr_t>(block->data()) + used;
+        size_t slop = (align - (current & (align - 1))) & (align - 1);
+        size_t end = used + slop + bytes;
+        if (end > block->size) {
+          break;
+        }
+        if (block->used.compare_exchange_weak(used, end,
+                                              std::memory_order_relaxed)) {
+          return block->data() + used + slop;
+        }
+      }
+    }
+
+    // The block is full.  Replace it, unless another thread already has.
+    MutexLock l(&mu_);
+    if (shared_block_.load(std::memory_order_relaxed) == block) {
+      char* memory = AllocateNewBlock(sizeof(SharedBlock) + kBlockSize);
+      shared_block_.store(new (memory) SharedBlock(kBlockSize),
+                          std::memory_order_release);
+    }
+  }
+}
+
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
   blocks_.push_back(result);
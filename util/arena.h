@@ -11,6 +11,9 @@
 #include <cstdint>
 #include <vector>
 
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
 namespace leveldb {
 
 class Arena {
@@ -28,6 +31,13 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc.
   char* AllocateAligned(size_t bytes);
 
+  // Like Allocate() and AllocateAligned(), but safe to call from several
+  // threads at once.  Small allocations are carved from a shared block
+  // with a compare-and-swap; mu_ is only taken to replace a full block.
+  // Must not race with the unsynchronized variants.
+  char* AllocateConcurrently(size_t bytes) LOCKS_EXCLUDED(mu_);
+  char* AllocateAlignedConcurrently(size_t bytes) LOCKS_EXCLUDED(mu_);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -35,6 +45,9 @@ class Arena {
   }
 
  private:
+  struct SharedBlock;
+
+  char* AllocateShared(size_t bytes, size_t align) LOCKS_EXCLUDED(mu_);
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
 
@@ -50,6 +63,12 @@ class Arena {
   // TODO(costan): This member is accessed via atomics, but the others are
   //               accessed without any locking. Is this OK?
   std::atomic<size_t> memory_usage_;
+
+  // Block the concurrent allocation variants currently carve from.
+  std::atomic<SharedBlock*> shared_block_;
+
+  // Serializes block allocation by the concurrent variants.
+  port::Mutex mu_;
 };
 
 inline char* Arena::Allocate(size_t bytes) {
@@ -4,7 +4,11 @@
 
 #include "util/arena.h"
 
+#include <atomic>
+#include <cstring>
+
 #include "gtest/gtest.h"
+#include "leveldb/env.h"
 #include "util/random.h"
 
 namespace leveldb {
@@ -58,4 +62,60 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+struct ConcurrentArenaState {
+  Arena arena;
+  std::atomic<int> done{0};
+};
+
+struct ConcurrentArenaThread {
+  ConcurrentArenaState* state;
+  int id;
+  std::vector<std::pair<size_t, char*>> allocated;
+};
+
+static void ConcurrentArenaBody(void* arg) {
+  ConcurrentArenaThread* t = reinterpret_cast<ConcurrentArenaThread*>(arg);
+  Random rnd(301 + t->id);
+  for (int i = 0; i < 20000; i++) {
+    size_t s = rnd.OneIn(1000) ? rnd.Uniform(6000) + 1 : rnd.Uniform(100) + 1;
+    char* r;
+    if (rnd.OneIn(2)) {
+      r = t->state->arena.AllocateAlignedConcurrently(s);
+      ASSERT_EQ(0, reinterpret_cast<uintptr_t>(r) & (sizeof(void*) - 1));
+    } else {
+      r = t->state->arena.AllocateConcurrently(s);
+    }
+    // Tag the allocation with our id; another thread handed overlapping
+    // memory would overwrite it.
+    std::memset(r, t->id, s);
+    t->allocated.push_back(std::make_pair(s, r));
+  }
+  t->state->done.fetch_add(1, std::memory_order_release);
+}
+
+TEST(ArenaTest, Concurrent) {
+  static const int kThreads = 4;
+  ConcurrentArenaState state;
+  ConcurrentArenaThread threads[kThreads];
+  for (int id = 0; id < kThreads; id++) {
+    threads[id].state = &state;
+    threads[id].id = id;
+    Env::Default()->StartThread(ConcurrentArenaBody, &threads[id]);
+  }
+  while (state.done.load(std::memory_order_acquire) < kThreads) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+
+  size_t bytes = 0;
+  for (int id = 0; id < kThreads; id++) {
+    for (const auto& allocation : threads[id].allocated) {
+      bytes += allocation.first;
+      for (size_t b = 0; b < allocation.first; b++) {
+        ASSERT_EQ(id, allocation.second[b]);
+      }
+    }
+  }
+  ASSERT_GE(state.arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
@@ -0,0 +1,304 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Binary fuse filters ("Binary Fuse Filters: Fast and Smaller Than Xor
+// Filters", Graf and Lemire, 2022).  Every key maps to three slots of an
+// array of r-bit fingerprints, in three consecutive segments of the array.
+// The array is filled so that the xor of the three slots of every key is
+// the fingerprint of the key; a key that is not in the filter passes with
+// a probability of 2^-r.  The array holds about 1.125 slots per key, so the
+// filter spends about 1.125 * r bits per key where a bloom filter with the
+// same false positive rate spends about 1.44 * r.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+// A filter is the packed array of fingerprints, padded so that every
+// fingerprint can be read with a 32-bit load, followed by:
+//    seed: fixed64
+//    segment_count: fixed32
+//    lg(segment_length): uint8
+//    fingerprint_bits: uint8
+// A filter with no fingerprint bits matches every key.
+const size_t kTrailerSize = 8 + 4 + 1 + 1;
+const size_t kFingerprintPadding = 3;
+const int kMaxFingerprintBits = 16;
+const int kMaxSegmentLengthBits = 18;
+
+// Number of seeds to try before giving up on building a filter.  A seed
+// fails with a small probability, so this is never reached in practice.
+const int kMaxAttempts = 100;
+
+uint64_t FuseKeyHash(const Slice& key) {
+  return (static_cast<uint64_t>(Hash(key.data(), key.size(), 0x1b873593))
+          << 32) |
+         Hash(key.data(), key.size(), 0xcc9e2d51);
+}
+
+// Finalizer of MurmurHash3, applied to the key hash plus the seed of the
+// filter so that a failed seed gives a different mapping on the next try.
+uint64_t FuseMix(uint64_t h, uint64_t seed) {
+  h += seed;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+struct FuseLayout {
+  uint32_t segment_length;
+  uint32_t segment_count;
+
+  uint32_t array_length() const {
+    return (segment_count + 2) * segment_length;
+  }
+
+  // Sets idx[0..2] to the slots of the mixed hash "h".
+  void Slots(uint64_t h, uint32_t idx[3]) const {
+    const uint64_t range =
+        static_cast<uint64_t>(segment_count) * segment_length;
+    const uint32_t mask = segment_length - 1;
+    idx[0] = static_cast<uint32_t>(((h >> 32) * range) >> 32);
+    idx[1] = (idx[0] + segment_length) ^
+             (static_cast<uint32_t>(h >> 18) & mask);
+    idx[2] = (idx[0] + 2 * segment_length) ^ (static_cast<uint32_t>(h) & mask);
+  }
+};
+
+// Sizes the array for n distinct keys as the reference implementation
+// does.  Small filters need proportionally more slots to be buildable.
+//
+// REQUIRES: n > 0
+FuseLayout ComputeLayout(size_t n) {
+  FuseLayout layout;
+  const int lg = std::min(
+      kMaxSegmentLengthBits,
+      static_cast<int>(std::floor(
+          std::log(static_cast<double>(n)) / std::log(3.33) + 2.25)));
+  layout.segment_length = 1u << lg;
+
+  size_t capacity = 0;
+  if (n > 1) {
+    const double size_factor =
+        std::max(1.125, 0.875 + 0.25 * std::log(1000000.0) /
+                                    std::log(static_cast<double>(n)));
+    capacity = static_cast<size_t>(std::round(n * size_factor));
+  }
+  const size_t segments =
+      (capacity + layout.segment_length - 1) / layout.segment_length;
+  layout.segment_count =
+      segments > 2 ? static_cast<uint32_t>(segments - 2) : 1;
+  return layout;
+}
+
+uint32_t Fingerprint(uint64_t h, int bits) {
+  return static_cast<uint32_t>(h ^ (h >> 32)) & ((1u << bits) - 1);
+}
+
+uint32_t GetSlot(const char* array, uint32_t i, int bits) {
+  const size_t bitpos = static_cast<size_t>(i) * bits;
+  return (DecodeFixed32(array + bitpos / 8) >> (bitpos % 8)) &
+         ((1u << bits) - 1);
+}
+
+// REQUIRES: slot i is still zero.
+void SetSlot(char* array, uint32_t i, int bits, uint32_t value) {
+  const size_t bitpos = static_cast<size_t>(i) * bits;
+  char* p = array + bitpos / 8;
+  EncodeFixed32(p, DecodeFixed32(p) | (value << (bitpos % 8)));
+}
+
+// Peels the keys with mixed hashes "hashes" off the slots of "layout":
+// repeatedly removes a key that is alone in one of its slots.  On success
+// returns true and appends every key's hash and the index (0..2) of its
+// slot that it was alone in to *order and *alone_in, in peeling order.
+bool Peel(const std::vector<uint64_t>& hashes, const FuseLayout& layout,
+          std::vector<uint64_t>* order, std::vector<uint8_t>* alone_in) {
+  const uint32_t array_length = layout.array_length();
+  // For every slot the number of keys in it (upper 6 bits) and the xor of
+  // the indexes 0..2 of the slot in those keys (lower 2 bits), and the xor
+  // of their hashes.  A slot with a single key then names that key.
+  std::vector<uint8_t> count(array_length, 0);
+  std::vector<uint64_t> xor_hash(array_length, 0);
+  uint32_t idx[3];
+  for (uint64_t h : hashes) {
+    layout.Slots(h, idx);
+    for (int i = 0; i < 3; i++) {
+      if ((count[idx[i]] >> 2) == 63) return false;
+      count[idx[i]] += 4;
+      count[idx[i]] ^= i;
+      xor_hash[idx[i]] ^= h;
+    }
+  }
+
+  std::vector<uint32_t> queue;
+  for (uint32_t i = 0; i < array_length; i++) {
+    if ((count[i] >> 2) == 1) queue.push_back(i);
+  }
+  order->clear();
+  alone_in->clear();
+  while (!queue.empty()) {
+    const uint32_t slot = queue.back();
+    queue.pop_back();
+    if ((count[slot] >> 2) != 1) continue;  // Emptied since it was queued
+    const uint64_t h = xor_hash[slot];
+    const int found = count[slot] & 3;
+    order->push_back(h);
+    alone_in->push_back(static_cast<uint8_t>(found));
+    layout.Slots(h, idx);
+    for (int i = 0; i < 3; i++) {
+      if (i == found) continue;
+      count[idx[i]] -= 4;
+      count[idx[i]] ^= i;
+      xor_hash[idx[i]] ^= h;
+      if ((count[idx[i]] >> 2) == 1) queue.push_back(idx[i]);
+    }
+    count[slot] = 0;
+  }
+  return order->size() == hashes.size();
+}
+
+void AppendMatchAllFilter(std::string* dst) {
+  PutFixed64(dst, 0);
+  PutFixed32(dst, 0);
+  dst->push_back(0);
+  dst->push_back(0);  // No fingerprint bits
+}
+
+void AppendBinaryFuseFilter(const Slice* keys, int n, int bits,
+                            std::string* dst) {
+  // Tables may hold several entries with the same user key, so the keys
+  // are not distinct.  Keys with equal hashes must only be added once.
+  std::vector<uint64_t> key_hashes(n);
+  for (int i = 0; i < n; i++) {
+    key_hashes[i] = FuseKeyHash(keys[i]);
+  }
+  std::sort(key_hashes.begin(), key_hashes.end());
+  key_hashes.erase(std::unique(key_hashes.begin(), key_hashes.end()),
+                   key_hashes.end());
+
+  if (key_hashes.empty()) {
+    PutFixed64(dst, 0);
+    PutFixed32(dst, 0);  // No segments
+    dst->push_back(0);
+    dst->push_back(static_cast<char>(bits));
+    return;
+  }
+
+  const FuseLayout layout = ComputeLayout(key_hashes.size());
+  std::vector<uint64_t> hashes(key_hashes.size());
+  std::vector<uint64_t> order;
+  std::vector<uint8_t> alone_in;
+  uint64_t seed = 0;
+  bool ok = false;
+  for (int attempt = 0; !ok && attempt < kMaxAttempts; attempt++) {
+    seed = FuseMix(attempt, 0x9e3779b97f4a7c15ull);
+    for (size_t i = 0; i < key_hashes.size(); i++) {
+      hashes[i] = FuseMix(key_hashes[i], seed);
+    }
+    ok = Peel(hashes, layout, &order, &alone_in);
+  }
+  if (!ok) {
+    AppendMatchAllFilter(dst);
+    return;
+  }
+
+  const size_t init_size = dst->size();
+  const size_t bytes =
+      (static_cast<size_t>(layout.array_length()) * bits + 7) / 8 +
+      kFingerprintPadding;
+  dst->resize(init_size + bytes, 0);
+  char* array = &(*dst)[init_size];
+  // Assign the slots in the reverse peeling order: the slot a key was
+  // alone in is then the last of its slots to be assigned.
+  uint32_t idx[3];
+  for (size_t i = order.size(); i-- > 0;) {
+    const uint64_t h = order[i];
+    const int found = alone_in[i];
+    layout.Slots(h, idx);
+    SetSlot(array, idx[found], bits,
+            Fingerprint(h, bits) ^ GetSlot(array, idx[(found + 1) % 3], bits) ^
+                GetSlot(array, idx[(found + 2) % 3], bits));
+  }
+
+  PutFixed64(dst, seed);
+  PutFixed32(dst, layout.segment_count);
+  int lg = 0;
+  while ((1u << lg) < layout.segment_length) lg++;
+  dst->push_back(static_cast<char>(lg));
+  dst->push_back(static_cast<char>(bits));
+}
+
+bool BinaryFuseKeyMayMatch(const Slice& key, const Slice& filter) {
+  if (filter.size() < kTrailerSize) return false;
+
+  const char* trailer = filter.data() + filter.size() - kTrailerSize;
+  const uint64_t seed = DecodeFixed64(trailer);
+  FuseLayout layout;
+  layout.segment_count = DecodeFixed32(trailer + 8);
+  const int lg = static_cast<unsigned char>(trailer[12]);
+  const int bits = static_cast<unsigned char>(trailer[13]);
+  if (bits == 0 || bits > kMaxFingerprintBits ||
+      lg > kMaxSegmentLengthBits) {
+    // Matches every key, or reserved for potentially new encodings.
+    return true;
+  }
+  if (layout.segment_count == 0) {
+    return false;  // Filter of no keys
+  }
+  layout.segment_length = 1u << lg;
+  const size_t bytes =
+      (static_cast<size_t>(layout.array_length()) * bits + 7) / 8 +
+      kFingerprintPadding;
+  if (filter.size() != bytes + kTrailerSize) {
+    return true;  // Do not trust a filter of the wrong size
+  }
+
+  const uint64_t h = FuseMix(FuseKeyHash(key), seed);
+  uint32_t idx[3];
+  layout.Slots(h, idx);
+  const char* array = filter.data();
+  return (GetSlot(array, idx[0], bits) ^ GetSlot(array, idx[1], bits) ^
+          GetSlot(array, idx[2], bits)) == Fingerprint(h, bits);
+}
+
+class BinaryFuseFilterPolicy : public FilterPolicy {
+ public:
+  explicit BinaryFuseFilterPolicy(int bits_per_key)
+      : bits_(std::max(1, std::min(kMaxFingerprintBits,
+                                   bits_per_key * 8 / 9))) {}
+
+  const char* Name() const override { return "leveldb.BinaryFuseFilter"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    AppendBinaryFuseFilter(keys, n, bits_, dst);
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    return BinaryFuseKeyMayMatch(key, filter);
+  }
+
+ private:
+  const int bits_;  // Bits per fingerprint
+};
+
+}  // namespace
+
+const FilterPolicy* NewBinaryFuseFilterPolicy(int bits_per_key) {
+  return new BinaryFuseFilterPolicy(bits_per_key);
+}
+
+}  // namespace leveldb
@@ -4,8 +4,22 @@
 
 #include "leveldb/filter_policy.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "leveldb/slice.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/hash.h"
+#include "util/monkey.h"
+#include "util/mutexlock.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LEVELDB_BLOOM_AVX2 1
+#else
+#define LEVELDB_BLOOM_AVX2 0
+#endif
 
 namespace leveldb {
 
@@ -14,69 +28,293 @@ static uint32_t BloomHash(const Slice& key) {
   return Hash(key.data(), key.size(), 0xbc9f1d34);
 }
 
+// Return the number of probes for a filter with "bits_per_key" bits/key.
+static size_t BloomProbes(double bits_per_key) {
+  // We intentionally round down to reduce probing cost a little bit
+  size_t k = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+  if (k < 1) k = 1;
+  if (k > 30) k = 30;
+  return k;
+}
+
+// Append to *dst a bloom filter of "bits" bits with "k" probes per key.
+static void AppendBloomFilter(const Slice* keys, int n, size_t bits, size_t k,
+                              std::string* dst) {
+  // For small n, we can see a very high false positive rate.  Fix it
+  // by enforcing a minimum bloom filter length.
+  if (bits < 64) bits = 64;
+
+  size_t bytes = (bits + 7) / 8;
+  bits = bytes * 8;
+
+  const size_t init_size = dst->size();
+  dst->resize(init_size + bytes, 0);
+  dst->push_back(static_cast<char>(k));  // Remember # of probes in filter
+  char* array = &(*dst)[init_size];
+  for (int i = 0; i < n; i++) {
+    // Use double-hashing to generate a sequence of hash values.
+    // See analysis in [Kirsch,Mitzenmacher 2006].
+    uint32_t h = BloomHash(keys[i]);
+    const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+    for (size_t j = 0; j < k; j++) {
+      const uint32_t bitpos = h % bits;
+      array[bitpos / 8] |= (1 << (bitpos % 8));
+      h += delta;
+    }
+  }
+}
+
+static bool BloomKeyMayMatch(const Slice& key, const Slice& bloom_filter) {
+  const size_t len = bloom_filter.size();
+  if (len < 2) return false;
+
+  const char* array = bloom_filter.data();
+  const size_t bits = (len - 1) * 8;
+
+  // Use the encoded k so that we can read filters generated by
+  // bloom filters created using different parameters.
+  const size_t k = array[len - 1];
+  if (k > 30) {
+    // Reserved for potentially new encodings for short bloom filters.
+    // Consider it a match.
+    return true;
+  }
+
+  uint32_t h = BloomHash(key);
+  const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+  for (size_t j = 0; j < k; j++) {
+    const uint32_t bitpos = h % bits;
+    if ((array[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+    h += delta;
+  }
+  return true;
+}
+
+// A blocked bloom filter is an array of 64-byte lines followed by the
+// number of probes.  Every key sets all of its bits in a single line, so a
+// lookup touches one line of the filter instead of k scattered bytes.
+// Confining the bits to a line costs a little accuracy, since some lines
+// get more keys than others.
+static const size_t kBloomLineBytes = 64;
+static const size_t kBloomLineBits = kBloomLineBytes * 8;
+
+// Probe counts above this are reserved for future encodings.
+static const size_t kMaxBlockedProbes = 16;
+
+static size_t BlockedBloomProbes(int bits_per_key) {
+  return std::min(BloomProbes(bits_per_key), kMaxBlockedProbes);
+}
+
+// The bit positions of the probes within the line are taken from the top
+// bits of successive multiples of a remix of the key hash.
+static const uint32_t kProbeMultiplier = 0x9e3779b9;
+
+static uint32_t ProbeHash(uint32_t h) {
+  // Finalizer of MurmurHash3.  Keys that map to the same line differ in
+  // the low bits of h only; mix them into all bits of the result.
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+static size_t BloomLine(uint32_t h, size_t num_lines) {
+  return static_cast<size_t>((static_cast<uint64_t>(h) * num_lines) >> 32);
+}
+
+static void AppendBlockedBloomFilter(const Slice* keys, int n, size_t bits,
+                                     size_t k, std::string* dst) {
+  const size_t num_lines =
+      std::max<size_t>(1, (bits + kBloomLineBits - 1) / kBloomLineBits);
+
+  const size_t init_size = dst->size();
+  dst->resize(init_size + num_lines * kBloomLineBytes, 0);
+  dst->push_back(static_cast<char>(k));  // Remember # of probes in filter
+  char* array = &(*dst)[init_size];
+  for (int i = 0; i < n; i++) {
+    const uint32_t h = BloomHash(keys[i]);
+    char* line = array + BloomLine(h, num_lines) * kBloomLineBytes;
+    uint32_t h2 = ProbeHash(h);
+    for (size_t j = 0; j < k; j++) {
+      const uint32_t bitpos = h2 >> 23;  // 0..511
+      line[bitpos / 8] |= (1 << (bitpos % 8));
+      h2 *= kProbeMultiplier;
+    }
+  }
+}
+
+static bool BlockedProbeScalar(const char* line, uint32_t h2, size_t k) {
+  for (size_t j = 0; j < k; j++) {
+    const uint32_t bitpos = h2 >> 23;
+    if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+    h2 *= kProbeMultiplier;
+  }
+  return true;
+}
+
+#if LEVELDB_BLOOM_AVX2
+// Checks eight probes at a time.  Viewed as sixteen little-endian 32-bit
+// words, bit "bitpos" of the line is bit bitpos % 32 of word bitpos / 32,
+// the same bit BlockedProbeScalar() looks at.
+__attribute__((target("avx2"))) static bool BlockedProbeAVX2(
+    const char* line, uint32_t h2, size_t k) {
+  // kProbeMultiplier^0 .. kProbeMultiplier^7
+  const __m256i powers =
+      _mm256_setr_epi32(0x00000001, 0x9e3779b9, 0xe35e67b1, 0x734297e9,
+                        0x35fbe861, 0xdeb7c719, 0x0448b211, 0x3459b749);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line));
+  const __m256i hi =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + 32));
+  for (int remaining = static_cast<int>(k); remaining > 0; remaining -= 8) {
+    const __m256i hashes = _mm256_mullo_epi32(_mm256_set1_epi32(h2), powers);
+    const __m256i bitpos = _mm256_srli_epi32(hashes, 23);
+    const __m256i word = _mm256_srli_epi32(bitpos, 5);
+    // Pick each word from the low or high half of the line by bit 3 of its
+    // index, moved to the sign bit that blendv looks at.
+    const __m256 words = _mm256_blendv_ps(
+        _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(lo, word)),
+        _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(hi, word)),
+        _mm256_castsi256_ps(_mm256_slli_epi32(word, 28)));
+    const __m256i bits = _mm256_sllv_epi32(
+        _mm256_set1_epi32(1), _mm256_and_si256(bitpos, _mm256_set1_epi32(31)));
+    const __m256i missing =
+        _mm256_andnot_si256(_mm256_castps_si256(words), bits);
+    const __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32(remaining),
+                                              lanes);
+    if (!_mm256_testz_si256(missing, active)) return false;
+    h2 *= 0xab25f4c1;  // kProbeMultiplier^8
+  }
+  return true;
+}
+
+static bool CpuHasAVX2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+#endif  // LEVELDB_BLOOM_AVX2
+
+static bool BlockedBloomKeyMayMatch(const Slice& key,
+                                    const Slice& bloom_filter) {
+  const size_t len = bloom_filter.size();
+  if (len < kBloomLineBytes + 1 || (len - 1) % kBloomLineBytes != 0) {
+    return false;
+  }
+
+  const char* array = bloom_filter.data();
+  const size_t k = static_cast<unsigned char>(array[len - 1]);
+  if (k > kMaxBlockedProbes) {
+    // Reserved for potentially new encodings.  Consider it a match.
+    return true;
+  }
+
+  const uint32_t h = BloomHash(key);
+  const char* line =
+      array + BloomLine(h, (len - 1) / kBloomLineBytes) * kBloomLineBytes;
+#if LEVELDB_BLOOM_AVX2
+  if (CpuHasAVX2()) {
+    return BlockedProbeAVX2(line, ProbeHash(h), k);
+  }
+#endif  // LEVELDB_BLOOM_AVX2
+  return BlockedProbeScalar(line, ProbeHash(h), k);
+}
+
 class BloomFilterPolicy : public FilterPolicy {
  public:
-  explicit BloomFilterPolicy(int bits_per_key) : bits_per_key_(bits_per_key) {
-    // We intentionally round down to reduce probing cost a little bit
-    k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
-    if (k_ < 1) k_ = 1;
-    if (k_ > 30) k_ = 30;
+  explicit BloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key), k_(BloomProbes(bits_per_key)) {}
+
+  const char* Name() const override { return "leveldb.BuiltinBloomFilter2"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    AppendBloomFilter(keys, n, n * bits_per_key_, k_, dst);
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
+    return BloomKeyMayMatch(key, bloom_filter);
   }
 
+ private:
+  size_t bits_per_key_;
+  size_t k_;
+};
+
+class MonkeyFilterPolicy : public FilterPolicy {
+ public:
+  explicit MonkeyFilterPolicy(double bits_per_key)
+      : bits_per_key_(bits_per_key) {}
+
+  // The filters are plain bloom filters, so share the bloom filter name.
   const char* Name() const override { return "leveldb.BuiltinBloomFilter2"; }
 
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
-    // Compute bloom filter size (in both bits and bytes)
-    size_t bits = n * bits_per_key_;
-
-    // For small n, we can see a very high false positive rate.  Fix it
-    // by enforcing a minimum bloom filter length.
-    if (bits < 64) bits = 64;
-
-    size_t bytes = (bits + 7) / 8;
-    bits = bytes * 8;
-
-    const size_t init_size = dst->size();
-    dst->resize(init_size + bytes, 0);
-    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
-    char* array = &(*dst)[init_size];
-    for (int i = 0; i < n; i++) {
-      // Use double-hashing to generate a sequence of hash values.
-      // See analysis in [Kirsch,Mitzenmacher 2006].
-      uint32_t h = BloomHash(keys[i]);
-      const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
-      for (size_t j = 0; j < k_; j++) {
-        const uint32_t bitpos = h % bits;
-        array[bitpos / 8] |= (1 << (bitpos % 8));
-        h += delta;
+    AppendFilter(keys, n, bits_per_key_, dst);
+  }
+
+  void CreateFilterForLevel(const Slice* keys, int n, int level,
+                            std::string* dst) const override {
+    double bits_per_key = bits_per_key_;
+    if (level >= 0) {
+      MutexLock l(&mu_);
+      if (static_cast<size_t>(level) < level_bits_.size()) {
+        bits_per_key = level_bits_[level];
       }
     }
+    AppendFilter(keys, n, bits_per_key, dst);
   }
 
   bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
-    const size_t len = bloom_filter.size();
-    if (len < 2) return false;
-
-    const char* array = bloom_filter.data();
-    const size_t bits = (len - 1) * 8;
-
-    // Use the encoded k so that we can read filters generated by
-    // bloom filters created using different parameters.
-    const size_t k = array[len - 1];
-    if (k > 30) {
-      // Reserved for potentially new encodings for short bloom filters.
-      // Consider it a match.
-      return true;
-    }
+    return BloomKeyMayMatch(key, bloom_filter);
+  }
 
-    uint32_t h = BloomHash(key);
-    const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
-    for (size_t j = 0; j < k; j++) {
-      const uint32_t bitpos = h % bits;
-      if ((array[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
-      h += delta;
+  void UpdateLevelSizes(const uint64_t* level_bytes, const int* level_runs,
+                        int num_levels) const override {
+    // Bytes stand in for the number of keys of a level; only the ratios
+    // between levels matter.
+    std::vector<double> entries(level_bytes, level_bytes + num_levels);
+    std::vector<double> bits(num_levels);
+    MonkeyBitsPerKey(num_levels, entries.data(), level_runs, bits_per_key_,
+                     bits.data());
+    MutexLock l(&mu_);
+    level_bits_.swap(bits);
+  }
+
+ private:
+  static void AppendFilter(const Slice* keys, int n, double bits_per_key,
+                           std::string* dst) {
+    if (bits_per_key < 1) {
+      // Not worth a filter.  Emit a filter that matches every key.
+      dst->push_back(0);
+      dst->push_back(static_cast<char>(kMatchAllProbes));
+      return;
     }
-    return true;
+    AppendBloomFilter(keys, n, static_cast<size_t>(n * bits_per_key),
+                      BloomProbes(bits_per_key), dst);
+  }
+
+  // Probe counts above 30 are treated as a match by BloomKeyMayMatch().
+  static const int kMatchAllProbes = 31;
+
+  const double bits_per_key_;
+  mutable port::Mutex mu_;
+  mutable std::vector<double> level_bits_ GUARDED_BY(mu_);
+};
+
+class BlockedBloomFilterPolicy : public FilterPolicy {
+ public:
+  explicit BlockedBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key), k_(BlockedBloomProbes(bits_per_key)) {}
+
+  const char* Name() const override { return "leveldb.BlockedBloomFilter"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    AppendBlockedBloomFilter(keys, n, n * bits_per_key_, k_, dst);
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
+    return BlockedBloomKeyMayMatch(key, bloom_filter);
   }
 
  private:
@@ -89,4 +327,12 @@ const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewMonkeyFilterPolicy(double bits_per_key) {
+  return new MonkeyFilterPolicy(bits_per_key);
+}
+
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BlockedBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace leveldb
@@ -3,9 +3,11 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "gtest/gtest.h"
+#include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/monkey.h"
 #include "util/testutil.h"
 
 namespace leveldb {
@@ -19,7 +21,8 @@ static Slice Key(int i, char* buffer) {
 
 class BloomTest : public testing::Test {
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  BloomTest() : BloomTest(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) {}
 
   ~BloomTest() { delete policy_; }
 
@@ -149,6 +152,275 @@ TEST_F(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters / 5);
 }
 
+// Checks filters of 1 to 10000 keys for false negatives, their size
+// against "bits_per_key" plus "max_overhead" bytes, and their false
+// positive rate against "max_rate" (and, for most of them, "good_rate").
+static void CheckVaryingLengths(BloomTest* t, int bits_per_key,
+                                size_t max_overhead, double good_rate,
+                                double max_rate) {
+  char buffer[sizeof(int)];
+
+  // Count number of filters that significantly exceed the false positive rate
+  int mediocre_filters = 0;
+  int good_filters = 0;
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    t->Reset();
+    for (int i = 0; i < length; i++) {
+      t->Add(Key(i, buffer));
+    }
+    t->Build();
+
+    ASSERT_LE(t->FilterSize(), length * bits_per_key / 8 + max_overhead)
+        << length;
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(t->Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // Check false positive rate
+    double rate = t->FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                   rate * 100.0, length, static_cast<int>(t->FilterSize()));
+    }
+    ASSERT_LE(rate, max_rate);
+    if (rate > good_rate)
+      mediocre_filters++;  // Allowed, but not too often
+    else
+      good_filters++;
+  }
+  if (kVerbose >= 1) {
+    std::fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
+                 mediocre_filters);
+  }
+  ASSERT_LE(mediocre_filters, good_filters / 5);
+}
+
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) {}
+};
+
+TEST_F(BlockedBloomTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(BlockedBloomTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(BlockedBloomTest, VaryingLengths) {
+  // Filters are rounded up to whole 64-byte lines, plus the probe count.
+  CheckVaryingLengths(this, 10, 64 + 1, 0.015, 0.025);
+}
+
+class BinaryFuseTest : public BloomTest {
+ public:
+  BinaryFuseTest() : BloomTest(NewBinaryFuseFilterPolicy(10)) {}
+};
+
+TEST_F(BinaryFuseTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(BinaryFuseTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(BinaryFuseTest, DuplicateKeys) {
+  Add("hello");
+  Add("hello");
+  Add("world");
+  Add("hello");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+}
+
+TEST_F(BinaryFuseTest, VaryingLengths) {
+  // 8-bit fingerprints in about 1.3 slots per key, plus the rounding of
+  // the segments of small filters.  1/256 is about 0.4%.
+  CheckVaryingLengths(this, 11, 160, 0.008, 0.008);
+}
+
+struct FilterStats {
+  double false_positive_rate;
+  size_t bytes;
+  uint64_t build_micros;
+  uint64_t lookup_micros;
+};
+
+// Keys in the filters measured by MeasureFilter(), and lookups of keys
+// missing from them.
+static const int kBenchmarkKeys = 1 << 20;
+static const int kBenchmarkLookups = 1 << 20;
+
+// Builds a filter of kBenchmarkKeys keys with "policy", which should be too
+// large for the L1 and L2 caches, and measures how it answers lookups of
+// missing keys.
+static void MeasureFilter(const FilterPolicy* policy, FilterStats* stats) {
+  std::vector<std::string> keys(kBenchmarkKeys);
+  std::vector<Slice> key_slices(kBenchmarkKeys);
+  char buffer[sizeof(int)];
+  for (int i = 0; i < kBenchmarkKeys; i++) {
+    keys[i] = Key(i, buffer).ToString();
+    key_slices[i] = keys[i];
+  }
+
+  std::string filter;
+  uint64_t start = Env::Default()->NowMicros();
+  policy->CreateFilter(key_slices.data(), kBenchmarkKeys, &filter);
+  stats->build_micros = Env::Default()->NowMicros() - start;
+  stats->bytes = filter.size();
+  for (int i = 0; i < kBenchmarkKeys; i += 97) {
+    ASSERT_TRUE(policy->KeyMayMatch(key_slices[i], filter));
+  }
+
+  start = Env::Default()->NowMicros();
+  int matches = 0;
+  for (int i = 0; i < kBenchmarkLookups; i++) {
+    if (policy->KeyMayMatch(Key(i + 1000000000, buffer), filter)) {
+      matches++;
+    }
+  }
+  stats->lookup_micros = Env::Default()->NowMicros() - start;
+  stats->false_positive_rate = matches / static_cast<double>(kBenchmarkLookups);
+  if (kVerbose >= 1) {
+    std::fprintf(stderr,
+                 "%-28s: %5.2f%% false positives, %6.1f ns/lookup, "
+                 "%5.2f bits/key, built in %d ms\n",
+                 policy->Name(), stats->false_positive_rate * 100.0,
+                 stats->lookup_micros * 1000.0 / kBenchmarkLookups,
+                 stats->bytes * 8.0 / kBenchmarkKeys,
+                 static_cast<int>(stats->build_micros / 1000));
+  }
+}
+
+// Compares the false positive rate and lookup speed of both bloom filter
+// policies.
+TEST(BloomBenchmark, PlainVersusBlocked) {
+  const FilterPolicy* policies[2] = {NewBloomFilterPolicy(10),
+                                     NewBlockedBloomFilterPolicy(10)};
+  FilterStats stats[2] = {};
+  for (int p = 0; p < 2; p++) {
+    ASSERT_NO_FATAL_FAILURE(MeasureFilter(policies[p], &stats[p]));
+    delete policies[p];
+  }
+  ASSERT_LE(stats[0].false_positive_rate, 0.0125);
+  ASSERT_LE(stats[1].false_positive_rate, 0.015);
+}
+
+// A binary fuse filter with 8 bits per key is about as selective as a
+// bloom filter with 10 bits per key.
+TEST(BloomBenchmark, BinaryFuseSpace) {
+  const FilterPolicy* policies[2] = {NewBloomFilterPolicy(10),
+                                     NewBinaryFuseFilterPolicy(8)};
+  FilterStats stats[2] = {};
+  for (int p = 0; p < 2; p++) {
+    ASSERT_NO_FATAL_FAILURE(MeasureFilter(policies[p], &stats[p]));
+    delete policies[p];
+  }
+  ASSERT_LE(stats[1].false_positive_rate, stats[0].false_positive_rate);
+  ASSERT_LE(stats[1].bytes, stats[0].bytes * 8 / 10);
+}
+
 // Different bits-per-byte
 
+TEST(MonkeyTest, Allocation) {
+  // Three levels with a size ratio of 10, one run each.
+  const double entries[4] = {0, 1000, 10000, 100000};
+  const int runs[4] = {0, 1, 1, 1};
+  double bits[4];
+  MonkeyBitsPerKey(4, entries, runs, 10, bits);
+
+  // Empty levels get the average.
+  ASSERT_EQ(10, bits[0]);
+
+  // Smaller levels get more bits per key, the largest level fewer.
+  ASSERT_GT(bits[1], bits[2]);
+  ASSERT_GT(bits[2], bits[3]);
+  ASSERT_LT(bits[3], 10);
+
+  // The memory budget is preserved.
+  double memory = 0;
+  for (int i = 0; i < 4; i++) memory += bits[i] * entries[i];
+  ASSERT_NEAR(10 * 111000, memory, 1);
+
+  // The false positive rate of every level is proportional to its size.
+  const double ln2_squared = std::log(2.0) * std::log(2.0);
+  const double p1 = std::exp(-bits[1] * ln2_squared);
+  const double p2 = std::exp(-bits[2] * ln2_squared);
+  ASSERT_NEAR(10.0, p2 / p1, 1e-6);
+}
+
+TEST(MonkeyTest, TinyBudget) {
+  // With hardly any memory, the largest level gets no filter at all.
+  const double entries[3] = {10, 100, 100000};
+  const int runs[3] = {1, 1, 1};
+  double bits[3];
+  MonkeyBitsPerKey(3, entries, runs, 0.01, bits);
+  ASSERT_EQ(0, bits[2]);
+  ASSERT_GT(bits[0], bits[1]);
+  ASSERT_GT(bits[1], 0);
+}
+
+TEST(MonkeyTest, PolicySizesFiltersPerLevel) {
+  const FilterPolicy* policy = NewMonkeyFilterPolicy(10);
+  const uint64_t level_bytes[3] = {0, 1 << 20, 100 << 20};
+  const int level_runs[3] = {0, 1, 1};
+  policy->UpdateLevelSizes(level_bytes, level_runs, 3);
+
+  std::vector<std::string> keys;
+  char buffer[sizeof(int)];
+  for (int i = 0; i < 1000; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  std::string unknown, small, large;
+  policy->CreateFilterForLevel(&key_slices[0], 1000, -1, &unknown);
+  policy->CreateFilterForLevel(&key_slices[0], 1000, 1, &small);
+  policy->CreateFilterForLevel(&key_slices[0], 1000, 2, &large);
+  ASSERT_EQ(1000 * 10 / 8 + 1, unknown.size());
+  ASSERT_GT(small.size(), unknown.size());
+  ASSERT_LT(large.size(), unknown.size());
+
+  // Filters are compatible with the plain bloom filter policy.
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  ASSERT_STREQ(bloom->Name(), policy->Name());
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(bloom->KeyMayMatch(key_slices[i], small));
+    ASSERT_TRUE(policy->KeyMayMatch(key_slices[i], large));
+  }
+  delete bloom;
+
+  delete policy;
+
+  // A level that gets less than a bit per key matches everything.
+  policy = NewMonkeyFilterPolicy(0.5);
+  const uint64_t skewed_bytes[2] = {1, uint64_t{1} << 40};
+  const int skewed_runs[2] = {1, 1};
+  policy->UpdateLevelSizes(skewed_bytes, skewed_runs, 2);
+  std::string none;
+  policy->CreateFilterForLevel(&key_slices[0], 1000, 1, &none);
+  ASSERT_EQ(2, none.size());
+  ASSERT_TRUE(policy->KeyMayMatch(Key(5000, buffer), none));
+  delete policy;
+}
+
 }  // namespace leveldb
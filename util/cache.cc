@@ -4,9 +4,12 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <new>
 
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -66,19 +69,21 @@ struct LRUHandle {
 // of porting hacks and is also faster than some of the built-in hash
 // table implementations in some of the compiler/runtime combinations
 // we have tested.  E.g., readrandom speeds up by ~5% over the g++
-// 4.4.3's builtin hashtable.
+// 4.4.3's builtin hashtable.  Entry is the handle type of a cache shard; it
+// needs key(), hash and next_hash.
+template <typename Entry>
 class HandleTable {
  public:
   HandleTable() : length_(0), elems_(0), list_(nullptr) { Resize(); }
   ~HandleTable() { delete[] list_; }
 
-  LRUHandle* Lookup(const Slice& key, uint32_t hash) {
+  Entry* Lookup(const Slice& key, uint32_t hash) {
     return *FindPointer(key, hash);
   }
 
-  LRUHandle* Insert(LRUHandle* h) {
-    LRUHandle** ptr = FindPointer(h->key(), h->hash);
-    LRUHandle* old = *ptr;
+  Entry* Insert(Entry* h) {
+    Entry** ptr = FindPointer(h->key(), h->hash);
+    Entry* old = *ptr;
     h->next_hash = (old == nullptr ? nullptr : old->next_hash);
     *ptr = h;
     if (old == nullptr) {
@@ -92,9 +97,9 @@ class HandleTable {
     return old;
   }
 
-  LRUHandle* Remove(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = FindPointer(key, hash);
-    LRUHandle* result = *ptr;
+  Entry* Remove(const Slice& key, uint32_t hash) {
+    Entry** ptr = FindPointer(key, hash);
+    Entry* result = *ptr;
     if (result != nullptr) {
       *ptr = result->next_hash;
       --elems_;
@@ -107,13 +112,13 @@ class HandleTable {
   // a linked list of cache entries that hash into the bucket.
   uint32_t length_;
   uint32_t elems_;
-  LRUHandle** list_;
+  Entry** list_;
 
   // Return a pointer to slot that points to a cache entry that
   // matches key/hash.  If there is no such cache entry, return a
   // pointer to the trailing slot in the corresponding linked list.
-  LRUHandle** FindPointer(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = &list_[hash & (length_ - 1)];
+  Entry** FindPointer(const Slice& key, uint32_t hash) {
+    Entry** ptr = &list_[hash & (length_ - 1)];
     while (*ptr != nullptr && ((*ptr)->hash != hash || key != (*ptr)->key())) {
       ptr = &(*ptr)->next_hash;
     }
@@ -125,15 +130,15 @@ class HandleTable {
     while (new_length < elems_) {
       new_length *= 2;
     }
-    LRUHandle** new_list = new LRUHandle*[new_length];
+    Entry** new_list = new Entry*[new_length];
     memset(new_list, 0, sizeof(new_list[0]) * new_length);
     uint32_t count = 0;
     for (uint32_t i = 0; i < length_; i++) {
-      LRUHandle* h = list_[i];
+      Entry* h = list_[i];
       while (h != nullptr) {
-        LRUHandle* next = h->next_hash;
+        Entry* next = h->next_hash;
         uint32_t hash = h->hash;
-        LRUHandle** ptr = &new_list[hash & (new_length - 1)];
+        Entry** ptr = &new_list[hash & (new_length - 1)];
         h->next_hash = *ptr;
         *ptr = h;
         h = next;
@@ -192,7 +197,7 @@ class LRUCache {
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
 
-  HandleTable table_ GUARDED_BY(mutex_);
+  HandleTable<LRUHandle> table_ GUARDED_BY(mutex_);
 };
 
 LRUCache::LRUCache() : capacity_(0), usage_(0) {
@@ -333,12 +338,227 @@ void LRUCache::Prune() {
   }
 }
 
-static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+// CLOCK cache implementation
+//
+// Each entry in the cache sits on a circular list that the clock hand
+// sweeps when room is needed.  Lookup() only takes the shard's lock shared:
+// it pins the entry with an atomic reference count and bumps the entry's
+// usage count instead of moving the entry on a list.  Release() takes no
+// lock at all.  The sweep decrements usage counts, skips pinned entries and
+// evicts the first unpinned entry whose count is already zero.  The count
+// saturates at kMaxClockUsage, so an entry that is looked up often survives
+// a few sweeps even when every other entry was looked up once.
+//
+// While an entry is in the cache, the cache holds one of its references, so
+// the reference count only drops to zero once the entry has been removed
+// from the hash table and no lookup can find it anymore.
+struct ClockHandle {
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  ClockHandle* next_hash;
+  ClockHandle* next;  // Clock list, only while in the cache
+  ClockHandle* prev;
+  size_t charge;
+  size_t key_length;
+  std::atomic<uint32_t> refs;  // References, including the cache's
+  std::atomic<uint8_t> usage;  // Lookups, decayed by the clock hand
+  uint32_t hash;               // Hash of key()
+  char key_data[1];            // Beginning of key
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+static const uint8_t kMaxClockUsage = 3;
+
+// A single shard of a sharded CLOCK cache.
+class ClockCache {
+ public:
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of
+  // ClockCache
+  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value));
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    ReadLock l(&mutex_);
+    return usage_;
+  }
 
-class ShardedLRUCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  static void Unref(ClockHandle* e);
+  void List_Remove(ClockHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void FinishErase(ClockHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void EvictToCapacity() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Initialized before use.
+  size_t capacity_;
+
+  // mutex_ protects the following state.  Lookups hold it shared, and all
+  // changes to the table or the list hold it exclusively.
+  mutable port::SharedMutex mutex_;
+  size_t usage_ GUARDED_BY(mutex_);
+  size_t entries_ GUARDED_BY(mutex_);
+
+  // Dummy head of the clock list.  New entries are added just behind the
+  // hand, so they are the last ones it reaches.
+  ClockHandle list_ GUARDED_BY(mutex_);
+  ClockHandle* hand_ GUARDED_BY(mutex_);
+
+  HandleTable<ClockHandle> table_ GUARDED_BY(mutex_);
+};
+
+ClockCache::ClockCache() : capacity_(0), usage_(0), entries_(0) {
+  list_.next = &list_;
+  list_.prev = &list_;
+  hand_ = &list_;
+}
+
+ClockCache::~ClockCache() {
+  for (ClockHandle* e = list_.next; e != &list_;) {
+    ClockHandle* next = e->next;
+    // Error if caller has an unreleased handle
+    assert(e->refs.load(std::memory_order_relaxed) == 1);
+    Unref(e);
+    e = next;
+  }
+}
+
+void ClockCache::Unref(ClockHandle* e) {
+  if (e->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {  // Deallocate.
+    (*e->deleter)(e->key(), e->value);
+    e->~ClockHandle();
+    free(e);
+  }
+}
+
+void ClockCache::List_Remove(ClockHandle* e) {
+  if (hand_ == e) {
+    hand_ = e->next;
+  }
+  e->next->prev = e->prev;
+  e->prev->next = e->next;
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  ReadLock l(&mutex_);
+  ClockHandle* e = table_.Lookup(key, hash);
+  if (e != nullptr) {
+    // The cache's reference keeps e alive while we hold the lock.
+    e->refs.fetch_add(1, std::memory_order_relaxed);
+    // Racing lookups may lose an increment, which is harmless.
+    const uint8_t usage = e->usage.load(std::memory_order_relaxed);
+    if (usage < kMaxClockUsage) {
+      e->usage.store(usage + 1, std::memory_order_relaxed);
+    }
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+Cache::Handle* ClockCache::Insert(const Slice& key, uint32_t hash, void* value,
+                                  size_t charge,
+                                  void (*deleter)(const Slice& key,
+                                                  void* value)) {
+  ClockHandle* e = new (malloc(sizeof(ClockHandle) - 1 + key.size()))
+      ClockHandle;
+  e->value = value;
+  e->deleter = deleter;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->hash = hash;
+  e->refs.store(1, std::memory_order_relaxed);  // for the returned handle.
+  e->usage.store(0, std::memory_order_relaxed);
+  std::memcpy(e->key_data, key.data(), key.size());
+
+  WriteLock l(&mutex_);
+  if (capacity_ > 0) {
+    e->refs.fetch_add(1, std::memory_order_relaxed);  // for the cache.
+    e->next = hand_;
+    e->prev = hand_->prev;
+    e->prev->next = e;
+    e->next->prev = e;
+    usage_ += charge;
+    entries_++;
+    FinishErase(table_.Insert(e));
+    EvictToCapacity();
+  }  // else don't cache. (capacity_==0 is supported and turns off caching.)
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+// If e != nullptr, finish removing *e from the cache; it has already been
+// removed from the hash table.
+void ClockCache::FinishErase(ClockHandle* e) {
+  if (e != nullptr) {
+    List_Remove(e);
+    usage_ -= e->charge;
+    entries_--;
+    Unref(e);
+  }
+}
+
+void ClockCache::EvictToCapacity() {
+  // Every entry is visited at most kMaxClockUsage times to decay its usage
+  // count, and once more to evict it.  Give up if everything is pinned.
+  size_t budget = (kMaxClockUsage + 1) * entries_ + 1;
+  while (usage_ > capacity_ && budget-- > 0) {
+    if (hand_ == &list_) {
+      hand_ = list_.next;
+      if (hand_ == &list_) break;  // Empty
+    }
+    ClockHandle* e = hand_;
+    hand_ = e->next;
+    if (e->refs.load(std::memory_order_acquire) > 1) {
+      continue;  // Pinned by a client
+    }
+    const uint8_t usage = e->usage.load(std::memory_order_relaxed);
+    if (usage > 0) {
+      e->usage.store(usage - 1, std::memory_order_relaxed);
+      continue;
+    }
+    table_.Remove(e->key(), e->hash);
+    FinishErase(e);
+  }
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  WriteLock l(&mutex_);
+  FinishErase(table_.Remove(key, hash));
+}
+
+void ClockCache::Prune() {
+  WriteLock l(&mutex_);
+  for (ClockHandle* e = list_.next; e != &list_;) {
+    ClockHandle* next = e->next;
+    if (e->refs.load(std::memory_order_acquire) == 1) {
+      table_.Remove(e->key(), e->hash);
+      FinishErase(e);
+    }
+    e = next;
+  }
+}
+
+static const int kDefaultNumShardBits = 4;
+static const int kMaxNumShardBits = 16;
+
+// Spreads keys over 2^num_shard_bits shards of type CacheShard, whose
+// handles are of type Entry.
+template <typename CacheShard, typename Entry>
+class ShardedCache : public Cache {
+ private:
+  const int num_shard_bits_;
+  CacheShard* const shard_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -346,16 +566,23 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+  uint32_t Shard(uint32_t hash) const {
+    return num_shard_bits_ == 0 ? 0 : hash >> (32 - num_shard_bits_);
+  }
+
+  int NumShards() const { return 1 << num_shard_bits_; }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
+  ShardedCache(size_t capacity, int num_shard_bits)
+      : num_shard_bits_(num_shard_bits),
+        shard_(new CacheShard[1 << num_shard_bits]),
+        last_id_(0) {
+    const size_t per_shard = (capacity + (NumShards() - 1)) / NumShards();
+    for (int s = 0; s < NumShards(); s++) {
       shard_[s].SetCapacity(per_shard);
     }
   }
-  ~ShardedLRUCache() override {}
+  ~ShardedCache() override { delete[] shard_; }
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
     const uint32_t hash = HashSlice(key);
@@ -366,7 +593,7 @@ class ShardedLRUCache : public Cache {
     return shard_[Shard(hash)].Lookup(key, hash);
   }
   void Release(Handle* handle) override {
-    LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
+    Entry* h = reinterpret_cast<Entry*>(handle);
     shard_[Shard(h->hash)].Release(handle);
   }
   void Erase(const Slice& key) override {
@@ -374,28 +601,51 @@ class ShardedLRUCache : public Cache {
     shard_[Shard(hash)].Erase(key, hash);
   }
   void* Value(Handle* handle) override {
-    return reinterpret_cast<LRUHandle*>(handle)->value;
+    return reinterpret_cast<Entry*>(handle)->value;
   }
   uint64_t NewId() override {
     MutexLock l(&id_mutex_);
     return ++(last_id_);
   }
   void Prune() override {
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < NumShards(); s++) {
       shard_[s].Prune();
     }
   }
   size_t TotalCharge() const override {
     size_t total = 0;
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < NumShards(); s++) {
       total += shard_[s].TotalCharge();
     }
     return total;
   }
 };
 
+// Clip num_shard_bits to the supported range; negative picks the default.
+static int SanitizeShardBits(int num_shard_bits) {
+  if (num_shard_bits < 0) return kDefaultNumShardBits;
+  if (num_shard_bits > kMaxNumShardBits) return kMaxNumShardBits;
+  return num_shard_bits;
+}
+
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity) {
+  return NewLRUCache(capacity, kDefaultNumShardBits);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits) {
+  return new ShardedCache<LRUCache, LRUHandle>(
+      capacity, SanitizeShardBits(num_shard_bits));
+}
+
+Cache* NewClockCache(size_t capacity) {
+  return NewClockCache(capacity, kDefaultNumShardBits);
+}
+
+Cache* NewClockCache(size_t capacity, int num_shard_bits) {
+  return new ShardedCache<ClockCache, ClockHandle>(
+      capacity, SanitizeShardBits(num_shard_bits));
+}
 
 }  // namespace leveldb
@@ -4,6 +4,8 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -24,7 +26,9 @@ static int DecodeKey(const Slice& k) {
 static void* EncodeValue(uintptr_t v) { return reinterpret_cast<void*>(v); }
 static int DecodeValue(void* v) { return reinterpret_cast<uintptr_t>(v); }
 
-class CacheTest : public testing::Test {
+// The parameter selects the cache implementation: false for NewLRUCache(),
+// true for NewClockCache().
+class CacheTest : public testing::TestWithParam<bool> {
  public:
   static void Deleter(const Slice& key, void* v) {
     current_->deleted_keys_.push_back(DecodeKey(key));
@@ -36,10 +40,14 @@ class CacheTest : public testing::Test {
   std::vector<int> deleted_values_;
   Cache* cache_;
 
-  CacheTest() : cache_(NewLRUCache(kCacheSize)) { current_ = this; }
+  CacheTest() : cache_(NewTestCache(kCacheSize)) { current_ = this; }
 
   ~CacheTest() { delete cache_; }
 
+  Cache* NewTestCache(size_t capacity) {
+    return GetParam() ? NewClockCache(capacity) : NewLRUCache(capacity);
+  }
+
   int Lookup(int key) {
     Cache::Handle* handle = cache_->Lookup(EncodeKey(key));
     const int r = (handle == nullptr) ? -1 : DecodeValue(cache_->Value(handle));
@@ -64,7 +72,9 @@ class CacheTest : public testing::Test {
 };
 CacheTest* CacheTest::current_;
 
-TEST_F(CacheTest, HitAndMiss) {
+INSTANTIATE_TEST_SUITE_P(LRUAndClock, CacheTest, ::testing::Bool());
+
+TEST_P(CacheTest, HitAndMiss) {
   ASSERT_EQ(-1, Lookup(100));
 
   Insert(100, 101);
@@ -87,7 +97,7 @@ TEST_F(CacheTest, HitAndMiss) {
   ASSERT_EQ(101, deleted_values_[0]);
 }
 
-TEST_F(CacheTest, Erase) {
+TEST_P(CacheTest, Erase) {
   Erase(200);
   ASSERT_EQ(0, deleted_keys_.size());
 
@@ -106,7 +116,7 @@ TEST_F(CacheTest, Erase) {
   ASSERT_EQ(1, deleted_keys_.size());
 }
 
-TEST_F(CacheTest, EntriesArePinned) {
+TEST_P(CacheTest, EntriesArePinned) {
   Insert(100, 101);
   Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
   ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
@@ -131,7 +141,7 @@ TEST_F(CacheTest, EntriesArePinned) {
   ASSERT_EQ(102, deleted_values_[1]);
 }
 
-TEST_F(CacheTest, EvictionPolicy) {
+TEST_P(CacheTest, EvictionPolicy) {
   Insert(100, 101);
   Insert(200, 201);
   Insert(300, 301);
@@ -150,7 +160,7 @@ TEST_F(CacheTest, EvictionPolicy) {
   cache_->Release(h);
 }
 
-TEST_F(CacheTest, UseExceedsCacheSize) {
+TEST_P(CacheTest, UseExceedsCacheSize) {
   // Overfill the cache, keeping handles on all inserted entries.
   std::vector<Cache::Handle*> h;
   for (int i = 0; i < kCacheSize + 100; i++) {
@@ -167,7 +177,7 @@ TEST_F(CacheTest, UseExceedsCacheSize) {
   }
 }
 
-TEST_F(CacheTest, HeavyEntries) {
+TEST_P(CacheTest, HeavyEntries) {
   // Add a bunch of light and heavy entries and then count the combined
   // size of items still in the cache, which must be approximately the
   // same as the total capacity.
@@ -194,13 +204,13 @@ TEST_F(CacheTest, HeavyEntries) {
   ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
 }
 
-TEST_F(CacheTest, NewId) {
+TEST_P(CacheTest, NewId) {
   uint64_t a = cache_->NewId();
   uint64_t b = cache_->NewId();
   ASSERT_NE(a, b);
 }
 
-TEST_F(CacheTest, Prune) {
+TEST_P(CacheTest, Prune) {
   Insert(1, 100);
   Insert(2, 200);
 
@@ -213,12 +223,56 @@ TEST_F(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
-TEST_F(CacheTest, ZeroSizeCache) {
+TEST_P(CacheTest, ZeroSizeCache) {
   delete cache_;
-  cache_ = NewLRUCache(0);
+  cache_ = NewTestCache(0);
 
   Insert(1, 100);
   ASSERT_EQ(-1, Lookup(1));
 }
 
+TEST_P(CacheTest, ShardBits) {
+  for (int bits : {-1, 0, 1, 8, 20}) {
+    delete cache_;
+    cache_ = GetParam() ? NewClockCache(kCacheSize, bits)
+                        : NewLRUCache(kCacheSize, bits);
+    for (int i = 0; i < 100; i++) {
+      Insert(i, 1000 + i);
+    }
+    for (int i = 0; i < 100; i++) {
+      ASSERT_EQ(1000 + i, Lookup(i)) << bits;
+    }
+    ASSERT_EQ(100, cache_->TotalCharge());
+  }
+}
+
+TEST_P(CacheTest, ConcurrentLookups) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumKeys = 100;
+  for (int i = 0; i < kNumKeys; i++) {
+    Insert(i, 1000 + i);
+  }
+
+  // Readers only pin and release entries, so nothing may be evicted.
+  std::vector<std::thread> threads;
+  std::atomic<int> mismatches(0);
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([this, t, &mismatches]() {
+      for (int n = 0; n < 10000; n++) {
+        const int key = (n * 7 + t) % kNumKeys;
+        Cache::Handle* h = cache_->Lookup(EncodeKey(key));
+        if (h == nullptr || DecodeValue(cache_->Value(h)) != 1000 + key) {
+          mismatches.fetch_add(1);
+        }
+        if (h != nullptr) cache_->Release(h);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(0, mismatches.load());
+  ASSERT_EQ(0, deleted_keys_.size());
+}
+
 }  // namespace leveldb
@@ -28,10 +28,25 @@ Status Env::DeleteDir(const std::string& dirname) { return RemoveDir(dirname); }
 Status Env::RemoveFile(const std::string& fname) { return DeleteFile(fname); }
 Status Env::DeleteFile(const std::string& fname) { return RemoveFile(fname); }
 
+void Env::ScheduleWithPriority(void (*function)(void* arg), void* arg,
+                               Priority pri) {
+  Schedule(function, arg);
+}
+
+void Env::IncBackgroundThreadsIfNeeded(int number, Priority pri) {}
+
 SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
 
+Status RandomAccessFile::MultiRead(ReadRequest* reqs, size_t n) const {
+  for (size_t i = 0; i < n; i++) {
+    reqs[i].status =
+        Read(reqs[i].offset, reqs[i].n, &reqs[i].result, reqs[i].scratch);
+  }
+  return Status::OK();
+}
+
 WritableFile::~WritableFile() = default;
 
 Logger::~Logger() = default;
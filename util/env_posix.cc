@@ -36,6 +36,11 @@
 #include "util/env_posix_test_helper.h"
 #include "util/posix_logger.h"
 
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif  // HAVE_IO_URING
+
 namespace leveldb {
 
 namespace {
@@ -168,6 +173,198 @@ class PosixSequentialFile final : public SequentialFile {
   const std::string filename_;
 };
 
+#if HAVE_IO_URING
+// A minimal io_uring instance for batches of reads, driven through the raw
+// system calls.  Each thread that issues batched reads gets a ring of its
+// own, so no locking is needed.
+class PosixIoUring {
+ public:
+  // Returns the calling thread's ring, or nullptr if the kernel does not
+  // let us use io_uring.  In that case callers fall back to pread().
+  static PosixIoUring* ForCurrentThread() {
+    static std::atomic<bool> unavailable(false);
+    if (unavailable.load(std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    thread_local PosixIoUring ring;
+    if (!ring.ok()) {
+      unavailable.store(true, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return ring.broken_ ? nullptr : &ring;
+  }
+
+  PosixIoUring(const PosixIoUring&) = delete;
+  PosixIoUring& operator=(const PosixIoUring&) = delete;
+
+  // Reads reqs[0..n-1] from "fd", keeping up to kQueueDepth reads in
+  // flight.  Requests the kernel fails are retried with pread(), so that
+  // their status matches Read().  If the ring itself fails, the batch is
+  // read with pread() and the thread stops using the ring.
+  Status Read(int fd, const std::string& filename,
+              RandomAccessFile::ReadRequest* reqs, size_t n) {
+    size_t submitted = 0;
+    size_t completed = 0;
+    while (completed < n) {
+      // Queue as many reads as the ring has room for.
+      unsigned tail = *sq_tail_;
+      while (submitted < n && submitted - completed < kQueueDepth) {
+        const unsigned index = tail & *sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(reqs[submitted].scratch);
+        sqe->len = static_cast<uint32_t>(reqs[submitted].n);
+        sqe->off = reqs[submitted].offset;
+        sqe->user_data = submitted;
+        sq_array_[index] = index;
+        tail++;
+        submitted++;
+      }
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+      // Submit whatever the kernel has not consumed yet and wait for at
+      // least one completion.
+      const unsigned to_submit =
+          tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+      if (Enter(to_submit, 1) < 0 && errno != EINTR && errno != EAGAIN &&
+          errno != EBUSY) {
+        // Only a broken ring fails this way.  Take back the reads that the
+        // kernel has not picked up yet, and wait for the others, since
+        // they write into the callers' buffers.  Then retire the ring and
+        // read everything with pread().
+        const unsigned sq_head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        submitted -= tail - sq_head;
+        __atomic_store_n(sq_tail_, sq_head, __ATOMIC_RELEASE);
+        completed += Reap(fd, filename, reqs);
+        while (completed < submitted) {
+          if (Enter(0, 1) < 0) {
+            std::this_thread::yield();
+          }
+          completed += Reap(fd, filename, reqs);
+        }
+        broken_ = true;
+        for (size_t i = 0; i < n; i++) {
+          PRead(fd, filename, &reqs[i]);
+        }
+        return Status::OK();
+      }
+      completed += Reap(fd, filename, reqs);
+    }
+    return Status::OK();
+  }
+
+ private:
+  static constexpr unsigned kQueueDepth = 64;
+
+  static void PRead(int fd, const std::string& filename,
+                    RandomAccessFile::ReadRequest* req) {
+    ssize_t read_size =
+        ::pread(fd, req->scratch, req->n, static_cast<off_t>(req->offset));
+    req->result = Slice(req->scratch, (read_size < 0) ? 0 : read_size);
+    req->status = (read_size < 0) ? PosixError(filename, errno) : Status::OK();
+  }
+
+  // Consumes the completions the kernel has posted so far, and returns
+  // their number.
+  size_t Reap(int fd, const std::string& filename,
+              RandomAccessFile::ReadRequest* reqs) {
+    size_t reaped = 0;
+    unsigned head = *cq_head_;
+    while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      const io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+      RandomAccessFile::ReadRequest* req = &reqs[cqe->user_data];
+      if (cqe->res >= 0) {
+        req->result = Slice(req->scratch, cqe->res);
+        req->status = Status::OK();
+      } else {
+        PRead(fd, filename, req);
+      }
+      head++;
+      reaped++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return reaped;
+  }
+
+  PosixIoUring()
+      : ring_fd_(-1),
+        broken_(false),
+        sq_ring_(MAP_FAILED),
+        cq_ring_(MAP_FAILED),
+        sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd_ = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, kQueueDepth, &params));
+    if (ring_fd_ < 0) {
+      return;
+    }
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    sqes_ = static_cast<io_uring_sqe*>(
+        ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+    if (!ok()) {
+      return;
+    }
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  }
+
+  ~PosixIoUring() {
+    if (sqes_ != MAP_FAILED) ::munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED) ::munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED) ::munmap(sq_ring_, sq_ring_size_);
+    if (ring_fd_ >= 0) ::close(ring_fd_);
+  }
+
+  bool ok() const {
+    return ring_fd_ >= 0 && sq_ring_ != MAP_FAILED && cq_ring_ != MAP_FAILED &&
+           sqes_ != MAP_FAILED;
+  }
+
+  int Enter(unsigned to_submit, unsigned min_complete) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, to_submit,
+                                      min_complete, IORING_ENTER_GETEVENTS,
+                                      nullptr, 0));
+  }
+
+  int ring_fd_;
+  bool broken_;  // Set once io_uring_enter() failed; the ring is not reused
+  void* sq_ring_;
+  void* cq_ring_;
+  io_uring_sqe* sqes_;
+  size_t sq_ring_size_;
+  size_t cq_ring_size_;
+  size_t sqes_size_;
+
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  io_uring_cqe* cqes_;
+};
+#endif  // HAVE_IO_URING
+
 // Implements random read access in a file using pread().
 //
 // Instances of this class are thread-safe, as required by the RandomAccessFile
@@ -223,6 +420,27 @@ class PosixRandomAccessFile final : public RandomAccessFile {
     return status;
   }
 
+  Status MultiRead(ReadRequest* reqs, size_t n) const override {
+#if HAVE_IO_URING
+    PosixIoUring* ring = (n > 1) ? PosixIoUring::ForCurrentThread() : nullptr;
+    if (ring != nullptr) {
+      int fd = fd_;
+      if (!has_permanent_fd_) {
+        fd = ::open(filename_.c_str(), O_RDONLY | kOpenBaseFlags);
+        if (fd < 0) {
+          return PosixError(filename_, errno);
+        }
+      }
+      Status status = ring->Read(fd, filename_, reqs, n);
+      if (!has_permanent_fd_) {
+        ::close(fd);
+      }
+      return status;
+    }
+#endif  // HAVE_IO_URING
+    return RandomAccessFile::MultiRead(reqs, n);
+  }
+
  private:
   const bool has_permanent_fd_;  // If false, the file is opened on every read.
   const int fd_;                 // -1 if has_permanent_fd_ is false.
@@ -689,7 +907,16 @@ class PosixEnv : public Env {
   }
 
   void Schedule(void (*background_work_function)(void* background_work_arg),
-                void* background_work_arg) override;
+                void* background_work_arg) override {
+    ScheduleWithPriority(background_work_function, background_work_arg,
+                         kLowPriority);
+  }
+
+  void ScheduleWithPriority(
+      void (*background_work_function)(void* background_work_arg),
+      void* background_work_arg, Priority pri) override;
+
+  void IncBackgroundThreadsIfNeeded(int number, Priority pri) override;
 
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
@@ -745,12 +972,6 @@ class PosixEnv : public Env {
   }
 
  private:
-  void BackgroundThreadMain();
-
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
-  }
-
   // Stores the work item data in a Schedule() call.
   //
   // Instances are constructed on the thread calling Schedule() and used on the
@@ -765,12 +986,22 @@ class PosixEnv : public Env {
     void* const arg;
   };
 
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+  // The threads and the queue of work items for one Priority.  Threads are
+  // started lazily, by the first Schedule() call that finds fewer running
+  // threads than requested.
+  struct BackgroundPool {
+    BackgroundPool() : cv(&mu), num_threads(1), started_threads(0) {}
+
+    port::Mutex mu;
+    port::CondVar cv GUARDED_BY(mu);
+    int num_threads GUARDED_BY(mu);  // Requested size of the pool.
+    int started_threads GUARDED_BY(mu);
+    std::queue<BackgroundWorkItem> queue GUARDED_BY(mu);
+  };
+
+  static void BackgroundThreadMain(BackgroundPool* pool);
 
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+  BackgroundPool background_pools_[2];  // Indexed by Priority.
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
@@ -806,47 +1037,51 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
-      mmap_limiter_(MaxMmaps()),
-      fd_limiter_(MaxOpenFiles()) {}
+    : mmap_limiter_(MaxMmaps()), fd_limiter_(MaxOpenFiles()) {}
 
-void PosixEnv::Schedule(
+void PosixEnv::ScheduleWithPriority(
     void (*background_work_function)(void* background_work_arg),
-    void* background_work_arg) {
-  background_work_mutex_.Lock();
-
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
+    void* background_work_arg, Priority pri) {
+  BackgroundPool* pool = &background_pools_[pri];
+  pool->mu.Lock();
+
+  // Start any background threads we haven't started yet.
+  while (pool->started_threads < pool->num_threads) {
+    pool->started_threads++;
+    std::thread background_thread(PosixEnv::BackgroundThreadMain, pool);
     background_thread.detach();
   }
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
-  }
+  // Idle background threads are waiting for work.  Wake one of them.
+  pool->queue.emplace(background_work_function, background_work_arg);
+  pool->cv.Signal();
+  pool->mu.Unlock();
+}
 
-  background_work_queue_.emplace(background_work_function, background_work_arg);
-  background_work_mutex_.Unlock();
+void PosixEnv::IncBackgroundThreadsIfNeeded(int number, Priority pri) {
+  BackgroundPool* pool = &background_pools_[pri];
+  pool->mu.Lock();
+  if (number > pool->num_threads) {
+    pool->num_threads = number;
+  }
+  pool->mu.Unlock();
 }
 
-void PosixEnv::BackgroundThreadMain() {
+void PosixEnv::BackgroundThreadMain(BackgroundPool* pool) {
   while (true) {
-    background_work_mutex_.Lock();
+    pool->mu.Lock();
 
     // Wait until there is work to be done.
-    while (background_work_queue_.empty()) {
-      background_work_cv_.Wait();
+    while (pool->queue.empty()) {
+      pool->cv.Wait();
     }
 
-    assert(!background_work_queue_.empty());
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
+    assert(!pool->queue.empty());
+    auto background_work_function = pool->queue.front().function;
+    void* background_work_arg = pool->queue.front().arg;
+    pool->queue.pop();
 
-    background_work_mutex_.Unlock();
+    pool->mu.Unlock();
     background_work_function(background_work_arg);
   }
 }
@@ -17,6 +17,7 @@
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "util/env_posix_test_helper.h"
+#include "util/mutexlock.h"
 #include "util/testutil.h"
 
 #if HAVE_O_CLOEXEC
@@ -212,6 +213,125 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, TestMultiRead) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/multi_read.txt";
+
+  std::string data;
+  for (int i = 0; i < 10000; i++) {
+    data.push_back(static_cast<char>('a' + i % 26));
+  }
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // Exceed both limits so that files of every kind are read: mmap-ed,
+  // with a permanent file descriptor, and opened on every read.
+  const int kNumFiles = kReadOnlyFileLimit + kMMapLimit + 5;
+  leveldb::RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+
+  // More reads than a batch can have in flight at once.
+  const int kNumReads = 200;
+  std::vector<RandomAccessFile::ReadRequest> reqs(kNumReads);
+  std::vector<std::string> scratch(kNumReads, std::string(100, 0));
+  for (int i = 0; i < kNumFiles; i++) {
+    for (int r = 0; r < kNumReads; r++) {
+      reqs[r].offset = r * 37 + i;
+      reqs[r].n = 1 + r % 100;
+      reqs[r].scratch = &scratch[r][0];
+    }
+    ASSERT_LEVELDB_OK(files[i]->MultiRead(reqs.data(), reqs.size()));
+    for (int r = 0; r < kNumReads; r++) {
+      ASSERT_LEVELDB_OK(reqs[r].status);
+      ASSERT_EQ(data.substr(reqs[r].offset, reqs[r].n),
+                reqs[r].result.ToString());
+    }
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, HighPriorityDoesNotWaitForLowPriority) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    bool low_released = false;
+    bool low_done = false;
+    bool high_done = false;
+
+    static void RunLow(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      while (!state->low_released) {
+        state->cvar.Wait();
+      }
+      state->low_done = true;
+      state->cvar.SignalAll();
+    }
+
+    static void RunHigh(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->high_done = true;
+      state->cvar.SignalAll();
+    }
+  };
+
+  // The low priority item holds the low priority thread until the high
+  // priority item has run.
+  RunState state;
+  env_->Schedule(&RunState::RunLow, &state);
+  env_->ScheduleWithPriority(&RunState::RunHigh, &state, Env::kHighPriority);
+
+  MutexLock l(&state.mu);
+  while (!state.high_done) {
+    state.cvar.Wait();
+  }
+  ASSERT_FALSE(state.low_done);
+  state.low_released = true;
+  state.cvar.SignalAll();
+  while (!state.low_done) {
+    state.cvar.Wait();
+  }
+}
+
+TEST_F(EnvPosixTest, IncBackgroundThreads) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    int running = 0;
+    int finished = 0;
+
+    // Returns only once both items run at the same time.
+    static void Run(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->running++;
+      state->cvar.SignalAll();
+      while (state->running < 2) {
+        state->cvar.Wait();
+      }
+      state->finished++;
+      state->cvar.SignalAll();
+    }
+  };
+
+  env_->IncBackgroundThreadsIfNeeded(2, Env::kLowPriority);
+  RunState state;
+  env_->Schedule(&RunState::Run, &state);
+  env_->Schedule(&RunState::Run, &state);
+
+  // Both items must be done with "state" before it goes out of scope.
+  MutexLock l(&state.mu);
+  while (state.finished < 2) {
+    state.cvar.Wait();
+  }
+}
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
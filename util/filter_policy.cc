@@ -8,4 +8,15 @@ namespace leveldb {
 
 FilterPolicy::~FilterPolicy() {}
 
+void FilterPolicy::CreateFilterForLevel(const Slice* keys, int n, int level,
+                                        std::string* dst) const {
+  CreateFilter(keys, n, dst);
+}
+
+void FilterPolicy::UpdateLevelSizes(const uint64_t* level_bytes,
+                                    const int* level_runs,
+                                    int num_levels) const {}
+
+RangeFilterPolicy::~RangeFilterPolicy() {}
+
 }  // namespace leveldb
@@ -0,0 +1,70 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/monkey.h"
+
+#include <cmath>
+#include <vector>
+
+namespace leveldb {
+
+void MonkeyBitsPerKey(int num_levels, const double* entries, const int* runs,
+                      double bits_per_key, double* result) {
+  // A bloom filter with b bits per key has a false positive rate of
+  // p = exp(-b * ln(2)^2).  Minimizing sum(runs[i] * p[i]) subject to
+  // sum(entries[i] * b[i]) = memory gives p[i] = lambda * run_size[i],
+  // with
+  //   -ln(lambda) = (memory * ln(2)^2 + sum(entries[i] * ln(run_size[i])))
+  //                 / sum(entries[i])
+  // where the sums cover the levels that get a filter (p[i] < 1).  Levels
+  // are dropped from largest run size down until that holds.
+  const double kLn2Squared = std::log(2.0) * std::log(2.0);
+  std::vector<bool> filtered(num_levels);
+  double memory = 0;
+  for (int i = 0; i < num_levels; i++) {
+    filtered[i] = (entries[i] > 0 && runs[i] > 0);
+    if (filtered[i]) {
+      memory += bits_per_key * entries[i];
+    }
+  }
+
+  double neg_ln_lambda = 0;
+  while (true) {
+    double total = 0;
+    double weighted_ln = 0;
+    int largest = -1;
+    double largest_ln = 0;
+    for (int i = 0; i < num_levels; i++) {
+      if (!filtered[i]) continue;
+      const double ln_run_size = std::log(entries[i] / runs[i]);
+      total += entries[i];
+      weighted_ln += entries[i] * ln_run_size;
+      if (largest < 0 || ln_run_size > largest_ln) {
+        largest = i;
+        largest_ln = ln_run_size;
+      }
+    }
+    if (largest < 0) break;
+
+    neg_ln_lambda = (memory * kLn2Squared + weighted_ln) / total;
+    if (largest_ln < neg_ln_lambda) {
+      // Every remaining level gets a false positive rate below 1.
+      break;
+    }
+    filtered[largest] = false;
+  }
+
+  for (int i = 0; i < num_levels; i++) {
+    if (filtered[i]) {
+      result[i] = (neg_ln_lambda - std::log(entries[i] / runs[i])) /
+                  kLn2Squared;
+    } else if (entries[i] > 0 && runs[i] > 0) {
+      result[i] = 0;
+    } else {
+      result[i] = bits_per_key;
+    }
+  }
+}
+
+}  // namespace leveldb
@@ -0,0 +1,30 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Allocation of bloom filter memory across the levels of the tree, as
+// described in "Monkey: Optimal Navigable Key-Value Store" (Dayan,
+// Athanassoulis, Idreos; SIGMOD 2017).
+
+#ifndef STORAGE_LEVELDB_UTIL_MONKEY_H_
+#define STORAGE_LEVELDB_UTIL_MONKEY_H_
+
+namespace leveldb {
+
+// Level i holds entries[i] keys (or any quantity proportional to it,
+// such as bytes) spread over runs[i] sorted runs of equal size.  Store in
+// result[i] the number of bits per key that the filters of level i
+// should use so that the total filter memory is bits_per_key times the
+// total number of entries, and the expected number of runs probed by a
+// lookup of a missing key is minimal.
+//
+// The optimum makes the false positive rate of a run proportional to the
+// size of the run.  A level whose optimal false positive rate would be 1
+// gets 0 bits per key (no useful filter).  Levels without entries get
+// bits_per_key.
+void MonkeyBitsPerKey(int num_levels, const double* entries, const int* runs,
+                      double bits_per_key, double* result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_MONKEY_H_
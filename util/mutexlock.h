@@ -34,6 +34,38 @@ class SCOPED_LOCKABLE MutexLock {
   port::Mutex* const mu_;
 };
 
+// Like MutexLock, for holding a port::SharedMutex exclusively.
+class SCOPED_LOCKABLE WriteLock {
+ public:
+  explicit WriteLock(port::SharedMutex* mu) EXCLUSIVE_LOCK_FUNCTION(mu)
+      : mu_(mu) {
+    this->mu_->Lock();
+  }
+  ~WriteLock() UNLOCK_FUNCTION() { this->mu_->Unlock(); }
+
+  WriteLock(const WriteLock&) = delete;
+  WriteLock& operator=(const WriteLock&) = delete;
+
+ private:
+  port::SharedMutex* const mu_;
+};
+
+// Like MutexLock, for holding a port::SharedMutex shared.
+class SCOPED_LOCKABLE ReadLock {
+ public:
+  explicit ReadLock(port::SharedMutex* mu) SHARED_LOCK_FUNCTION(mu)
+      : mu_(mu) {
+    this->mu_->LockShared();
+  }
+  ~ReadLock() UNLOCK_FUNCTION() { this->mu_->UnlockShared(); }
+
+  ReadLock(const ReadLock&) = delete;
+  ReadLock& operator=(const ReadLock&) = delete;
+
+ private:
+  port::SharedMutex* const mu_;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_UTIL_MUTEXLOCK_H_
@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace leveldb {
+
+void PerfContext::Reset() {
+  memtable_hit_count = 0;
+  block_cache_hit_count = 0;
+  block_cache_miss_count = 0;
+  block_read_count = 0;
+  block_read_bytes = 0;
+  filter_useful_count = 0;
+  filter_positive_count = 0;
+  filter_false_positive_count = 0;
+  for (int level = 0; level < kNumLevels; level++) {
+    get_read_bytes[level] = 0;
+  }
+}
+
+static void AppendCounter(std::string* result, const char* name,
+                          uint64_t value) {
+  if (value == 0) {
+    return;
+  }
+  char buf[100];
+  std::snprintf(buf, sizeof(buf), "%s%s = %" PRIu64,
+                result->empty() ? "" : ", ", name, value);
+  result->append(buf);
+}
+
+std::string PerfContext::ToString() const {
+  std::string result;
+  AppendCounter(&result, "memtable_hit_count", memtable_hit_count);
+  AppendCounter(&result, "block_cache_hit_count", block_cache_hit_count);
+  AppendCounter(&result, "block_cache_miss_count", block_cache_miss_count);
+  AppendCounter(&result, "block_read_count", block_read_count);
+  AppendCounter(&result, "block_read_bytes", block_read_bytes);
+  AppendCounter(&result, "filter_useful_count", filter_useful_count);
+  AppendCounter(&result, "filter_positive_count", filter_positive_count);
+  AppendCounter(&result, "filter_false_positive_count",
+                filter_false_positive_count);
+  char name[30];
+  for (int level = 0; level < kNumLevels; level++) {
+    std::snprintf(name, sizeof(name), "get_read_bytes[%d]", level);
+    AppendCounter(&result, name, get_read_bytes[level]);
+  }
+  return result;
+}
+
+PerfContext* GetPerfContext() {
+  static thread_local PerfContext perf_context;
+  return &perf_context;
+}
+
+}  // namespace leveldb
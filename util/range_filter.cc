@@ -0,0 +1,358 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Range filters of truncated keys.  The keys of a filter share a common
+// prefix, which is stored once.  The next 8 bytes of every key, read as a
+// big-endian number, are its image: images are in the same order as the
+// keys, though different keys may share one.  The filter holds the top t
+// bits of the distinct images as a sorted list, where t is r bits more than
+// it takes to tell at least half of the images apart.  A range of keys then
+// maps to a range of truncated images, which the filter may match only if
+// it holds a value in it.  An empty range that is short compared to the
+// gaps between keys passes with a probability of about 2^-r; longer ranges
+// pass more often.
+//
+// The list is Rice-coded with the parameter that suits the mean gap between
+// values: about 2^r if the images are spread evenly, so that a gap takes
+// about r + 2 bits.  Every 64th value is stored in full with the position
+// of the next gap in the code, so that a lookup decodes at most 63 gaps
+// after a binary search.
+
+#include <algorithm>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+namespace {
+
+// A filter is the Rice code of the gaps, padded with 8 zero bytes so that
+// it can be read 8 bytes at a time, followed by the samples:
+//    value: fixed64
+//    bit offset of the next gap: fixed32
+// and then by the common prefix of the keys and:
+//    prefix_size: fixed32
+//    count: fixed32
+//    shift: uint8
+//    rice_bits: uint8
+// "count" is the number of values, and "shift" the number of image bits
+// that are dropped from each.
+const size_t kTrailerSize = 4 + 4 + 1 + 1;
+const size_t kSampleSize = 8 + 4;
+const size_t kCodePadding = 8;
+const uint32_t kValuesPerSample = 64;
+const int kMaxRiceBits = 56;
+
+// Returns the first 8 bytes of s, padded with zeros, as a big-endian number.
+uint64_t KeyImage(const Slice& s) {
+  uint64_t image = 0;
+  for (size_t i = 0; i < 8; i++) {
+    image <<= 8;
+    if (i < s.size()) {
+      image |= static_cast<unsigned char>(s[i]);
+    }
+  }
+  return image;
+}
+
+// Returns s without its first n bytes.
+Slice Suffix(const Slice& s, size_t n) {
+  return Slice(s.data() + n, s.size() - n);
+}
+
+// Returns the number of distinct values of the top "bits" bits of the
+// sorted "images".
+size_t CountDistinct(const std::vector<uint64_t>& images, int bits) {
+  const int shift = 64 - bits;
+  size_t count = 0;
+  for (size_t i = 0; i < images.size(); i++) {
+    if (i == 0 || (images[i] >> shift) != (images[i - 1] >> shift)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+class BitWriter {
+ public:
+  explicit BitWriter(std::string* dst)
+      : dst_(dst), start_(dst->size()), acc_(0), bits_(0) {}
+
+  uint64_t position() const { return (dst_->size() - start_) * 8 + bits_; }
+
+  // REQUIRES: n <= 56
+  void Write(uint64_t value, int n) {
+    if (n == 0) return;
+    acc_ |= (value & ((~uint64_t{0}) >> (64 - n))) << bits_;
+    bits_ += n;
+    while (bits_ >= 8) {
+      dst_->push_back(static_cast<char>(acc_ & 0xff));
+      acc_ >>= 8;
+      bits_ -= 8;
+    }
+  }
+
+  // Writes q one bits followed by a zero bit.
+  void WriteUnary(uint64_t q) {
+    for (; q >= 32; q -= 32) {
+      Write(0xffffffffu, 32);
+    }
+    Write((uint64_t{1} << q) - 1, static_cast<int>(q) + 1);
+  }
+
+  void Finish() {
+    if (bits_ > 0) {
+      dst_->push_back(static_cast<char>(acc_ & 0xff));
+      acc_ = 0;
+      bits_ = 0;
+    }
+  }
+
+ private:
+  std::string* const dst_;
+  const size_t start_;  // Size of *dst_ before the first bit
+  uint64_t acc_;  // Bits not yet appended to *dst_
+  int bits_;      // Number of bits in acc_, less than 8 between calls
+};
+
+class BitReader {
+ public:
+  // REQUIRES: data[0, limit / 8 + 8) is readable.
+  BitReader(const char* data, uint64_t limit, uint64_t position)
+      : data_(data), limit_(limit), position_(position) {}
+
+  bool overrun() const { return position_ > limit_; }
+
+  // REQUIRES: n <= 56 and !overrun()
+  uint64_t Read(int n) {
+    if (n == 0) return 0;
+    const uint64_t value = Peek() & ((~uint64_t{0}) >> (64 - n));
+    position_ += n;
+    return value;
+  }
+
+  // Reads one bits up to the next zero bit and returns their number.
+  //
+  // REQUIRES: !overrun()
+  uint64_t ReadUnary() {
+    const uint64_t kAllOnes = (uint64_t{1} << 56) - 1;
+    uint64_t q = 0;
+    uint64_t window;
+    while (((window = Peek()) & kAllOnes) == kAllOnes) {
+      q += 56;
+      position_ += 56;
+      if (overrun()) return q;
+    }
+    int ones = 0;
+    while (window & 1) {
+      window >>= 1;
+      ones++;
+    }
+    position_ += ones + 1;
+    return q + ones;
+  }
+
+ private:
+  // Returns at least 56 bits at position_.
+  uint64_t Peek() const {
+    return DecodeFixed64(data_ + position_ / 8) >> (position_ % 8);
+  }
+
+  const char* const data_;
+  const uint64_t limit_;  // End of the code in bits
+  uint64_t position_;
+};
+
+void AppendRangeFilter(const Slice* keys, int n, int extra_bits,
+                       std::string* dst) {
+  // Keys are sorted, so the common prefix of all keys is that of the first
+  // and the last one.
+  size_t prefix_size = 0;
+  if (n > 0) {
+    const Slice& first = keys[0];
+    const Slice& last = keys[n - 1];
+    while (prefix_size < first.size() && prefix_size < last.size() &&
+           first[prefix_size] == last[prefix_size]) {
+      prefix_size++;
+    }
+  }
+
+  std::vector<uint64_t> images;
+  images.reserve(n);
+  for (int i = 0; i < n; i++) {
+    const uint64_t image = KeyImage(Suffix(keys[i], prefix_size));
+    if (images.empty() || images.back() != image) {
+      images.push_back(image);
+    }
+  }
+
+  // Find the fewest bits that tell at least half of the images apart.  If
+  // the images are spread evenly, that is about log2(images.size()).
+  int lo = 1;
+  int hi = 64;
+  while (lo < hi) {
+    const int mid = (lo + hi) / 2;
+    if (CountDistinct(images, mid) * 2 >= images.size()) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  const int shift = 64 - std::min(64, lo + extra_bits);
+
+  std::vector<uint64_t> values;
+  values.reserve(images.size());
+  for (uint64_t image : images) {
+    const uint64_t value = image >> shift;
+    if (values.empty() || values.back() != value) {
+      values.push_back(value);
+    }
+  }
+
+  int rice_bits = 0;
+  if (values.size() > 1) {
+    const uint64_t mean_gap =
+        (values.back() - values.front()) / (values.size() - 1);
+    while (rice_bits < kMaxRiceBits && (mean_gap >> (rice_bits + 1)) > 0) {
+      rice_bits++;
+    }
+  }
+
+  std::string samples;
+  BitWriter code(dst);
+  for (size_t i = 0; i < values.size(); i++) {
+    if (i % kValuesPerSample == 0) {
+      PutFixed64(&samples, values[i]);
+      PutFixed32(&samples, static_cast<uint32_t>(code.position()));
+    } else {
+      const uint64_t gap = values[i] - values[i - 1] - 1;
+      code.WriteUnary(gap >> rice_bits);
+      code.Write(gap, rice_bits);
+    }
+  }
+  code.Finish();
+  dst->append(kCodePadding, '\0');
+  dst->append(samples);
+  if (n > 0) {
+    dst->append(keys[0].data(), prefix_size);
+  }
+  PutFixed32(dst, static_cast<uint32_t>(prefix_size));
+  PutFixed32(dst, static_cast<uint32_t>(values.size()));
+  dst->push_back(static_cast<char>(shift));
+  dst->push_back(static_cast<char>(rice_bits));
+}
+
+bool RangeFilterMayMatch(const Slice& start, const Slice& limit,
+                         const Slice& filter) {
+  if (filter.size() < kTrailerSize) return true;
+
+  const char* trailer = filter.data() + filter.size() - kTrailerSize;
+  const uint32_t prefix_size = DecodeFixed32(trailer);
+  const uint32_t count = DecodeFixed32(trailer + 4);
+  const int shift = static_cast<unsigned char>(trailer[8]);
+  const int rice_bits = static_cast<unsigned char>(trailer[9]);
+  if (count == 0) {
+    return false;  // Filter of no keys
+  }
+  const uint64_t num_samples = (count - 1) / kValuesPerSample + 1;
+  const uint64_t rest = filter.size() - kTrailerSize;
+  if (shift > 63 || rice_bits > kMaxRiceBits || prefix_size > rest ||
+      num_samples * kSampleSize + kCodePadding > rest - prefix_size) {
+    return true;  // Reserved for potentially new encodings
+  }
+  const Slice prefix(trailer - prefix_size, prefix_size);
+  const char* samples = prefix.data() - num_samples * kSampleSize;
+  const uint64_t code_limit = (samples - kCodePadding - filter.data()) * 8;
+
+  if (start.compare(limit) >= 0) {
+    return false;
+  }
+  // Map [start, limit) to the range [lo, hi] of images that its keys have.
+  uint64_t lo, hi;
+  if (start.starts_with(prefix)) {
+    lo = KeyImage(Suffix(start, prefix_size));
+  } else if (start.compare(prefix) < 0) {
+    lo = 0;
+  } else {
+    return false;  // All keys are before start
+  }
+  if (limit.starts_with(prefix)) {
+    if (limit.size() == prefix_size) {
+      return false;  // All keys are at or after limit
+    }
+    hi = KeyImage(Suffix(limit, prefix_size));
+  } else if (limit.compare(prefix) < 0) {
+    return false;
+  } else {
+    hi = ~uint64_t{0};
+  }
+  lo >>= shift;
+  hi >>= shift;
+
+  // Find the last sample that is not after lo, or the first one
+  uint64_t left = 0;
+  uint64_t right = num_samples - 1;
+  while (left < right) {
+    const uint64_t mid = (left + right + 1) / 2;
+    if (DecodeFixed64(samples + mid * kSampleSize) <= lo) {
+      left = mid;
+    } else {
+      right = mid - 1;
+    }
+  }
+  const char* sample = samples + left * kSampleSize;
+  uint64_t value = DecodeFixed64(sample);
+  if (value >= lo) {
+    return value <= hi;
+  }
+  BitReader code(filter.data(), code_limit, DecodeFixed32(sample + 8));
+  const uint64_t first = left * kValuesPerSample;
+  const uint64_t end = std::min<uint64_t>(count, first + kValuesPerSample);
+  for (uint64_t i = first + 1; i < end; i++) {
+    if (code.overrun()) return true;
+    const uint64_t q = code.ReadUnary();
+    if (code.overrun()) return true;
+    value += ((q << rice_bits) | code.Read(rice_bits)) + 1;
+    if (value >= lo) {
+      return value <= hi;
+    }
+  }
+  // The first value of the next sample is after lo
+  return left + 1 < num_samples &&
+         DecodeFixed64(sample + kSampleSize) <= hi;
+}
+
+class TruncatedKeyRangeFilterPolicy : public RangeFilterPolicy {
+ public:
+  explicit TruncatedKeyRangeFilterPolicy(int bits_per_key)
+      : extra_bits_(std::max(0, std::min(32, bits_per_key - 3))) {}
+
+  const char* Name() const override {
+    return "leveldb.TruncatedKeyRangeFilter";
+  }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    AppendRangeFilter(keys, n, extra_bits_, dst);
+  }
+
+  bool RangeMayMatch(const Slice& start, const Slice& limit,
+                     const Slice& filter) const override {
+    return RangeFilterMayMatch(start, limit, filter);
+  }
+
+ private:
+  // Bits kept beyond those that tell the keys apart
+  const int extra_bits_;
+};
+
+}  // namespace
+
+const RangeFilterPolicy* NewRangeFilterPolicy(int bits_per_key) {
+  return new TruncatedKeyRangeFilterPolicy(bits_per_key);
+}
+
+}  // namespace leveldb
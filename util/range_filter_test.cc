@@ -0,0 +1,166 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+// Returns v as 8 big-endian bytes, so that numbers and keys sort alike.
+static std::string Key(uint64_t v) {
+  std::string result(8, '\0');
+  for (int i = 7; i >= 0; i--) {
+    result[i] = static_cast<char>(v & 0xff);
+    v >>= 8;
+  }
+  return result;
+}
+
+class RangeFilterTest : public testing::Test {
+ public:
+  RangeFilterTest() : policy_(NewRangeFilterPolicy(10)) {}
+
+  ~RangeFilterTest() { delete policy_; }
+
+  void Add(const std::string& key) { keys_.push_back(key); }
+
+  void Build() {
+    std::sort(keys_.begin(), keys_.end());
+    std::vector<Slice> key_slices(keys_.begin(), keys_.end());
+    filter_.clear();
+    policy_->CreateFilter(key_slices.data(),
+                          static_cast<int>(key_slices.size()), &filter_);
+  }
+
+  size_t FilterSize() const { return filter_.size(); }
+
+  bool Matches(const Slice& start, const Slice& limit) const {
+    return policy_->RangeMayMatch(start, limit, filter_);
+  }
+
+ protected:
+  std::vector<std::string> keys_;
+
+ private:
+  const RangeFilterPolicy* policy_;
+  std::string filter_;
+};
+
+TEST_F(RangeFilterTest, EmptyFilter) {
+  Build();
+  ASSERT_TRUE(!Matches("", "z"));
+  ASSERT_TRUE(!Matches("hello", "world"));
+}
+
+TEST_F(RangeFilterTest, Small) {
+  Add("hello");
+  Add("world");
+  Build();
+  ASSERT_TRUE(Matches("hello", "hello1"));
+  ASSERT_TRUE(Matches("a", "hellp"));
+  ASSERT_TRUE(Matches("world", "x"));
+  ASSERT_TRUE(Matches("", "zzz"));
+  ASSERT_TRUE(!Matches("x", "z"));
+  ASSERT_TRUE(!Matches("a", "c"));
+  ASSERT_TRUE(!Matches("hello", "hello"));
+  ASSERT_TRUE(!Matches("world", "hello"));
+}
+
+TEST_F(RangeFilterTest, CommonPrefix) {
+  for (int i = 0; i < 1000; i++) {
+    Add("user0000" + Key(i * 1000003));
+  }
+  Build();
+  ASSERT_TRUE(Matches("user", "user1"));
+  ASSERT_TRUE(Matches("user0000" + Key(5000015), "user0000" + Key(5000016)));
+  ASSERT_TRUE(Matches("user0000" + Key(5000014), "user0000" + Key(5000016)));
+  ASSERT_TRUE(!Matches("a", "user"));
+  ASSERT_TRUE(!Matches("user", "user0"));
+  ASSERT_TRUE(!Matches("user1", "z"));
+  ASSERT_TRUE(!Matches("user0000" + Key(1000003000), "z"));
+}
+
+TEST_F(RangeFilterTest, DecimalKeys) {
+  // The images of such keys differ in their last bytes only
+  char buf[20];
+  const int kNumKeys = 10000;
+  for (int i = 0; i < kNumKeys; i++) {
+    std::snprintf(buf, sizeof(buf), "%016d", 2 * i);
+    Add(buf);
+  }
+  Build();
+  int false_positives = 0;
+  for (int i = 0; i < kNumKeys; i++) {
+    std::snprintf(buf, sizeof(buf), "%016d", 2 * i);
+    ASSERT_TRUE(Matches(buf, std::string(buf) + '\0'));
+    std::snprintf(buf, sizeof(buf), "%016d", 2 * i + 1);
+    if (Matches(buf, std::string(buf) + '\0')) {
+      false_positives++;
+    }
+  }
+  std::fprintf(stderr, "False positives: %5.2f%% ; bytes = %6d\n",
+               false_positives * 100.0 / kNumKeys,
+               static_cast<int>(FilterSize()));
+  ASSERT_LE(false_positives, kNumKeys * 4 / 100);
+}
+
+TEST_F(RangeFilterTest, VaryingLengths) {
+  Random rnd(301);
+  int mediocre_filters = 0;
+  int good_filters = 0;
+
+  for (int length = 1; length <= 100000; length *= 10) {
+    keys_.clear();
+    for (int i = 0; i < length; i++) {
+      Add(Key((uint64_t{rnd.Next()} << 32) | rnd.Next()));
+    }
+    std::vector<std::string> keys = keys_;
+    std::sort(keys.begin(), keys.end());
+    Build();
+
+    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 11) / 8 + 40))
+        << length;
+
+    // All ranges that hold a key must match
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_TRUE(Matches(keys[i], keys[i] + '\0')) << length << " " << i;
+      ASSERT_TRUE(Matches(Slice(keys[i].data(), 7), keys[i] + '\0'))
+          << length << " " << i;
+    }
+
+    // Check false positive rate of empty ranges that are much shorter than
+    // the gaps between keys
+    const uint64_t width = (~uint64_t{0}) / length / 1024;
+    int false_positives = 0;
+    for (int i = 0; i < 10000; i++) {
+      const uint64_t start = (uint64_t{rnd.Next()} << 32) | rnd.Next();
+      const std::string start_key = Key(start);
+      const std::string limit_key = Key(start + width);
+      if (limit_key <= start_key) continue;
+      auto it = std::lower_bound(keys.begin(), keys.end(), start_key);
+      if (it != keys.end() && *it < limit_key) continue;
+      if (Matches(start_key, limit_key)) {
+        false_positives++;
+      }
+    }
+    const double rate = false_positives / 10000.0;
+    std::fprintf(stderr,
+                 "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                 rate * 100.0, length, static_cast<int>(FilterSize()));
+    ASSERT_LE(rate, 0.04);
+    if (rate > 0.02)
+      mediocre_filters++;
+    else
+      good_filters++;
+  }
+  std::fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
+               mediocre_filters);
+  ASSERT_LE(mediocre_filters, good_filters / 2);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,181 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limiter.h"
+
+#include <algorithm>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() = default;
+
+void RateLimiter::SetPendingCompactionBytes(uint64_t bytes) {}
+
+namespace {
+
+// The bucket holds at most this many microseconds worth of bytes, so that
+// an idle limiter does not let a long burst through.
+static const uint64_t kMaxBurstMicros = 100000;
+
+// A waiting request checks the bucket again at least this often.
+static const uint64_t kMaxWaitMicros = 100000;
+
+// An auto-tuned limiter picks the rate at which the pending compactions
+// would be done within this many seconds...
+static const uint64_t kAutoTuneSeconds = 30;
+
+// ...but never less than the highest rate divided by this.
+static const uint64_t kAutoTuneRange = 10;
+
+class GenericRateLimiter : public RateLimiter {
+ public:
+  GenericRateLimiter(uint64_t bytes_per_second, bool auto_tuned, Env* env)
+      : env_(env),
+        auto_tuned_(auto_tuned),
+        max_rate_(std::max<uint64_t>(bytes_per_second, 1)),
+        rate_(auto_tuned ? std::max<uint64_t>(max_rate_ / kAutoTuneRange, 1)
+                         : max_rate_),
+        pending_compaction_bytes_(0),
+        available_(0),
+        last_refill_micros_(env->NowMicros()) {
+    for (int i = 0; i < 2; i++) {
+      waiting_[i] = 0;
+      total_bytes_[i] = 0;
+    }
+  }
+
+  void Request(size_t bytes, Env::Priority pri) override {
+    MutexLock l(&mu_);
+    waiting_[pri]++;
+    while (true) {
+      Refill();
+      // Requests may overdraw the bucket, so that requests larger than
+      // the bucket are served too.  The requests that follow wait until
+      // the debt is paid.
+      if (available_ > 0 &&
+          (pri == Env::kHighPriority || waiting_[Env::kHighPriority] == 0)) {
+        break;
+      }
+      uint64_t wait = kMaxWaitMicros;
+      if (available_ < 0) {
+        wait = std::min(
+            wait, static_cast<uint64_t>(-available_ * 1e6 / rate_) + 1);
+      }
+      mu_.Unlock();
+      env_->SleepForMicroseconds(static_cast<int>(wait));
+      mu_.Lock();
+    }
+    waiting_[pri]--;
+    available_ -= static_cast<double>(bytes);
+    total_bytes_[pri] += bytes;
+  }
+
+  void SetBytesPerSecond(uint64_t bytes_per_second) override {
+    MutexLock l(&mu_);
+    Refill();
+    max_rate_ = std::max<uint64_t>(bytes_per_second, 1);
+    UpdateRate();
+  }
+
+  uint64_t GetBytesPerSecond() const override {
+    MutexLock l(&mu_);
+    return rate_;
+  }
+
+  uint64_t GetTotalBytesThrough(Env::Priority pri) const override {
+    MutexLock l(&mu_);
+    return total_bytes_[pri];
+  }
+
+  void SetPendingCompactionBytes(uint64_t bytes) override {
+    if (!auto_tuned_) {
+      return;
+    }
+    MutexLock l(&mu_);
+    Refill();
+    pending_compaction_bytes_ = bytes;
+    UpdateRate();
+  }
+
+ private:
+  // Add the bytes that the time since the last refill is worth.
+  void Refill() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const uint64_t now = env_->NowMicros();
+    if (now > last_refill_micros_) {
+      available_ += (now - last_refill_micros_) * 1e-6 * rate_;
+      available_ = std::min(available_, kMaxBurstMicros * 1e-6 * rate_);
+    }
+    last_refill_micros_ = now;
+  }
+
+  void UpdateRate() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (!auto_tuned_) {
+      rate_ = max_rate_;
+      return;
+    }
+    const uint64_t min_rate = std::max<uint64_t>(max_rate_ / kAutoTuneRange, 1);
+    rate_ = std::min(
+        max_rate_,
+        std::max(min_rate, pending_compaction_bytes_ / kAutoTuneSeconds));
+  }
+
+  Env* const env_;
+  const bool auto_tuned_;
+
+  mutable port::Mutex mu_;
+  uint64_t max_rate_ GUARDED_BY(mu_);
+  uint64_t rate_ GUARDED_BY(mu_);
+  uint64_t pending_compaction_bytes_ GUARDED_BY(mu_);
+
+  // Bytes that may be requested without waiting, or minus the bytes that
+  // the next request has to wait for.
+  double available_ GUARDED_BY(mu_);
+  uint64_t last_refill_micros_ GUARDED_BY(mu_);
+
+  int waiting_[2] GUARDED_BY(mu_);  // Waiting requests by priority
+  uint64_t total_bytes_[2] GUARDED_BY(mu_);
+};
+
+class RateLimitedFile : public WritableFile {
+ public:
+  RateLimitedFile(WritableFile* base, RateLimiter* limiter, Env::Priority pri)
+      : base_(base), limiter_(limiter), pri_(pri) {}
+
+  ~RateLimitedFile() override { delete base_; }
+
+  Status Append(const Slice& data) override {
+    limiter_->Request(data.size(), pri_);
+    return base_->Append(data);
+  }
+  Status Close() override { return base_->Close(); }
+  Status Flush() override { return base_->Flush(); }
+  Status Sync() override { return base_->Sync(); }
+
+ private:
+  WritableFile* const base_;
+  RateLimiter* const limiter_;
+  const Env::Priority pri_;
+};
+
+}  // namespace
+
+RateLimiter* NewGenericRateLimiter(uint64_t bytes_per_second, bool auto_tuned,
+                                   Env* env) {
+  return new GenericRateLimiter(bytes_per_second, auto_tuned,
+                                env != nullptr ? env : Env::Default());
+}
+
+WritableFile* NewRateLimitedFile(WritableFile* base, RateLimiter* limiter,
+                                 Env::Priority pri) {
+  if (limiter == nullptr) {
+    return base;
+  }
+  return new RateLimitedFile(base, limiter, pri);
+}
+
+}  // namespace leveldb
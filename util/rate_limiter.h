@@ -0,0 +1,21 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+
+#include "leveldb/env.h"
+#include "leveldb/rate_limiter.h"
+
+namespace leveldb {
+
+// Return a file that requests the bytes of every Append() from "limiter"
+// with priority "pri" before it passes them on to "base".  The result
+// owns "base".  Returns "base" itself if "limiter" is null.
+WritableFile* NewRateLimitedFile(WritableFile* base, RateLimiter* limiter,
+                                 Env::Priority pri);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
@@ -0,0 +1,147 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+#include "util/rate_limiter.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+// An Env whose clock only moves when a thread sleeps.
+class FakeClockEnv : public EnvWrapper {
+ public:
+  FakeClockEnv() : EnvWrapper(Env::Default()), now_micros_(1000000) {}
+
+  uint64_t NowMicros() override { return now_micros_; }
+  void SleepForMicroseconds(int micros) override { now_micros_ += micros; }
+
+ private:
+  uint64_t now_micros_;
+};
+
+class StringSink : public WritableFile {
+ public:
+  Status Append(const Slice& data) override {
+    contents_.append(data.data(), data.size());
+    return Status::OK();
+  }
+  Status Close() override { return Status::OK(); }
+  Status Flush() override { return Status::OK(); }
+  Status Sync() override { return Status::OK(); }
+
+  const std::string& contents() const { return contents_; }
+
+ private:
+  std::string contents_;
+};
+
+TEST(RateLimiterTest, Rate) {
+  FakeClockEnv env;
+  RateLimiter* limiter = NewGenericRateLimiter(1 << 20, false, &env);
+  ASSERT_EQ(1 << 20, limiter->GetBytesPerSecond());
+  const uint64_t start = env.NowMicros();
+  for (int i = 0; i < 200; i++) {
+    limiter->Request(10 << 10, Env::kLowPriority);
+  }
+  // 2000KB at 1MB/s take about two seconds, minus the last request that
+  // is served without waiting for its bytes.
+  const uint64_t elapsed = env.NowMicros() - start;
+  ASSERT_GE(elapsed, 1900000);
+  ASSERT_LE(elapsed, 2000000);
+  ASSERT_EQ(200 * (10 << 10), limiter->GetTotalBytesThrough(Env::kLowPriority));
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(Env::kHighPriority));
+
+  limiter->SetBytesPerSecond(2 << 20);
+  ASSERT_EQ(2 << 20, limiter->GetBytesPerSecond());
+  delete limiter;
+}
+
+TEST(RateLimiterTest, LargeRequests) {
+  FakeClockEnv env;
+  RateLimiter* limiter = NewGenericRateLimiter(1 << 20, false, &env);
+  // Requests larger than the bucket are served once it holds any bytes,
+  // and delay the next ones until the bytes have been paid for.
+  const uint64_t start = env.NowMicros();
+  limiter->Request(4 << 20, Env::kHighPriority);
+  ASSERT_LE(env.NowMicros() - start, 100000);
+  limiter->Request(1, Env::kHighPriority);
+  ASSERT_GE(env.NowMicros() - start, 3900000);
+  delete limiter;
+}
+
+TEST(RateLimiterTest, AutoTune) {
+  FakeClockEnv env;
+  RateLimiter* limiter = NewGenericRateLimiter(100 << 20, true, &env);
+  ASSERT_EQ((100 << 20) / 10, limiter->GetBytesPerSecond());
+
+  // The rate grows with the compaction debt, up to the highest rate
+  limiter->SetPendingCompactionBytes(uint64_t{900} << 20);
+  ASSERT_EQ(30 << 20, limiter->GetBytesPerSecond());
+  limiter->SetPendingCompactionBytes(uint64_t{100} << 30);
+  ASSERT_EQ(100 << 20, limiter->GetBytesPerSecond());
+  limiter->SetBytesPerSecond(50 << 20);
+  ASSERT_EQ(50 << 20, limiter->GetBytesPerSecond());
+  limiter->SetPendingCompactionBytes(0);
+  ASSERT_EQ((50 << 20) / 10, limiter->GetBytesPerSecond());
+  delete limiter;
+
+  // Limiters that are not auto-tuned ignore the debt
+  limiter = NewGenericRateLimiter(100 << 20, false, &env);
+  limiter->SetPendingCompactionBytes(uint64_t{100} << 30);
+  ASSERT_EQ(100 << 20, limiter->GetBytesPerSecond());
+  delete limiter;
+}
+
+TEST(RateLimiterTest, HighPriorityGoesFirst) {
+  RateLimiter* limiter = NewGenericRateLimiter(4 << 20);
+  const int kRequests = 40;
+  const size_t kBytes = 10 << 10;
+  std::atomic<uint64_t> low_bytes_when_high_done(0);
+  std::thread low([&] {
+    for (int i = 0; i < kRequests; i++) {
+      limiter->Request(kBytes, Env::kLowPriority);
+    }
+  });
+  std::thread high([&] {
+    for (int i = 0; i < kRequests; i++) {
+      limiter->Request(kBytes, Env::kHighPriority);
+    }
+    low_bytes_when_high_done.store(
+        limiter->GetTotalBytesThrough(Env::kLowPriority));
+  });
+  high.join();
+  low.join();
+  ASSERT_LT(low_bytes_when_high_done.load(), kRequests * kBytes / 2);
+  ASSERT_EQ(kRequests * kBytes,
+            limiter->GetTotalBytesThrough(Env::kLowPriority));
+  ASSERT_EQ(kRequests * kBytes,
+            limiter->GetTotalBytesThrough(Env::kHighPriority));
+  delete limiter;
+}
+
+TEST(RateLimiterTest, RateLimitedFile) {
+  FakeClockEnv env;
+  StringSink* sink = new StringSink;
+  ASSERT_EQ(sink, NewRateLimitedFile(sink, nullptr, Env::kLowPriority));
+
+  RateLimiter* limiter = NewGenericRateLimiter(1 << 20, false, &env);
+  WritableFile* file = NewRateLimitedFile(sink, limiter, Env::kHighPriority);
+  ASSERT_NE(sink, file);
+  ASSERT_LEVELDB_OK(file->Append("hello"));
+  ASSERT_LEVELDB_OK(file->Append(" world"));
+  ASSERT_LEVELDB_OK(file->Close());
+  ASSERT_EQ("hello world", sink->contents());
+  ASSERT_EQ(11, limiter->GetTotalBytesThrough(Env::kHighPriority));
+  delete file;  // Deletes sink
+  delete limiter;
+}
+
+}  // namespace leveldb
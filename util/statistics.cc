@@ -0,0 +1,118 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/statistics.h"
+
+#include <atomic>
+#include <cstdio>
+
+#include "leveldb/env.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+// Add the counters that "end" gained since "start" to "*sum".
+static void AddCounters(const PerfContext& start, const PerfContext& end,
+                        PerfContext* sum) {
+  sum->memtable_hit_count += end.memtable_hit_count - start.memtable_hit_count;
+  sum->block_cache_hit_count +=
+      end.block_cache_hit_count - start.block_cache_hit_count;
+  sum->block_cache_miss_count +=
+      end.block_cache_miss_count - start.block_cache_miss_count;
+  sum->block_read_count += end.block_read_count - start.block_read_count;
+  sum->block_read_bytes += end.block_read_bytes - start.block_read_bytes;
+  sum->filter_useful_count +=
+      end.filter_useful_count - start.filter_useful_count;
+  sum->filter_positive_count +=
+      end.filter_positive_count - start.filter_positive_count;
+  sum->filter_false_positive_count +=
+      end.filter_false_positive_count - start.filter_false_positive_count;
+  for (int level = 0; level < PerfContext::kNumLevels; level++) {
+    sum->get_read_bytes[level] +=
+        end.get_read_bytes[level] - start.get_read_bytes[level];
+  }
+}
+
+// Return the shard of the calling thread.  Threads are assigned shards
+// round-robin when they first record an operation.
+static int ShardOfThread(int num_shards) {
+  static std::atomic<int> next_shard(0);
+  static thread_local int shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed);
+  return shard % num_shards;
+}
+
+Statistics::Statistics(Env* env) : env_(env) {
+  for (Shard& shard : shards_) {
+    MutexLock l(&shard.mu);
+    for (Histogram& histogram : shard.histograms) {
+      histogram.Clear();
+    }
+  }
+}
+
+Statistics::~Statistics() = default;
+
+void Statistics::Record(Operation op, uint64_t micros,
+                        const PerfContext& start) {
+  Shard* shard = &shards_[ShardOfThread(kNumShards)];
+  MutexLock l(&shard->mu);
+  shard->histograms[op].Add(static_cast<double>(micros));
+  AddCounters(start, *GetPerfContext(), &shard->counters);
+}
+
+std::string Statistics::ToString() const {
+  static const char* const kNames[kNumOperations] = {"Get", "MultiGet",
+                                                     "Write", "Seek", "Next"};
+  Histogram histograms[kNumOperations];
+  for (Histogram& histogram : histograms) {
+    histogram.Clear();
+  }
+  const PerfContext zero;
+  PerfContext counters;
+  for (const Shard& shard : shards_) {
+    MutexLock l(&shard.mu);
+    for (int op = 0; op < kNumOperations; op++) {
+      histograms[op].Merge(shard.histograms[op]);
+    }
+    AddCounters(zero, shard.counters, &counters);
+  }
+
+  std::string result;
+  char buf[200];
+  std::snprintf(buf, sizeof(buf),
+                "                        Latency (micros)\n"
+                "Operation     Count   Average    Median       P99\n"
+                "-------------------------------------------------\n");
+  result.append(buf);
+  for (int op = 0; op < kNumOperations; op++) {
+    const Histogram& h = histograms[op];
+    if (h.Count() > 0) {
+      std::snprintf(buf, sizeof(buf), "%-9s %9.0f %9.2f %9.2f %9.2f\n",
+                    kNames[op], h.Count(), h.Average(), h.Median(),
+                    h.Percentile(99.0));
+      result.append(buf);
+    }
+  }
+  result.append(counters.ToString());
+  result.push_back('\n');
+  return result;
+}
+
+OperationTimer::OperationTimer(Statistics* statistics, Statistics::Operation op)
+    : statistics_(statistics), op_(op), start_micros_(0) {
+  if (statistics_ != nullptr) {
+    start_micros_ = statistics_->env()->NowMicros();
+    start_ = *GetPerfContext();
+  }
+}
+
+OperationTimer::~OperationTimer() {
+  if (statistics_ != nullptr) {
+    statistics_->Record(op_, statistics_->env()->NowMicros() - start_micros_,
+                        start_);
+  }
+}
+
+}  // namespace leveldb
@@ -0,0 +1,86 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_STATISTICS_H_
+#define STORAGE_LEVELDB_UTIL_STATISTICS_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/perf_context.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/histogram.h"
+
+namespace leveldb {
+
+class Env;
+
+// Latencies of the operations of a database and the PerfContext counters
+// that they incurred, summed over all of the threads that use it.  Each
+// thread records into one of a few shards, so that threads rarely contend
+// for the same mutex.
+//
+// Thread-safe (provides internal synchronization)
+class Statistics {
+ public:
+  enum Operation {
+    kGet,
+    kMultiGet,
+    kWrite,  // Put(), Delete() and Write()
+    kSeek,   // Seek(), SeekToFirst() and SeekToLast() of iterators
+    kNext,   // Next() and Prev() of iterators
+    kNumOperations
+  };
+
+  explicit Statistics(Env* env);
+
+  Statistics(const Statistics&) = delete;
+  Statistics& operator=(const Statistics&) = delete;
+
+  ~Statistics();
+
+  Env* env() const { return env_; }
+
+  // Record that an operation "op" took "micros", and add the counters that
+  // the PerfContext of the calling thread gained since it was "start".
+  void Record(Operation op, uint64_t micros, const PerfContext& start);
+
+  // Return a multi-line summary of the latencies and counters.
+  std::string ToString() const;
+
+ private:
+  enum { kNumShards = 8 };
+
+  struct Shard {
+    mutable port::Mutex mu;
+    Histogram histograms[kNumOperations] GUARDED_BY(mu);
+    PerfContext counters GUARDED_BY(mu);
+  };
+
+  Env* const env_;
+  Shard shards_[kNumShards];
+};
+
+// Records the latency of an operation, from its construction to its
+// destruction, in "statistics", unless "statistics" is null.
+class OperationTimer {
+ public:
+  OperationTimer(Statistics* statistics, Statistics::Operation op);
+
+  OperationTimer(const OperationTimer&) = delete;
+  OperationTimer& operator=(const OperationTimer&) = delete;
+
+  ~OperationTimer();
+
+ private:
+  Statistics* const statistics_;
+  const Statistics::Operation op_;
+  uint64_t start_micros_;
+  PerfContext start_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_STATISTICS_H_